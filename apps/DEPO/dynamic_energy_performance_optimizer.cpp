@@ -15,9 +15,12 @@
 */
 
 #include "eco.hpp"
-#include "devices/cuda_device.hpp"
-#include "devices/multi_cuda_device.hpp"
 #include "devices/intel_device.hpp"
+#include "devices/amd_cpu_device.hpp"
+#include "devices/powercap_device.hpp"
+#include "devices/power_control_device.hpp"
+#include "devices/plugin_device.hpp"
+#include "devices/device_plugin_export.hpp"
 
 #include "data_structures/results_container.hpp"
 #include <boost/program_options.hpp>
@@ -56,7 +59,11 @@ parseArgs(po::variables_map& map)
         {
             std::cout << "Using Linear Search algorithm by default.\n";
         }
-        if (map.count("en"))
+        if (map.count("metric"))
+        {
+            std::cout << "Using custom metric \"" << map["metric"].as<std::string>() << "\" as selected.\n";
+        }
+        else if (map.count("en"))
         {
             map.erase("en");
             std::cout << "Using ENERGY metric as selected.\n";
@@ -112,6 +119,47 @@ std::optional<std::vector<int>> checkIfDeviceTypeIsGPU(po::variables_map& map)
     return gpuIDs;
 }
 
+std::optional<std::vector<int>> checkIfDeviceTypeIsXPU(po::variables_map& map)
+{
+    std::optional<std::vector<int>> xpuIDs = std::nullopt;
+    if (map.count("xpu"))
+    {
+        xpuIDs = parseGpuIdList(map["xpu"].as<std::string>());
+        map.erase("xpu");
+        std::cout << "Using XPU(s) with ID(s)=";
+        for (size_t i = 0; i < xpuIDs->size(); ++i)
+        {
+            std::cout << xpuIDs->at(i) << (i + 1 < xpuIDs->size() ? "," : "");
+        }
+        std::cout << " backend for Intel XPU optimization.\n";
+    }
+    return xpuIDs;
+}
+
+// NVIDIA, Intel and AMD GPUs are driven by their device plugins, so that DEPO also runs on
+// nodes without the vendor libraries; nullptr when the plugin cannot be loaded
+static std::shared_ptr<PluginDevice> makeGpuPluginDevice(const std::string& name, const std::vector<int>& ids, bool async)
+{
+    std::string options;
+    for (int id : ids)
+    {
+        options += std::to_string(id) + ",";
+    }
+    if (async)
+    {
+        options += "async";
+    }
+    try
+    {
+        return PluginDevice::make(name, options);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "[DEPO] " << e.what() << "\n";
+        return nullptr;
+    }
+}
+
 void cleanArgv(int& argc, char* argv[])
 {
     for (int idx = 1; idx < argc;)
@@ -124,7 +172,13 @@ void cleanArgv(int& argc, char* argv[])
             flag == "--eds" ||
             flag == "--no-tuning" ||
             flag == "--async" ||
-            std::string(flag).substr(0,6) == "--gpu="
+            flag == "--powercap" ||
+            flag == "--power-control" ||
+            std::string(flag).substr(0,6) == "--gpu=" ||
+            std::string(flag).substr(0,6) == "--xpu=" ||
+            std::string(flag).substr(0,7) == "--rocm=" ||
+            std::string(flag).substr(0,9) == "--metric=" ||
+            std::string(flag).substr(0,9) == "--plugin="
             )
         {
             for (int i = 1; i < argc -1; i++)
@@ -134,7 +188,7 @@ void cleanArgv(int& argc, char* argv[])
             argv[argc-1] = nullptr;
             argc--;
         }
-        else if (flag == "--gpu")
+        else if (flag == "--gpu" || flag == "--xpu" || flag == "--rocm" || flag == "--metric" || flag == "--plugin")
         {
             // erase two args: the flag and the value
             for (int i = 1; i < argc -2; i++)
@@ -172,6 +226,45 @@ static inline std::string readPathInfo()
     return "";
 }
 
+// CUPTI injection library counting the kernels of the profiled application (see profiling_injection)
+static bool setupCudaInjection(const std::vector<int>& gpuIDs, bool wantAsyncMultiGpu)
+{
+    int e1 = setenv("INJECTION_KERNEL_COUNT", "1", 1);
+    std::string path = readPathInfo();
+
+    if (path == "")
+    {
+        std::cerr << "`/tmp/depo_gpu_path` is empty. You should probably run `./build.sh` in `split/profiling_injection` directory.";
+        std::cerr << "\nClosing DEPO called for GPU backend.\n";
+        return false;
+    }
+    path = path + "/libinjection_2.so";
+
+    int e2 = setenv("CUDA_INJECTION64_PATH", path.c_str(), 1);
+    int e3 = -1;
+    int e4 = -1;
+    if (wantAsyncMultiGpu && gpuIDs.size() > 1)
+    {
+        std::string idList;
+        for (size_t i = 0; i < gpuIDs.size(); ++i)
+        {
+            if (i > 0) idList += ',';
+            idList += std::to_string(gpuIDs.at(i));
+        }
+        e3 = setenv("DEPO_ASYNC_MULTI_GPU", "1", 1);
+        e4 = setenv("DEPO_TARGET_GPU_IDS", idList.c_str(), 1);
+        std::cout << "DEPO async multi-GPU: per-GPU search (stock DEPO algorithm each GPU); target GPU IDs=" << idList << "\n";
+    }
+    std::cout << "ENV1 status: " << e1 << ", value: " << getenv("INJECTION_KERNEL_COUNT")
+              << "\nENV2 status: " << e2 << ", value: " << getenv("CUDA_INJECTION64_PATH") << "\n";
+    if (e3 == 0 && e4 == 0)
+    {
+        std::cout << "ENV3 status: " << e3 << ", DEPO_ASYNC_MULTI_GPU=" << getenv("DEPO_ASYNC_MULTI_GPU")
+                  << "\nENV4 status: " << e4 << ", DEPO_TARGET_GPU_IDS=" << getenv("DEPO_TARGET_GPU_IDS") << "\n";
+    }
+    return true;
+}
+
 
 int main (int argc, char *argv[])
 {
@@ -190,9 +283,15 @@ int main (int argc, char *argv[])
         ("en", "use Energy metric")
         ("edp", "use Energy Delay Product metric")
         ("eds", "use Energy SumDelay  metric")
+        ("metric", po::value<std::string>(), "minimize a custom metric expression, e.g. \"E*T^2\" or \"E subject to perf >= 0.95*ref_perf\" (see README)")
         ("no-tuning", "run app only checking the power and energy consumption")
-        ("gpu", po::value<std::string>(), "use GPU backend; accept single ID (e.g., 0) or comma-separated list (e.g., 0,1,2)")
-        ("async", "multi-GPU only: same Linear/GSS as single-GPU, once per GPU (other GPUs fixed); CUPTI counts all targets; caps may differ. Not /tmp/trigger_file async tuning")
+        ("powercap", "use the CPU power domains discovered in /sys/class/powercap instead of the vendor specific CPU backend")
+        ("power-control", "use the CPU through the power control helper (PowerControlHelper, socket from ECO_POWER_CONTROL_SOCKET); default when not run as root and the helper is running")
+        ("gpu", po::value<std::string>(), "use GPU backend (cuda plugin); accept single ID (e.g., 0) or comma-separated list (e.g., 0,1,2)")
+        ("xpu", po::value<std::string>(), "use Intel XPU backend (xpu plugin); accept single ID (e.g., 0) or comma-separated list of cards (e.g., 0,1,2)")
+        ("async", "multi-GPU/XPU only: same Linear/GSS as single-GPU, once per GPU or card (others fixed); CUPTI counts all targets; caps may differ. Not /tmp/trigger_file async tuning")
+        ("rocm", po::value<int>(), "use AMD GPU backend (rocm plugin, ROCm SMI) with the given ID")
+        ("plugin", po::value<std::string>(), "use a device plugin (see ECO_PLUGIN_PATH): name (e.g. intel, cuda, xpu) or auto, optionally with :options, e.g. cuda:0,1,async")
     ;
     po::variables_map optionsMap;
     po::store(po::parse_command_line(argc, argv, desc), optionsMap);
@@ -206,65 +305,115 @@ int main (int argc, char *argv[])
     }
     // read metric and search algorithm
     std::tie(metric, search) = parseArgs(optionsMap);
-    std::optional<std::vector<int>> gpuIDs = checkIfDeviceTypeIsGPU(optionsMap);
+    std::optional<std::string> customMetric;
+    if (optionsMap.count("metric"))
+    {
+        customMetric = optionsMap["metric"].as<std::string>();
+        try
+        {
+            // fail before the devices are initialized, compiled again below with k from config.yaml
+            MetricExpression::compile(*customMetric);
+        }
+        catch (const std::invalid_argument& e)
+        {
+            std::cerr << "[DEPO] Invalid --metric: " << e.what() << "\n";
+            return 1;
+        }
+    }
     const bool wantAsyncMultiGpu = optionsMap.count("async") > 0;
+    // no injection library for XPUs: XVE instructions are streamed by Level Zero metrics in process
+    std::optional<std::vector<int>> xpuIDs = checkIfDeviceTypeIsXPU(optionsMap);
+    if (wantAsyncMultiGpu && xpuIDs.has_value() && xpuIDs->size() == 1)
+    {
+        std::cerr << "[DEPO] Warning: --async applies only with multiple XPUs (--xpu 0,1,...); ignoring --async.\n";
+    }
+    std::optional<std::vector<int>> gpuIDs = checkIfDeviceTypeIsGPU(optionsMap);
     if (wantAsyncMultiGpu && gpuIDs.has_value() && gpuIDs->size() == 1)
     {
         std::cerr << "[DEPO] Warning: --async applies only with multiple GPUs (--gpu 0,1,...); ignoring --async.\n";
     }
+    std::optional<int> rocmID;
+    if (optionsMap.count("rocm"))
+    {
+        rocmID = optionsMap["rocm"].as<int>();
+        std::cout << "Using GPU with ID=" << *rocmID << " backend for AMD ROCm optimization.\n";
+    }
+    std::optional<std::string> pluginSpec;
+    if (optionsMap.count("plugin"))
+    {
+        pluginSpec = optionsMap["plugin"].as<std::string>();
+    }
     cleanArgv(argc, argv);
 
 
     std::shared_ptr<Device> device;
-    if (gpuIDs.has_value())
+    bool usesCudaInjection = false;
+    if (pluginSpec.has_value())
     {
-        if (gpuIDs->size() > 1)
+        const auto separator = pluginSpec->find(':');
+        const auto pluginOptions = separator == std::string::npos ? std::string() : pluginSpec->substr(separator + 1);
+        std::shared_ptr<PluginDevice> plugin;
+        try
         {
-            device = std::make_shared<MultiCudaDevice>(*gpuIDs, wantAsyncMultiGpu);
+            plugin = PluginDevice::make(pluginSpec->substr(0, separator), pluginOptions);
         }
-        else
+        catch (const std::exception& e)
         {
-            device = std::make_shared<CudaDevice>(gpuIDs->front());
-        }
-
-        int e1 = setenv("INJECTION_KERNEL_COUNT", "1", 1);
-        std::string path = readPathInfo();
-
-        if (path == "")
-        {
-            std::cerr << "`/tmp/depo_gpu_path` is empty. You should probably run `./build.sh` in `split/profiling_injection` directory.";
-            std::cerr << "\nClosing DEPO called for GPU backend.\n";
+            std::cerr << "[DEPO] " << e.what() << "\n";
             return 1;
         }
-        path = path + "/libinjection_2.so";
-
-        int e2 = setenv("CUDA_INJECTION64_PATH", path.c_str(), 1);
-        int e3 = -1;
-        int e4 = -1;
-        if (wantAsyncMultiGpu && gpuIDs->size() > 1)
+        std::cout << "Using device plugin " << plugin->getPluginName() << ": " << plugin->getName() << "\n";
+        if (plugin->getPluginName() == "cuda")
         {
-            std::string idList;
-            for (size_t i = 0; i < gpuIDs->size(); ++i)
+            auto parsed = parseDevicePluginOptions(pluginOptions.c_str());
+            if (!setupCudaInjection(parsed.ids.empty() ? std::vector<int>{0} : parsed.ids, parsed.async))
             {
-                if (i > 0) idList += ',';
-                idList += std::to_string(gpuIDs->at(i));
+                return 1;
             }
-            e3 = setenv("DEPO_ASYNC_MULTI_GPU", "1", 1);
-            e4 = setenv("DEPO_TARGET_GPU_IDS", idList.c_str(), 1);
-            std::cout << "DEPO async multi-GPU: per-GPU search (stock DEPO algorithm each GPU); target GPU IDs=" << idList << "\n";
+            usesCudaInjection = true;
         }
-        std::cout << "ENV1 status: " << e1 << ", value: " << getenv("INJECTION_KERNEL_COUNT")
-                  << "\nENV2 status: " << e2 << ", value: " << getenv("CUDA_INJECTION64_PATH") << "\n";
-        if (e3 == 0 && e4 == 0)
+        device = plugin;
+    }
+    else if (rocmID.has_value())
+    {
+        device = makeGpuPluginDevice("rocm", {*rocmID}, false);
+    }
+    else if (xpuIDs.has_value())
+    {
+        device = makeGpuPluginDevice("xpu", *xpuIDs, wantAsyncMultiGpu);
+    }
+    else if (gpuIDs.has_value())
+    {
+        device = makeGpuPluginDevice("cuda", *gpuIDs, wantAsyncMultiGpu);
+        if (device != nullptr && !setupCudaInjection(*gpuIDs, wantAsyncMultiGpu))
         {
-            std::cout << "ENV3 status: " << e3 << ", DEPO_ASYNC_MULTI_GPU=" << getenv("DEPO_ASYNC_MULTI_GPU")
-                      << "\nENV4 status: " << e4 << ", DEPO_TARGET_GPU_IDS=" << getenv("DEPO_TARGET_GPU_IDS") << "\n";
+            return 1;
         }
+        usesCudaInjection = true;
+    }
+    else if (optionsMap.count("power-control") || PowerControlDevice::shouldUseHelper())
+    {
+        auto helperDevice = std::make_shared<PowerControlDevice>();
+        // the nmi_watchdog write above needs root
+        helperDevice->setNmiWatchdog(false);
+        device = helperDevice;
+    }
+    else if (optionsMap.count("powercap"))
+    {
+        device = std::make_shared<PowercapDevice>();
+    }
+    else if (AmdCpuDevice::isAmdCpu())
+    {
+        device = std::make_shared<AmdCpuDevice>();
     }
     else
     {
         device = std::make_shared<IntelDevice>();
     }
+    if (device == nullptr)
+    {
+        return 1;
+    }
 
     std::unique_ptr<Eco> eco = std::make_unique<Eco>(device);
     std::stringstream ssout;
@@ -282,6 +431,10 @@ int main (int argc, char *argv[])
         result = eco->runAppWithSampling(argv, argc);
         printPowerLogWithDynamicMetrics = false;
     }
+    else if (customMetric.has_value())
+    {
+        result = eco->runAppWithSearch(argv, MetricExpression::compile(*customMetric, eco->getK()), search, argc);
+    }
     else
     {
         result = eco->runAppWithSearch(argv, metric, search, argc);
@@ -293,12 +446,13 @@ int main (int argc, char *argv[])
     eco->logToResultFile(ssout);
     eco->plotPowerLog(result, applicationCommand.str(), printPowerLogWithDynamicMetrics);
 
-    if (gpuIDs.has_value())
+    if (usesCudaInjection)
     {
         unsetenv("INJECTION_KERNEL_COUNT");
         unsetenv("CUDA_INJECTION64_PATH");
         unsetenv("DEPO_ASYNC_MULTI_GPU");
         unsetenv("DEPO_TARGET_GPU_IDS");
+        unsetenv("INJECTION_MODE");
     }
 
 	return 0;
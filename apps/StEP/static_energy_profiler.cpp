@@ -16,16 +16,10 @@
 
 #include "eco.hpp"
 #include "devices/intel_device.hpp"
+#include "devices/amd_cpu_device.hpp"
+#include "devices/power_control_device.hpp"
+#include "devices/plugin_device.hpp"
 #include "plot_builder.hpp"
-#ifdef WITH_XPU
-#include "devices/xpu_device.hpp"
-const char devcmd[] = "--xpu=";
-using TargetDevice  = XPUDevice;
-#else
-#include "devices/cuda_device.hpp"
-const char devcmd[] = "--gpu=";
-using TargetDevice  = CudaDevice;
-#endif
 
 #include <cstdlib>
 
@@ -38,10 +32,14 @@ int main(int argc, char* argv[])
 
     bool isGpuOrXpu = false;
     int  gpuID = -1;
+    // the GPUs are driven by their device plugins: --gpu= by cuda, --xpu= by xpu
+    std::string plugin;
     if (argc >= 1)
     {
-        if (std::string(argv[1]).substr(0, 6) == devcmd)
+        const std::string devcmd = std::string(argv[1]).substr(0, 6);
+        if (devcmd == "--gpu=" || devcmd == "--xpu=")
         {
+            plugin = devcmd == "--gpu=" ? "cuda" : "xpu";
             gpuID = stoi(std::string(argv[1]).substr(6, 1));
             // remove the --gpu flag from 1st arg
             for (int i = 1; i < argc - 1; i++)
@@ -55,28 +53,33 @@ int main(int argc, char* argv[])
 
 
     std::shared_ptr<Device> device;
-    if (!isGpuOrXpu)
+    if (!isGpuOrXpu && PowerControlDevice::shouldUseHelper())
+    {
+        auto helperDevice = std::make_shared<PowerControlDevice>();
+        // the nmi_watchdog write above needs root
+        helperDevice->setNmiWatchdog(false);
+        device = helperDevice;
+    }
+    else if (!isGpuOrXpu && AmdCpuDevice::isAmdCpu())
+    {
+        device = std::make_shared<AmdCpuDevice>();
+    }
+    else if (!isGpuOrXpu)
     {
         device = std::make_shared<IntelDevice>();
     }
     else
     {
-        #ifdef WITH_XPU
-        bool        useAmperes = true;
-        const char* env_p      = std::getenv("USE_AMPERES");
-
-        if (env_p != nullptr)
+        // current capping of XPUs unless USE_AMPERES=0, see the xpu plugin
+        try
         {
-            std::string env_value(env_p);
-            if (env_value == "0" || env_value == "False" || env_value == "false")
-            {
-                useAmperes = false;
-            }
+            device = PluginDevice::make(plugin, std::to_string(gpuID));
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "[StEP] " << e.what() << "\n";
+            return 1;
         }
-        device = std::make_shared<TargetDevice>(gpuID, useAmperes);
-        #else //GPU
-        device = std::make_shared<TargetDevice>(gpuID);
-        #endif
     }
     std::unique_ptr<Eco> eco = std::make_unique<Eco>(device);
 
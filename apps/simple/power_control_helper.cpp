@@ -0,0 +1,111 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "devices/amd_cpu_device.hpp"
+#include "devices/intel_device.hpp"
+#include "devices/powercap_device.hpp"
+#include "power_interface/power_control_server.hpp"
+
+namespace {
+
+PowerControlServer* runningServer = nullptr;
+
+void stopServer(int)
+{
+    if (runningServer != nullptr)
+    {
+        runningServer->stop();
+    }
+}
+
+} // namespace
+
+// Privileged helper letting unprivileged DEPO/StEP processes read the CPU energy and set
+// the power caps (see PowerControlServer and PowerControlDevice).
+int main (int argc, char *argv[])
+{
+    PowerControlServerOptions options;
+    bool usePowercap = false;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string flag = argv[i];
+        if (flag == "--socket" && i + 1 < argc)
+        {
+            options.socketPath = argv[++i];
+        }
+        else if (flag == "--allow-cgroup" && i + 1 < argc)
+        {
+            options.allowedCgroups.push_back(argv[++i]);
+        }
+        else if (flag == "--period-ms" && i + 1 < argc)
+        {
+            options.samplePeriod = std::chrono::milliseconds(std::max(1, std::stoi(argv[++i])));
+        }
+        else if (flag == "--powercap")
+        {
+            usePowercap = true;
+        }
+        else
+        {
+            std::cout << "Usage: ./PowerControlHelper [--socket path] [--allow-cgroup cgroup]... [--period-ms ms] [--powercap]\n"
+                      << "  --socket        defaults to " << powerControlDefaultSocketPath << "\n"
+                      << "  --allow-cgroup  cgroup v2 path (e.g. /user.slice/user-1000.slice) whose processes may\n"
+                      << "                  connect, with its subtree; may be repeated, root is always allowed\n"
+                      << "  --period-ms     energy sampling period, 10 ms by default\n"
+                      << "  --powercap      use the zones of /sys/class/powercap instead of the vendor specific CPU backend\n";
+            return flag == "--help" || flag == "-h" ? 0 : 1;
+        }
+    }
+    if (options.allowedCgroups.empty())
+    {
+        std::cerr << "[WARNING] No --allow-cgroup given, only root processes can connect\n";
+    }
+
+    std::shared_ptr<Device> device;
+    if (usePowercap)
+    {
+        device = std::make_shared<PowercapDevice>();
+    }
+    else if (AmdCpuDevice::isAmdCpu())
+    {
+        device = std::make_shared<AmdCpuDevice>();
+    }
+    else
+    {
+        device = std::make_shared<IntelDevice>();
+    }
+
+    PowerControlServer server(device, options);
+    runningServer = &server;
+    struct sigaction action {};
+    action.sa_handler = stopServer;
+    sigemptyset(&action.sa_mask);
+    for (int signo : {SIGINT, SIGTERM, SIGHUP})
+    {
+        sigaction(signo, &action, nullptr);
+    }
+    server.run();
+    runningServer = nullptr;
+    // the server restores the caps of the connected clients when it is destroyed
+    return 0;
+}
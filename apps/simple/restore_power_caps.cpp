@@ -0,0 +1,53 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "params_config.hpp"
+#include "power_interface/power_cap_journal.hpp"
+
+// Writes back the power caps left by DEPO/StEP processes that were killed or crashed
+// (see PowerCapJournal). Journals of running processes are skipped.
+int main (int argc, char *argv[]) {
+
+    std::string journalDir;
+    bool dryRun = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--dry-run")) {
+            dryRun = true;
+        } else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
+            std::cout << "Usage: ./RestorePowerCaps [journal_dir] [--dry-run]\n"
+                      << "  journal_dir defaults to powerCapJournalDir from ./config.yaml or "
+                      << PowerCapJournal::defaultDir << "\n";
+            return 0;
+        } else {
+            journalDir = argv[i];
+        }
+    }
+    if (journalDir.empty()) {
+        try {
+            journalDir = ParamsConfig(false).powerCapJournalDir_;
+        } catch (const std::exception&) {
+            journalDir = PowerCapJournal::defaultDir;
+        }
+    }
+    const int failures = PowerCapJournal::restoreLeftovers(journalDir, dryRun);
+    if (failures) {
+        std::cerr << failures << " setting(s) not restored, the journals are kept in " << journalDir << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+  device_sampling_benchmark - per call latency of the hot Device methods
+
+  Measures the latency distribution (p50/p99/max) of the methods called on every control
+  loop tick and of DeviceStateAccumulator::sample() end to end, so that the cost of a tick
+  is known before msPause is tightened. The max sample rate is derived from the p99 of
+  sample(), i.e. the rate sustainable with the tail latency.
+
+  usage: device_sampling_benchmark [--device=null|sim|cpu|gpu|multigpu|xpu] [--gpu=0,1,...] [--iterations=N]
+
+  "null" is a Device returning constants and "sim" a SimulatedDevice in real time - both
+  isolate the overhead of the framework itself. setPowerLimitInMicroWatts re-applies the
+  current limit, which still changes the state of some devices (IntelDevice also sets the
+  200 ms time window), so the default limits are restored at the end.
+*/
+
+#include "device_state.hpp"
+#include "devices/intel_device.hpp"
+#include "devices/simulated_device.hpp"
+#include "devices/plugin_device.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Device without any backend, the cost of a tick is the cost of the framework only
+class NullDevice : public Device
+{
+  public:
+    std::string getName() const override { return "Null device"; }
+    std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override { return {50, 250}; }
+    double getPowerLimitInWatts() const override { return limitInMicroWatts_ / 1e6; }
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override { limitInMicroWatts_ = limitInMicroW; }
+    void reset() override {}
+    unsigned long long int getPerfCounter() const override { return ++counter_; }
+    double getCurrentPowerInWatts(std::optional<Domain> = std::nullopt) const override { return 100.0; }
+    void restoreDefaultLimits() override { limitInMicroWatts_ = 250000000; }
+    std::string getDeviceTypeString() const override { return "null"; }
+    void triggerPowerApiSample() override {}
+
+  private:
+    unsigned long limitInMicroWatts_ {250000000};
+    mutable unsigned long long int counter_ {0};
+};
+
+struct LatencyStats
+{
+    double meanInMicroSeconds {0.0};
+    double p50InMicroSeconds {0.0};
+    double p99InMicroSeconds {0.0};
+    double maxInMicroSeconds {0.0};
+};
+
+static LatencyStats measure(const std::function<void()>& call, unsigned iterations)
+{
+    // warm up caches, lazy initialization of the backend, etc.
+    for (unsigned i = 0; i < std::max(1u, iterations / 10); i++)
+    {
+        call();
+    }
+    std::vector<double> latencies(iterations);
+    for (auto& latency : latencies)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        call();
+        latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+    std::sort(latencies.begin(), latencies.end());
+    LatencyStats stats;
+    for (auto latency : latencies)
+    {
+        stats.meanInMicroSeconds += latency / iterations;
+    }
+    stats.p50InMicroSeconds = latencies[iterations / 2];
+    stats.p99InMicroSeconds = latencies[std::min<size_t>(iterations - 1, iterations * 99 / 100)];
+    stats.maxInMicroSeconds = latencies.back();
+    return stats;
+}
+
+static std::vector<int> parseIds(const std::string& list)
+{
+    std::vector<int> ids;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty())
+        {
+            ids.push_back(std::stoi(item));
+        }
+    }
+    return ids;
+}
+
+static std::shared_ptr<Device> makeDevice(const std::string& type, const std::vector<int>& ids)
+{
+    if (type == "null")
+    {
+        return std::make_shared<NullDevice>();
+    }
+    if (type == "sim")
+    {
+        return std::make_shared<SimulatedDevice>(SimulatedDeviceModel(), getRealClock());
+    }
+    if (type == "cpu")
+    {
+        return std::make_shared<IntelDevice>();
+    }
+    // the GPUs through their device plugins, as in DEPO
+    const std::string firstId = ids.empty() ? "0" : std::to_string(ids.front());
+    if (type == "xpu")
+    {
+        return PluginDevice::make("xpu", firstId);
+    }
+    if (type == "gpu")
+    {
+        return PluginDevice::make("cuda", firstId);
+    }
+    if (type == "multigpu")
+    {
+        std::string options;
+        for (int id : ids.empty() ? std::vector<int>{0, 1} : ids)
+        {
+            options += std::to_string(id) + ",";
+        }
+        return PluginDevice::make("cuda", options);
+    }
+    return nullptr;
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string deviceOption = "--device=";
+    const std::string gpuOption = "--gpu=";
+    const std::string iterationsOption = "--iterations=";
+    std::string deviceType = "null";
+    std::vector<int> ids;
+    unsigned iterations = 1000;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        if (arg.rfind(deviceOption, 0) == 0)
+        {
+            deviceType = arg.substr(deviceOption.size());
+        }
+        else if (arg.rfind(gpuOption, 0) == 0)
+        {
+            ids = parseIds(arg.substr(gpuOption.size()));
+        }
+        else if (arg.rfind(iterationsOption, 0) == 0)
+        {
+            iterations = std::max(1, std::stoi(arg.substr(iterationsOption.size())));
+        }
+        else
+        {
+            std::cerr << "Unknown option " << arg << "\n";
+            return 1;
+        }
+    }
+
+    auto device = makeDevice(deviceType, ids);
+    if (!device)
+    {
+        std::cerr << "Device " << deviceType << " is not supported\n";
+        return 1;
+    }
+    DeviceStateAccumulator deviceState(device);
+    const unsigned long limitInMicroWatts = device->getPowerLimitInWatts() * 1e6;
+
+    std::vector<std::pair<std::string, std::function<void()>>> calls {
+        {"triggerPowerApiSample", [&] { device->triggerPowerApiSample(); }},
+        {"getCurrentPowerInWatts", [&] { device->getCurrentPowerInWatts(std::nullopt); }},
+        {"getPerfCounter", [&] { device->getPerfCounter(); }},
+        {"setPowerLimitInMicroWatts", [&] { device->setPowerLimitInMicroWatts(limitInMicroWatts); }},
+        {"DeviceStateAccumulator::sample", [&] { deviceState.sample(); }}};
+
+    std::cout << "# " << device->getName() << ", " << iterations << " calls per method\n"
+              << "#method\t\t\t\tmean[us]\tp50[us]\t\tp99[us]\t\tmax[us]\n";
+    LatencyStats sampleStats;
+    for (const auto& [name, call] : calls)
+    {
+        const auto stats = measure(call, iterations);
+        std::cout << std::left << std::setw(32) << name << std::right << std::fixed << std::setprecision(2)
+                  << stats.meanInMicroSeconds << "\t\t" << stats.p50InMicroSeconds << "\t\t"
+                  << stats.p99InMicroSeconds << "\t\t" << stats.maxInMicroSeconds << "\n";
+        if (name == "DeviceStateAccumulator::sample")
+        {
+            sampleStats = stats;
+        }
+    }
+    std::cout << "# max sustainable sample rate (p99 of sample()): "
+              << std::setprecision(1) << 1e6 / sampleStats.p99InMicroSeconds << " Hz\n";
+    device->restoreDefaultLimits();
+    return 0;
+}
@@ -0,0 +1,322 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+  search_algorithm_benchmark - tuning overhead and cap quality of every SearchAlgorithm
+
+  Each algorithm runs against a library of synthetic SimulatedDeviceModels (and optionally
+  power_log.csv traces recorded by StEP/DEPO) in virtual time, once per TargetMetric and
+  per msTestPhasePeriod. For every run the number of probes (applied power caps), tuning
+  time, energy spent while tuning and regret of the found cap against the true optimum of
+  the model are reported.
+
+  usage: search_algorithm_benchmark [--periods=100,250,...] [recorded power_log.csv ...]
+
+  Writes search_benchmark.csv, per algorithm and metric summaries averaged over the library
+  and gnuplot summaries to a bench_experiment_<timestamp>/ directory.
+*/
+
+#include "device_state.hpp"
+#include "trigger.hpp"
+#include "params_config.hpp"
+#include "plot_builder.hpp"
+#include "algorithms/linear_search.hpp"
+#include "algorithms/golden_section_search.hpp"
+#include "devices/simulated_device.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+
+struct BenchmarkCase
+{
+    std::string name;
+    SimulatedDeviceModel model;
+};
+
+struct BenchmarkRun
+{
+    unsigned probes {0};
+    double tuningTimeInSeconds {0.0};
+    double tuningEnergyInJoules {0.0};
+    double capInWatts {0.0};
+};
+
+// SimulatedDevice counting the power caps applied by the search algorithm
+class ProbeCountingDevice : public SimulatedDevice
+{
+  public:
+    using SimulatedDevice::SimulatedDevice;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override
+    {
+        ++probes_;
+        SimulatedDevice::setPowerLimitInMicroWatts(limitInMicroW);
+    }
+    unsigned getProbes() const { return probes_; }
+
+  private:
+    unsigned probes_ {0};
+};
+
+static std::string metricName(TargetMetric metric)
+{
+    switch (metric)
+    {
+        case TargetMetric::MIN_E: return "E";
+        case TargetMetric::MIN_E_X_T: return "EDP";
+        case TargetMetric::MIN_M_PLUS: return "M_plus";
+    }
+    return "undefined";
+}
+
+static std::vector<BenchmarkCase> makeSyntheticCases()
+{
+    std::vector<BenchmarkCase> cases;
+    for (double sensitivity : {0.2, 0.5, 0.8})
+    {
+        for (double idle : {20.0, 45.0})
+        {
+            for (bool noisy : {false, true})
+            {
+                BenchmarkCase c;
+                std::stringstream name;
+                name << "s" << sensitivity << "_idle" << idle << (noisy ? "_noisy" : "");
+                c.name = name.str();
+                c.model.idlePowerInWatts = idle;
+                c.model.phases = {SimulatedPhase{1e6, 200.0, 1e6, sensitivity}};
+                if (noisy)
+                {
+                    c.model.powerNoiseStdDevInWatts = 3.0;
+                    c.model.throughputRelativeNoise = 0.05;
+                    c.model.actuationLagInSeconds = 0.05;
+                }
+                cases.push_back(c);
+            }
+        }
+    }
+    // alternating compute and memory bound phases
+    BenchmarkCase mixed;
+    mixed.name = "mixed_phases";
+    mixed.model.idlePowerInWatts = 40.0;
+    mixed.model.phases = {SimulatedPhase{5.0, 230.0, 2e6, 0.9}, SimulatedPhase{5.0, 150.0, 5e5, 0.1}};
+    cases.push_back(mixed);
+    return cases;
+}
+
+/*
+  steadyStateResult - noise and lag free result of the whole model at a fixed cap
+
+  Used as the oracle: the phases are weighted by their duration, exactly as the simulated
+  device integrates them.
+*/
+static PowAndPerfResult steadyStateResult(const SimulatedDeviceModel& model, double capInWatts)
+{
+    double work = 0.0;
+    double time = 0.0;
+    double energy = 0.0;
+    const double idle = model.idlePowerInWatts;
+    for (const auto& phase : model.phases)
+    {
+        const double demand = std::max(phase.uncappedPowerInWatts, idle);
+        const double power = std::max(idle, std::min(demand, capInWatts));
+        const double ratio = demand > idle ? (power - idle) / (demand - idle) : 1.0;
+        work += phase.maxThroughput * std::pow(std::clamp(ratio, 0.0, 1.0), phase.capSensitivity) * phase.durationInSeconds;
+        energy += power * phase.durationInSeconds;
+        time += phase.durationInSeconds;
+    }
+    return PowAndPerfResult(work, time, capInWatts, energy, energy / time, 0.0, energy / time);
+}
+
+// value of the metric to be minimized by the search, the search reference is taken at the default limit
+static double metricValue(const SimulatedDeviceModel& model, double capInWatts, const MetricExpression& metric)
+{
+    return metric.evaluate(steadyStateResult(model, capInWatts), steadyStateResult(model, model.defaultLimitInWatts));
+}
+
+static double findOptimalCapInWatts(const SimulatedDeviceModel& model, const MetricExpression& metric)
+{
+    const double stepInWatts = 0.25;
+    double bestCap = model.defaultLimitInWatts;
+    double bestValue = metricValue(model, bestCap, metric);
+    for (double cap = model.minLimitInWatts; cap <= model.maxLimitInWatts; cap += stepInWatts)
+    {
+        const double value = metricValue(model, cap, metric);
+        if (value < bestValue)
+        {
+            bestValue = value;
+            bestCap = cap;
+        }
+    }
+    return bestCap;
+}
+
+static BenchmarkRun runSearch(const SearchAlgorithm& algorithm, const SimulatedDeviceModel& model,
+                              const MetricExpression& metric, int msTestPhasePeriod, ParamsConfig& cfg, Logger& logger)
+{
+    auto clock = std::make_shared<SimulatedClock>();
+    auto device = std::make_shared<ProbeCountingDevice>(model, clock);
+    DeviceStateAccumulator deviceState(device);
+    Trigger trigger(cfg);
+    deviceState.resetState();
+
+    // the algorithms report their progress on stdout, keep the benchmark output readable
+    std::stringstream silenced;
+    auto coutBuffer = std::cout.rdbuf(silenced.rdbuf());
+    // no child process - waitpid fails and leaves procStatus untouched
+    int procStatus = 1;
+    auto reference = SearchAlgorithm::sampleAndAccumulatePowAndPerfForGivenPeriod(
+        msTestPhasePeriod * 1000, cfg.msPause_, deviceState, trigger, procStatus, -1, logger);
+    const auto capInMicroWatts = algorithm(
+        device, deviceState, trigger, metric, reference, procStatus, -1, cfg.msPause_, msTestPhasePeriod, logger);
+    std::cout.rdbuf(coutBuffer);
+
+    BenchmarkRun run;
+    run.probes = device->getProbes();
+    run.tuningTimeInSeconds = clock->getElapsedSeconds();
+    run.tuningEnergyInJoules = device->getTotalEnergyInJoules();
+    run.capInWatts = capInMicroWatts / 1e6;
+    return run;
+}
+
+static std::vector<int> parsePeriods(const std::string& list)
+{
+    std::vector<int> periods;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty())
+        {
+            periods.push_back(std::stoi(item));
+        }
+    }
+    return periods;
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string periodsOption = "--periods=";
+    std::vector<int> msTestPhasePeriods {100, 250, 500, 1000, 2000};
+    auto cases = makeSyntheticCases();
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg(argv[i]);
+        if (arg.rfind(periodsOption, 0) == 0)
+        {
+            msTestPhasePeriods = parsePeriods(arg.substr(periodsOption.size()));
+            continue;
+        }
+        auto model = SimulatedDeviceModel::fromPowerLog(arg);
+        if (model.phases.empty())
+        {
+            std::cerr << "Skipping " << arg << ": not a power log\n";
+            continue;
+        }
+        cases.push_back(BenchmarkCase{"replay_" + std::to_string(i), model});
+    }
+
+    ParamsConfig cfg;
+    Logger logger("bench");
+    logger.setMuteConsole(true);
+    const auto outDir = logger.getOutputDir();
+
+    std::vector<std::pair<std::string, std::shared_ptr<SearchAlgorithm>>> algorithms {
+        {"Linear", std::make_shared<LinearSearchAlgorithm>()},
+        {"GSS", std::make_shared<GoldenSectionSearchAlgorithm>()}};
+    const std::vector<TargetMetric> metrics {TargetMetric::MIN_E, TargetMetric::MIN_E_X_T, TargetMetric::MIN_M_PLUS};
+
+    std::ofstream csv(outDir + "search_benchmark.csv", std::ios::out | std::ios::trunc);
+    csv << "case,algorithm,metric,msTestPhasePeriod,probes,tuning_time[s],tuning_energy[J],cap[W],optimal_cap[W],regret[%]\n";
+
+    // averages over the library per algorithm, metric and period
+    std::map<std::pair<std::string, std::string>, std::map<int, BenchmarkRun>> sums;
+    std::map<std::pair<std::string, std::string>, std::map<int, double>> regretSums;
+
+    for (const auto& benchmarkCase : cases)
+    {
+        for (auto metric : metrics)
+        {
+            const auto expression = MetricExpression::fromTargetMetric(metric, cfg.k_);
+            const double optimalCap = findOptimalCapInWatts(benchmarkCase.model, expression);
+            const double optimalValue = metricValue(benchmarkCase.model, optimalCap, expression);
+            for (const auto& [algorithmName, algorithm] : algorithms)
+            {
+                for (int period : msTestPhasePeriods)
+                {
+                    const auto run = runSearch(*algorithm, benchmarkCase.model, expression, period, cfg, logger);
+                    const double value = metricValue(benchmarkCase.model, run.capInWatts, expression);
+                    const double regret = 100.0 * (value / optimalValue - 1.0);
+                    csv << benchmarkCase.name << "," << algorithmName << "," << metricName(metric) << ","
+                        << period << "," << run.probes << "," << run.tuningTimeInSeconds << ","
+                        << run.tuningEnergyInJoules << "," << run.capInWatts << "," << optimalCap << ","
+                        << regret << "\n";
+                    std::cout << benchmarkCase.name << "\t" << algorithmName << "\t" << metric << "\t"
+                              << period << " ms\tprobes " << run.probes << "\tcap " << run.capInWatts
+                              << " W (opt. " << optimalCap << " W)\tregret " << regret << " %\n";
+
+                    auto& sum = sums[{algorithmName, metricName(metric)}][period];
+                    sum.probes += run.probes;
+                    sum.tuningTimeInSeconds += run.tuningTimeInSeconds;
+                    sum.tuningEnergyInJoules += run.tuningEnergyInJoules;
+                    regretSums[{algorithmName, metricName(metric)}][period] += regret;
+                }
+            }
+        }
+    }
+    csv.close();
+
+    // gnuplot reads whitespace separated columns, hence separate summary files
+    std::map<std::string, std::vector<Series>> regretSeries;
+    std::vector<Series> tuningTimeSeries;
+    for (const auto& [key, perPeriod] : sums)
+    {
+        const auto& [algorithmName, metric] = key;
+        const auto fileName = outDir + "summary_" + algorithmName + "_" + metric + ".dat";
+        std::ofstream summary(fileName, std::ios::out | std::ios::trunc);
+        summary << "#msTestPhasePeriod\tregret[%]\ttuning_time[s]\tprobes\ttuning_energy[J]\n";
+        for (const auto& [period, sum] : perPeriod)
+        {
+            const double n = cases.size();
+            summary << period << "\t" << regretSums[key][period] / n << "\t" << sum.tuningTimeInSeconds / n
+                    << "\t" << sum.probes / n << "\t" << sum.tuningEnergyInJoules / n << "\n";
+        }
+        summary.close();
+        regretSeries[metric].push_back(Series(fileName, 1, 2, algorithmName));
+        if (metric == metricName(TargetMetric::MIN_E))
+        {
+            tuningTimeSeries.push_back(Series(fileName, 1, 3, algorithmName));
+        }
+    }
+
+    for (const auto& [metric, series] : regretSeries)
+    {
+        PlotBuilder plot(outDir + "regret_" + metric + ".png");
+        plot.setPlotTitle("Mean regret of min(" + metric + ") search");
+        plot.setXlabel("msTestPhasePeriod [ms]");
+        plot.setYlabel("regret [%]");
+        plot.plot(series);
+    }
+    PlotBuilder plot(outDir + "tuning_time.png");
+    plot.setPlotTitle("Mean tuning time of min(E) search");
+    plot.setXlabel("msTestPhasePeriod [ms]");
+    plot.setYlabel("tuning time [s]");
+    plot.plot(tuningTimeSeries);
+
+    std::cout << "Results written to " << outDir << "\n";
+    return 0;
+}
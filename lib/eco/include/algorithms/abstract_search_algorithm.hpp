@@ -17,18 +17,28 @@
 #pragma once
 
 #include <sys/wait.h>
+#include <algorithm>
+#include <optional>
+#include <utility>
 #include "logging/both_stream.hpp"
 #include "logging/log.hpp"
+#include "data_structures/metric_expression.hpp"
 
 
 class SearchAlgorithm
 {
   public:
+    SearchAlgorithm() = default;
+    /// \p limitsRangeInWatts narrows the device limits range explored by the algorithm (e.g. by WorkloadClassifier).
+    explicit SearchAlgorithm(std::optional<std::pair<unsigned, unsigned>> limitsRangeInWatts) :
+      limitsRangeInWatts_(limitsRangeInWatts) {}
+    virtual ~SearchAlgorithm() = default;
+
     virtual unsigned operator() (
       std::shared_ptr<Device>,
       DeviceStateAccumulator&,
       Trigger&,
-      TargetMetric,
+      const MetricExpression&,
       const PowAndPerfResult&,
       int&,
       int,
@@ -46,13 +56,14 @@ class SearchAlgorithm
       Logger& logger)
     {
       auto pauseInMicroSeconds = powerSamplingPeriodInMilliSeconds * 1000;
-      usleep(pauseInMicroSeconds);
+      auto clock = deviceState.getClock();
+      clock->sleepForMicroSeconds(pauseInMicroSeconds);
       deviceState.sample();
       auto resultAccumulator = deviceState.getCurrentPowerAndPerf();
 
       while (tuningTimeWindowInMicroSeconds > pauseInMicroSeconds)
       {
-        usleep(pauseInMicroSeconds);
+        clock->sleepForMicroSeconds(pauseInMicroSeconds);
         deviceState.sample();
         auto tmp = deviceState.getCurrentPowerAndPerf(trigger);
         logger.logPowerLogLine(deviceState, tmp);
@@ -65,4 +76,24 @@ class SearchAlgorithm
 
       return resultAccumulator;
     }
+
+  protected:
+    std::pair<unsigned, unsigned> getLimitsRangeInWatts(const std::shared_ptr<Device>& device) const
+    {
+      const auto deviceRange = device->getMinMaxLimitInWatts();
+      if (!limitsRangeInWatts_.has_value())
+      {
+        return deviceRange;
+      }
+      const auto minLimitInWatts = std::max(deviceRange.first, limitsRangeInWatts_->first);
+      const auto maxLimitInWatts = std::min(deviceRange.second, limitsRangeInWatts_->second);
+      if (minLimitInWatts >= maxLimitInWatts)
+      {
+        return deviceRange;
+      }
+      return std::make_pair(minLimitInWatts, maxLimitInWatts);
+    }
+
+  private:
+    std::optional<std::pair<unsigned, unsigned>> limitsRangeInWatts_;
 };
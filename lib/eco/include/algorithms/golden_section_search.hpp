@@ -22,11 +22,13 @@
 class GoldenSectionSearchAlgorithm : public SearchAlgorithm
 {
   public:
+    using SearchAlgorithm::SearchAlgorithm;
+
     unsigned operator() (
       std::shared_ptr<Device> device,
       DeviceStateAccumulator& deviceState,
       Trigger& trigger,
-      TargetMetric metric,
+      const MetricExpression& metric,
       const PowAndPerfResult& reference,
       int& procStatus,
       int childProcID,
@@ -34,7 +36,7 @@ class GoldenSectionSearchAlgorithm : public SearchAlgorithm
       int tuningTimeWindowInMilliSeconds,
       Logger& logger) const
     {
-        const auto [minLimitInWatts, maxLimitInWatts] = device->getMinMaxLimitInWatts();
+        const auto [minLimitInWatts, maxLimitInWatts] = getLimitsRangeInWatts(device);
         int EPSILON = (maxLimitInWatts - minLimitInWatts) * 1e6 / 25;
 
         int a = minLimitInWatts * 1e6; // micro watts
@@ -80,7 +82,7 @@ class GoldenSectionSearchAlgorithm : public SearchAlgorithm
             logger.logPowerLogLine(deviceState, fR, reference);
           }
 
-          if (!fL.isRightBetter(fR, metric)) {
+          if (!metric.isRightBetter(fL, fR, reference)) {
             // choose subrange [a, rightCandidateInMilliWatts]
             b = rightCandidateInMicroWatts;
             rightCandidateInMicroWatts = leftCandidateInMicroiWatts;
@@ -22,11 +22,13 @@
 class LinearSearchAlgorithm : public SearchAlgorithm
 {
   public:
+    using SearchAlgorithm::SearchAlgorithm;
+
     unsigned operator() (
       std::shared_ptr<Device> device,
       DeviceStateAccumulator& deviceState,
       Trigger& trigger,
-      TargetMetric metric,
+      const MetricExpression& metric,
       const PowAndPerfResult& reference,
       int& procStatus,
       int childProcID,
@@ -34,12 +36,14 @@ class LinearSearchAlgorithm : public SearchAlgorithm
       int tuningTimeWindowInMilliSeconds,
       Logger& logger) const
     {
-      const auto [minLimitInWatts, maxLimitInWatts] = device->getMinMaxLimitInWatts();
+      const auto [minLimitInWatts, maxLimitInWatts] = getLimitsRangeInWatts(device);
       const auto minLimitInMictoWatts = minLimitInWatts * 1e6;
       const auto maxLimitInMictoWatts = maxLimitInWatts * 1e6;
       int STEP = (maxLimitInMictoWatts - minLimitInMictoWatts) / 10;
 
       auto bestResultSoFar = reference;
+      // the reference was taken with the limit active before the search started
+      unsigned bestLimitInMicroWatts = device->getPowerLimitInWatts() * 1e6;
       int currentLimitInMicroWatts = maxLimitInMictoWatts;
 
       while(procStatus)
@@ -54,9 +58,10 @@ class LinearSearchAlgorithm : public SearchAlgorithm
           childProcID,
           logger);
         logger.logPowerLogLine(deviceState, currentResult, reference);
-        if (bestResultSoFar.isRightBetter(currentResult, metric))
+        if (metric.isRightBetter(bestResultSoFar, currentResult, reference))
         {
             bestResultSoFar = std::move(currentResult);
+            bestLimitInMicroWatts = currentLimitInMicroWatts;
         }
         if (currentLimitInMicroWatts == minLimitInMictoWatts)
         {
@@ -69,6 +74,6 @@ class LinearSearchAlgorithm : public SearchAlgorithm
         }
         waitpid(childProcID, &procStatus, WNOHANG);
       }
-      return (unsigned)(bestResultSoFar.appliedPowerCapInWatts_ * 1e6);
+      return bestLimitInMicroWatts;
     }
 };
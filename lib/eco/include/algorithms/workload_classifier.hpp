@@ -0,0 +1,79 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <utility>
+
+#include "data_structures/workload_profile.hpp"
+
+/*
+  WorkloadClassifier - roofline-like labelling of a workload phase used to seed the search range
+
+  CPU: low IPC with high memory traffic per instruction means the phase sits under the
+  bandwidth roof (memory-bound), low IPC with little traffic means it stalls on latency.
+  GPU: memory busy time dominating means memory-bound, compute units idle most of the
+  time means latency-bound (launch gaps, low occupancy).
+  The label selects the part of the limits range the search algorithm starts from.
+*/
+class WorkloadClassifier
+{
+  public:
+    static WorkloadClass classify(const WorkloadProfile& profile)
+    {
+        if (profile.ipc_.has_value() && profile.bytesPerInstruction_.has_value())
+        {
+            if (*profile.ipc_ >= HIGH_IPC)
+            {
+                return WorkloadClass::COMPUTE_BOUND;
+            }
+            return *profile.bytesPerInstruction_ >= MEMORY_BOUND_BYTES_PER_INSTRUCTION ?
+                WorkloadClass::MEMORY_BOUND : WorkloadClass::LATENCY_BOUND;
+        }
+        if (profile.computeUtilization_.has_value() && profile.memoryUtilization_.has_value())
+        {
+            if (*profile.computeUtilization_ < LOW_COMPUTE_UTILIZATION)
+            {
+                return WorkloadClass::LATENCY_BOUND;
+            }
+            return *profile.memoryUtilization_ >= HIGH_MEMORY_UTILIZATION ?
+                WorkloadClass::MEMORY_BOUND : WorkloadClass::COMPUTE_BOUND;
+        }
+        return WorkloadClass::UNKNOWN;
+    }
+
+    /// Part of [minLimitInWatts, maxLimitInWatts] worth searching for the given workload class.
+    static std::pair<unsigned, unsigned> narrowRange(WorkloadClass wc, unsigned minLimitInWatts, unsigned maxLimitInWatts)
+    {
+        const double range = maxLimitInWatts - std::min(minLimitInWatts, maxLimitInWatts);
+        switch (wc) {
+            case WorkloadClass::COMPUTE_BOUND :
+                return {minLimitInWatts + unsigned(0.4 * range), maxLimitInWatts};
+            case WorkloadClass::MEMORY_BOUND :
+                return {minLimitInWatts, minLimitInWatts + unsigned(0.6 * range)};
+            case WorkloadClass::LATENCY_BOUND :
+                return {minLimitInWatts, minLimitInWatts + unsigned(0.8 * range)};
+            default :
+                return {minLimitInWatts, maxLimitInWatts};
+        }
+    }
+
+    static constexpr double HIGH_IPC {1.5};
+    static constexpr double MEMORY_BOUND_BYTES_PER_INSTRUCTION {0.5};
+    static constexpr double LOW_COMPUTE_UTILIZATION {50.0};
+    static constexpr double HIGH_MEMORY_UTILIZATION {60.0};
+};
@@ -0,0 +1,82 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+/*
+  Clock - time source and sleep used by the control loop
+
+  RealClock reads std::chrono::high_resolution_clock and really sleeps. SimulatedClock is a
+  discrete-event clock: sleeping only moves the virtual time forward, so a session driven by
+  a simulated device (see SimulatedDevice) runs as fast as the computations allow.
+  Time points share the high_resolution_clock type, so both clocks can be used wherever
+  std::chrono::high_resolution_clock::now() was used before.
+*/
+class Clock
+{
+  public:
+    using TimePoint = std::chrono::high_resolution_clock::time_point;
+
+    virtual ~Clock() = default;
+    virtual TimePoint now() const = 0;
+    virtual void sleepFor(std::chrono::nanoseconds duration) = 0;
+    virtual bool isSimulated() const { return false; }
+
+    void sleepForMicroSeconds(long long us) { sleepFor(std::chrono::microseconds(us)); }
+};
+
+class RealClock : public Clock
+{
+  public:
+    TimePoint now() const override { return std::chrono::high_resolution_clock::now(); }
+    void sleepFor(std::chrono::nanoseconds duration) override { std::this_thread::sleep_for(duration); }
+};
+
+class SimulatedClock : public Clock
+{
+  public:
+    TimePoint now() const override
+    {
+        return TimePoint(std::chrono::duration_cast<TimePoint::duration>(
+            std::chrono::nanoseconds(elapsedInNanoSeconds_.load(std::memory_order_acquire))));
+    }
+    void sleepFor(std::chrono::nanoseconds duration) override { advance(duration); }
+    bool isSimulated() const override { return true; }
+
+    void advance(std::chrono::nanoseconds duration)
+    {
+        if (duration.count() > 0)
+        {
+            elapsedInNanoSeconds_.fetch_add(duration.count(), std::memory_order_acq_rel);
+        }
+    }
+    double getElapsedSeconds() const { return elapsedInNanoSeconds_.load(std::memory_order_acquire) / 1e9; }
+
+  private:
+    std::atomic<long long> elapsedInNanoSeconds_ {0};
+};
+
+/// Process wide clock shared by the real devices and the control loop.
+inline std::shared_ptr<Clock> getRealClock()
+{
+    static std::shared_ptr<Clock> clock = std::make_shared<RealClock>();
+    return clock;
+}
@@ -0,0 +1,54 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+/// Hardware energy counter reading together with the hardware timestamp of that reading.
+struct EnergyCounterSample {
+    uint64_t energyInMicroJoules {0};
+    uint64_t timestampInMicroSeconds {0};
+};
+
+/*
+  EnergyIntegrator - energy consumed since reset()
+
+  Devices with an energy counter (e.g. Level Zero zesPowerGetEnergyCounter) add counter
+  samples: the energy is the counter difference and the interval is taken from the counter
+  timestamps, so it does not depend on when the sample was read. A sample with the same
+  timestamp as the previous one (counter not updated yet) is ignored. Other devices add
+  their sampled power held over an interval measured with nanosecond resolution.
+*/
+class EnergyIntegrator {
+public:
+    /// Zeroes the energy; the next counter sample only sets the origin.
+    void reset();
+    void addPowerSample(double powerInWatts, std::chrono::nanoseconds interval);
+    void addEnergyCounterSample(const EnergyCounterSample& sample);
+
+    double getEnergyInJoules() const { return energyInJoules_; }
+    /// Average power of the last interval, 0.0 until an interval was integrated.
+    double getLastIntervalPowerInWatts() const;
+
+private:
+    double energyInJoules_ {0.0};
+    double lastIntervalEnergyInJoules_ {0.0};
+    double lastIntervalInSeconds_ {0.0};
+    std::optional<EnergyCounterSample> lastCounterSample_;
+};
@@ -115,6 +115,8 @@ struct FinalPowerAndPerfResult {
     double powercap {0.0}, energy {0.0}, pkgPower {0.0}, pp0power {0.0}, pp1power {0.0},
            dramPower {0.0}, inst {0.0}, cycl {0.0}, deltaE {0.0}, deltaT {0.0},
            relativeDeltaE {0.0}, relativeDeltaT {0.0}, enerTimeProd {0.0}, mPlus{1.0};
+    double dramPowercap {-1.0}; // set only when DRAM cap is profiled/tuned along with PKG cap
+    double frequencyLimitInMHz {-1.0}; // set only when frequency limit is tuned (frequencySearch)
     TimeResult time_;
     EnergyTimeResult getEnergyAndTime() const { return EnergyTimeResult(energy, time_, pkgPower); }
     double getInstrPerSec() const { return inst / time_.totalTime_; }
@@ -0,0 +1,49 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <ctime>
+#include <optional>
+#include <string>
+
+struct IdlePowerEntry {
+    double pkgPowerInWatts {0.0};
+    double dramPowerInWatts {0.0};
+    std::time_t measuredAt {0};
+};
+
+/*
+  IdlePowerCache - idle power measurements persisted in a yaml file
+
+  Entries are keyed by a string describing the host and the device configuration (see
+  IntelDevice::makeIdlePowerCacheKey) and are valid for expiryInSeconds after measurement.
+  The file may be shared by several hosts (e.g. on a shared file system), so it is updated
+  by read-modify-rename.
+*/
+class IdlePowerCache {
+public:
+    IdlePowerCache(std::string path, long expiryInSeconds) :
+        path_(path), expiryInSeconds_(expiryInSeconds) {}
+    bool isEnabled() const { return expiryInSeconds_ > 0 && !path_.empty(); }
+    /// Valid entry for \p key, std::nullopt when missing, stale or when the cache is disabled.
+    std::optional<IdlePowerEntry> lookup(const std::string& key) const;
+    void store(const std::string& key, const IdlePowerEntry& entry) const;
+
+private:
+    std::string path_;
+    long expiryInSeconds_;
+};
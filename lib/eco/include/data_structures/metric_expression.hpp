@@ -0,0 +1,99 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "eco_constants.hpp"
+#include "data_structures/power_and_perf_result.hpp"
+
+/*
+  MetricExpression - target metric of the search compiled from a text expression
+
+  The expression is minimized and may be followed by constraints, e.g.
+      E*T^2
+      E subject to perf >= 0.95*ref_perf
+      (ref_perf/perf) * ((k-1)*P/ref_P + 1) / k            (EDS, see fromTargetMetric)
+  Variables are computed from the accumulated PowAndPerfResult of a test window and of the
+  reference run (measured with the default limit before the search):
+      E, ref_E        energy per unit of work [J]
+      T, ref_T        time per unit of work [s]
+      P, ref_P        average power [W]
+      perf, ref_perf  units of work per second
+      cap             applied limit [W]
+      k               k from config.yaml
+  Operators: + - * / ^ (right associative), unary -, parentheses, min(a, b), max(a, b).
+  Constraints are joined with "and" and compare two expressions with >=, <=, > or <.
+
+  Every part is compiled to a flat postfix program evaluated by a switch over the opcodes,
+  so the comparison in the search loop does not allocate and has no virtual calls. A result
+  meeting all constraints is better than any result violating them, among the latter the
+  one with the smaller sum of relative violations is better.
+*/
+class MetricExpression
+{
+public:
+    /// Throws std::invalid_argument pointing at the offending position of \p text.
+    static MetricExpression compile(const std::string& text, double k = 2.0);
+    /// Expression equivalent to one of the metrics selectable with --en/--edp/--eds.
+    static MetricExpression fromTargetMetric(TargetMetric metric, double k = 2.0);
+
+    const std::string& getText() const { return text_; }
+    bool hasConstraints() const { return !constraints_.empty(); }
+    double evaluate(const PowAndPerfResult& result, const PowAndPerfResult& reference) const;
+    /// 0.0 when all constraints hold, otherwise the sum of relative violations.
+    double getConstraintsViolation(const PowAndPerfResult& result, const PowAndPerfResult& reference) const;
+    bool isRightBetter(const PowAndPerfResult& left, const PowAndPerfResult& right, const PowAndPerfResult& reference) const;
+
+    enum class OpCode : std::uint8_t { CONSTANT, VARIABLE, ADD, SUB, MUL, DIV, POW, NEG, MIN, MAX };
+    struct Instruction
+    {
+        OpCode op;
+        std::uint8_t variable;
+        double constant;
+    };
+    using Program = std::vector<Instruction>;
+    static constexpr size_t maxStackDepth = 32;
+
+private:
+    enum class Relation : std::uint8_t { GE, GT, LE, LT };
+    struct Constraint
+    {
+        Program left;
+        Relation relation;
+        Program right;
+    };
+    using Variables = std::array<double, 9>;
+
+    static Variables makeVariables(const PowAndPerfResult& result, const PowAndPerfResult& reference);
+    static double run(const Program& program, const Variables& variables);
+    double getConstraintsViolation(const Variables& variables) const;
+
+    std::string text_;
+    Program objective_;
+    std::vector<Constraint> constraints_;
+
+    friend class MetricParser;
+};
+
+template <class Stream>
+Stream& operator<<(Stream& os, const MetricExpression& metric)
+{
+    os << metric.getText();
+    return os;
+}
@@ -42,9 +42,8 @@ struct PowAndPerfResult {
     double getInstrPerJoule() const { return instructionsCount_/energyInJoules_; }
     double getEnergyPerInstr() const { return energyInJoules_/instructionsCount_; }
     double getEnergyTimeProd() const { return getInstrPerSecond() * getInstrPerSecond() / averageCorePowerInWatts_; }
-    double checkPlusMetric(PowAndPerfResult ref, double k);
+    double checkPlusMetric(const PowAndPerfResult& ref, double k) const;
     friend std::ostream& operator<<(std::ostream&, const PowAndPerfResult&);
-    bool isRightBetter(PowAndPerfResult&, TargetMetric = TargetMetric::MIN_E);
     double instructionsCount_ {0.01};
     double periodInSeconds_ {0.01};
     double appliedPowerCapInWatts_ {0.01};
@@ -52,7 +51,6 @@ struct PowAndPerfResult {
     double averageCorePowerInWatts_ {0.01};
     double averageMemoryPowerInWatts_ {0.01};
     double filteredPowerOfLimitedDomainInWatts_ {0.01}; // assume that either Core or Memory is limited
-    double myPlusMetric_ {1.0};
 
     friend PowAndPerfResult& operator+=(PowAndPerfResult& left, const PowAndPerfResult& right)
     {
@@ -0,0 +1,61 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <optional>
+
+enum class WorkloadClass {
+    UNKNOWN,
+    COMPUTE_BOUND,
+    MEMORY_BOUND,
+    LATENCY_BOUND
+};
+
+template <class Stream>
+Stream& operator<<(Stream& os, const WorkloadClass& wc) {
+    switch(wc) {
+        case WorkloadClass::COMPUTE_BOUND :
+            os << "compute-bound";
+            break;
+        case WorkloadClass::MEMORY_BOUND :
+            os << "memory-bound";
+            break;
+        case WorkloadClass::LATENCY_BOUND :
+            os << "latency-bound";
+            break;
+        default :
+            os << "unknown";
+            break;
+    }
+    return os;
+}
+
+/*
+  WorkloadProfile - hardware counters summary of a workload phase
+
+  Filled by Device::endWorkloadProfiling. Each device fills only the counters it has,
+  the rest is left empty: CPUs report IPC and memory controller traffic, GPUs report
+  the busy time of compute units and of memory.
+*/
+struct WorkloadProfile
+{
+    std::optional<double> ipc_;                   // instructions per cycle (CPU)
+    std::optional<double> bytesPerInstruction_;   // memory controller traffic per retired instruction (CPU)
+    std::optional<double> memoryBandwidthInGBps_; // memory controller read + write traffic (CPU)
+    std::optional<double> computeUtilization_;    // percent of time compute units were busy (GPU)
+    std::optional<double> memoryUtilization_;     // percent of time device memory was read or written (GPU)
+};
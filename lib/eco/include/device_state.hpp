@@ -17,7 +17,9 @@
 #pragma once
 
 #include "devices/abstract_device.hpp"
+#include "perf_counter_interfaces/progress_metric.hpp"
 #include "data_structures/power_and_perf_result.hpp"
+#include "data_structures/energy_integrator.hpp"
 #include "trigger.hpp"
 
 using TimePoint = std::chrono::time_point<std::chrono::high_resolution_clock>;
@@ -25,13 +27,14 @@ using TimePoint = std::chrono::time_point<std::chrono::high_resolution_clock>;
 struct PowerAndPerfState
 {
     PowerAndPerfState() = delete;
-    PowerAndPerfState(double pow, unsigned long long ker, TimePoint t) :
-        power_(pow), kernelsCount_(ker), time_(t)
+    PowerAndPerfState(double pow, unsigned long long ker, TimePoint t, double memPow = 0.0) :
+        power_(pow), kernelsCount_(ker), time_(t), memoryPower_(memPow)
     {
     }
-    double power_;
+    double power_; // includes memoryPower_ when memory domain is accounted
     unsigned long long kernelsCount_;
     TimePoint time_;
+    double memoryPower_;
 };
 
 class DeviceStateAccumulator
@@ -51,10 +54,38 @@ public:
     /*
       getEnergySinceReset - is used for the final evaluation of energy consumed
 
-      returns the integrate of energy sampled since last Accumulator reset.
+      returns the integrate of energy sampled since last Accumulator reset. Devices with
+      an energy counter (see Device::getEnergyCounterSample) contribute counter differences
+      instead of sampled power.
     */
     double getEnergySinceReset() const;
 
+    /*
+      getEnergySinceResetPerDomain - per power domain energy (e.g. PKG, PP0, DRAM)
+
+      returns the energy since last reset as reported by the device power interface
+      (for Intel CPUs it is Rapl::getTotalEnergy() summed over packages). Empty when
+      the device does not distinguish power domains.
+    */
+    EnergyCrossDomains getEnergySinceResetPerDomain() const;
+
+    /*
+      includeDomainInEnergy - accounts additional power domain in the sampled power
+
+      By default only the main device power reading is integrated. When a secondary domain
+      (e.g. DRAM) is limited as well its power has to be a part of the optimized energy,
+      otherwise lowering its cap would look free for the search algorithm.
+    */
+    void includeDomainInEnergy(Domain d) { accountedExtraDomains_.insert(d); }
+
+    /*
+      setProgressMetric - selects the counter of useful work reported as performance
+
+      By default it is the device performance counter (see DevicePerfCounterMetric).
+    */
+    void setProgressMetric(std::shared_ptr<ProgressMetric> metric) { progressMetric_ = metric; }
+    std::shared_ptr<ProgressMetric> getProgressMetric() const { return progressMetric_; }
+
     /*
       getTimeSinceReset - is used for the final evaluation of time spent on computations
 
@@ -64,7 +95,7 @@ public:
     double getTimeSinceReset() const
     {
         return std::chrono::duration_cast<Resolution>(
-                    std::chrono::high_resolution_clock::now()  - timeOfLastReset_).count();
+                    clock_->now()  - timeOfLastReset_).count();
     }
 
     /*
@@ -77,7 +108,7 @@ public:
     double getTimeSinceObjectCreation() const
     {
         return std::chrono::duration_cast<Resolution>(
-                    std::chrono::high_resolution_clock::now()  - absoluteStartTime_).count();
+                    clock_->now()  - absoluteStartTime_).count();
     }
 
     // Temporary disabled
@@ -89,11 +120,15 @@ public:
     double getCurrentPower(Domain d);
     double getPerfCounterSinceReset();
     std::shared_ptr<Device> getDevice() const { return device_; }
+    std::shared_ptr<Clock> getClock() const { return clock_; }
 
 private:
+    std::shared_ptr<Clock> clock_; // taken from the device
     TimePoint absoluteStartTime_;
     TimePoint timeOfLastReset_;
     std::shared_ptr<Device> device_;
     PowerAndPerfState prev_, curr_, next_;
-    double totalEnergySinceReset_ {0.0};
+    EnergyIntegrator energy_;
+    std::set<Domain> accountedExtraDomains_;
+    std::shared_ptr<ProgressMetric> progressMetric_;
 };
@@ -23,6 +23,12 @@
 #include <optional>
 #include <cpucounters.h>
 #include "eco_constants.hpp"
+#include "clock.hpp"
+#include "power_interface/frequency_actuator.hpp"
+#include "data_structures/workload_profile.hpp"
+#include "data_structures/energy_integrator.hpp"
+
+class ProgressMetric;
 
 class Device
 {
@@ -56,6 +62,8 @@ public:
       may be just left empty. For Intel it needs to have Rapl::sample() method call.
     */
     virtual void triggerPowerApiSample() = 0;
+    /// Time source of the device readings; the control loop sleeps and measures time with it.
+    virtual std::shared_ptr<Clock> getClock() const { return getRealClock(); }
 
     /// True when multi-GPU async mode: each subdevice can have a different power cap (e.g. DEPO --async).
     virtual bool usesIndependentSubdevicePowerCaps() const { return false; }
@@ -68,6 +76,40 @@ public:
         }
     }
     virtual std::vector<unsigned long> getCurrentPerGpuCapsMicroWatts() const { return {}; }
+    /*
+      beginSubdeviceSearchSession - redirects the single-cap API to one subdevice
+
+      Used with usesIndependentSubdevicePowerCaps(): \p baselineCapsMicroW holds fixed limits
+      for all subdevices and setPowerLimitInMicroWatts/getPowerLimitInWatts refer only to
+      subdevice \p focusIndex, so that stock SearchAlgorithm objects tune one GPU at a time.
+      Devices without independent subdevice caps ignore the call.
+    */
+    virtual void beginSubdeviceSearchSession(size_t /*focusIndex*/, const std::vector<unsigned long>& /*baselineCapsMicroW*/) {}
+    virtual void endSubdeviceSearchSession() {}
+
+    /// True when \p dom can be power-limited on its own (e.g. Intel RAPL DRAM). Default: only the main domain.
+    virtual bool isCappableDomain(Domain dom) const { return dom == Domain::PKG; }
+    /// Energy in Joules integrated per power domain since last reset(); empty when the device has a single domain.
+    virtual EnergyCrossDomains getEnergySinceResetPerDomain() const { return {}; }
+    /// Energy counter of the main domain read by the last triggerPowerApiSample(), std::nullopt when the device has none.
+    virtual std::optional<EnergyCounterSample> getEnergyCounterSample() const { return std::nullopt; }
+    /*
+      beginDomainSearchSession - redirects the single-cap API to another power domain
+
+      While the session is active getMinMaxLimitInWatts, getPowerLimitInWatts and
+      setPowerLimitInMicroWatts refer to \p dom instead of the main domain, so that stock
+      SearchAlgorithm objects can sweep, e.g., the DRAM cap with the PKG cap kept fixed.
+      Devices without such domains ignore the call.
+    */
+    virtual void beginDomainSearchSession(Domain /*dom*/) {}
+    virtual void endDomainSearchSession() {}
+    /// Frequency control of the device for \p domain, nullptr when not supported.
+    virtual std::shared_ptr<FrequencyActuator> getFrequencyActuator(FrequencyDomain /*domain*/) { return nullptr; }
+    /// Hardware counters profile of the workload between the two calls, std::nullopt when not supported.
+    virtual void beginWorkloadProfiling() {}
+    virtual std::optional<WorkloadProfile> endWorkloadProfiling() { return std::nullopt; }
+    /// Device specific progress metric named \p name (see makeProgressMetric), nullptr when not supported.
+    virtual std::shared_ptr<ProgressMetric> makeDeviceProgressMetric(const std::string& /*name*/) { return nullptr; }
 
 private:
 };
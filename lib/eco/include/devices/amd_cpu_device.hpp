@@ -0,0 +1,136 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <sys/types.h>
+#include "devices/abstract_device.hpp"
+#include "power_interface/amd_hsmp.hpp"
+#include "perf_counter_interfaces/perf_event_counters.hpp"
+
+/*
+  AmdEnergySource - where AmdCpuDevice reads the energy counters from
+
+  MSR reads MSR_AMD_PKG_ENERGY_STATUS (one per socket) and MSR_AMD_CORE_ENERGY_STATUS
+  (one per physical core) through /dev/cpu/<cpu>/msr. HWMON reads the same counters
+  accumulated by the amd_energy hwmon driver (energyN_input in micro-joules, labelled
+  Esocket<k> and Ecore<k>), which does not need access to the msr device nodes.
+  AUTO uses MSR when the msr device nodes can be read and HWMON otherwise.
+*/
+enum class AmdEnergySource
+{
+    AUTO,
+    MSR,
+    HWMON
+};
+
+/*
+  AmdCpuDevice - AMD Zen CPUs (EPYC, Ryzen) as a Device
+
+  Energy is read from the RAPL-compatible AMD energy counters (see AmdEnergySource): the
+  package counters sum up to the PKG domain, the core counters to the PP0 domain. The 32-bit
+  MSR counters wrap around every few minutes under load, so they are accumulated into
+  joules on each triggerPowerApiSample().
+
+  Power capping uses the socket power limit of the HSMP driver (see AmdHsmp). The total
+  limit is split evenly between the sockets. When /dev/hsmp is not available the device
+  only measures: the limits range is {0, 0} and setPowerLimitInMicroWatts() is ignored.
+  As for IntelDevice the maximal limit is the sum of the default socket limits.
+
+  All the files are looked up under \p rootDir (/proc/cpuinfo, /sys/devices/system/cpu,
+  /sys/class/hwmon, /dev/cpu, /dev/hsmp), so the device can run on a fake sysfs tree.
+*/
+class AmdCpuDevice : public Device
+{
+public:
+    explicit AmdCpuDevice(AmdEnergySource source = AmdEnergySource::AUTO,
+                          const std::string& rootDir = "",
+                          std::shared_ptr<Clock> clock = getRealClock());
+    ~AmdCpuDevice() override;
+
+    /// True when vendor_id in <rootDir>/proc/cpuinfo is AuthenticAMD (or HygonGenuine).
+    static bool isAmdCpu(const std::string& rootDir = "");
+
+    std::string getName() const override { return modelName_; }
+    std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override;
+    double getPowerLimitInWatts() const override;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override;
+    void reset() override;
+    unsigned long long int getPerfCounter() const override;
+    double getCurrentPowerInWatts(std::optional<Domain> dom = std::nullopt) const override;
+    void restoreDefaultLimits() override;
+    std::string getDeviceTypeString() const override { return "cpu"; }
+    void triggerPowerApiSample() override;
+    std::shared_ptr<Clock> getClock() const override { return clock_; }
+    EnergyCrossDomains getEnergySinceResetPerDomain() const override;
+    std::optional<EnergyCounterSample> getEnergyCounterSample() const override;
+
+    AmdEnergySource getEnergySource() const { return source_; }
+    bool isPowerCappingAvailable() const { return !defaultSocketLimitsInMilliWatts_.empty(); }
+    int getNumPackages() const { return static_cast<int>(pkgToFirstCoreMap_.size()); }
+    int getNumCoreCounters() const { return static_cast<int>(coreCounters_.size()); }
+
+private:
+    struct EnergyCounter
+    {
+        int fd {-1};
+        off_t msrOffset {-1}; // -1 for the amd_energy files
+        uint64_t lastRaw {0};
+        double joules {0.0};  // accumulated since construction
+    };
+
+    void detectCPU();
+    void detectTopology();
+    bool openMsrCounters();
+    bool openHwmonCounters();
+    void initPowerCapping();
+    std::string makeIdlePowerCacheKey() const;
+    void updateCounter(EnergyCounter& counter) const;
+    bool readRaw(const EnergyCounter& counter, uint64_t& raw) const;
+    static double sumJoules(const std::vector<EnergyCounter>& counters);
+
+    const std::string rootDir_;
+    std::shared_ptr<Clock> clock_;
+    AmdEnergySource source_;
+    std::string modelName_ {"AMD CPU"};
+    std::vector<int> pkgToFirstCoreMap_;
+    std::vector<int> physicalCoreFirstCpus_;
+    double msrEnergyUnitInJoules_ {0.0};
+    std::vector<EnergyCounter> pkgCounters_;
+    std::vector<EnergyCounter> coreCounters_;
+
+    std::optional<Clock::TimePoint> lastSampleTime_;
+    double lastPkgJoules_ {0.0};
+    double lastCoreJoules_ {0.0};
+    double pkgPowerInWatts_ {0.0};
+    double corePowerInWatts_ {0.0};
+    double pkgJoulesAtReset_ {0.0};
+    double coreJoulesAtReset_ {0.0};
+
+    std::unique_ptr<PerfEventCounters> perfEventCounters_;
+    double perfEventInstructionsAtReset_ {0.0};
+
+    std::unique_ptr<AmdHsmp> hsmp_;
+    std::vector<uint32_t> defaultSocketLimitsInMilliWatts_;
+    std::vector<uint32_t> maxSocketLimitsInMilliWatts_;
+    double currentPowerLimitInWatts_ {0.0};
+    double idlePowerInWatts_ {0.0}; // the min limit, measured when capping is available
+    const std::string journalDeviceName_ {"amd_cpu"};
+};
@@ -71,13 +71,19 @@ class CudaDevice : public Device
     void triggerPowerApiSample() override {}; // empty method since, NVIDIA GPU does not need to explicit trigger API sampling
     void restoreDefaultLimits() override;
     std::string getDeviceTypeString() const override { return "gpu"; };
+    std::shared_ptr<FrequencyActuator> getFrequencyActuator(FrequencyDomain domain) override;
+    std::optional<WorkloadProfile> endWorkloadProfiling() override;
+    /// "gpu_busy" - kernel busy time from the injection library activity records.
+    std::shared_ptr<ProgressMetric> makeDeviceProgressMetric(const std::string& name) override;
 
 
   private:
     void initDeviceHandles();
+    std::string getJournalDeviceName() const { return "gpu" + std::to_string(deviceID_); }
     nvmlReturn_t nvResult_;
     unsigned int deviceCount_ {0};
     int deviceID_;
     std::vector<nvmlDevice_t> deviceHandles_;
     double defaultPowerLimitInWatts_;
+    std::shared_ptr<FrequencyActuator> frequencyActuator_;
 };
@@ -0,0 +1,220 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "devices/abstract_device.hpp"
+#include "devices/eco_device_v1.h"
+
+/*
+  device_plugin_export.hpp - packages a Device implementation as an eco_device_v1 plugin
+
+  A plugin source defines a probe and a factory and exports the table with one line:
+
+      ECO_DEVICE_PLUGIN("cuda", "gpu", probeCuda, makeCudaDevice)
+
+  Every call is forwarded to the Device created by the factory, exceptions are caught
+  and reported through last_error(), none crosses the C ABI.
+*/
+
+/// Parsed eco_device_v1::create options: "0,1,async" selects devices 0 and 1 with independent caps.
+struct DevicePluginOptions
+{
+    std::vector<int> ids;
+    bool async {false};
+};
+
+inline DevicePluginOptions parseDevicePluginOptions(const char* options)
+{
+    DevicePluginOptions parsed;
+    std::stringstream ss(options != nullptr ? options : "");
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (item == "async")
+        {
+            parsed.async = true;
+        }
+        else if (!item.empty())
+        {
+            parsed.ids.push_back(std::stoi(item));
+        }
+    }
+    return parsed;
+}
+
+struct eco_device
+{
+    std::unique_ptr<Device> device;
+    std::string error;
+};
+
+using DevicePluginFactory = std::unique_ptr<Device> (*)(const DevicePluginOptions&);
+
+namespace device_plugin {
+
+inline std::string& createError()
+{
+    static std::string error;
+    return error;
+}
+
+template <class F>
+int guarded(eco_device* dev, F&& f)
+{
+    try
+    {
+        f();
+        return 0;
+    }
+    catch (const std::exception& e)
+    {
+        dev->error = e.what();
+    }
+    catch (...)
+    {
+        dev->error = "unknown error";
+    }
+    return -1;
+}
+
+template <class T, class F>
+T guardedValue(eco_device* dev, T onError, F&& f)
+{
+    T value = onError;
+    guarded(dev, [&] { value = f(); });
+    return value;
+}
+
+inline int copyString(const std::string& s, char* buf, size_t len)
+{
+    if (buf == nullptr || len == 0)
+    {
+        return -1;
+    }
+    std::strncpy(buf, s.c_str(), len - 1);
+    buf[len - 1] = '\0';
+    return 0;
+}
+
+template <DevicePluginFactory Factory>
+const eco_device_v1* table(const char* name, const char* type, int (*probe)(void))
+{
+    static const eco_device_v1 t = [&] {
+        eco_device_v1 v {};
+        v.abi_version = ECO_DEVICE_ABI_VERSION;
+        v.name = name;
+        v.type = type;
+        v.probe = probe;
+        v.create = [](const char* options) -> eco_device* {
+            auto dev = std::make_unique<eco_device>();
+            if (guarded(dev.get(), [&] { dev->device = Factory(parseDevicePluginOptions(options)); }) != 0
+                || dev->device == nullptr)
+            {
+                createError() = dev->device == nullptr && dev->error.empty() ? "no device created" : dev->error;
+                return nullptr;
+            }
+            return dev.release();
+        };
+        v.destroy = [](eco_device* dev) { delete dev; };
+        v.last_error = [](eco_device* dev) { return dev != nullptr ? dev->error.c_str() : createError().c_str(); };
+        v.get_name = [](eco_device* dev, char* buf, size_t len) {
+            std::string n;
+            return guarded(dev, [&] { n = dev->device->getName(); }) == 0 ? copyString(n, buf, len) : -1;
+        };
+        v.get_min_max_limit = [](eco_device* dev, unsigned* minW, unsigned* maxW) {
+            return guarded(dev, [&] { std::tie(*minW, *maxW) = dev->device->getMinMaxLimitInWatts(); });
+        };
+        v.get_power_limit = [](eco_device* dev) {
+            return guardedValue(dev, -1.0, [&] { return dev->device->getPowerLimitInWatts(); });
+        };
+        v.set_power_limit = [](eco_device* dev, unsigned long limitUw) {
+            return guarded(dev, [&] { dev->device->setPowerLimitInMicroWatts(limitUw); });
+        };
+        v.restore_default_limits = [](eco_device* dev) {
+            return guarded(dev, [&] { dev->device->restoreDefaultLimits(); });
+        };
+        v.sample = [](eco_device* dev) { return guarded(dev, [&] { dev->device->triggerPowerApiSample(); }); };
+        v.get_power = [](eco_device* dev, int domain) {
+            return guardedValue(dev, 0.0, [&] {
+                return dev->device->getCurrentPowerInWatts(
+                    domain == ECO_DEVICE_DOMAIN_ALL ? std::nullopt : std::optional<Domain>(static_cast<Domain>(domain)));
+            });
+        };
+        v.get_energy_counter = [](eco_device* dev, uint64_t* energyUj, uint64_t* timestampUs) {
+            std::optional<EnergyCounterSample> counter;
+            if (guarded(dev, [&] { counter = dev->device->getEnergyCounterSample(); }) != 0 || !counter.has_value())
+            {
+                return -1;
+            }
+            *energyUj = counter->energyInMicroJoules;
+            *timestampUs = counter->timestampInMicroSeconds;
+            return 0;
+        };
+        v.reset = [](eco_device* dev) { return guarded(dev, [&] { dev->device->reset(); }); };
+        v.get_perf_counter = [](eco_device* dev) {
+            return guardedValue(dev, 0ULL, [&] { return dev->device->getPerfCounter(); });
+        };
+        v.get_num_subdevices = [](eco_device* dev) {
+            return guardedValue(dev, size_t {1}, [&] { return dev->device->getNumSubdevices(); });
+        };
+        v.get_subdevice_label = [](eco_device* dev, size_t index, char* buf, size_t len) {
+            std::string label;
+            return guarded(dev, [&] { label = dev->device->getSubdeviceLabel(index); }) == 0 ? copyString(label, buf, len) : -1;
+        };
+        v.get_subdevice_power = [](eco_device* dev, size_t index) {
+            return guardedValue(dev, 0.0, [&] { return dev->device->getCurrentPowerInWattsForSubdevice(index); });
+        };
+        v.get_subdevice_power_limit = [](eco_device* dev, size_t index) {
+            return guardedValue(dev, -1.0, [&] { return dev->device->getPowerLimitInWattsForSubdevice(index); });
+        };
+        v.has_independent_subdevice_caps = [](eco_device* dev) {
+            return guardedValue(dev, 0, [&] { return dev->device->usesIndependentSubdevicePowerCaps() ? 1 : 0; });
+        };
+        v.set_subdevice_power_limits = [](eco_device* dev, const unsigned long* limitsUw, size_t count) {
+            return guarded(dev, [&] {
+                dev->device->setPowerLimitsPerGpuMicroWatts(std::vector<unsigned long>(limitsUw, limitsUw + count));
+            });
+        };
+        v.begin_subdevice_search = [](eco_device* dev, size_t index, const unsigned long* baselineUw, size_t count) {
+            return guarded(dev, [&] {
+                dev->device->beginSubdeviceSearchSession(index, std::vector<unsigned long>(baselineUw, baselineUw + count));
+            });
+        };
+        v.end_subdevice_search = [](eco_device* dev) {
+            return guarded(dev, [&] { dev->device->endSubdeviceSearchSession(); });
+        };
+        return v;
+    }();
+    return &t;
+}
+
+} // namespace device_plugin
+
+#define ECO_DEVICE_PLUGIN(NAME, TYPE, PROBE, FACTORY)                                                                  \
+    extern "C" const eco_device_v1* eco_device_v1_entry(void)                                                         \
+    {                                                                                                                  \
+        return device_plugin::table<FACTORY>(NAME, TYPE, PROBE);                                                       \
+    }
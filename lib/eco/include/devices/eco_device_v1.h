@@ -0,0 +1,104 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+  eco_device_v1.h - C ABI of device plugins (version 1)
+
+  A device plugin is a shared library exporting eco_device_v1_entry(), which returns a
+  table of functions implementing one power-manageable device type (e.g. NVIDIA GPUs
+  through NVML). PluginDevice dlopens the plugins found in ECO_PLUGIN_PATH and wraps
+  them as a Device. The GPU devices are linked into their plugins only and libeco links
+  no vendor library, so one binary serves CPU-only, NVIDIA and Intel GPU nodes and only
+  the vendor libraries of the selected plugin are loaded. A plugin whose vendor library
+  is absent simply fails to load.
+
+  All functions are called from one thread. Functions returning int return 0 on success
+  and a negative value on failure; last_error() then describes the failure. No C++
+  exception may cross this interface.
+*/
+
+#ifndef ECO_DEVICE_V1_H
+#define ECO_DEVICE_V1_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ECO_DEVICE_ABI_VERSION 1u
+#define ECO_DEVICE_V1_ENTRY "eco_device_v1_entry"
+#define ECO_PLUGIN_PATH_ENV "ECO_PLUGIN_PATH"
+
+/* ECO_DEVICE_DOMAIN_ALL, or the Domain values of eco_constants.hpp */
+#define ECO_DEVICE_DOMAIN_ALL (-1)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct eco_device eco_device; /* opaque device instance of a plugin */
+
+typedef struct eco_device_v1
+{
+    uint32_t abi_version; /* ECO_DEVICE_ABI_VERSION */
+    const char* name;     /* short plugin name, e.g. "cuda" */
+    const char* type;     /* "cpu", "gpu" or "xpu", see Device::getDeviceTypeString */
+
+    /* 1 when the hardware is present, 0 otherwise; must not initialize the device */
+    int (*probe)(void);
+    /* \p options: comma separated device ids and flags, e.g. "0,1,async"; NULL on failure */
+    eco_device* (*create)(const char* options);
+    void (*destroy)(eco_device* dev);
+    /* message of the last failure of \p dev (or of create() when \p dev is NULL) */
+    const char* (*last_error)(eco_device* dev);
+
+    int (*get_name)(eco_device* dev, char* buf, size_t len);
+
+    /* power limits in Watts (or Amperes for current capping devices), caps in micro-units */
+    int (*get_min_max_limit)(eco_device* dev, unsigned* min_w, unsigned* max_w);
+    double (*get_power_limit)(eco_device* dev);
+    int (*set_power_limit)(eco_device* dev, unsigned long limit_uw);
+    int (*restore_default_limits)(eco_device* dev);
+
+    /* reads the power interface, after which get_power and get_energy_counter are current */
+    int (*sample)(eco_device* dev);
+    double (*get_power)(eco_device* dev, int domain);
+    /* -1 when the device has no hardware energy counter */
+    int (*get_energy_counter)(eco_device* dev, uint64_t* energy_uj, uint64_t* timestamp_us);
+
+    int (*reset)(eco_device* dev);
+    unsigned long long (*get_perf_counter)(eco_device* dev);
+
+    /* subdevices (e.g. GPUs of a multi-GPU device), a single device reports 1 */
+    size_t (*get_num_subdevices)(eco_device* dev);
+    int (*get_subdevice_label)(eco_device* dev, size_t index, char* buf, size_t len);
+    double (*get_subdevice_power)(eco_device* dev, size_t index);
+    double (*get_subdevice_power_limit)(eco_device* dev, size_t index);
+    /* 1 when every subdevice can have its own cap, see set_subdevice_power_limits */
+    int (*has_independent_subdevice_caps)(eco_device* dev);
+    int (*set_subdevice_power_limits)(eco_device* dev, const unsigned long* limits_uw, size_t count);
+    int (*begin_subdevice_search)(eco_device* dev, size_t index, const unsigned long* baseline_uw, size_t count);
+    int (*end_subdevice_search)(eco_device* dev);
+} eco_device_v1;
+
+typedef const eco_device_v1* (*eco_device_v1_entry_fn)(void);
+
+/* exported by every plugin */
+const eco_device_v1* eco_device_v1_entry(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ECO_DEVICE_V1_H */
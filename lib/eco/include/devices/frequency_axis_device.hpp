@@ -0,0 +1,62 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <optional>
+
+#include "devices/abstract_device.hpp"
+#include "power_interface/frequency_actuator.hpp"
+
+/*
+  FrequencyAxisDevice - exposes the frequency limit of the wrapped device through the power cap API
+
+  It lets the stock SearchAlgorithm functors sweep a frequency limit instead of a power cap.
+  One "watt" of the exposed limit corresponds to MHZ_PER_LIMIT_UNIT MHz, so that the
+  micro-scaled limits used by the algorithms still fit into an int. Power, performance and
+  reset calls are forwarded to the wrapped device unchanged.
+*/
+class FrequencyAxisDevice : public Device
+{
+  public:
+    static constexpr unsigned MHZ_PER_LIMIT_UNIT = 10;
+
+    FrequencyAxisDevice(std::shared_ptr<Device> device, std::shared_ptr<FrequencyActuator> actuator);
+    ~FrequencyAxisDevice() override = default;
+
+    std::string getName() const override;
+    std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override;
+    double getPowerLimitInWatts() const override;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override;
+    void reset() override { device_->reset(); }
+    unsigned long long int getPerfCounter() const override { return device_->getPerfCounter(); }
+    double getCurrentPowerInWatts(std::optional<Domain> dom = std::nullopt) const override { return device_->getCurrentPowerInWatts(dom); }
+    void restoreDefaultLimits() override { actuator_->restoreDefaultFrequency(); }
+    std::string getDeviceTypeString() const override { return device_->getDeviceTypeString(); }
+    double getTriggerPowerInWatts() const override { return device_->getTriggerPowerInWatts(); }
+    void triggerPowerApiSample() override { device_->triggerPowerApiSample(); }
+    std::shared_ptr<Clock> getClock() const override { return device_->getClock(); }
+    EnergyCrossDomains getEnergySinceResetPerDomain() const override { return device_->getEnergySinceResetPerDomain(); }
+
+    /// Converts the value returned by a SearchAlgorithm run on this device into MHz.
+    static unsigned toFrequencyInMHz(unsigned long limitInMicroUnits);
+
+  private:
+    std::shared_ptr<Device> device_;
+    std::shared_ptr<FrequencyActuator> actuator_;
+};
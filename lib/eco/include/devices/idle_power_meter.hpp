@@ -0,0 +1,32 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include "devices/abstract_device.hpp"
+#include "data_structures/idle_power_cache.hpp"
+
+/*
+  measureIdlePower - average power of the idle device, the minimal power limit of the CPU devices
+
+  Caps below the idle power are not honored by RAPL or the SMU, so the search algorithms
+  start there. \p device is sampled every msPause for up to idleCheckTime (config.yaml);
+  the measurement ends early once the readings of the last 2 seconds are stable. The result
+  is cached in idlePowerCacheFile under \p cacheKey (see IdlePowerCache), an empty key
+  disables the cache. The DRAM domain is measured along with the main one when \p withDram.
+*/
+IdlePowerEntry measureIdlePower(Device& device, const std::string& cacheKey, bool withDram, const std::string& deviceLabel);
@@ -24,6 +24,9 @@
 #include <cpucounters.h>
 #include "power_interface/Rapl.hpp"
 #include "devices/abstract_device.hpp"
+#include "perf_counter_interfaces/perf_event_counters.hpp"
+#include <map>
+#include <chrono>
 
 struct RaplDirs
 {
@@ -47,14 +50,28 @@ struct RaplDefaults
     std::shared_ptr<SubdomainInfo> defaultConstrDRAM_;
 };
 
+/*
+  CpuPerfCounterBackend - source of the instructions retired returned by getPerfCounter
+
+  PERF_EVENT reads per CPU perf_event counter groups and falls back to PCM when they can
+  not be opened. PCM is programmed lazily, only when a PCM based metric (workload profiling,
+  fp_ops progress metric) is requested, and from then on provides the instructions count.
+*/
+enum class CpuPerfCounterBackend
+{
+    PERF_EVENT,
+    PCM
+};
+
 class IntelDevice : public Device
 {
 public:
-    IntelDevice();
+    explicit IntelDevice(CpuPerfCounterBackend backend = CpuPerfCounterBackend::PERF_EVENT);
     virtual ~IntelDevice() = default;
 
     double getPowerLimitInWatts() const override;
     void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW, Domain dom);
     std::string getName() const override;
     void reset() override;
     double getCurrentPowerInWatts(std::optional<Domain> = std::nullopt) const override;
@@ -71,10 +88,26 @@ public:
     std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override;
     std::string getDeviceTypeString() const override { return "cpu"; };
 
+    /*
+      DRAM co-optimization - RAPL DRAM domain can be limited independently from PKG
+
+      The DRAM limit range spans from the DRAM idle power (or MSR_DRAM_POWER_INFO minimum,
+      whichever is higher) to the DRAM max power reported by MSR_DRAM_POWER_INFO. While
+      a DRAM search session is active the generic single-cap API refers to the DRAM domain.
+    */
+    bool isCappableDomain(Domain dom) const override;
+    EnergyCrossDomains getEnergySinceResetPerDomain() const override;
+    void beginDomainSearchSession(Domain dom) override;
+    void endDomainSearchSession() override { searchedDomain_ = Domain::PKG; }
+    std::shared_ptr<FrequencyActuator> getFrequencyActuator(FrequencyDomain domain) override;
+    void beginWorkloadProfiling() override;
+    std::optional<WorkloadProfile> endWorkloadProfiling() override;
+    std::shared_ptr<ProgressMetric> makeDeviceProgressMetric(const std::string& name) override;
+
     void readAndStoreDefaultLimits();
     void restoreDefaultLimits() override;
     AvailableRaplPowerDomains getAvailablePowerDomains();
-    bool isDomainAvailable(Domain);
+    bool isDomainAvailable(Domain) const;
     double getNumInstructionsSinceReset() const;
     std::vector<int> getPkgToFirstCoreMap() const { return pkgToFirstCoreMap_; }
 
@@ -83,24 +116,40 @@ private:
     void detectPackages();
     void detectPowerCapsAvailability();
     void prepareRaplDirsFromAvailableDomains();
-    void initPerformanceCounters();
+    void initPerformanceCounters(CpuPerfCounterBackend backend);
+    void initPcm();
+    pcm::PCM* getPcm();
     std::string mapCpuFamilyName(int model) const;
     void setLongTimeWindow(int); // might be useless
+    void writeCapToFile(const std::string& fileName, int value); // journaled, see PowerCapJournal
     void initRaplObjectsForEachPKG();
     void checkIdlePowerConsumption();
+    std::string makeIdlePowerCacheKey() const;
+    void readDramPowerRange();
 
     int totalPackages_ {0};
     int totalCores_ {0};
     int model_ {-1};
-    pcm::PCM* pcm_;
+    pcm::PCM* pcm_ {nullptr};
+    std::unique_ptr<PerfEventCounters> perfEventCounters_;
+    double perfEventInstructionsAtReset_ {0.0};
+    double instructionsBeforePcmSwitch_ {0.0};
     AvailableRaplPowerDomains devicePowerProfile_;
     RaplDirs raplDirs_;
     RaplDefaults raplDefaultCaps_;
     double currentPowerLimitInWatts_;
+    double currentDramPowerLimitInWatts_ {0.0};
     double idlePowerConsumption_;
+    double idleDramPowerConsumption_ {0.0};
+    std::pair<double, double> dramMinMaxPowerInWatts_ {0.0, 0.0};
+    Domain searchedDomain_ {Domain::PKG};
+    std::map<FrequencyDomain, std::shared_ptr<FrequencyActuator>> frequencyActuators_;
     const std::string defaultLimitsFile_ {"./default_limits_dump.txt"};
+    const std::string journalDeviceName_ {"cpu"};
     std::vector<int> pkgToFirstCoreMap_;
     std::vector<Rapl> raplVec_;
     pcm::SystemCounterState sysBeforeState_;
     std::vector<pcm::CoreCounterState> beforeState_;
+    pcm::SystemCounterState workloadProfilingBeforeState_;
+    Clock::TimePoint workloadProfilingStart_;
 };
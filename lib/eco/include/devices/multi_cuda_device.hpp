@@ -52,13 +52,16 @@ class MultiCudaDevice : public Device
     double getCurrentPowerInWattsForSubdevice(size_t index) const override;
     double getPowerLimitInWattsForSubdevice(size_t index) const override;
     std::string getSubdeviceLabel(size_t index) const override { return std::string("gpu") + std::to_string(deviceIDs_.at(index)); }
+    /// "gpu_busy" - kernel busy time summed over the GPUs (see CudaDevice).
+    std::shared_ptr<ProgressMetric> makeDeviceProgressMetric(const std::string& name) override;
 
     /// Run stock single-GPU search on one GPU: \p baselineCaps holds fixed limits for all GPUs; only index \p focusIndex is swept.
-    void beginPerGpuSearchSession(size_t focusIndex, const std::vector<unsigned long>& baselineCapsMicroW);
-    void endPerGpuSearchSession();
+    void beginSubdeviceSearchSession(size_t focusIndex, const std::vector<unsigned long>& baselineCapsMicroW) override;
+    void endSubdeviceSearchSession() override;
 
   private:
     void applyPerGpuVectorMicroWatts_(const std::vector<unsigned long>& capsMicroW);
+    nvmlReturn_t setJournaledPowerLimit(int deviceID, unsigned long limitInMilliWatts); // see PowerCapJournal
     void initDeviceHandles();
     void validateHomogeneousModel() const;
 
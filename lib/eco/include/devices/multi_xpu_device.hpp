@@ -0,0 +1,87 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <optional>
+
+#include "devices/abstract_device.hpp"
+#include "devices/xpu_device.hpp"
+
+/*
+  MultiXPUDevice - several Level Zero cards of one node managed as a single device
+
+  Mirrors MultiCudaDevice: every card is a subdevice with its own card power domain
+  and cap, power and XVE instruction counts are summed over the cards. The tiles
+  (stacks) of every card keep their own energy counters (getCurrentPowerInWattsForTile).
+  With \p asyncIndependentPerCardCaps (DEPO --async) each card can use a different cap
+  and the search is run once per card.
+*/
+class MultiXPUDevice : public Device
+{
+  public:
+    explicit MultiXPUDevice(const std::vector<int>& deviceIds, bool asyncIndependentPerCardCaps = false,
+                            bool useAmperes = true);
+    ~MultiXPUDevice() override = default;
+
+    // Device interface
+    std::string getName() const override;
+    std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override;
+    double getPowerLimitInWatts() const override;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override;
+    void setPowerLimitsPerGpuMicroWatts(const std::vector<unsigned long>& microWattsPerSubdevice) override;
+    bool usesIndependentSubdevicePowerCaps() const override { return asyncIndependentPerCardCaps_; }
+    std::vector<unsigned long> getCurrentPerGpuCapsMicroWatts() const override { return currentCapsMicroW_; }
+    void reset() override;
+    double getCurrentPowerInWatts(std::optional<Domain> = std::nullopt) const override;
+    unsigned long long int getPerfCounter() const override;
+    double getTriggerPowerInWatts() const override { return getCurrentPowerInWattsForSubdevice(0); }
+    void triggerPowerApiSample() override;
+    /// Sum of the card energy counters; the timestamp advances by the largest card interval.
+    std::optional<EnergyCounterSample> getEnergyCounterSample() const override { return lastEnergySample_; }
+    void restoreDefaultLimits() override;
+    std::string getDeviceTypeString() const override { return "xpu"; }
+    size_t getNumSubdevices() const override { return cards_.size(); }
+    double getCurrentPowerInWattsForSubdevice(size_t index) const override;
+    double getPowerLimitInWattsForSubdevice(size_t index) const override;
+    std::string getSubdeviceLabel(size_t index) const override { return std::string("xpu") + std::to_string(deviceIDs_.at(index)); }
+
+    /// Run stock single-card search on one card: \p baselineCaps holds fixed limits for all cards; only index \p focusIndex is swept.
+    void beginSubdeviceSearchSession(size_t focusIndex, const std::vector<unsigned long>& baselineCapsMicroW) override;
+    void endSubdeviceSearchSession() override;
+
+    size_t getNumTiles(size_t card) const { return cards_.at(card)->getNumTilePowerDomains(); }
+    double getCurrentPowerInWattsForTile(size_t card, size_t tile) const { return cards_.at(card)->getCurrentPowerInWattsForTile(tile); }
+
+  private:
+    void applyPerCardVectorMicroWatts_(const std::vector<unsigned long>& capsMicroW);
+    void setCardPowerLimit_(size_t card, unsigned long limitInMicroW);
+
+    std::vector<int> deviceIDs_;
+    std::vector<std::unique_ptr<XPUDevice>> cards_;
+    bool asyncIndependentPerCardCaps_ {false};
+    std::vector<unsigned long> currentCapsMicroW_;
+    bool inPerCardSearchSession_ {false};
+    size_t searchFocusIndex_ {0};
+    std::vector<unsigned long> searchBaselineCapsMicroW_;
+    // the card counters have timestamps of their own, see triggerPowerApiSample
+    std::vector<std::optional<uint64_t>> lastCardTimestampsInMicroSeconds_;
+    uint64_t combinedTimestampInMicroSeconds_ {0};
+    std::optional<EnergyCounterSample> lastEnergySample_;
+};
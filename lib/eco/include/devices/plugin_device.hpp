@@ -0,0 +1,86 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "devices/abstract_device.hpp"
+#include "devices/eco_device_v1.h"
+
+/*
+  PluginDevice - Device implemented by a dlopened eco_device_v1 plugin
+
+  The plugins (libeco_device_<name>.so) are looked up in the colon separated directories
+  of ECO_PLUGIN_PATH, by default in the plugin directory of the build. A plugin which cannot
+  be loaded, e.g. because its vendor library is not installed on the node, is skipped.
+  Loaded plugins are never unloaded, their vendor libraries may keep threads running.
+  Failing cap or sample calls are reported on std::cerr, like in MultiCudaDevice.
+*/
+class PluginDevice : public Device
+{
+  public:
+    /// Loads the plugin library \p path and creates its device with \p options; throws std::runtime_error on failure.
+    explicit PluginDevice(const std::string& path, const std::string& options = "");
+    ~PluginDevice() override;
+    PluginDevice(const PluginDevice&) = delete;
+    PluginDevice& operator=(const PluginDevice&) = delete;
+
+    /// Plugin libraries found in the plugin directories, sorted by name.
+    static std::vector<std::string> discoverPlugins();
+    /*
+      make - device of the plugin named \p name (e.g. "cuda", "xpu", "intel")
+
+      For "auto" the first plugin whose hardware is present (probe()) is used, accelerators
+      before CPUs. Throws std::runtime_error when no such plugin can be loaded.
+    */
+    static std::shared_ptr<PluginDevice> make(const std::string& name, const std::string& options = "");
+    /// Loads the plugin named \p name without creating a device (e.g. for its PowerCapJournal restorers), false when it cannot be loaded.
+    static bool load(const std::string& name);
+
+    std::string getPluginName() const { return api_->name; }
+
+    // Device interface
+    std::string getName() const override;
+    std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override;
+    double getPowerLimitInWatts() const override;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override;
+    void reset() override;
+    unsigned long long int getPerfCounter() const override;
+    double getCurrentPowerInWatts(std::optional<Domain> dom = std::nullopt) const override;
+    void restoreDefaultLimits() override;
+    std::string getDeviceTypeString() const override { return api_->type; }
+    void triggerPowerApiSample() override;
+    std::optional<EnergyCounterSample> getEnergyCounterSample() const override;
+    size_t getNumSubdevices() const override;
+    double getCurrentPowerInWattsForSubdevice(size_t index) const override;
+    double getPowerLimitInWattsForSubdevice(size_t index) const override;
+    std::string getSubdeviceLabel(size_t index) const override;
+    bool usesIndependentSubdevicePowerCaps() const override;
+    void setPowerLimitsPerGpuMicroWatts(const std::vector<unsigned long>& microWattsPerSubdevice) override;
+    void beginSubdeviceSearchSession(size_t focusIndex, const std::vector<unsigned long>& baselineCapsMicroW) override;
+    void endSubdeviceSearchSession() override;
+
+  private:
+    PluginDevice(const eco_device_v1* api, const std::string& options);
+    void warnOnError(int result, const char* call) const;
+
+    const eco_device_v1* api_ {nullptr};
+    eco_device* device_ {nullptr};
+};
@@ -0,0 +1,89 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "devices/abstract_device.hpp"
+#include "power_interface/power_control_protocol.hpp"
+
+/*
+  PowerControlDevice - the CPU power device of the power control helper, for unprivileged processes
+
+  Connects to the helper (PowerControlServer) and maps its shared memory snapshot: energy,
+  power and limits are read from the mapping with no system call, power caps and the NMI
+  watchdog are set with batched requests over the socket. The helper restores the caps
+  when the connection is closed, also when this process is killed.
+
+  The instructions counter is the one of the helper device, published in the snapshot:
+  system-wide counting needs CAP_PERFMON or kernel.perf_event_paranoid <= 0, which an
+  unprivileged process does not have on a default node.
+*/
+class PowerControlDevice : public Device
+{
+public:
+    explicit PowerControlDevice(const std::string& socketPath = defaultSocketPath(), std::shared_ptr<Clock> clock = getRealClock());
+    ~PowerControlDevice() override;
+    PowerControlDevice(const PowerControlDevice&) = delete;
+    PowerControlDevice& operator=(const PowerControlDevice&) = delete;
+
+    /// ECO_POWER_CONTROL_SOCKET or powerControlDefaultSocketPath.
+    static std::string defaultSocketPath();
+    /// True when an unprivileged process should use the helper: not root and the helper socket exists.
+    static bool shouldUseHelper(const std::string& socketPath = defaultSocketPath());
+
+    std::string getName() const override;
+    std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override;
+    double getPowerLimitInWatts() const override;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override;
+    void reset() override;
+    unsigned long long int getPerfCounter() const override;
+    double getCurrentPowerInWatts(std::optional<Domain> dom = std::nullopt) const override;
+    void restoreDefaultLimits() override;
+    std::string getDeviceTypeString() const override;
+    void triggerPowerApiSample() override;
+    std::shared_ptr<Clock> getClock() const override { return clock_; }
+
+    bool isCappableDomain(Domain dom) const override;
+    EnergyCrossDomains getEnergySinceResetPerDomain() const override;
+    std::optional<EnergyCounterSample> getEnergyCounterSample() const override;
+    void beginDomainSearchSession(Domain dom) override { searchedDomain_ = dom; }
+    void endDomainSearchSession() override { searchedDomain_ = Domain::PKG; }
+
+    /// Sets the limits of several domains in one request, false when the helper refused any of them.
+    bool setPowerLimitsInMicroWatts(const std::vector<std::pair<Domain, unsigned long>>& limits);
+    /// The helper restores the original value with the power limits.
+    bool setNmiWatchdog(bool enabled);
+
+private:
+    std::vector<PowerControlResult> transact(const std::vector<PowerControlCommand>& commands, int* receivedFd = nullptr);
+    bool isMeasuredDomain(Domain dom) const;
+    uint64_t readPerfCounter() const;
+
+    std::shared_ptr<Clock> clock_;
+    int socketFd_ {-1};
+    const PowerControlSnapshot* snapshot_ {nullptr};
+    PowerControlReading lastReading_;
+    PowerControlReading readingAtReset_;
+    std::map<Domain, double> powerInWatts_;
+    Domain searchedDomain_ {Domain::PKG};
+    uint64_t perfCounterAtReset_ {0};
+};
@@ -0,0 +1,118 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include "devices/abstract_device.hpp"
+#include "perf_counter_interfaces/perf_event_counters.hpp"
+
+/*
+  PowercapZone - one zone of the Linux powercap framework, e.g. /sys/class/powercap/intel-rapl:0:1
+
+  The zone name gives the domain: package-<n> is PKG, core is PP0, uncore is PP1 and dram
+  is DRAM. energy_uj is kept open and read with pread; it wraps to 0 after
+  max_energy_range_uj. The constraint named long_term (constraint_0 when the names are
+  missing) is the one written by setPowerLimitInMicroWatts.
+*/
+struct PowercapZone
+{
+    std::string path;
+    std::string name;
+    Domain domain {Domain::PKG};
+    int energyFd {-1};
+    uint64_t maxEnergyRangeInMicroJoules {0};
+    uint64_t lastEnergyInMicroJoules {0};
+    double joules {0.0}; // accumulated since construction
+    std::string powerLimitFile; // empty when the zone can not be limited
+    long long defaultPowerLimitInMicroWatts {0};
+};
+
+/*
+  PowercapDevice - CPU (or SoC) power domains discovered in the powercap sysfs as a Device
+
+  Unlike IntelDevice nothing depends on the CPU model or on /dev/cpu/<n>/msr: the zones
+  and their constraints are walked under <rootDir>/sys/class/powercap, so the device works
+  with every powercap driver that names its zones as intel-rapl does (intel-rapl,
+  intel-rapl-mmio, the AMD RAPL driver) and, with rootDir, on a synthetic directory tree.
+  Zones of another control type duplicating a zone name (e.g. intel-rapl-mmio package-0)
+  and the psys zone, which overlaps the packages, are skipped.
+
+  The device power limit is split evenly between the zones of the domain; as for
+  IntelDevice the maximal limit is the sum of the default long term limits and the
+  minimal one the idle power of the domain measured in the constructor. Reading
+  energy_uj requires root on kernels with the PLATYPUS mitigation, writing limits always.
+*/
+class PowercapDevice : public Device
+{
+public:
+    explicit PowercapDevice(const std::string& rootDir = "", std::shared_ptr<Clock> clock = getRealClock());
+    ~PowercapDevice() override;
+    PowercapDevice(const PowercapDevice&) = delete;
+    PowercapDevice& operator=(const PowercapDevice&) = delete;
+
+    /// True when <rootDir>/sys/class/powercap has at least one package zone.
+    static bool isAvailable(const std::string& rootDir = "");
+
+    std::string getName() const override { return name_; }
+    std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override;
+    double getPowerLimitInWatts() const override;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW, Domain dom);
+    void reset() override;
+    unsigned long long int getPerfCounter() const override;
+    double getCurrentPowerInWatts(std::optional<Domain> dom = std::nullopt) const override;
+    void restoreDefaultLimits() override;
+    std::string getDeviceTypeString() const override { return "cpu"; }
+    void triggerPowerApiSample() override;
+    std::shared_ptr<Clock> getClock() const override { return clock_; }
+
+    bool isCappableDomain(Domain dom) const override;
+    EnergyCrossDomains getEnergySinceResetPerDomain() const override;
+    std::optional<EnergyCounterSample> getEnergyCounterSample() const override;
+    void beginDomainSearchSession(Domain dom) override;
+    void endDomainSearchSession() override { searchedDomain_ = Domain::PKG; }
+
+    const std::vector<PowercapZone>& getZones() const { return zones_; }
+
+private:
+    void discoverZones();
+    bool openZone(PowercapZone& zone) const;
+    bool readEnergy(const PowercapZone& zone, uint64_t& energyInMicroJoules) const;
+    void writeLimit(const std::string& fileName, long long value);
+    double sumJoules(Domain dom) const;
+    std::string makeIdlePowerCacheKey() const;
+
+    const std::string rootDir_;
+    std::shared_ptr<Clock> clock_;
+    std::string name_ {"powercap"};
+    std::vector<PowercapZone> zones_;
+    std::map<Domain, double> currentLimitInWatts_;
+    std::map<Domain, double> idlePowerInWatts_; // PKG and DRAM, the min limits
+    std::map<Domain, double> powerInWatts_;
+    std::map<Domain, double> lastJoules_;
+    std::map<Domain, double> joulesAtReset_;
+    std::optional<Clock::TimePoint> lastSampleTime_;
+    Domain searchedDomain_ {Domain::PKG};
+
+    std::unique_ptr<PerfEventCounters> perfEventCounters_;
+    double perfEventInstructionsAtReset_ {0.0};
+    const std::string journalDeviceName_ {"powercap"};
+};
@@ -0,0 +1,67 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <optional>
+#include "devices/abstract_device.hpp"
+
+#include <rocm_smi/rocm_smi.h>
+
+/*
+  RocmDevice - AMD Instinct (and Radeon) GPU pointed by devID, managed with ROCm SMI
+
+  Power and the power cap are read and written with rsmi_dev_power_ave_get and
+  rsmi_dev_power_cap_get/set (sensor 0), the limits range comes from
+  rsmi_dev_power_cap_range_get. Energy is taken from the accumulated energy counter
+  (rsmi_dev_energy_count_get) read by triggerPowerApiSample().
+
+  There is no kernel counting injection library for HIP, so getPerfCounter() returns the
+  accumulated coarse grain GFX activity (rsmi_utilization_count_get) since reset(): the
+  GPU busy time in the units of the driver, which grows with the work done at a fixed
+  clock like the kernels count of CudaDevice.
+
+  Built only with -DWITH_ROCM=ON.
+*/
+class RocmDevice : public Device
+{
+  public:
+    explicit RocmDevice(int devID = 0);
+    ~RocmDevice() override = default;
+
+    double getPowerLimitInWatts() const override;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override;
+    std::string getName() const override;
+    std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override;
+    void reset() override;
+    double getCurrentPowerInWatts(std::optional<Domain> = std::nullopt) const override;
+    unsigned long long int getPerfCounter() const override;
+    void triggerPowerApiSample() override;
+    void restoreDefaultLimits() override;
+    std::string getDeviceTypeString() const override { return "gpu"; }
+    std::optional<EnergyCounterSample> getEnergyCounterSample() const override { return lastEnergySample_; }
+
+  private:
+    std::string getJournalDeviceName() const { return "rocm" + std::to_string(deviceID_); }
+    std::optional<uint64_t> readGfxActivity() const;
+    void printError(const char* what, rsmi_status_t status) const;
+
+    uint32_t deviceID_;
+    uint64_t defaultPowerCapInMicroWatts_ {0};
+    uint64_t gfxActivityAtReset_ {0};
+    std::optional<EnergyCounterSample> lastEnergySample_;
+};
@@ -0,0 +1,126 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "devices/abstract_device.hpp"
+#include "clock.hpp"
+
+/*
+  SimulatedPhase - one phase of a synthetic workload
+
+  When uncapped the phase draws uncappedPowerInWatts and reaches maxThroughput (work units
+  per second). Under a cap below its demand the throughput follows
+      maxThroughput * ((cap - idle) / (uncappedPower - idle)) ^ capSensitivity
+  capSensitivity 0 models a memory-bound phase (cap costs nothing), 1 a phase whose work
+  scales linearly with dynamic power.
+*/
+struct SimulatedPhase
+{
+    double durationInSeconds {10.0};
+    double uncappedPowerInWatts {200.0};
+    double maxThroughput {1e6};
+    double capSensitivity {0.5};
+};
+
+struct SimulatedDeviceModel
+{
+    unsigned minLimitInWatts {50};
+    unsigned maxLimitInWatts {250};
+    double defaultLimitInWatts {250.0};
+    double idlePowerInWatts {20.0};
+    std::vector<SimulatedPhase> phases {SimulatedPhase()};
+    bool repeatPhases {true};              // after the last phase start again, otherwise stay idle
+    double powerNoiseStdDevInWatts {0.0};  // gaussian noise of power readings
+    double throughputRelativeNoise {0.0};  // relative gaussian noise of the work done per step
+    double actuationLagInSeconds {0.0};    // time constant of the first order response to a new cap
+    double integrationStepInSeconds {0.01};
+    unsigned seed {0};
+
+    /*
+      fromPowerLog - replays a power_log.csv recorded by StEP/DEPO
+
+      Each row becomes a phase lasting until the next row, with the recorded average power
+      as the uncapped power and the recorded perf counter delta per second as the max
+      throughput. The trace should be recorded with the default limit, e.g. with DEPO in
+      sampling only mode. Limits, noise and lag are taken from \p base. Returns a model with
+      no phases when the file can not be parsed.
+    */
+    static SimulatedDeviceModel fromPowerLog(const std::string& powerLogPath, SimulatedDeviceModel base);
+    static SimulatedDeviceModel fromPowerLog(const std::string& powerLogPath);
+};
+
+/*
+  SimulatedDevice - hardware-free Device driven by SimulatedDeviceModel
+
+  The model state is integrated lazily up to clock->now() whenever the device is queried, so
+  with a SimulatedClock the whole control loop runs in virtual time.
+*/
+class SimulatedDevice : public Device
+{
+  public:
+    SimulatedDevice(SimulatedDeviceModel model, std::shared_ptr<Clock> clock);
+    ~SimulatedDevice() override = default;
+
+    std::string getName() const override { return "Simulated device"; }
+    std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override;
+    double getPowerLimitInWatts() const override;
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override;
+    void reset() override;
+    unsigned long long int getPerfCounter() const override;
+    double getCurrentPowerInWatts(std::optional<Domain> = std::nullopt) const override;
+    void restoreDefaultLimits() override;
+    std::string getDeviceTypeString() const override { return "sim"; }
+    void triggerPowerApiSample() override;
+    EnergyCrossDomains getEnergySinceResetPerDomain() const override;
+
+    std::shared_ptr<Clock> getClock() const override { return clock_; }
+    /// Total work and energy since construction, independent of reset().
+    double getTotalWork() const;
+    double getTotalEnergyInJoules() const;
+    /// Index of the phase active at the current time, -1 when the workload finished.
+    int getCurrentPhaseIndex() const;
+
+  private:
+    void advanceTo(Clock::TimePoint t) const;
+    int phaseIndexAt(double timeInSeconds) const;
+
+    SimulatedDeviceModel model_;
+    std::vector<double> phaseEndsInSeconds_; // cumulative phase durations
+    std::shared_ptr<Clock> clock_;
+    double capInWatts_;
+    Clock::TimePoint startTime_;
+
+    // integrated model state, updated lazily from const getters
+    mutable std::recursive_mutex mutex_;
+    mutable std::mt19937 rng_;
+    mutable Clock::TimePoint lastUpdate_;
+    mutable double effectiveCapInWatts_;
+    mutable double instantPowerInWatts_ {0.0};
+    mutable double totalEnergy_ {0.0};
+    mutable double totalWork_ {0.0};
+    double energyAtReset_ {0.0};
+    double workAtReset_ {0.0};
+    double energyAtLastSample_ {0.0};
+    Clock::TimePoint lastSampleTime_;
+    double lastSampledPowerInWatts_ {-1.0};
+};
@@ -26,6 +26,7 @@
 #include <fstream>
 #include <iomanip>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <chrono>
 #include <sys/stat.h>
@@ -49,10 +50,7 @@
  * in the system XPU device.
  * By design at the moment the get/set power methods use only deviceID_
  * which is a member of the object.
- *
- * FUTURE WORK:
- * In the future this may change when, e.g., DEPO or StEP would consider
- * multi-gpu support.
+ * Several cards are managed together by MultiXPUDevice.
  */
 class XPUDevice : public Device
 {
@@ -77,7 +75,14 @@ public:
     void                          reset() override;
     double                        getCurrentPowerInWatts(std::optional<Domain> = std::nullopt) const override;
     unsigned long long int        getPerfCounter() const;
+    /// XVE instructions executed by tile \p tile since reset(), the tiles sum up to getPerfCounter().
+    unsigned long long int        getPerfCounterForTile(size_t tile) const;
+    size_t                        getNumTiles() const;
+    /// Power of tile \p tile from its ZES_POWER_DOMAIN_STACK energy counter, 0 when the card has no such domain.
+    double                        getCurrentPowerInWattsForTile(size_t tile) const;
+    size_t                        getNumTilePowerDomains() const;
     void                          triggerPowerApiSample() override;
+    std::optional<EnergyCounterSample> getEnergyCounterSample() const override { return last_energy_sample_; }
     void                          restoreDefaultLimits() override;
     std::string                   getDeviceTypeString() const override;
 
@@ -88,14 +93,20 @@ private:
     zes_device_properties_t                 getDeviceProperties(zes_device_handle_t& device);
     zes_power_domain_t                      getPowerDomainProperties(zes_pwr_handle_t& domain);
     void                                    getPowerDomain(zes_device_handle_t& device);
-    std::vector<zes_power_limit_ext_desc_t> getLimits() const;
+    const std::vector<zes_power_limit_ext_desc_t>& getLimits() const;
     zes_power_energy_counter_t              sampleEnergyCounter();
+    zes_power_energy_counter_t              sampleEnergyCounter(zes_pwr_handle_t domain);
     std::tuple<unsigned, unsigned>          calculateMinMaxLimitsinWatts();
     double                                  getInnerPowerLimit(bool useAmperes) const;
+    std::string                             getJournalDeviceName() const;
+    std::string                             getJournalTarget(const zes_power_limit_ext_desc_t& limit) const; // see PowerCapJournal
+    ZeMetricCollector*                      getMetricCollector() const;
 
+    zes_driver_handle_t     driver_ {nullptr};
     zes_device_handle_t     device;
     zes_device_properties_t device_properties;
     zes_pwr_handle_t        power_handle;
+    size_t                  power_domain_index_ {0}; // of power_handle among the power domains of the device
 
     ze_result_t                      zeResult_;
     unsigned int                     deviceCount_ {0};
@@ -106,11 +117,16 @@ private:
     bool                             useAmperes_;        // If true, the power limit is in Amperes, otherwise in Watts
     unsigned                         minLimitValue = 0;  // Minimal value possible to set as a limit[uWatts]
     unsigned                         maxLimitValue = 0;  // Maximal value possible to set as a limit[uWatts]
-    // We will store two energy samples just to compute current power usage
-    // Energy is in microJoules
-    // timestamp is in microseconds
-    // energy_samples[1] -- newer sample
-    // energy_sample[0] -- older sample
-    zes_power_energy_counter_t energy_samples[2];
-    ZeMetricCollector*         metric_collector_ = nullptr;
+    // Current power is the energy counter difference of the last two samples
+    // divided by the difference of their (hardware) timestamps
+    EnergyIntegrator                   energy_;
+    std::optional<EnergyCounterSample> last_energy_sample_;
+    // the same for every tile (stack) power domain of the card
+    std::vector<zes_pwr_handle_t> tile_power_handles_;
+    std::vector<EnergyIntegrator> tile_energy_;
+    // limits are read once per setPowerLimitInMicroWatts, not on every getPowerLimitInWatts
+    mutable std::optional<std::vector<zes_power_limit_ext_desc_t>> limits_cache_;
+    // metrics streaming is started on first use (reset/getPerfCounter), not at construction
+    mutable std::once_flag     metric_collector_init_;
+    mutable ZeMetricCollector* metric_collector_ = nullptr;
 };
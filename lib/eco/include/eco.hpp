@@ -29,6 +29,8 @@
 //----------------------------------------------------------------------------------
 #include "algorithms/linear_search.hpp"
 #include "algorithms/golden_section_search.hpp"
+#include "algorithms/workload_classifier.hpp"
+#include "power_interface/frequency_actuator.hpp"
 #include "data_structures/power_and_perf_result.hpp"
 #include "eco_constants.hpp"
 #include "data_structures/final_power_and_perf_result.hpp"
@@ -37,14 +39,15 @@
 #include "logging/both_stream.hpp"
 #include "logging/log.hpp"
 #include "trigger.hpp"
+#include "clock.hpp"
 
 
 template <class F>
-inline auto measureDuration(F&& fun)
+inline auto measureDuration(const Clock& clock, F&& fun)
 {
-    const auto start = std::chrono::high_resolution_clock::now();
+    const auto start = clock.now();
     fun();
-    return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    return std::chrono::duration<double>(clock.now() - start).count();
 }
 
 static inline
@@ -59,7 +62,7 @@ using Algorithm = std::function<unsigned(
   std::shared_ptr<Device>,
   DeviceStateAccumulator&,
   Trigger&,
-  TargetMetric,
+  const MetricExpression&,
   const PowAndPerfResult&,
   int&,
   int,
@@ -71,11 +74,17 @@ class Eco
 {
   public:
     FinalPowerAndPerfResult runAppWithSampling(char* const*, int = 1);
+    /// Metric given by --en/--edp/--eds, replaced by customMetric from config.yaml when it is set.
     FinalPowerAndPerfResult runAppWithSearch(
       char* const*,
       TargetMetric,
       SearchType,
       int = 1);
+    FinalPowerAndPerfResult runAppWithSearch(
+      char* const*,
+      const MetricExpression&,
+      SearchType,
+      int = 1);
     void plotPowerLog(std::optional<FinalPowerAndPerfResult>, std::string = "", bool=false);
     std::string getDeviceName() const { return device_->getName(); }
 
@@ -96,6 +105,8 @@ class Eco
     ParamsConfig cfg_; // stores defaults values of params or reads it from config.yaml
     Trigger trigger_;
     std::shared_ptr<Device> device_;
+    std::shared_ptr<Clock> clock_; // device clock, simulated for SimulatedDevice
+    std::shared_ptr<FrequencyActuator> frequencyActuator_; // set only when frequencySearch is on and supported
     CrossDomainQuantity idleAvPow_;
 
     DeviceStateAccumulator devStateGlobal_;
@@ -112,8 +123,15 @@ class Eco
     void reportResult(double = 0.0, double = 0.0);
     void waitForTuningTrigger(int&, int);
     void execPhase(int, int&, int, PowAndPerfResult&,
-        const std::optional<std::vector<unsigned long>>& perGpuCapsMicroW = std::nullopt);
+        const std::optional<std::vector<unsigned long>>& perGpuCapsMicroW = std::nullopt,
+        const std::optional<unsigned long>& dramCapMicroW = std::nullopt,
+        const std::optional<unsigned>& frequencyLimitInMHz = std::nullopt);
+    bool isDramCapSearchOn() const;
+    void restoreDefaults();
+    std::optional<std::pair<unsigned, unsigned>> classifyWorkload();
+    FinalPowerAndPerfResult makeFinalResult(double, TimeResult, double) const;
     int mainAppProcess(char* const*, int&);
+    pid_t forkAppProcess(char* const*, int&);
     int& adjustHighPowLimit(PowAndPerfResult, int&);
 
 };
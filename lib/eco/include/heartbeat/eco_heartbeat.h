@@ -0,0 +1,105 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+/*
+  eco_heartbeat.h - header-only application heartbeat API (C and C++)
+
+  An application calls eco_heartbeat(units) whenever it completes a piece of useful work
+  (e.g. one solver iteration). The units are added to a counter in the shared memory
+  object named by the ECO_HEARTBEAT_SHM environment variable, which DEPO/StEP create and
+  export to the profiled application when progressMetric is "heartbeat". Without the
+  variable the calls are no-ops, so instrumented applications run unchanged elsewhere.
+
+  Requires POSIX shared memory: compile strict C (-std=c99) with -D_DEFAULT_SOURCE and
+  link with -lrt on older glibc.
+*/
+
+#ifndef ECO_HEARTBEAT_H
+#define ECO_HEARTBEAT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define ECO_HEARTBEAT_SHM_ENV "ECO_HEARTBEAT_SHM"
+#define ECO_HEARTBEAT_MAGIC 0x45434F48u /* "ECOH" */
+#define ECO_HEARTBEAT_VERSION 1u
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct eco_heartbeat_shm
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t units; /* sum of units reported with eco_heartbeat() */
+    uint64_t beats; /* number of eco_heartbeat() calls */
+};
+
+/* Maps the shared counter on first use. Returns NULL when heartbeats are not consumed. */
+static inline struct eco_heartbeat_shm* eco_heartbeat_region(void)
+{
+    static struct eco_heartbeat_shm* region = NULL;
+    static int initialized = 0;
+    if (__atomic_load_n(&initialized, __ATOMIC_ACQUIRE))
+    {
+        return __atomic_load_n(&region, __ATOMIC_RELAXED);
+    }
+    struct eco_heartbeat_shm* mapped = NULL;
+    const char* name = getenv(ECO_HEARTBEAT_SHM_ENV);
+    if (name != NULL && name[0] != '\0')
+    {
+        int fd = shm_open(name, O_RDWR, 0);
+        if (fd >= 0)
+        {
+            void* addr = mmap(NULL, sizeof(struct eco_heartbeat_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (addr != MAP_FAILED)
+            {
+                mapped = (struct eco_heartbeat_shm*)addr;
+                if (mapped->magic != ECO_HEARTBEAT_MAGIC || mapped->version != ECO_HEARTBEAT_VERSION)
+                {
+                    munmap(addr, sizeof(struct eco_heartbeat_shm));
+                    mapped = NULL;
+                }
+            }
+        }
+    }
+    /* concurrent first calls may map the object twice, both mappings are valid */
+    __atomic_store_n(&region, mapped, __ATOMIC_RELAXED);
+    __atomic_store_n(&initialized, 1, __ATOMIC_RELEASE);
+    return mapped;
+}
+
+/* Reports \p units of completed work. Lock-free, safe to call from any thread. */
+static inline void eco_heartbeat(uint64_t units)
+{
+    struct eco_heartbeat_shm* region = eco_heartbeat_region();
+    if (region != NULL)
+    {
+        __atomic_fetch_add(&region->units, units, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&region->beats, 1, __ATOMIC_RELAXED);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ECO_HEARTBEAT_H */
@@ -0,0 +1,66 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../../../src/logging.hpp"
+
+/*
+  StartupTimer - wall time breakdown of a device initialization
+
+  measure() may be called from several threads when independent probes run concurrently.
+  report() prints the breakdown at debug level (e.g. SPDLOG_LEVEL=debug).
+*/
+class StartupTimer
+{
+  public:
+    explicit StartupTimer(std::string owner) :
+      owner_(std::move(owner)), start_(std::chrono::steady_clock::now()) {}
+
+    template <class F>
+    void measure(const std::string& step, F&& f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+        std::lock_guard<std::mutex> lock(mutex_);
+        steps_.emplace_back(step, duration.count());
+    }
+
+    void report() const
+    {
+        LOAD_ENV_LEVELS()
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [step, durationInMs] : steps_)
+        {
+            LOG_DEBUG("{} startup: {} {:.1f} ms", owner_, step, durationInMs);
+        }
+        const std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - start_;
+        LOG_DEBUG("{} startup: total {:.1f} ms", owner_, total.count());
+    }
+
+  private:
+    std::string owner_;
+    std::chrono::steady_clock::time_point start_;
+    mutable std::mutex mutex_;
+    std::vector<std::pair<std::string, double>> steps_;
+};
@@ -21,6 +21,7 @@
 class ParamsConfig {
 public:
     ParamsConfig();
+    explicit ParamsConfig(bool printExplained);
     const std::string configFileName_ {"params.conf"};
 	int msPause_ {5}; // sampling time
     int percentStep_ {5};
@@ -29,6 +30,7 @@ public:
     int perfDropStopCondition_ {100};
     int powerSampleOn_ {1};
     int targetMetric_ {0}; // 0 - Energy by default, 1 - EDP, 2 - EDS
+    std::string customMetric_ {""}; // see MetricExpression, empty - metric selected with --en/--edp/--eds
     int msTestPhasePeriod_ {1000};
     int usTestPhasePeriod_ {msTestPhasePeriod_ * 1000};
     int reducedPowerCapRange_ {0};
@@ -38,6 +40,14 @@ public:
     int repeatTuningPeriodInSec_ {10}; // seconds
     double k_ {1.0};
     bool doWaitPhase_ {true};
+    int dramCapSearch_ {0}; // 0 - PKG cap only, 1 - PKG x DRAM caps (Intel CPU with RAPL DRAM domain)
+    std::string progressMetric_ {"device"}; // see makeProgressMetric
+    int frequencySearch_ {0}; // 0 - off, 1 - core (CPU cores / GPU graphics clock), 2 - uncore (Intel CPU)
+    int workloadClassifier_ {0}; // 0 - full limits range searched, 1 - range narrowed by the workload class
+    int frequencySearchOnly_ {0}; // 0 - frequency tuned after power cap, 1 - power cap left at default
+    std::string idlePowerCacheFile_ {"./idle_power_cache.yaml"};
+    int idlePowerCacheExpiry_ {86400}; // seconds, 0 - idle power measured on every start
+    std::string powerCapJournalDir_ {"/run/eco_power_caps"}; // see PowerCapJournal, empty - journal disabled
     void printConfigExplained();
 private:
     void loadConfig();
@@ -0,0 +1,50 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "perf_counter_interfaces/progress_metric.hpp"
+#include "heartbeat/eco_heartbeat.h"
+
+/*
+  HeartbeatMetric - application heartbeats (see heartbeat/eco_heartbeat.h) as progress metric
+
+  Creates the shared memory counter and exports its name in ECO_HEARTBEAT_SHM, so that the
+  application started afterwards (fork + execv inherit the environment) reports into it.
+  Heartbeat units per second become the throughput optimized by the search algorithms.
+*/
+class HeartbeatMetric : public ProgressMetric
+{
+public:
+    HeartbeatMetric();
+    ~HeartbeatMetric() override;
+    HeartbeatMetric(const HeartbeatMetric&) = delete;
+    HeartbeatMetric& operator=(const HeartbeatMetric&) = delete;
+
+    std::string getName() const override { return "heartbeat"; }
+    void reset() override;
+    unsigned long long getCountSinceReset() override;
+    bool isAvailable() const { return region_ != nullptr; }
+
+private:
+    unsigned long long readUnits() const;
+
+    std::string shmName_;
+    eco_heartbeat_shm* region_ {nullptr};
+    unsigned long long baseline_ {0};
+};
@@ -0,0 +1,48 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cpucounters.h>
+
+#include "perf_counter_interfaces/progress_metric.hpp"
+
+/*
+  PcmFpOpsMetric - floating point operations retired on all cores of Intel CPUs
+
+  Reprograms PCM core counters with FP_ARITH_INST_RETIRED (Skylake and newer) split by
+  vector width and weights each width by its number of double precision lanes. Single
+  precision and FMA are therefore counted as double precision operations - the metric is
+  meant to compare work done across power caps, not to report exact FLOPs. Fixed counters
+  (instructions retired, cycles) keep working after reprogramming.
+*/
+class PcmFpOpsMetric : public ProgressMetric
+{
+public:
+    explicit PcmFpOpsMetric(pcm::PCM* pcm);
+    std::string getName() const override { return "fp_ops"; }
+    void reset() override;
+    unsigned long long getCountSinceReset() override;
+    bool isProgrammed() const { return programmed_; }
+
+private:
+    pcm::SystemCounterState readState() const;
+
+    pcm::PCM* pcm_;
+    pcm::SystemCounterState before_;
+    bool programmed_ {false};
+};
@@ -0,0 +1,59 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+
+/*
+  PerfEventCounters - instructions and cycles retired on all CPUs via perf_event_open
+
+  One counter group (instructions as the leader, cycles as a member) is opened per online
+  CPU with PERF_FORMAT_GROUP, so a sample is a single read() per CPU instead of the full
+  core, socket and uncore snapshot taken by PCM getAllCounterStates. Counts are scaled by
+  time enabled/running when the kernel multiplexes the PMU.
+
+  The counters are not read with rdpmc: user space rdpmc returns the counter of the CPU the
+  reading thread runs on, so reading CPU-wide groups of all CPUs would require migrating the
+  sampling thread to every CPU, which costs more than a read() per group.
+
+  Opening CPU-wide events requires CAP_PERFMON or kernel.perf_event_paranoid <= 0; isOpen()
+  returns false otherwise.
+*/
+class PerfEventCounters
+{
+public:
+    struct Values
+    {
+        double instructions {0.0};
+        double cycles {0.0};
+    };
+
+    PerfEventCounters();
+    ~PerfEventCounters();
+    PerfEventCounters(const PerfEventCounters&) = delete;
+    PerfEventCounters& operator=(const PerfEventCounters&) = delete;
+
+    bool isOpen() const { return !groupLeaderFds_.empty(); }
+    /// Totals summed over all CPUs since the counters were opened.
+    Values read() const;
+
+private:
+    void close();
+
+    std::vector<int> groupLeaderFds_;
+    std::vector<int> memberFds_;
+};
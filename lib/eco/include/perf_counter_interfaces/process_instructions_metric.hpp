@@ -0,0 +1,50 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "perf_counter_interfaces/progress_metric.hpp"
+
+/*
+  ProcessInstructionsMetric - instructions retired by the tuned application only
+
+  A perf_event counter opened on the application PID with inherit set follows all its
+  threads and child processes on any CPU, so work of other tenants of a shared node and
+  of the sampling thread itself does not pollute the performance signal. The counter is
+  opened disabled with enable_on_exec, between fork and exec of the application (see
+  attachToProcess), so only the application itself is counted. Counts 0 until attached.
+*/
+class ProcessInstructionsMetric : public ProgressMetric
+{
+public:
+    ProcessInstructionsMetric() = default;
+    ~ProcessInstructionsMetric() override;
+    ProcessInstructionsMetric(const ProcessInstructionsMetric&) = delete;
+    ProcessInstructionsMetric& operator=(const ProcessInstructionsMetric&) = delete;
+
+    std::string getName() const override { return "process_instructions"; }
+    void reset() override;
+    unsigned long long getCountSinceReset() override;
+    void attachToProcess(pid_t pid) override;
+
+private:
+    unsigned long long readInstructions() const;
+
+    int fd_ {-1};
+    unsigned long long baseline_ {0};
+};
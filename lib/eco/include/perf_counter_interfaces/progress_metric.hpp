@@ -0,0 +1,96 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+#include "devices/abstract_device.hpp"
+
+/*
+  ProgressMetric - source of the "useful work done" counter used by DeviceStateAccumulator
+
+  The counter delta between two samples is stored in PowAndPerfResult::instructionsCount_,
+  so MetricExpression/checkPlusMetric and the search algorithms optimize energy per unit of
+  the selected metric. The default (DevicePerfCounterMetric) keeps the device specific
+  counter: kernel launches on GPUs, retired instructions on CPUs.
+*/
+class ProgressMetric
+{
+public:
+    virtual ~ProgressMetric() = default;
+    virtual std::string getName() const = 0;
+    /// Called on DeviceStateAccumulator::resetState(), after Device::reset().
+    virtual void reset() = 0;
+    virtual unsigned long long getCountSinceReset() = 0;
+    /// Called with the PID of the tuned application after fork, before it calls exec.
+    virtual void attachToProcess(pid_t /*pid*/) {}
+};
+
+class DevicePerfCounterMetric : public ProgressMetric
+{
+public:
+    explicit DevicePerfCounterMetric(std::shared_ptr<Device> device) : device_(device) {}
+    std::string getName() const override { return "device"; }
+    void reset() override {}
+    unsigned long long getCountSinceReset() override { return device_->getPerfCounter(); }
+private:
+    std::shared_ptr<Device> device_;
+};
+
+/*
+  FileCounterMetric - monotonic counter written to a file by the application or a tool
+
+  E.g. a CUPTI injection library dumping FLOPs or SM active cycles. The value read at
+  reset() is used as the baseline.
+*/
+class FileCounterMetric : public ProgressMetric
+{
+public:
+    explicit FileCounterMetric(const std::string& path) : path_(path) {}
+    std::string getName() const override { return "file:" + path_; }
+    void reset() override;
+    unsigned long long getCountSinceReset() override;
+private:
+    long long readCounter() const;
+    std::string path_;
+    unsigned long long baseline_ {0};
+    unsigned long long lastValue_ {0};
+};
+
+/*
+  makeInjectionBusyTimeMetric - kernel busy time of the GPUs in nanoseconds
+
+  Published to ./gpu_busy_ns by the CUPTI injection library from activity records,
+  which is switched to that mode (INJECTION_MODE=activity) for the tuned application.
+  Used by the CUDA devices for the "gpu_busy" progress metric.
+*/
+std::shared_ptr<ProgressMetric> makeInjectionBusyTimeMetric();
+
+/*
+  makeProgressMetric - creates the metric described by \p spec
+
+  "device" (default) - Device::getPerfCounter,
+  "file:<path>"      - FileCounterMetric,
+  "heartbeat"        - HeartbeatMetric (application instrumented with heartbeat/eco_heartbeat.h),
+  "process_instructions" - ProcessInstructionsMetric (instructions of the tuned application only),
+  other names are resolved by Device::makeDeviceProgressMetric (e.g. "fp_ops" on Intel,
+  "gpu_busy" on NVIDIA GPUs).
+  Falls back to "device" with a warning when \p spec is not supported.
+*/
+std::shared_ptr<ProgressMetric> makeProgressMetric(const std::string& spec, std::shared_ptr<Device> device);
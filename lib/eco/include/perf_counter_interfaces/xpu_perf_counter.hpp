@@ -22,6 +22,7 @@
 #include <atomic>
 #include <cstdlib>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -96,6 +97,16 @@ inline const std::map<ze_result_t, std::string> errorMap = []
     return map;
 }();
 
+enum MetricType
+{
+    METRIC_INST_ALU0  = 0,
+    METRIC_INST_ALU1  = 1,
+    METRIC_INST_XMX   = 2,
+    METRIC_INST_SEND  = 3,
+    METRIC_INST_CTRL  = 4,
+    METRIC_TYPE_COUNT = 5
+};
+
 struct MetricResult
 {
     uint64_t inst_alu0 = 0;
@@ -103,6 +114,8 @@ struct MetricResult
     uint64_t inst_xmx  = 0;
     uint64_t inst_send = 0;
     uint64_t inst_ctrl = 0;
+
+    uint64_t total() const { return inst_alu0 + inst_alu1 + inst_xmx + inst_send + inst_ctrl; }
 };
 
 enum CollectorState
@@ -112,6 +125,14 @@ enum CollectorState
     COLLECTOR_STATE_DISABLED = 2
 };
 
+/*
+  ZeMetricCollector - XVE instructions executed on an XPU, per tile (subdevice)
+
+  Every tile (or the root device when it has no subdevices) has its own metric streamer and
+  collector thread, which adds the instructions of every read to atomic per-type counters.
+  The counters are only ever written by that thread, so they are read without a lock and
+  reset() just takes a baseline. Counts are raw instructions, no precision is dropped.
+*/
 class ZeMetricCollector
 {
 public:
@@ -128,44 +149,32 @@ public:
         // TODO: put somewhere information that metrics discovery library should
         // be available in LD_LIBRARY_PATH
 
-        // create metric group
-        zet_metric_group_handle_t group       = nullptr;
-        ze_result_t               status      = ZE_RESULT_SUCCESS;
-        uint32_t                  group_count = 0;
-        status                                = zetMetricGroupGet(device, &group_count, nullptr);
-        if (status == ZE_RESULT_SUCCESS && group_count != 0)
+        // tiles of multi-stack devices (e.g. Ponte Vecchio) are streamed separately
+        ze_result_t                     status          = ZE_RESULT_SUCCESS;
+        uint32_t                        subdevice_count = 0;
+        std::vector<ze_device_handle_t> tile_devices;
+        status = zeDeviceGetSubDevices(device, &subdevice_count, nullptr);
+        if (status == ZE_RESULT_SUCCESS && subdevice_count > 0)
         {
-            std::vector<zet_metric_group_handle_t> group_list(group_count, nullptr);
-            status = zetMetricGroupGet(device, &group_count, group_list.data());
+            tile_devices.resize(subdevice_count, nullptr);
+            status = zeDeviceGetSubDevices(device, &subdevice_count, tile_devices.data());
             if (status != ZE_RESULT_SUCCESS)
             {
                 throw std::runtime_error(errorMap.at(status));
             }
-            zet_metric_group_handle_t target = nullptr;
-            for (uint32_t i = 0; i < group_count; ++i)
-            {
-                zet_metric_group_properties_t group_props {};
-                group_props.stype = ZET_STRUCTURE_TYPE_METRIC_GROUP_PROPERTIES;
-                status            = zetMetricGroupGetProperties(group_list[i], &group_props);
-                if (status != ZE_RESULT_SUCCESS)
-                {
-                    throw std::runtime_error(errorMap.at(status));
-                }
-
-                if (group_name == group_props.name &&
-                    (group_props.samplingType & ZET_METRIC_GROUP_SAMPLING_TYPE_FLAG_TIME_BASED))
-                {
-                    target = group_list[i];
-                    break;
-                }
-            }
-            group = target;
-            LOG_DEBUG("Level Zero Metric Group created");
         }
         else
         {
-            throw std::runtime_error("Unable to find any metric groups");
+            tile_devices.push_back(device);
+        }
+
+        // create metric groups
+        std::vector<zet_metric_group_handle_t> groups;
+        for (auto tile_device : tile_devices)
+        {
+            groups.push_back(FindMetricGroup(tile_device, group_name));
         }
+        LOG_DEBUG("Level Zero Metric Groups created for {} tile(s)", tile_devices.size());
 
         // create context
         status                           = ZE_RESULT_SUCCESS;
@@ -178,7 +187,7 @@ public:
         }
         LOG_DEBUG("Level Zero Context created");
 
-        return new ZeMetricCollector(device, context, group);
+        return new ZeMetricCollector(tile_devices, context, groups);
     }
 
     ~ZeMetricCollector()
@@ -195,80 +204,160 @@ public:
 
     void DisableCollection() { DisableMetrics(); }
 
+    size_t getTileCount() const { return tiles_.size(); }
+
     void resetAccumulatedMetrics()
     {
-        accumulated_metrics_                               = 0;
-        std::vector<MetricResult>* metric_results_to_reset = nullptr;
+        for (auto& tile : tiles_)
         {
-            std::lock_guard<std::mutex> lock(metric_results_mutex_);
-            metric_results_to_reset = current_metric_results_;
-            current_metric_results_ =
-                (current_metric_results_ == &metric_results1_) ? &metric_results2_ : &metric_results1_;
+            for (int type = 0; type < METRIC_TYPE_COUNT; ++type)
+            {
+                tile->baseline[type].store(tile->total[type].load(std::memory_order_relaxed),
+                                           std::memory_order_relaxed);
+            }
         }
-        metric_results_to_reset->clear();
     }
 
-    uint64_t getAccumulatedMetricsSinceLastReset()
+    MetricResult getTileMetricsSinceLastReset(size_t tile_index) const
     {
-        std::vector<MetricResult>* metric_results_to_process = nullptr;
+        const Tile& tile = *tiles_.at(tile_index);
+        uint64_t    since_reset[METRIC_TYPE_COUNT];
+        for (int type = 0; type < METRIC_TYPE_COUNT; ++type)
         {
-            std::lock_guard<std::mutex> lock(metric_results_mutex_);
-            metric_results_to_process = current_metric_results_;
-            current_metric_results_ =
-                (current_metric_results_ == &metric_results1_) ? &metric_results2_ : &metric_results1_;
+            since_reset[type] = tile.total[type].load(std::memory_order_relaxed) -
+                                tile.baseline[type].load(std::memory_order_relaxed);
         }
+        MetricResult result;
+        result.inst_alu0 = since_reset[METRIC_INST_ALU0];
+        result.inst_alu1 = since_reset[METRIC_INST_ALU1];
+        result.inst_xmx  = since_reset[METRIC_INST_XMX];
+        result.inst_send = since_reset[METRIC_INST_SEND];
+        result.inst_ctrl = since_reset[METRIC_INST_CTRL];
+        return result;
+    }
 
+    uint64_t getAccumulatedMetricsSinceLastReset() const
+    {
         uint64_t acc_sum = 0;
-        for (const auto& metric : *metric_results_to_process)
+        for (size_t i = 0; i < tiles_.size(); ++i)
         {
-            acc_sum += metric.inst_alu0 + metric.inst_alu1 + metric.inst_xmx + metric.inst_send + metric.inst_ctrl;
+            acc_sum += getTileMetricsSinceLastReset(i).total();
         }
-
-        metric_results_to_process->clear();
-
-        accumulated_metrics_ += (acc_sum / 1000000UL);
-        return accumulated_metrics_;
+        return acc_sum;
     }
 
 private:
-    ZeMetricCollector(ze_device_handle_t device, ze_context_handle_t context, zet_metric_group_handle_t group)
-    : device_(device), context_(context), metric_group_(group)
+    // Streamer state and counters of one tile, the counters have their own cache lines
+    struct Tile
     {
-        if (device_ == nullptr || context_ == nullptr || metric_group_ == nullptr)
+        ze_device_handle_t             device       = nullptr;
+        zet_metric_group_handle_t      metric_group = nullptr;
+        uint32_t                       report_size  = 0;
+        int                            metric_ids[METRIC_TYPE_COUNT] {};
+        std::vector<zet_typed_value_t> report_list; // reused between reads
+        std::thread                    collector_thread;
+
+        alignas(64) std::atomic<uint64_t> total[METRIC_TYPE_COUNT] {};
+        alignas(64) std::atomic<uint64_t> baseline[METRIC_TYPE_COUNT] {};
+    };
+
+    ZeMetricCollector(const std::vector<ze_device_handle_t>&        devices,
+                      ze_context_handle_t                           context,
+                      const std::vector<zet_metric_group_handle_t>& groups)
+    : context_(context)
+    {
+        if (context_ == nullptr || devices.size() != groups.size())
         {
             throw std::invalid_argument("Invalid device, context or metric group handle");
         }
+        for (size_t i = 0; i < devices.size(); ++i)
+        {
+            if (devices[i] == nullptr || groups[i] == nullptr)
+            {
+                throw std::invalid_argument("Invalid device, context or metric group handle");
+            }
+            auto tile          = std::make_unique<Tile>();
+            tile->device       = devices[i];
+            tile->metric_group = groups[i];
+            tiles_.push_back(std::move(tile));
+        }
         SetCollectionConfig();
-        SetReportSize();
-        SetMetricIndices();
+        for (auto& tile : tiles_)
+        {
+            SetReportSize(*tile);
+            SetMetricIndices(*tile);
+        }
         EnableMetrics();
     }
 
+    static zet_metric_group_handle_t FindMetricGroup(ze_device_handle_t device, const std::string& group_name)
+    {
+        ze_result_t status      = ZE_RESULT_SUCCESS;
+        uint32_t    group_count = 0;
+        status                  = zetMetricGroupGet(device, &group_count, nullptr);
+        if (status != ZE_RESULT_SUCCESS || group_count == 0)
+        {
+            throw std::runtime_error("Unable to find any metric groups");
+        }
+        std::vector<zet_metric_group_handle_t> group_list(group_count, nullptr);
+        status = zetMetricGroupGet(device, &group_count, group_list.data());
+        if (status != ZE_RESULT_SUCCESS)
+        {
+            throw std::runtime_error(errorMap.at(status));
+        }
+        for (uint32_t i = 0; i < group_count; ++i)
+        {
+            zet_metric_group_properties_t group_props {};
+            group_props.stype = ZET_STRUCTURE_TYPE_METRIC_GROUP_PROPERTIES;
+            status            = zetMetricGroupGetProperties(group_list[i], &group_props);
+            if (status != ZE_RESULT_SUCCESS)
+            {
+                throw std::runtime_error(errorMap.at(status));
+            }
+
+            if (group_name == group_props.name &&
+                (group_props.samplingType & ZET_METRIC_GROUP_SAMPLING_TYPE_FLAG_TIME_BASED))
+            {
+                return group_list[i];
+            }
+        }
+        return nullptr;
+    }
+
     void EnableMetrics()
     {
-        if (collector_thread_ != nullptr || collector_state_ != COLLECTOR_STATE_IDLE)
+        if (collector_state_ != COLLECTOR_STATE_IDLE)
         {
             throw std::runtime_error("Invalid collector state");
         }
 
-        collector_state_.store(COLLECTOR_STATE_IDLE, std::memory_order_release);
-        collector_thread_ = new std::thread(Collect, this);
+        enabled_tiles_.store(0, std::memory_order_release);
+        for (auto& tile : tiles_)
+        {
+            tile->collector_thread = std::thread(Collect, this, tile.get());
+        }
 
-        while (collector_state_.load(std::memory_order_acquire) != COLLECTOR_STATE_ENABLED)
+        while (enabled_tiles_.load(std::memory_order_acquire) != tiles_.size())
         {
             std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
+        collector_state_.store(COLLECTOR_STATE_ENABLED, std::memory_order_release);
     }
 
     void DisableMetrics()
     {
-        if (collector_thread_ == nullptr)
+        // called by both the owner and the destructor
+        if (collector_state_.exchange(COLLECTOR_STATE_DISABLED, std::memory_order_acq_rel) != COLLECTOR_STATE_ENABLED)
         {
-            throw std::runtime_error("Invalid collector state");
+            return;
+        }
+        for (auto& tile : tiles_)
+        {
+            if (tile->collector_thread.joinable())
+            {
+                tile->collector_thread.join();
+            }
         }
-        collector_state_.store(COLLECTOR_STATE_DISABLED, std::memory_order_release);
-        collector_thread_->join();
-        delete collector_thread_;
     }
 
     void SetCollectionConfig()
@@ -287,20 +376,20 @@ private:
         LOG_DEBUG("COLLECTOR_DELAY_NS: {}", collector_delay_ns);
     }
 
-    void SetReportSize()
+    void SetReportSize(Tile& tile)
     {
         ze_result_t                   status = ZE_RESULT_SUCCESS;
         zet_metric_group_properties_t group_props {};
         group_props.stype = ZET_STRUCTURE_TYPE_METRIC_GROUP_PROPERTIES;
-        status            = zetMetricGroupGetProperties(metric_group_, &group_props);
+        status            = zetMetricGroupGetProperties(tile.metric_group, &group_props);
         if (status != ZE_RESULT_SUCCESS)
         {
             throw std::runtime_error(errorMap.at(status));
         }
-        report_size_ = group_props.metricCount;
+        tile.report_size = group_props.metricCount;
     }
 
-    void SetMetricIndices()
+    void SetMetricIndices(Tile& tile)
     {
         auto GetMetricId = [&](zet_metric_group_handle_t group, const std::string& name) -> int
         {
@@ -339,29 +428,31 @@ private:
             return target;
         };
 
-        inst_alu0_id_ = GetMetricId(metric_group_, "XVE_INST_EXECUTED_ALU0_ALL");
-        inst_alu1_id_ = GetMetricId(metric_group_, "XVE_INST_EXECUTED_ALU1_ALL");
-        inst_xmx_id_  = GetMetricId(metric_group_, "XVE_INST_EXECUTED_XMX_ALL");
-        inst_send_id_ = GetMetricId(metric_group_, "XVE_INST_EXECUTED_SEND_ALL");
-        inst_ctrl_id_ = GetMetricId(metric_group_, "XVE_INST_EXECUTED_CONTROL_ALL");
-        if (inst_alu0_id_ <= 0 || inst_alu1_id_ <= 0 || inst_xmx_id_ <= 0 || inst_send_id_ <= 0 || inst_ctrl_id_ <= 0)
+        tile.metric_ids[METRIC_INST_ALU0] = GetMetricId(tile.metric_group, "XVE_INST_EXECUTED_ALU0_ALL");
+        tile.metric_ids[METRIC_INST_ALU1] = GetMetricId(tile.metric_group, "XVE_INST_EXECUTED_ALU1_ALL");
+        tile.metric_ids[METRIC_INST_XMX]  = GetMetricId(tile.metric_group, "XVE_INST_EXECUTED_XMX_ALL");
+        tile.metric_ids[METRIC_INST_SEND] = GetMetricId(tile.metric_group, "XVE_INST_EXECUTED_SEND_ALL");
+        tile.metric_ids[METRIC_INST_CTRL] = GetMetricId(tile.metric_group, "XVE_INST_EXECUTED_CONTROL_ALL");
+        for (int type = 0; type < METRIC_TYPE_COUNT; ++type)
         {
-            throw std::runtime_error("Unable to find all required metrics");
+            if (tile.metric_ids[type] <= 0)
+            {
+                throw std::runtime_error("Unable to find all required metrics");
+            }
         }
     }
 
-    void AppendCalculatedMetrics(const std::vector<uint8_t>& storage)
+    static void AppendCalculatedMetrics(Tile& tile, const std::vector<uint8_t>& storage)
     {
         if (storage.size() == 0)
         {
             return;
         }
 
-        ze_result_t                    status = ZE_RESULT_SUCCESS;
-        std::vector<zet_typed_value_t> report_list;
+        ze_result_t status = ZE_RESULT_SUCCESS;
 
         uint32_t value_count = 0;
-        status               = zetMetricGroupCalculateMetricValues(metric_group_,
+        status               = zetMetricGroupCalculateMetricValues(tile.metric_group,
                                                      ZET_METRIC_GROUP_CALCULATION_TYPE_METRIC_VALUES,
                                                      storage.size(),
                                                      storage.data(),
@@ -373,50 +464,43 @@ private:
             return;
         }
 
-        report_list.resize(value_count);
-        status = zetMetricGroupCalculateMetricValues(metric_group_,
+        tile.report_list.resize(value_count);
+        status = zetMetricGroupCalculateMetricValues(tile.metric_group,
                                                      ZET_METRIC_GROUP_CALCULATION_TYPE_METRIC_VALUES,
                                                      storage.size(),
                                                      storage.data(),
                                                      &value_count,
-                                                     report_list.data());
+                                                     tile.report_list.data());
         if (status != ZE_RESULT_SUCCESS)
         {
             LOG_ERROR("Some data was lost while trying to calculate metric values");
             return;
         }
-        report_list.resize(value_count);
 
-        MetricResult metric_result;
+        uint64_t sums[METRIC_TYPE_COUNT] {};
 
-        const zet_typed_value_t* report = report_list.data();
-        while (report < report_list.data() + report_list.size())
+        const zet_typed_value_t* report = tile.report_list.data();
+        while (report + tile.report_size <= tile.report_list.data() + value_count)
         {
-            const auto inst_alu0 = report[inst_alu0_id_].value.ui64;
-            const auto inst_alu1 = report[inst_alu1_id_].value.ui64;
-            const auto inst_xmx  = report[inst_xmx_id_].value.ui64;
-            const auto inst_send = report[inst_send_id_].value.ui64;
-            const auto inst_ctrl = report[inst_ctrl_id_].value.ui64;
-
-            metric_result.inst_alu0 += inst_alu0;
-            metric_result.inst_alu1 += inst_alu1;
-            metric_result.inst_xmx += inst_xmx;
-            metric_result.inst_send += inst_send;
-            metric_result.inst_ctrl += inst_ctrl;
-
-            report += report_size_;
+            for (int type = 0; type < METRIC_TYPE_COUNT; ++type)
+            {
+                sums[type] += report[tile.metric_ids[type]].value.ui64;
+            }
+            report += tile.report_size;
         }
 
+        // the collector thread of the tile is the only writer
+        for (int type = 0; type < METRIC_TYPE_COUNT; ++type)
         {
-            std::lock_guard<std::mutex> lock(metric_results_mutex_);
-            current_metric_results_->push_back(metric_result);
+            tile.total[type].store(tile.total[type].load(std::memory_order_relaxed) + sums[type],
+                                   std::memory_order_relaxed);
         }
     }
 
-    static void Collect(ZeMetricCollector* collector)
+    static void Collect(ZeMetricCollector* collector, Tile* tile)
     {
         ze_result_t status = ZE_RESULT_SUCCESS;
-        status = zetContextActivateMetricGroups(collector->context_, collector->device_, 1, &collector->metric_group_);
+        status = zetContextActivateMetricGroups(collector->context_, tile->device, 1, &tile->metric_group);
         if (status != ZE_RESULT_SUCCESS)
         {
             throw std::runtime_error(errorMap.at(status));
@@ -451,8 +535,8 @@ private:
                                                              collector->collector_sampling_period_ns};
         zet_metric_streamer_handle_t metric_streamer      = nullptr;
         status                                            = zetMetricStreamerOpen(collector->context_,
-                                       collector->device_,
-                                       collector->metric_group_,
+                                       tile->device,
+                                       tile->metric_group,
                                        &metric_streamer_desc,
                                        event,
                                        &metric_streamer);
@@ -461,7 +545,7 @@ private:
             throw std::runtime_error(errorMap.at(status));
         }
 
-        collector->collector_state_.store(COLLECTOR_STATE_ENABLED, std::memory_order_release);
+        collector->enabled_tiles_.fetch_add(1, std::memory_order_acq_rel);
 
         std::vector<uint8_t> storage;
         while (collector->collector_state_.load(std::memory_order_acquire) != COLLECTOR_STATE_DISABLED)
@@ -492,7 +576,7 @@ private:
                 }
                 storage.resize(data_size);
                 if (storage.size() > 0)
-                    collector->AppendCalculatedMetrics(storage);
+                    AppendCalculatedMetrics(*tile, storage);
             }
         }
 
@@ -508,7 +592,7 @@ private:
         {
             throw std::runtime_error(errorMap.at(status));
         }
-        if (auto status = zetContextActivateMetricGroups(collector->context_, collector->device_, 0, nullptr);
+        if (auto status = zetContextActivateMetricGroups(collector->context_, tile->device, 0, nullptr);
             status != ZE_RESULT_SUCCESS)
         {
             throw std::runtime_error(errorMap.at(status));
@@ -516,29 +600,14 @@ private:
     }
 
 private:
-    ze_device_handle_t  device_  = nullptr;
     ze_context_handle_t context_ = nullptr;
 
-    std::thread*                collector_thread_ = nullptr;
-    std::atomic<CollectorState> collector_state_ {COLLECTOR_STATE_IDLE};
-
-    zet_metric_group_handle_t metric_group_ = nullptr;
-    // double buffering
-    std::vector<MetricResult>  metric_results1_;
-    std::vector<MetricResult>  metric_results2_;
-    std::vector<MetricResult>* current_metric_results_ = &metric_results1_;
-    std::mutex                 metric_results_mutex_;
-
-    uint64_t accumulated_metrics_ = 0;
-    uint32_t report_size_;
-    int      inst_alu0_id_;
-    int      inst_alu1_id_;
-    int      inst_xmx_id_;
-    int      inst_send_id_;
-    int      inst_ctrl_id_;
+    std::vector<std::unique_ptr<Tile>> tiles_;
+    std::atomic<CollectorState>        collector_state_ {COLLECTOR_STATE_IDLE};
+    std::atomic<size_t>                enabled_tiles_ {0};
 
 public:
     uint32_t collector_notify_interval    = 32768;
     uint32_t collector_sampling_period_ns = 5000000;
     uint64_t collector_delay_ns           = 50000000;
-};
\ No newline at end of file
+};
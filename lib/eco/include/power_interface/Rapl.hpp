@@ -19,8 +19,10 @@
 #include "eco_constants.hpp"
 #include "msr_offsets.hpp"
 #include "msr.hpp"
+#include "clock.hpp"
 
 #include <chrono>
+#include <memory>
 #include <set>
 
 #define MAX_PACKAGES	16
@@ -47,7 +49,7 @@ struct RaplState {
 	uint64_t pp0_ {0};
 	uint64_t pp1_ {0};
 	uint64_t dram_ {0};
-	TimePoint timeSec_ {std::chrono::high_resolution_clock::now()};
+	TimePoint timeSec_ {};
 };
 
 class RaplStateSequence {
@@ -81,9 +83,10 @@ private:
 	int cpuCore_;
 	RaplState totalResultSinceLastReset_;
     RaplStateSequence rss_;
+	std::shared_ptr<Clock> clock_;
 
 public:
-	Rapl(int, AvailableRaplPowerDomains);
+	Rapl(int, AvailableRaplPowerDomains, std::shared_ptr<Clock> = getRealClock());
 	~Rapl() {}
 	void reset();
 	void sample();
@@ -99,6 +102,8 @@ public:
 	double dram_average_power() const;
 
 	double pkg_max_power() const;
+	double dram_max_power() const;
+	double dram_min_power() const;
 
 	double pkg_total_energy() const;
 	double pp0_total_energy() const;
@@ -0,0 +1,50 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+/*
+  AmdHsmp - socket power limits of AMD EPYC through the HSMP driver (amd_hsmp, /dev/hsmp)
+
+  The Host System Management Port is the AMD counterpart of the RAPL power limit registers:
+  the SMU of each socket is asked for (or given) the socket power limit in milliwatts with
+  the HSMP_IOCTL_CMD ioctl. isOpen() returns false when the driver is not loaded or the
+  device node is not accessible; all requests fail then.
+*/
+class AmdHsmp
+{
+public:
+    static constexpr const char* defaultDevicePath = "/dev/hsmp";
+
+    explicit AmdHsmp(const std::string& devicePath = defaultDevicePath);
+    ~AmdHsmp();
+    AmdHsmp(const AmdHsmp&) = delete;
+    AmdHsmp& operator=(const AmdHsmp&) = delete;
+
+    bool isOpen() const { return fd_ >= 0; }
+    std::optional<uint32_t> getSocketPowerInMilliWatts(uint16_t socket) const;
+    std::optional<uint32_t> getSocketPowerLimitInMilliWatts(uint16_t socket) const;
+    std::optional<uint32_t> getSocketPowerLimitMaxInMilliWatts(uint16_t socket) const;
+    bool setSocketPowerLimitInMilliWatts(uint16_t socket, uint32_t limitInMilliWatts) const;
+
+private:
+    std::optional<uint32_t> get(uint32_t messageId, uint16_t socket) const;
+
+    int fd_ {-1};
+};
@@ -0,0 +1,60 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <utility>
+
+enum class FrequencyDomain {
+    CORE,   // CPU cores (cpufreq) or GPU graphics/SM clock
+    UNCORE  // CPU uncore (ring/mesh, LLC and memory controller)
+};
+
+template <class Stream>
+Stream& operator<<(Stream& os, const FrequencyDomain& fd) {
+    switch(fd) {
+        case FrequencyDomain::CORE :
+            os << "core";
+            break;
+        case FrequencyDomain::UNCORE :
+            os << "uncore";
+            break;
+        default :
+            os << "unknown frequency domain";
+            break;
+    }
+    return os;
+}
+
+/*
+  FrequencyActuator - frequency counterpart of the power limit API of the Device
+
+  Frequency limit is applied as an upper bound of the frequency range the hardware
+  (or the OS governor) may select from. It gives more deterministic performance than
+  power capping. Actuators are created by the Device (see Device::getFrequencyActuator)
+  and remember the defaults read at creation for restoreDefaultFrequency().
+*/
+class FrequencyActuator
+{
+public:
+    virtual ~FrequencyActuator() = default;
+    virtual std::string getName() const = 0;
+    virtual std::pair<unsigned, unsigned> getMinMaxFrequencyInMHz() const = 0;
+    virtual unsigned getFrequencyLimitInMHz() const = 0;
+    virtual void setFrequencyLimitInMHz(unsigned limitInMHz) = 0;
+    virtual void restoreDefaultFrequency() = 0;
+};
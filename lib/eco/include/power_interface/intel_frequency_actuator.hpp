@@ -0,0 +1,80 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "power_interface/frequency_actuator.hpp"
+#include "power_interface/msr.hpp"
+
+/*
+  IntelCoreFrequencyActuator - limits CPU cores frequency with cpufreq scaling_max_freq
+
+  The same limit is written for every online core. The range is read from
+  cpuinfo_min_freq and cpuinfo_max_freq of the first core. The limits are journaled
+  (see PowerCapJournal) as the "cpufreq" device.
+*/
+class IntelCoreFrequencyActuator : public FrequencyActuator
+{
+public:
+    IntelCoreFrequencyActuator(int numCores);
+    ~IntelCoreFrequencyActuator() override = default;
+
+    std::string getName() const override { return "Intel core (cpufreq)"; }
+    std::pair<unsigned, unsigned> getMinMaxFrequencyInMHz() const override;
+    unsigned getFrequencyLimitInMHz() const override { return currentLimitInMHz_; }
+    void setFrequencyLimitInMHz(unsigned limitInMHz) override;
+    void restoreDefaultFrequency() override;
+
+private:
+    const std::string cpufreqBaseDirectory_ {"/sys/devices/system/cpu/cpu"};
+    const std::string journalDeviceName_ {"cpufreq"};
+    std::vector<std::string> scalingMaxFreqFiles_;
+    std::vector<int> defaultScalingMaxFreqInKHz_;
+    unsigned minFrequencyInMHz_ {0};
+    unsigned maxFrequencyInMHz_ {0};
+    unsigned currentLimitInMHz_ {0};
+};
+
+/*
+  IntelUncoreFrequencyActuator - limits uncore frequency with MSR_UNCORE_RATIO_LIMIT
+
+  The max ratio field of MSR 0x620 is written on the first core of each package,
+  the min ratio field is left untouched. The range spans from the default min to
+  the default max ratio (100 MHz each). The limits are journaled (see PowerCapJournal)
+  as the "uncore" device.
+*/
+class IntelUncoreFrequencyActuator : public FrequencyActuator
+{
+public:
+    IntelUncoreFrequencyActuator(std::vector<int> pkgToFirstCoreMap);
+    ~IntelUncoreFrequencyActuator() override = default;
+
+    std::string getName() const override { return "Intel uncore (MSR_UNCORE_RATIO_LIMIT)"; }
+    std::pair<unsigned, unsigned> getMinMaxFrequencyInMHz() const override;
+    unsigned getFrequencyLimitInMHz() const override { return currentLimitInMHz_; }
+    void setFrequencyLimitInMHz(unsigned limitInMHz) override;
+    void restoreDefaultFrequency() override;
+
+private:
+    const std::string journalDeviceName_ {"uncore"};
+    std::vector<int> pkgToFirstCoreMap_;
+    std::vector<UncoreRatioLimit> defaultRatioLimits_;
+    unsigned minFrequencyInMHz_ {0};
+    unsigned maxFrequencyInMHz_ {0};
+    unsigned currentLimitInMHz_ {0};
+};
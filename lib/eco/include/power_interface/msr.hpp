@@ -25,6 +25,11 @@ enum class Quantity {
     Power,
     Time
 };
+struct UncoreRatioLimit {
+    unsigned minRatio;
+    unsigned maxRatio;
+};
+
 struct PowerInfo {
     double thermalDesignPower;
     double minPower;
@@ -41,11 +46,16 @@ public:
     double getUnits(Quantity q);
     double getFixedDramUnitsValue(); // some server CPUs use different Power Unit for DRAM
     PowerInfo getPowerInfoForPKG();
+    PowerInfo getPowerInfoForDRAM();
     void enableClamping(Domain domain = Domain::PKG);
     void enablePowerCapping(Domain domain = Domain::PKG);
     void disableClamping(Domain domain = Domain::PKG);
     void disablePowerCapping(Domain domain = Domain::PKG);
     bool checkLockedByBIOS();
+    UncoreRatioLimit getUncoreRatioLimit();
+    void setUncoreRatioLimit(UncoreRatioLimit limit);
+    uint64_t getUncoreRatioLimitRegister(); // raw MSR_UNCORE_RATIO_LIMIT, see PowerCapJournal
+    static uint64_t encodeUncoreRatioLimit(uint64_t rawValue, UncoreRatioLimit limit);
 
 private:
     int fileDescriptor_ {UNDEFINED_FD};
@@ -53,4 +63,5 @@ private:
 	void writeMSR(int offset, uint64_t value);
 	uint64_t readMSR(int offset);
     int getOffsetForPowerLimit(Domain domain = Domain::PKG);
+    PowerInfo decodePowerInfo(uint64_t rawValue);
 };
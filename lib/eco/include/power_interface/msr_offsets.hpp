@@ -37,9 +37,20 @@
 #define MSR_DRAM_PERF_STATUS        0x61B
 #define MSR_DRAM_POWER_INFO         0x61C
 
+/* Uncore frequency control (Haswell-EP and later server parts) */
+#define MSR_UNCORE_RATIO_LIMIT      0x620
+#define UNCORE_MAX_RATIO_MASK       0x7F
+#define UNCORE_MIN_RATIO_OFFSET     0x08
+#define UNCORE_RATIO_TO_MHZ         100
+
 /* PSYS RAPL Domain */
 #define MSR_PLATFORM_ENERGY_STATUS  0x64d
 
+/* AMD Zen RAPL-compatible energy counters (Family 17h and later) */
+#define MSR_AMD_RAPL_POWER_UNIT     0xC0010299
+#define MSR_AMD_CORE_ENERGY_STATUS  0xC001029A
+#define MSR_AMD_PKG_ENERGY_STATUS   0xC001029B
+
 /* RAPL UNIT BITMASK */
 #define POWER_UNIT_OFFSET           0
 #define POWER_UNIT_MASK             0x0F
@@ -0,0 +1,57 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "power_interface/frequency_actuator.hpp"
+
+#include <nvml.h>
+
+/*
+  NvmlFrequencyActuator - limits NVIDIA GPU graphics clock
+
+  nvmlDeviceSetGpuLockedClocks is used when supported - the clock is locked to
+  the [min supported, limit] range. Otherwise (e.g. on older or consumer GPUs)
+  nvmlDeviceSetApplicationsClocks is used with the closest supported graphics clock
+  not higher than the limit and the highest supported memory clock. The clocks are
+  journaled (see PowerCapJournal) as the "gpu<index>_clocks" device, the journal
+  restores them with their reset.
+*/
+class NvmlFrequencyActuator : public FrequencyActuator
+{
+public:
+    NvmlFrequencyActuator(nvmlDevice_t deviceHandle);
+    ~NvmlFrequencyActuator() override = default;
+
+    std::string getName() const override;
+    std::pair<unsigned, unsigned> getMinMaxFrequencyInMHz() const override;
+    unsigned getFrequencyLimitInMHz() const override { return currentLimitInMHz_; }
+    void setFrequencyLimitInMHz(unsigned limitInMHz) override;
+    void restoreDefaultFrequency() override;
+
+private:
+    unsigned findSupportedGraphicsClock(unsigned limitInMHz) const;
+
+    nvmlDevice_t deviceHandle_;
+    std::string journalDeviceName_;
+    std::string journalTarget_; // NVML device index
+    bool useLockedClocks_ {true};
+    unsigned memoryClockInMHz_ {0};
+    std::vector<unsigned> supportedGraphicsClocksInMHz_; // sorted ascending
+    unsigned currentLimitInMHz_ {0};
+};
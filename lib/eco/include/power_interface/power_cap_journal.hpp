@@ -0,0 +1,117 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+  PowerCapJournal - write-ahead journal of the power caps changed by this process
+
+  Devices record the original value of every setting they may change (recordOriginal) and
+  every new value before it is written (apply). Records are appended to
+  <journalDir>/<pid>.journal and flushed to disk with fdatasync before the setting is
+  changed, so the journal survives SIGKILL, the OOM killer or a crash of the process.
+  Once a device restored its defaults (markRestored) and the process exits, the journal
+  is removed.
+
+  A journal is owned by its process through flock(), which the kernel releases when the
+  process dies. restoreLeftovers() writes back the originals found in journals that are
+  not owned by a live process. It is called when the journal of a new process is opened
+  (i.e. before any device reads its default limits) and by the RestorePowerCaps tool
+  (apps/simple), which can also be run periodically from a systemd timer.
+
+  Besides the power caps, the frequency limits (cpufreq scaling_max_freq, MSR_UNCORE_RATIO_LIMIT,
+  NVML locked and application clocks) are journaled the same way.
+
+  The sysfs, MSR and HSMP settings are restored by the journal itself. The vendor backends (NVML,
+  ROCm SMI, Level Zero) are restored by the code of their device plugins, which registers a restorer
+  (registerRestorer) when it is loaded, so that libeco does not depend on the vendor
+  libraries. A journal left by a process which used such a backend loads its plugin
+  (PluginDevice::load) to restore it.
+
+  installSignalHandlers() restores the caps on termination signals (SIGINT, SIGTERM,
+  SIGHUP, SIGQUIT) from a helper thread woken by the handler through a pipe, so that NVML
+  (or HSMP and ROCm SMI) can be used. On fatal signals (SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT) only the sysfs
+  settings (RAPL) are restored, from the handler, with async-signal-safe calls; the NVML,
+  HSMP, ROCm SMI and Level Zero caps stay in the journal for restoreLeftovers(). The signal is then re-raised.
+*/
+class PowerCapJournal
+{
+public:
+    enum class Backend { SYSFS, NVML, HSMP, ROCM_SMI, MSR, NVML_LOCKED_CLOCKS, NVML_APPLICATION_CLOCKS, LEVEL_ZERO };
+    static constexpr const char* defaultDir = "/run/eco_power_caps";
+
+    struct Record
+    {
+        std::string device;
+        Backend backend;
+        std::string target; // sysfs file path, NVML/ROCm SMI device index, HSMP socket index, <msr file>:<offset>
+                            // or <card>:<power domain>:<level>:<unit> of Level Zero
+        long long value;    // as written to the sysfs file or MSR, in milliwatts for NVML and HSMP, in microwatts for
+                            // ROCm SMI, in MHz for the NVML clocks (whose original is the default set by their reset),
+                            // in milliwatts or milliamperes for Level Zero
+    };
+    /// Writes back the original \p record of a vendor backend, false on failure.
+    using Restorer = bool (*)(const Record& record);
+
+    /// Registers the restorer of a vendor \p backend; returns true, so that it can initialize a static.
+    static bool registerRestorer(Backend backend, Restorer restorer);
+
+    /// Journal of this process in the powerCapJournalDir from config.yaml, opened on the first call.
+    static PowerCapJournal& instance();
+    /// Writes back the originals from journals of processes that are gone, returns the number of failures.
+    static int restoreLeftovers(const std::string& journalDir, bool dryRun = false);
+    static void installSignalHandlers();
+
+    explicit PowerCapJournal(const std::string& journalDir);
+    ~PowerCapJournal();
+    PowerCapJournal(const PowerCapJournal&) = delete;
+    PowerCapJournal& operator=(const PowerCapJournal&) = delete;
+
+    /// Journaling is off when the journal directory is not writable (caps are still restored on signals).
+    bool isEnabled() const { return fd_ >= 0; }
+    /// Records the value restored by \p device in restoreDefaultLimits; the first record per target is kept.
+    void recordOriginal(const std::string& device, Backend backend, const std::string& target, long long value);
+    /// Journals \p value and then calls \p write (which changes the setting) under the journal lock.
+    template <class F>
+    void apply(const std::string& device, Backend backend, const std::string& target, long long value, F&& write)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        journalApplied(Record{device, backend, target, value});
+        write();
+    }
+    /// \p device has restored its defaults by itself.
+    void markRestored(const std::string& device);
+    /// Writes back the originals of all devices with caps applied.
+    void restoreAll();
+
+private:
+    static void runSignalRestorer();
+    int restoreAllLocked();
+    void removeFile();
+    void journalApplied(const Record& record);
+    void append(const Record& record, const char* kind);
+    void appendLine(const std::string& line);
+
+    std::string path_;
+    int fd_ {-1};
+    std::mutex mutex_;
+    std::vector<Record> originals_;
+    std::map<std::string, bool> devicesWithCapsApplied_;
+};
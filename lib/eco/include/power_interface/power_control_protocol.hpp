@@ -0,0 +1,173 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+/*
+  Binary protocol of the power control helper (PowerControlServer, apps/simple/PowerControlHelper)
+
+  The helper runs as root, owns the CPU power device and lets unprivileged DEPO/StEP
+  processes (PowerControlDevice) read energy and set power caps:
+
+  - readings are published in a shared memory snapshot (a sealed memfd, passed read-only
+    with SCM_RIGHTS in the reply to HELLO). The helper samples the device every period and
+    updates the snapshot under a seqlock, so a client reads energy and limits from its
+    mapping without any system call.
+  - requests go over a SOCK_SEQPACKET UNIX socket. One message is one batch of up to
+    powerControlMaxCommands commands, applied in order, and is answered by one message
+    with a result per command, e.g. PKG and DRAM caps are set in a single round trip.
+
+  All fields are in host byte order; the helper and its clients run on the same host.
+*/
+
+constexpr uint32_t powerControlMagic = 0x45434f50; // "ECOP"
+constexpr uint16_t powerControlVersion = 2;
+constexpr const char* powerControlDefaultSocketPath = "/run/eco_power_control.sock";
+constexpr size_t powerControlMaxDomains = 4; // indexed by Domain (PKG, PP0, PP1, DRAM)
+constexpr size_t powerControlMaxCommands = 16;
+constexpr unsigned powerControlSnapshotMaxRetries = 10000; // a helper update takes a few stores
+
+enum class PowerControlOp : uint32_t
+{
+    HELLO = 1,                  // reply carries the snapshot fd, value = snapshot size
+    SET_POWER_LIMIT = 2,        // domain, value = limit in microwatts
+    RESTORE_DEFAULT_LIMITS = 3, // restores the limits and the NMI watchdog changed by the connection
+    SET_NMI_WATCHDOG = 4,       // value = 0 or 1
+};
+
+struct PowerControlCommand
+{
+    uint32_t op;
+    uint32_t domain;
+    uint64_t value;
+};
+
+struct PowerControlRequest
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t numCommands;
+    PowerControlCommand commands[powerControlMaxCommands]; // only numCommands are sent
+};
+
+struct PowerControlResult
+{
+    int32_t status; // 0 or -errno, e.g. -EBUSY when another connection holds the caps
+    uint32_t reserved;
+    uint64_t value;
+};
+
+struct PowerControlResponse
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t numResults;
+    PowerControlResult results[powerControlMaxCommands]; // only numResults are sent
+};
+
+constexpr size_t powerControlRequestSize(size_t numCommands)
+{
+    return offsetof(PowerControlRequest, commands) + numCommands * sizeof(PowerControlCommand);
+}
+
+constexpr size_t powerControlResponseSize(size_t numResults)
+{
+    return offsetof(PowerControlResponse, results) + numResults * sizeof(PowerControlResult);
+}
+
+/*
+  PowerControlSnapshot - layout of the shared memory published by the helper
+
+  The fields below sequence are constant after the helper started. sequence is odd while
+  the helper updates the readings; readers retry until they see the same even value before
+  and after copying them (readPowerControlSnapshot), and give up after
+  powerControlSnapshotMaxRetries attempts, e.g. when the helper died in the middle of an update.
+*/
+struct PowerControlSnapshot
+{
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> timestampInMicroSeconds;
+    std::atomic<uint64_t> energyInMicroJoules[powerControlMaxDomains]; // since the helper started
+    std::atomic<uint64_t> powerLimitInMicroWatts[powerControlMaxDomains];
+    std::atomic<uint64_t> perfCounter; // getPerfCounter of the helper device, system-wide instructions in millions
+
+    uint32_t measuredDomainMask; // bit (1 << Domain)
+    uint32_t cappableDomainMask;
+    uint32_t minLimitInWatts[powerControlMaxDomains];
+    uint32_t maxLimitInWatts[powerControlMaxDomains];
+    char deviceName[128];
+    char deviceType[16];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the snapshot is shared between processes");
+static_assert(std::is_standard_layout_v<PowerControlRequest> && std::is_standard_layout_v<PowerControlResponse>);
+
+struct PowerControlReading
+{
+    uint64_t sequence {0};
+    uint64_t timestampInMicroSeconds {0};
+    uint64_t energyInMicroJoules[powerControlMaxDomains] {};
+    uint64_t powerLimitInMicroWatts[powerControlMaxDomains] {};
+    uint64_t perfCounter {0};
+};
+
+inline std::optional<PowerControlReading> readPowerControlSnapshot(const PowerControlSnapshot& snapshot)
+{
+    PowerControlReading reading;
+    for (unsigned attempt = 0; attempt < powerControlSnapshotMaxRetries; ++attempt)
+    {
+        const uint64_t before = snapshot.sequence.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            continue;
+        }
+        reading.timestampInMicroSeconds = snapshot.timestampInMicroSeconds.load(std::memory_order_relaxed);
+        for (size_t dom = 0; dom < powerControlMaxDomains; ++dom)
+        {
+            reading.energyInMicroJoules[dom] = snapshot.energyInMicroJoules[dom].load(std::memory_order_relaxed);
+            reading.powerLimitInMicroWatts[dom] = snapshot.powerLimitInMicroWatts[dom].load(std::memory_order_relaxed);
+        }
+        reading.perfCounter = snapshot.perfCounter.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (snapshot.sequence.load(std::memory_order_relaxed) == before)
+        {
+            reading.sequence = before;
+            return reading;
+        }
+    }
+    return std::nullopt;
+}
+
+inline void writePowerControlSnapshot(PowerControlSnapshot& snapshot, const PowerControlReading& reading)
+{
+    const uint64_t sequence = snapshot.sequence.load(std::memory_order_relaxed);
+    snapshot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    snapshot.timestampInMicroSeconds.store(reading.timestampInMicroSeconds, std::memory_order_relaxed);
+    for (size_t dom = 0; dom < powerControlMaxDomains; ++dom)
+    {
+        snapshot.energyInMicroJoules[dom].store(reading.energyInMicroJoules[dom], std::memory_order_relaxed);
+        snapshot.powerLimitInMicroWatts[dom].store(reading.powerLimitInMicroWatts[dom], std::memory_order_relaxed);
+    }
+    snapshot.perfCounter.store(reading.perfCounter, std::memory_order_relaxed);
+    snapshot.sequence.store(sequence + 2, std::memory_order_release);
+}
@@ -0,0 +1,112 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "devices/abstract_device.hpp"
+#include "power_interface/power_control_protocol.hpp"
+
+struct PowerControlServerOptions
+{
+    std::string socketPath {powerControlDefaultSocketPath};
+    /// cgroup paths (e.g. /user.slice/user-1000.slice or /slurm/uid_1000) whose processes may connect, with their subtrees.
+    std::vector<std::string> allowedCgroups;
+    /// root clients are accepted whatever their cgroup
+    bool allowRoot {true};
+    std::chrono::milliseconds samplePeriod {10};
+    std::string nmiWatchdogFile {"/proc/sys/kernel/nmi_watchdog"};
+    std::string procDir {"/proc"};
+};
+
+/*
+  PowerControlServer - the privileged side of the power control helper (see power_control_protocol.hpp)
+
+  Publishes the readings of \p device in the shared memory snapshot and serves the
+  requests of PowerControlDevice clients from a single thread (run), so the device is
+  never used concurrently. A connecting process is authorized by its credentials
+  (SO_PEERCRED) and the cgroup v2 path in /proc/<pid>/cgroup, which must be one of
+  allowedCgroups or below it; other connections are closed at once. The pidfd of the
+  connecting process (SO_PEERPIDFD), still alive after the cgroup was read, rules out a
+  reused pid. Kernels before 6.5 have no SO_PEERPIDFD and only root clients are accepted
+  there: a pid looked up after accept may already name another process. What remains is
+  the SO_PEERCRED semantics: the peer is the process that called connect, which may have
+  passed the socket on to another one.
+
+  Only one connection at a time holds the caps: the first one setting a limit or the
+  NMI watchdog, until it restores the defaults or disconnects. A client killed with the
+  caps still set has them restored when the kernel closes its socket; if the helper
+  itself dies, the PowerCapJournal of the device covers them (RestorePowerCaps).
+*/
+class PowerControlServer
+{
+public:
+    PowerControlServer(std::shared_ptr<Device> device, PowerControlServerOptions options = {});
+    ~PowerControlServer();
+    PowerControlServer(const PowerControlServer&) = delete;
+    PowerControlServer& operator=(const PowerControlServer&) = delete;
+
+    /// Serves the clients until stop() is called.
+    void run();
+    /// Makes run() return; async-signal-safe.
+    void stop();
+
+    /// cgroup v2 path of \p pid, std::nullopt when unknown or without the unified hierarchy (cgroup v1 only).
+    static std::optional<std::string> cgroupOfProcess(pid_t pid, const std::string& procDir = "/proc");
+    bool isAuthorized(uid_t uid, const std::optional<std::string>& cgroup) const;
+
+private:
+    struct Connection
+    {
+        int fd {-1};
+        pid_t pid {0};
+        uid_t uid {0};
+        std::string cgroup;
+        std::optional<std::string> originalNmiWatchdog;
+    };
+
+    void sample();
+    void publish();
+    void readLimits();
+    void acceptConnection();
+    /// False when the connection has to be closed.
+    bool serveRequest(Connection& connection);
+    PowerControlResult execute(Connection& connection, const PowerControlCommand& command, bool& limitsChanged);
+    bool acquireCaps(const Connection& connection);
+    void restoreDefaults(Connection& connection);
+    void closeConnection(size_t index);
+
+    std::shared_ptr<Device> device_;
+    const PowerControlServerOptions options_;
+    int listenFd_ {-1};
+    int stopPipe_[2] {-1, -1};
+    int snapshotFd_ {-1};
+    int readOnlySnapshotFd_ {-1};
+    PowerControlSnapshot* snapshot_ {nullptr};
+    uint32_t cappableDomainMask_ {0};
+    uint32_t minLimitInWatts_[powerControlMaxDomains] {};
+    uint32_t maxLimitInWatts_[powerControlMaxDomains] {};
+    PowerControlReading reading_;
+    std::optional<Clock::TimePoint> lastSampleTime_;
+    double integratedJoules_ {0.0};
+    std::vector<Connection> connections_;
+    int capsOwnerFd_ {-1};
+};
@@ -0,0 +1,42 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/device_plugin_export.hpp"
+#include "devices/cuda_device.hpp"
+#include "devices/multi_cuda_device.hpp"
+
+static int probeCuda()
+{
+    unsigned int count = 0;
+    if (nvmlInit() != NVML_SUCCESS)
+    {
+        return 0;
+    }
+    const bool present = nvmlDeviceGetCount(&count) == NVML_SUCCESS && count > 0;
+    nvmlShutdown();
+    return present ? 1 : 0;
+}
+
+static std::unique_ptr<Device> makeCudaDevice(const DevicePluginOptions& options)
+{
+    if (options.ids.size() > 1)
+    {
+        return std::make_unique<MultiCudaDevice>(options.ids, options.async);
+    }
+    return std::make_unique<CudaDevice>(options.ids.empty() ? 0 : options.ids.front());
+}
+
+ECO_DEVICE_PLUGIN("cuda", "gpu", probeCuda, makeCudaDevice)
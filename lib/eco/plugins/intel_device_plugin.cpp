@@ -0,0 +1,42 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/device_plugin_export.hpp"
+#include "devices/intel_device.hpp"
+
+#include <fstream>
+#include <string>
+
+static int probeIntelCpu()
+{
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line))
+    {
+        if (line.rfind("vendor_id", 0) == 0)
+        {
+            return line.find("GenuineIntel") != std::string::npos ? 1 : 0;
+        }
+    }
+    return 0;
+}
+
+static std::unique_ptr<Device> makeIntelDevice(const DevicePluginOptions&)
+{
+    return std::make_unique<IntelDevice>();
+}
+
+ECO_DEVICE_PLUGIN("intel", "cpu", probeIntelCpu, makeIntelDevice)
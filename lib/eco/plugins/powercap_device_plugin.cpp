@@ -0,0 +1,31 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/device_plugin_export.hpp"
+#include "devices/powercap_device.hpp"
+
+// vendor neutral, "auto" takes it only when neither the amd nor the intel plugin probes the CPU
+static int probePowercap()
+{
+    return PowercapDevice::isAvailable() ? 1 : 0;
+}
+
+static std::unique_ptr<Device> makePowercapDevice(const DevicePluginOptions&)
+{
+    return std::make_unique<PowercapDevice>();
+}
+
+ECO_DEVICE_PLUGIN("powercap", "cpu", probePowercap, makePowercapDevice)
@@ -0,0 +1,37 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/device_plugin_export.hpp"
+#include "devices/rocm_device.hpp"
+
+static int probeRocm()
+{
+    uint32_t count = 0;
+    if (rsmi_init(0) != RSMI_STATUS_SUCCESS)
+    {
+        return 0;
+    }
+    const bool present = rsmi_num_monitor_devices(&count) == RSMI_STATUS_SUCCESS && count > 0;
+    rsmi_shut_down();
+    return present ? 1 : 0;
+}
+
+static std::unique_ptr<Device> makeRocmDevice(const DevicePluginOptions& options)
+{
+    return std::make_unique<RocmDevice>(options.ids.empty() ? 0 : options.ids.front());
+}
+
+ECO_DEVICE_PLUGIN("rocm", "gpu", probeRocm, makeRocmDevice)
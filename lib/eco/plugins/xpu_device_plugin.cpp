@@ -0,0 +1,49 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/device_plugin_export.hpp"
+#include "devices/xpu_device.hpp"
+#include "devices/multi_xpu_device.hpp"
+
+#include <cstdlib>
+
+static int probeXpu()
+{
+    // Sysman has to be requested before the first zeInit of the process (see XPUDevice::initL0)
+    setenv("ZES_ENABLE_SYSMAN", "1", 0);
+    setenv("ZET_ENABLE_METRICS", "1", 0);
+    uint32_t count = 0;
+    if (zeInit(ZE_INIT_FLAG_GPU_ONLY) != ZE_RESULT_SUCCESS || zeDriverGet(&count, nullptr) != ZE_RESULT_SUCCESS)
+    {
+        return 0;
+    }
+    return count > 0 ? 1 : 0;
+}
+
+static std::unique_ptr<Device> makeXpuDevice(const DevicePluginOptions& options)
+{
+    // current capping by default, USE_AMPERES=0 switches to power capping (as in StEP)
+    const char* env_p      = std::getenv("USE_AMPERES");
+    const bool  useAmperes = env_p == nullptr
+                            || !(std::string(env_p) == "0" || std::string(env_p) == "False" || std::string(env_p) == "false");
+    if (options.ids.size() > 1)
+    {
+        return std::make_unique<MultiXPUDevice>(options.ids, options.async, useAmperes);
+    }
+    return std::make_unique<XPUDevice>(options.ids.empty() ? 0 : options.ids.front(), useAmperes);
+}
+
+ECO_DEVICE_PLUGIN("xpu", "xpu", probeXpu, makeXpuDevice)
@@ -0,0 +1,56 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "data_structures/energy_integrator.hpp"
+
+void EnergyIntegrator::reset()
+{
+    energyInJoules_ = 0.0;
+    lastCounterSample_.reset();
+}
+
+void EnergyIntegrator::addPowerSample(double powerInWatts, std::chrono::nanoseconds interval)
+{
+    lastIntervalInSeconds_ = std::chrono::duration<double>(interval).count();
+    lastIntervalEnergyInJoules_ = powerInWatts * lastIntervalInSeconds_;
+    energyInJoules_ += lastIntervalEnergyInJoules_;
+}
+
+void EnergyIntegrator::addEnergyCounterSample(const EnergyCounterSample& sample)
+{
+    if (lastCounterSample_.has_value())
+    {
+        const auto& last = *lastCounterSample_;
+        if (sample.timestampInMicroSeconds == last.timestampInMicroSeconds)
+        {
+            return;
+        }
+        // a counter going backwards (e.g. device reset) only moves the origin
+        if (sample.timestampInMicroSeconds > last.timestampInMicroSeconds
+            && sample.energyInMicroJoules >= last.energyInMicroJoules)
+        {
+            lastIntervalInSeconds_ = (sample.timestampInMicroSeconds - last.timestampInMicroSeconds) * 1e-6;
+            lastIntervalEnergyInJoules_ = (sample.energyInMicroJoules - last.energyInMicroJoules) * 1e-6;
+            energyInJoules_ += lastIntervalEnergyInJoules_;
+        }
+    }
+    lastCounterSample_ = sample;
+}
+
+double EnergyIntegrator::getLastIntervalPowerInWatts() const
+{
+    return lastIntervalInSeconds_ > 0.0 ? lastIntervalEnergyInJoules_ / lastIntervalInSeconds_ : 0.0;
+}
@@ -0,0 +1,84 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "data_structures/idle_power_cache.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+#include <yaml-cpp/yaml.h>
+
+std::optional<IdlePowerEntry> IdlePowerCache::lookup(const std::string& key) const
+{
+    if (!isEnabled())
+    {
+        return std::nullopt;
+    }
+    try
+    {
+        const auto node = YAML::LoadFile(path_)[key];
+        if (!node)
+        {
+            return std::nullopt;
+        }
+        IdlePowerEntry entry;
+        entry.pkgPowerInWatts = node["pkg"].as<double>();
+        entry.dramPowerInWatts = node["dram"].as<double>();
+        entry.measuredAt = node["measuredAt"].as<long>();
+        if (std::time(nullptr) - entry.measuredAt > expiryInSeconds_)
+        {
+            return std::nullopt;
+        }
+        return entry;
+    }
+    catch (const YAML::Exception&)
+    {
+        // missing or corrupted file - measure again
+        return std::nullopt;
+    }
+}
+
+void IdlePowerCache::store(const std::string& key, const IdlePowerEntry& entry) const
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    YAML::Node cache;
+    try
+    {
+        cache = YAML::LoadFile(path_);
+    }
+    catch (const YAML::Exception&)
+    {
+        cache = YAML::Node(YAML::NodeType::Map);
+    }
+    cache[key]["pkg"] = entry.pkgPowerInWatts;
+    cache[key]["dram"] = entry.dramPowerInWatts;
+    cache[key]["measuredAt"] = static_cast<long>(entry.measuredAt);
+
+    // write aside and rename, so that concurrent readers never see a partial file
+    const auto tmpPath = path_ + "." + std::to_string(getpid());
+    std::ofstream file(tmpPath, std::ios::out | std::ios::trunc);
+    file << cache << "\n";
+    file.close();
+    if (!file || std::rename(tmpPath.c_str(), path_.c_str()) != 0)
+    {
+        std::cerr << "[WARNING] Could not update idle power cache " << path_ << "\n";
+        std::remove(tmpPath.c_str());
+    }
+}
@@ -0,0 +1,431 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "data_structures/metric_expression.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+enum Variable : std::uint8_t { E, T, P, PERF, CAP, REF_E, REF_T, REF_P, REF_PERF };
+
+const std::pair<const char*, Variable> variableNames[] = {
+    {"E", E}, {"T", T}, {"P", P}, {"perf", PERF}, {"cap", CAP},
+    {"ref_E", REF_E}, {"ref_T", REF_T}, {"ref_P", REF_P}, {"ref_perf", REF_PERF}};
+
+} // namespace
+
+// recursive descent parser emitting postfix programs
+class MetricParser
+{
+public:
+    using OpCode = MetricExpression::OpCode;
+
+    MetricParser(const std::string& text, double k) : text_(text), k_(k) {}
+
+    MetricExpression parse()
+    {
+        MetricExpression metric;
+        metric.text_ = text_;
+        metric.objective_ = parseProgram();
+        if (acceptKeyword("subject"))
+        {
+            expectKeyword("to");
+            do
+            {
+                MetricExpression::Constraint constraint;
+                constraint.left = parseProgram();
+                constraint.relation = parseRelation();
+                constraint.right = parseProgram();
+                metric.constraints_.push_back(std::move(constraint));
+            }
+            while (acceptKeyword("and"));
+        }
+        skipSpaces();
+        if (pos_ != text_.size())
+        {
+            fail("unexpected '" + text_.substr(pos_, 1) + "'");
+        }
+        return metric;
+    }
+
+private:
+    MetricExpression::Program parseProgram()
+    {
+        MetricExpression::Program program;
+        parseSum(program);
+        checkStackDepth(program);
+        return program;
+    }
+
+    void parseSum(MetricExpression::Program& program)
+    {
+        parseProduct(program);
+        while (true)
+        {
+            if (accept('+'))
+            {
+                parseProduct(program);
+                emit(program, OpCode::ADD);
+            }
+            else if (accept('-'))
+            {
+                parseProduct(program);
+                emit(program, OpCode::SUB);
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
+
+    void parseProduct(MetricExpression::Program& program)
+    {
+        parseUnary(program);
+        while (true)
+        {
+            if (accept('*'))
+            {
+                parseUnary(program);
+                emit(program, OpCode::MUL);
+            }
+            else if (accept('/'))
+            {
+                parseUnary(program);
+                emit(program, OpCode::DIV);
+            }
+            else
+            {
+                return;
+            }
+        }
+    }
+
+    void parseUnary(MetricExpression::Program& program)
+    {
+        if (accept('-'))
+        {
+            parseUnary(program);
+            emit(program, OpCode::NEG);
+            return;
+        }
+        parsePrimary(program);
+        if (accept('^'))
+        {
+            parseUnary(program); // right associative
+            emit(program, OpCode::POW);
+        }
+    }
+
+    void parsePrimary(MetricExpression::Program& program)
+    {
+        skipSpaces();
+        if (accept('('))
+        {
+            parseSum(program);
+            expect(')');
+            return;
+        }
+        if (pos_ < text_.size() && (std::isdigit(text_[pos_]) || text_[pos_] == '.'))
+        {
+            char* end = nullptr;
+            const double value = std::strtod(text_.c_str() + pos_, &end);
+            pos_ = end - text_.c_str();
+            program.push_back({OpCode::CONSTANT, 0, value});
+            return;
+        }
+        const auto namePos = pos_;
+        const auto name = parseIdentifier();
+        if (name.empty())
+        {
+            fail(pos_ < text_.size() ? "unexpected '" + text_.substr(pos_, 1) + "'" : "unexpected end");
+        }
+        if (name == "min" || name == "max")
+        {
+            expect('(');
+            parseSum(program);
+            expect(',');
+            parseSum(program);
+            expect(')');
+            emit(program, name == "min" ? OpCode::MIN : OpCode::MAX);
+            return;
+        }
+        if (name == "k")
+        {
+            program.push_back({OpCode::CONSTANT, 0, k_});
+            return;
+        }
+        for (const auto& [variableName, variable] : variableNames)
+        {
+            if (name == variableName)
+            {
+                program.push_back({OpCode::VARIABLE, variable, 0.0});
+                return;
+            }
+        }
+        pos_ = namePos;
+        fail("unknown variable '" + name + "'");
+    }
+
+    MetricExpression::Relation parseRelation()
+    {
+        using Relation = MetricExpression::Relation;
+        if (accept('>'))
+        {
+            return accept('=') ? Relation::GE : Relation::GT;
+        }
+        if (accept('<'))
+        {
+            return accept('=') ? Relation::LE : Relation::LT;
+        }
+        fail("expected >=, >, <= or <");
+        return Relation::GE;
+    }
+
+    std::string parseIdentifier()
+    {
+        skipSpaces();
+        const auto start = pos_;
+        while (pos_ < text_.size() && (std::isalnum(text_[pos_]) || text_[pos_] == '_'))
+        {
+            pos_++;
+        }
+        return text_.substr(start, pos_ - start);
+    }
+
+    bool acceptKeyword(const std::string& keyword)
+    {
+        const auto start = pos_;
+        if (parseIdentifier() == keyword)
+        {
+            return true;
+        }
+        pos_ = start;
+        return false;
+    }
+
+    void expectKeyword(const std::string& keyword)
+    {
+        if (!acceptKeyword(keyword))
+        {
+            fail("expected '" + keyword + "'");
+        }
+    }
+
+    bool accept(char c)
+    {
+        skipSpaces();
+        if (pos_ < text_.size() && text_[pos_] == c)
+        {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c)
+    {
+        if (!accept(c))
+        {
+            fail(std::string("expected '") + c + "'");
+        }
+    }
+
+    void skipSpaces()
+    {
+        while (pos_ < text_.size() && std::isspace(text_[pos_]))
+        {
+            pos_++;
+        }
+    }
+
+    void emit(MetricExpression::Program& program, OpCode op)
+    {
+        program.push_back({op, 0, 0.0});
+    }
+
+    void checkStackDepth(const MetricExpression::Program& program)
+    {
+        size_t depth = 0;
+        size_t maxDepth = 0;
+        for (const auto& instruction : program)
+        {
+            if (instruction.op == OpCode::CONSTANT || instruction.op == OpCode::VARIABLE)
+            {
+                maxDepth = std::max(maxDepth, ++depth);
+            }
+            else if (instruction.op != OpCode::NEG)
+            {
+                depth--;
+            }
+        }
+        if (maxDepth > MetricExpression::maxStackDepth)
+        {
+            fail("expression nested too deeply");
+        }
+    }
+
+    [[noreturn]] void fail(const std::string& message) const
+    {
+        throw std::invalid_argument("metric \"" + text_ + "\": " + message + " at position " + std::to_string(pos_));
+    }
+
+    const std::string& text_;
+    double k_;
+    size_t pos_ {0};
+};
+
+MetricExpression MetricExpression::compile(const std::string& text, double k)
+{
+    return MetricParser(text, k).parse();
+}
+
+MetricExpression MetricExpression::fromTargetMetric(TargetMetric metric, double k)
+{
+    switch (metric)
+    {
+        case TargetMetric::MIN_E_X_T:
+            // minimizing E*T is maximizing getEnergyTimeProd() (perf^2 / P)
+            return compile("E*T", k);
+        case TargetMetric::MIN_M_PLUS:
+            // Energy Delay Sum relative to the reference run, see PowAndPerfResult::checkPlusMetric
+            return compile("(ref_perf/perf) * ((k-1)*P/ref_P + 1) / k", k);
+        case TargetMetric::MIN_E:
+        default:
+            return compile("E", k);
+    }
+}
+
+MetricExpression::Variables MetricExpression::makeVariables(const PowAndPerfResult& result, const PowAndPerfResult& reference)
+{
+    Variables variables;
+    variables[E] = result.getEnergyPerInstr();
+    variables[T] = result.periodInSeconds_ / result.instructionsCount_;
+    variables[P] = result.averageCorePowerInWatts_;
+    variables[PERF] = result.getInstrPerSecond();
+    variables[CAP] = result.appliedPowerCapInWatts_;
+    variables[REF_E] = reference.getEnergyPerInstr();
+    variables[REF_T] = reference.periodInSeconds_ / reference.instructionsCount_;
+    variables[REF_P] = reference.averageCorePowerInWatts_;
+    variables[REF_PERF] = reference.getInstrPerSecond();
+    return variables;
+}
+
+double MetricExpression::run(const Program& program, const Variables& variables)
+{
+    double stack[maxStackDepth];
+    size_t top = 0;
+    for (const auto& instruction : program)
+    {
+        switch (instruction.op)
+        {
+            case OpCode::CONSTANT:
+                stack[top++] = instruction.constant;
+                break;
+            case OpCode::VARIABLE:
+                stack[top++] = variables[instruction.variable];
+                break;
+            case OpCode::NEG:
+                stack[top - 1] = -stack[top - 1];
+                break;
+            case OpCode::ADD:
+                top--;
+                stack[top - 1] += stack[top];
+                break;
+            case OpCode::SUB:
+                top--;
+                stack[top - 1] -= stack[top];
+                break;
+            case OpCode::MUL:
+                top--;
+                stack[top - 1] *= stack[top];
+                break;
+            case OpCode::DIV:
+                top--;
+                stack[top - 1] /= stack[top];
+                break;
+            case OpCode::POW:
+                top--;
+                stack[top - 1] = std::pow(stack[top - 1], stack[top]);
+                break;
+            case OpCode::MIN:
+                top--;
+                stack[top - 1] = std::min(stack[top - 1], stack[top]);
+                break;
+            case OpCode::MAX:
+                top--;
+                stack[top - 1] = std::max(stack[top - 1], stack[top]);
+                break;
+        }
+    }
+    return stack[0];
+}
+
+double MetricExpression::evaluate(const PowAndPerfResult& result, const PowAndPerfResult& reference) const
+{
+    return run(objective_, makeVariables(result, reference));
+}
+
+double MetricExpression::getConstraintsViolation(const PowAndPerfResult& result, const PowAndPerfResult& reference) const
+{
+    return getConstraintsViolation(makeVariables(result, reference));
+}
+
+double MetricExpression::getConstraintsViolation(const Variables& variables) const
+{
+    double violation = 0.0;
+    for (const auto& constraint : constraints_)
+    {
+        const double left = run(constraint.left, variables);
+        const double right = run(constraint.right, variables);
+        bool holds = false;
+        switch (constraint.relation)
+        {
+            case Relation::GE: holds = left >= right; break;
+            case Relation::GT: holds = left > right; break;
+            case Relation::LE: holds = left <= right; break;
+            case Relation::LT: holds = left < right; break;
+        }
+        if (!holds)
+        {
+            // relative to the bound so that constraints of different units can be summed
+            const double scale = std::max(std::fabs(right), std::numeric_limits<double>::min());
+            violation += std::max(std::fabs(left - right) / scale, std::numeric_limits<double>::epsilon());
+        }
+    }
+    return violation;
+}
+
+bool MetricExpression::isRightBetter(const PowAndPerfResult& left, const PowAndPerfResult& right, const PowAndPerfResult& reference) const
+{
+    const auto leftVariables = makeVariables(left, reference);
+    const auto rightVariables = makeVariables(right, reference);
+    if (!constraints_.empty())
+    {
+        const double leftViolation = getConstraintsViolation(leftVariables);
+        const double rightViolation = getConstraintsViolation(rightVariables);
+        if (leftViolation != rightViolation)
+        {
+            return rightViolation < leftViolation;
+        }
+    }
+    return run(objective_, rightVariables) < run(objective_, leftVariables);
+}
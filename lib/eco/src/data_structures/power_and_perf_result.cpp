@@ -32,23 +32,7 @@ std::ostream& operator<<(std::ostream& os, const PowAndPerfResult& res) {
     return os;
 }
 
-bool PowAndPerfResult::isRightBetter(PowAndPerfResult& right, TargetMetric mode) {
-    if (mode == TargetMetric::MIN_E) {
-        return this->getEnergyPerInstr() > right.getEnergyPerInstr();
-    } else if (mode == TargetMetric::MIN_E_X_T) {
-        return this->getEnergyTimeProd() < right.getEnergyTimeProd();
-    } else if (mode == TargetMetric::MIN_M_PLUS) {
-        // this is dirty hack as actually Metric Plus is looking for minimum
-        // not maximum of this metric.
-        return this->myPlusMetric_ > right.myPlusMetric_;
-    } else {
-        // exception should be thrown as it should never happen to compare with unexpected mode
-        return false;
-    }
-}
-
-double PowAndPerfResult::checkPlusMetric(PowAndPerfResult ref, double k) {
-    myPlusMetric_ = (1.0/k) * (ref.getInstrPerSecond()/getInstrPerSecond()) *
-                    ((k-1.0) * (averageCorePowerInWatts_ / ref.averageCorePowerInWatts_) + 1.0);
-    return myPlusMetric_;
+double PowAndPerfResult::checkPlusMetric(const PowAndPerfResult& ref, double k) const {
+    return (1.0/k) * (ref.getInstrPerSecond()/getInstrPerSecond()) *
+           ((k-1.0) * (averageCorePowerInWatts_ / ref.averageCorePowerInWatts_) + 1.0);
 }
@@ -19,20 +19,23 @@
 #include <set>
 
 DeviceStateAccumulator::DeviceStateAccumulator(std::shared_ptr<Device> d) :
-    absoluteStartTime_(std::chrono::high_resolution_clock::now()),
-    timeOfLastReset_(std::chrono::high_resolution_clock::now()),
+    clock_(d->getClock()),
+    absoluteStartTime_(clock_->now()),
+    timeOfLastReset_(clock_->now()),
     device_(d),
     prev_(0.0, 0, timeOfLastReset_),
     curr_(prev_),
-    next_(prev_)
+    next_(prev_),
+    progressMetric_(std::make_shared<DevicePerfCounterMetric>(d))
 {
 }
 
 void DeviceStateAccumulator::resetState()
 {
     device_->reset();
-    timeOfLastReset_ = std::chrono::high_resolution_clock::now();
-    totalEnergySinceReset_ = 0.0;
+    progressMetric_->reset();
+    timeOfLastReset_ = clock_->now();
+    energy_.reset();
     sample();
     sample();
 }
@@ -49,15 +52,29 @@ DeviceStateAccumulator& DeviceStateAccumulator::sample()
     device_->triggerPowerApiSample();
     // for other devices like NVIDIA it is handled by the API (e.g., NVML)
     // ------------------------------------------------------------------
-    const auto  perfCounter = device_->getPerfCounter();
+    const auto  perfCounter = progressMetric_->getCountSinceReset();
+    double memoryPower = 0.0;
+    for (auto&& dom : accountedExtraDomains_)
+    {
+        memoryPower += device_->getCurrentPowerInWatts(dom);
+    }
 
     next_ = PowerAndPerfState(
-        device_->getCurrentPowerInWatts(std::nullopt),
+        device_->getCurrentPowerInWatts(std::nullopt) + memoryPower,
         perfCounter,
-        std::chrono::high_resolution_clock::now());
+        clock_->now(),
+        memoryPower);
 
-    auto timeDeltaMs = std::chrono::duration_cast<std::chrono::milliseconds>(next_.time_ - curr_.time_).count();
-    totalEnergySinceReset_ += next_.power_ * timeDeltaMs / 1000;
+    // extra domains are only available as power, then the whole sum is integrated as power
+    const auto energyCounter = accountedExtraDomains_.empty() ? device_->getEnergyCounterSample() : std::nullopt;
+    if (energyCounter.has_value())
+    {
+        energy_.addEnergyCounterSample(*energyCounter);
+    }
+    else
+    {
+        energy_.addPowerSample(next_.power_, std::chrono::duration_cast<std::chrono::nanoseconds>(next_.time_ - curr_.time_));
+    }
     return *this;
 }
 
@@ -70,12 +87,17 @@ double DeviceStateAccumulator::getCurrentPower(Domain d)
 
 double DeviceStateAccumulator::getPerfCounterSinceReset()
 {
-    return device_->getPerfCounter();
+    return progressMetric_->getCountSinceReset();
 }
 
 double DeviceStateAccumulator::getEnergySinceReset() const
 {
-    return totalEnergySinceReset_;
+    return energy_.getEnergyInJoules();
+}
+
+EnergyCrossDomains DeviceStateAccumulator::getEnergySinceResetPerDomain() const
+{
+    return device_->getEnergySinceResetPerDomain();
 }
 
 PowAndPerfResult DeviceStateAccumulator::getCurrentPowerAndPerf(std::optional<std::reference_wrapper<Trigger>> trigger) const
@@ -95,7 +117,7 @@ PowAndPerfResult DeviceStateAccumulator::getCurrentPowerAndPerf(std::optional<st
         device_->getPowerLimitInWatts(),
         next_.power_ * timeDeltaMilliSeconds / 1000, // Watts x seconds
         next_.power_,
-        0.0, // memory power - not available for GPU
+        next_.memoryPower_, // memory power - 0.0 unless memory domain is accounted (not available for GPU)
         (trigger.has_value() ? trigger->get().getCurrentFilteredPowerInWatts() : -1.0) // TODO: this should be filtered power
         );
 }
@@ -0,0 +1,568 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/amd_cpu_device.hpp"
+#include "devices/idle_power_meter.hpp"
+#include "power_interface/msr_offsets.hpp"
+#include "power_interface/power_cap_journal.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr int maxCpus {1024};
+constexpr uint64_t msrCounterMask {0xFFFFFFFFull};
+
+std::optional<int> readIntFromFile(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+    int value;
+    if (file >> value)
+    {
+        return value;
+    }
+    return std::nullopt;
+}
+
+std::string readFirstLine(const fs::path& fileName)
+{
+    std::ifstream file(fileName);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+std::string cpuinfoValue(const std::string& line)
+{
+    const auto colon = line.find(':');
+    if (colon == std::string::npos)
+    {
+        return "";
+    }
+    const auto begin = line.find_first_not_of(" \t", colon + 1);
+    return begin == std::string::npos ? "" : line.substr(begin);
+}
+
+} // namespace
+
+AmdCpuDevice::AmdCpuDevice(AmdEnergySource source, const std::string& rootDir, std::shared_ptr<Clock> clock)
+    : rootDir_(rootDir), clock_(std::move(clock)), source_(source)
+{
+    if (!isAmdCpu(rootDir_))
+    {
+        throw std::runtime_error("AmdCpuDevice: not an AMD CPU (vendor_id in " + rootDir_ + "/proc/cpuinfo)");
+    }
+    detectCPU();
+    detectTopology();
+
+    bool isOpen = false;
+    if (source_ != AmdEnergySource::HWMON)
+    {
+        isOpen = openMsrCounters();
+        if (isOpen)
+        {
+            source_ = AmdEnergySource::MSR;
+        }
+    }
+    if (!isOpen && source_ != AmdEnergySource::MSR)
+    {
+        isOpen = openHwmonCounters();
+        if (isOpen)
+        {
+            source_ = AmdEnergySource::HWMON;
+        }
+    }
+    if (!isOpen)
+    {
+        throw std::runtime_error("AmdCpuDevice: energy counters unavailable, load the msr module (and run as root) or the amd_energy hwmon driver");
+    }
+    std::cout << "[INFO] " << modelName_ << ": " << pkgCounters_.size() << " package and " << coreCounters_.size()
+              << " core energy counters read from " << (source_ == AmdEnergySource::MSR ? "MSR" : "amd_energy hwmon") << "\n";
+
+    initPowerCapping();
+
+    perfEventCounters_ = std::make_unique<PerfEventCounters>();
+    if (!perfEventCounters_->isOpen())
+    {
+        // PCM does not support AMD CPUs, there is no fallback as in IntelDevice
+        std::cerr << "[WARNING] perf_event counters unavailable, AMD CPU instructions retired reported as 0\n";
+        perfEventCounters_.reset();
+    }
+
+    if (isPowerCappingAvailable())
+    {
+        // HSMP reports no min limit and the SMU does not honor limits below the idle power
+        idlePowerInWatts_ = measureIdlePower(*this, makeIdlePowerCacheKey(), false, "AmdCpuDevice").pkgPowerInWatts;
+    }
+
+    triggerPowerApiSample();
+    reset();
+}
+
+std::string AmdCpuDevice::makeIdlePowerCacheKey() const
+{
+    if (!rootDir_.empty())
+    {
+        return ""; // synthetic tree, not cached
+    }
+    char hostname[256] = {0};
+    gethostname(hostname, sizeof(hostname) - 1);
+    std::stringstream key;
+    key << hostname << "|" << modelName_ << "|" << getNumPackages() << " pkg|limits";
+    for (auto limit : defaultSocketLimitsInMilliWatts_)
+    {
+        key << " " << limit;
+    }
+    return key.str();
+}
+
+AmdCpuDevice::~AmdCpuDevice()
+{
+    for (auto* counters : {&pkgCounters_, &coreCounters_})
+    {
+        for (auto& counter : *counters)
+        {
+            if (counter.fd >= 0)
+            {
+                ::close(counter.fd);
+            }
+        }
+    }
+}
+
+bool AmdCpuDevice::isAmdCpu(const std::string& rootDir)
+{
+    std::ifstream cpuinfo(rootDir + "/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line))
+    {
+        if (line.rfind("vendor_id", 0) == 0)
+        {
+            const auto vendor = cpuinfoValue(line);
+            return vendor == "AuthenticAMD" || vendor == "HygonGenuine";
+        }
+    }
+    return false;
+}
+
+void AmdCpuDevice::detectCPU()
+{
+    std::ifstream cpuinfo(rootDir_ + "/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line))
+    {
+        if (line.rfind("model name", 0) == 0)
+        {
+            modelName_ = cpuinfoValue(line);
+            break;
+        }
+    }
+}
+
+void AmdCpuDevice::detectTopology()
+{
+    std::set<std::pair<int, int>> physicalCores;
+    for (int cpu = 0; cpu < maxCpus; ++cpu)
+    {
+        const std::string topologyDir = rootDir_ + "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        const auto package = readIntFromFile(topologyDir + "physical_package_id");
+        if (!package.has_value())
+        {
+            break;
+        }
+        if (static_cast<int>(pkgToFirstCoreMap_.size()) <= *package)
+        {
+            pkgToFirstCoreMap_.resize(*package + 1, -1);
+        }
+        if (pkgToFirstCoreMap_[*package] < 0)
+        {
+            pkgToFirstCoreMap_[*package] = cpu;
+        }
+        // SMT siblings share the core energy counter
+        const auto coreId = readIntFromFile(topologyDir + "core_id").value_or(cpu);
+        if (physicalCores.insert({*package, coreId}).second)
+        {
+            physicalCoreFirstCpus_.push_back(cpu);
+        }
+    }
+    if (pkgToFirstCoreMap_.empty())
+    {
+        throw std::runtime_error("AmdCpuDevice: no CPU found in " + rootDir_ + "/sys/devices/system/cpu");
+    }
+    std::cout << "\tDetected " << physicalCoreFirstCpus_.size() << " cores in " << pkgToFirstCoreMap_.size() << " packages\n";
+}
+
+bool AmdCpuDevice::openMsrCounters()
+{
+    auto openCounter = [this](int cpu, off_t offset) {
+        EnergyCounter counter;
+        counter.fd = ::open((rootDir_ + "/dev/cpu/" + std::to_string(cpu) + "/msr").c_str(), O_RDONLY | O_CLOEXEC);
+        counter.msrOffset = offset;
+        return counter;
+    };
+    auto unitCounter = openCounter(pkgToFirstCoreMap_.front(), MSR_AMD_RAPL_POWER_UNIT);
+    uint64_t units = 0;
+    const bool unitsRead = unitCounter.fd >= 0
+        && ::pread(unitCounter.fd, &units, sizeof(units), MSR_AMD_RAPL_POWER_UNIT) == sizeof(units);
+    if (unitCounter.fd >= 0)
+    {
+        ::close(unitCounter.fd);
+    }
+    if (!unitsRead)
+    {
+        return false;
+    }
+    msrEnergyUnitInJoules_ = std::pow(0.5, (units & ENERGY_UNIT_MASK) >> ENERGY_UNIT_OFFSET);
+
+    for (int cpu : pkgToFirstCoreMap_)
+    {
+        pkgCounters_.push_back(openCounter(cpu, MSR_AMD_PKG_ENERGY_STATUS));
+    }
+    for (int cpu : physicalCoreFirstCpus_)
+    {
+        coreCounters_.push_back(openCounter(cpu, MSR_AMD_CORE_ENERGY_STATUS));
+    }
+    for (auto* counters : {&pkgCounters_, &coreCounters_})
+    {
+        for (auto& counter : *counters)
+        {
+            if (!readRaw(counter, counter.lastRaw))
+            {
+                std::cerr << "[WARNING] Cannot read AMD energy MSRs: " << strerror(errno) << "\n";
+                for (auto* opened : {&pkgCounters_, &coreCounters_})
+                {
+                    for (auto& c : *opened)
+                    {
+                        if (c.fd >= 0) ::close(c.fd);
+                    }
+                    opened->clear();
+                }
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool AmdCpuDevice::openHwmonCounters()
+{
+    std::error_code ec;
+    for (const auto& hwmon : fs::directory_iterator(rootDir_ + "/sys/class/hwmon", ec))
+    {
+        if (readFirstLine(hwmon.path() / "name") != "amd_energy")
+        {
+            continue;
+        }
+        // energyN_label -> energyN_input, ordered by the socket/core number of the label
+        std::map<int, std::string> sockets;
+        std::map<int, std::string> cores;
+        for (const auto& entry : fs::directory_iterator(hwmon.path(), ec))
+        {
+            const std::string fileName = entry.path().filename().string();
+            const std::string suffix = "_label";
+            if (fileName.rfind("energy", 0) != 0 || fileName.size() <= suffix.size()
+                || fileName.compare(fileName.size() - suffix.size(), suffix.size(), suffix) != 0)
+            {
+                continue;
+            }
+            const std::string label = readFirstLine(entry.path());
+            const std::string input = (hwmon.path() / (fileName.substr(0, fileName.size() - suffix.size()) + "_input")).string();
+            if (label.rfind("Esocket", 0) == 0)
+            {
+                sockets[std::atoi(label.c_str() + 7)] = input;
+            }
+            else if (label.rfind("Ecore", 0) == 0)
+            {
+                cores[std::atoi(label.c_str() + 5)] = input;
+            }
+        }
+        auto openCounters = [this](const std::map<int, std::string>& inputs, std::vector<EnergyCounter>& counters) {
+            for (const auto& [index, input] : inputs)
+            {
+                EnergyCounter counter;
+                counter.fd = ::open(input.c_str(), O_RDONLY | O_CLOEXEC);
+                if (counter.fd < 0 || !readRaw(counter, counter.lastRaw))
+                {
+                    std::cerr << "[WARNING] Cannot read " << input << ": " << strerror(errno) << "\n";
+                    if (counter.fd >= 0) ::close(counter.fd);
+                    continue;
+                }
+                counters.push_back(counter);
+            }
+        };
+        openCounters(sockets, pkgCounters_);
+        openCounters(cores, coreCounters_);
+        if (!pkgCounters_.empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AmdCpuDevice::initPowerCapping()
+{
+    hsmp_ = std::make_unique<AmdHsmp>(rootDir_ + AmdHsmp::defaultDevicePath);
+    if (!hsmp_->isOpen())
+    {
+        std::cerr << "[WARNING] " << rootDir_ << AmdHsmp::defaultDevicePath
+                  << " not available (amd_hsmp driver), AMD CPU power capping disabled\n";
+        return;
+    }
+    std::vector<uint32_t> defaults;
+    std::vector<uint32_t> maxima;
+    for (size_t socket = 0; socket < pkgToFirstCoreMap_.size(); ++socket)
+    {
+        const auto limit = hsmp_->getSocketPowerLimitInMilliWatts(socket);
+        if (!limit.has_value())
+        {
+            std::cerr << "[WARNING] Cannot read the HSMP power limit of socket " << socket << ", AMD CPU power capping disabled\n";
+            return;
+        }
+        defaults.push_back(*limit);
+        maxima.push_back(hsmp_->getSocketPowerLimitMaxInMilliWatts(socket).value_or(*limit));
+    }
+    // caps left by a killed process are restored before the defaults are stored
+    auto& journal = PowerCapJournal::instance();
+    for (size_t socket = 0; socket < defaults.size(); ++socket)
+    {
+        journal.recordOriginal(journalDeviceName_, PowerCapJournal::Backend::HSMP, std::to_string(socket), defaults[socket]);
+    }
+    defaultSocketLimitsInMilliWatts_ = defaults;
+    maxSocketLimitsInMilliWatts_ = maxima;
+    for (auto limit : defaults)
+    {
+        currentPowerLimitInWatts_ += limit / 1000.0;
+    }
+}
+
+std::pair<unsigned, unsigned> AmdCpuDevice::getMinMaxLimitInWatts() const
+{
+    // as for IntelDevice the default limit is the max and the idle power the min
+    unsigned maxInWatts = 0;
+    for (auto limit : defaultSocketLimitsInMilliWatts_)
+    {
+        maxInWatts += limit / 1000;
+    }
+    return std::make_pair(std::min(static_cast<unsigned>(idlePowerInWatts_), maxInWatts), maxInWatts);
+}
+
+double AmdCpuDevice::getPowerLimitInWatts() const
+{
+    return isPowerCappingAvailable() ? currentPowerLimitInWatts_ : -1.0;
+}
+
+void AmdCpuDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
+{
+    if (!isPowerCappingAvailable())
+    {
+        return;
+    }
+    const uint32_t perSocketInMilliWatts = static_cast<uint32_t>(limitInMicroW / 1000 / defaultSocketLimitsInMilliWatts_.size());
+    auto& journal = PowerCapJournal::instance();
+    double appliedInWatts = 0.0;
+    for (size_t socket = 0; socket < defaultSocketLimitsInMilliWatts_.size(); ++socket)
+    {
+        const uint32_t limit = std::min(perSocketInMilliWatts, maxSocketLimitsInMilliWatts_[socket]);
+        bool isSet = false;
+        journal.apply(journalDeviceName_, PowerCapJournal::Backend::HSMP, std::to_string(socket), limit, [&] {
+            isSet = hsmp_->setSocketPowerLimitInMilliWatts(socket, limit);
+        });
+        if (!isSet)
+        {
+            std::cerr << "[ERROR] Cannot set the HSMP power limit of socket " << socket << " to " << limit << " mW\n";
+        }
+        appliedInWatts += (isSet ? limit : hsmp_->getSocketPowerLimitInMilliWatts(socket).value_or(0)) / 1000.0;
+    }
+    currentPowerLimitInWatts_ = appliedInWatts;
+}
+
+void AmdCpuDevice::restoreDefaultLimits()
+{
+    if (!isPowerCappingAvailable())
+    {
+        return;
+    }
+    bool isRestored = true;
+    for (size_t socket = 0; socket < defaultSocketLimitsInMilliWatts_.size(); ++socket)
+    {
+        if (!hsmp_->setSocketPowerLimitInMilliWatts(socket, defaultSocketLimitsInMilliWatts_[socket]))
+        {
+            std::cerr << "[ERROR] Cannot restore the HSMP power limit of socket " << socket << "\n";
+            isRestored = false;
+        }
+    }
+    if (isRestored)
+    {
+        PowerCapJournal::instance().markRestored(journalDeviceName_);
+    }
+    currentPowerLimitInWatts_ = 0.0;
+    for (auto limit : defaultSocketLimitsInMilliWatts_)
+    {
+        currentPowerLimitInWatts_ += limit / 1000.0;
+    }
+}
+
+bool AmdCpuDevice::readRaw(const EnergyCounter& counter, uint64_t& raw) const
+{
+    if (counter.msrOffset >= 0)
+    {
+        uint64_t data = 0;
+        if (::pread(counter.fd, &data, sizeof(data), counter.msrOffset) != sizeof(data))
+        {
+            return false;
+        }
+        raw = data & msrCounterMask;
+        return true;
+    }
+    char buffer[32];
+    const ssize_t length = ::pread(counter.fd, buffer, sizeof(buffer) - 1, 0);
+    if (length <= 0)
+    {
+        return false;
+    }
+    buffer[length] = '\0';
+    char* end = nullptr;
+    raw = std::strtoull(buffer, &end, 10);
+    return end != buffer;
+}
+
+void AmdCpuDevice::updateCounter(EnergyCounter& counter) const
+{
+    uint64_t raw = 0;
+    if (!readRaw(counter, raw))
+    {
+        return;
+    }
+    if (counter.msrOffset >= 0)
+    {
+        // unsigned 32-bit arithmetic handles a single wrap-around between two samples
+        counter.joules += ((raw - counter.lastRaw) & msrCounterMask) * msrEnergyUnitInJoules_;
+    }
+    else
+    {
+        // amd_energy accumulates to 64 bits, a smaller value means the driver was reloaded
+        counter.joules += (raw >= counter.lastRaw ? raw - counter.lastRaw : raw) / 1e6;
+    }
+    counter.lastRaw = raw;
+}
+
+double AmdCpuDevice::sumJoules(const std::vector<EnergyCounter>& counters)
+{
+    double joules = 0.0;
+    for (const auto& counter : counters)
+    {
+        joules += counter.joules;
+    }
+    return joules;
+}
+
+void AmdCpuDevice::triggerPowerApiSample()
+{
+    const auto now = clock_->now();
+    for (auto* counters : {&pkgCounters_, &coreCounters_})
+    {
+        for (auto& counter : *counters)
+        {
+            updateCounter(counter);
+        }
+    }
+    const double pkgJoules = sumJoules(pkgCounters_);
+    const double coreJoules = sumJoules(coreCounters_);
+    if (lastSampleTime_.has_value())
+    {
+        const double seconds = std::chrono::duration<double>(now - *lastSampleTime_).count();
+        if (seconds > 0.0)
+        {
+            pkgPowerInWatts_ = (pkgJoules - lastPkgJoules_) / seconds;
+            corePowerInWatts_ = (coreJoules - lastCoreJoules_) / seconds;
+        }
+    }
+    lastSampleTime_ = now;
+    lastPkgJoules_ = pkgJoules;
+    lastCoreJoules_ = coreJoules;
+}
+
+double AmdCpuDevice::getCurrentPowerInWatts(std::optional<Domain> dom) const
+{
+    switch (dom.value_or(Domain::PKG))
+    {
+        case Domain::PKG:
+            return pkgPowerInWatts_;
+        case Domain::PP0:
+            return corePowerInWatts_;
+        default:
+            return 0.0;
+    }
+}
+
+void AmdCpuDevice::reset()
+{
+    pkgJoulesAtReset_ = lastPkgJoules_;
+    coreJoulesAtReset_ = lastCoreJoules_;
+    if (perfEventCounters_)
+    {
+        perfEventInstructionsAtReset_ = perfEventCounters_->read().instructions;
+    }
+}
+
+unsigned long long int AmdCpuDevice::getPerfCounter() const
+{
+    if (!perfEventCounters_)
+    {
+        return 0;
+    }
+    return (unsigned long long) ((perfEventCounters_->read().instructions - perfEventInstructionsAtReset_) / 1000000);
+}
+
+EnergyCrossDomains AmdCpuDevice::getEnergySinceResetPerDomain() const
+{
+    EnergyCrossDomains result;
+    result[Domain::PKG] = lastPkgJoules_ - pkgJoulesAtReset_;
+    if (!coreCounters_.empty())
+    {
+        result[Domain::PP0] = lastCoreJoules_ - coreJoulesAtReset_;
+    }
+    return result;
+}
+
+std::optional<EnergyCounterSample> AmdCpuDevice::getEnergyCounterSample() const
+{
+    if (!lastSampleTime_.has_value())
+    {
+        return std::nullopt;
+    }
+    EnergyCounterSample sample;
+    sample.energyInMicroJoules = static_cast<uint64_t>(std::llround(lastPkgJoules_ * 1e6));
+    sample.timestampInMicroSeconds = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(lastSampleTime_->time_since_epoch()).count());
+    return sample;
+}
@@ -15,6 +15,25 @@
 */
 
 #include "devices/cuda_device.hpp"
+#include "power_interface/nvml_frequency_actuator.hpp"
+#include "logging/startup_timer.hpp"
+#include "power_interface/power_cap_journal.hpp"
+#include "perf_counter_interfaces/progress_metric.hpp"
+
+#include <cmath>
+
+// NVML power limits of a journal, also those of MultiCudaDevice (see PowerCapJournal)
+static bool restoreNvmlPowerLimit(const PowerCapJournal::Record& record)
+{
+    static const bool isNvmlInitialized = NVML_SUCCESS == nvmlInit();
+    nvmlDevice_t handle;
+    return isNvmlInitialized
+        && NVML_SUCCESS == nvmlDeviceGetHandleByIndex(std::stoul(record.target), &handle)
+        && NVML_SUCCESS == nvmlDeviceSetPowerManagementLimit(handle, static_cast<unsigned>(record.value));
+}
+
+[[maybe_unused]] static const bool isNvmlRestorerRegistered =
+    PowerCapJournal::registerRestorer(PowerCapJournal::Backend::NVML, restoreNvmlPowerLimit);
 
 static inline
 void logCurrentRangeGSS(int a, int leftCandidateInMilliWatts, int rightCandidateInMilliWatts, int b)
@@ -82,31 +101,11 @@ CudaDevice::CudaDevice(int devID) :
     deviceID_(devID) // and then this field shall not be a member of this class as the API allows for access to any device
 {
     std::cout << "[DEBUG]: CudaDevice constructor called!\n";
-    int major;
-    CUresult result;
-    CUdevice device {deviceID_};
-
-    result = cuInit(0);
-    if (result != CUDA_SUCCESS)
-    {
-        printf("Error code %d on cuInit\n", result);
-        exit(-1);
-    }
-    result = cuDeviceGet(&device,0);
-    if (result != CUDA_SUCCESS)
-    {
-        printf("Error code %d on cuDeviceGet\n", result);
-        exit(-1);
-    }
-
-    result = cuDeviceGetAttribute (&major, CU_DEVICE_ATTRIBUTE_COMPUTE_CAPABILITY_MAJOR, device);
-    if (result != CUDA_SUCCESS)
-    {
-        printf("Error code %d on cuDeviceGetAttribute\n", result);
-        exit(-1);
-    }
-    // NVML INITIALIZATIONS
-    nvResult_ = nvmlInit();
+    // Only NVML is needed for power management and monitoring - the CUDA driver (cuInit
+    // creates no context but loads and initializes the whole driver) is left to the
+    // application and the injection library.
+    StartupTimer timer("CudaDevice");
+    timer.measure("nvmlInit", [this] { nvResult_ = nvmlInit(); });
     if (NVML_SUCCESS != nvResult_)
     {
         printf("Failed to initialize NVML: %s\n", nvmlErrorString(nvResult_));
@@ -119,9 +118,14 @@ CudaDevice::CudaDevice(int devID) :
         return;
     }
     printf("Found %d device%s\n\n", deviceCount_, deviceCount_ != 1 ? "s" : "");
-    initDeviceHandles();
+    timer.measure("initDeviceHandles", [this] { initDeviceHandles(); });
     std::cout << "DEBUG device handles initialized succesfully" << std::endl;
+    // caps left by a killed process are restored before the default is read
+    timer.measure("PowerCapJournal", [] { PowerCapJournal::instance(); });
     defaultPowerLimitInWatts_ = this->getPowerLimitInWatts();
+    PowerCapJournal::instance().recordOriginal(getJournalDeviceName(), PowerCapJournal::Backend::NVML,
+                                               std::to_string(deviceID_), std::lround(defaultPowerLimitInWatts_ * 1000));
+    timer.report();
 }
 
 double CudaDevice::getPowerLimitInWatts() const
@@ -163,7 +167,11 @@ std::pair<unsigned, unsigned> CudaDevice::getMinMaxLimitInWatts() const
 void CudaDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
 {
     unsigned long limitInMilliWatts = limitInMicroW / 1e3;
-    nvmlReturn_t nvResult = nvmlDeviceSetPowerManagementLimit (deviceHandles_[deviceID_], limitInMilliWatts);
+    nvmlReturn_t nvResult;
+    PowerCapJournal::instance().apply(getJournalDeviceName(), PowerCapJournal::Backend::NVML, std::to_string(deviceID_),
+                                      limitInMilliWatts, [&] {
+        nvResult = nvmlDeviceSetPowerManagementLimit (deviceHandles_[deviceID_], limitInMilliWatts);
+    });
     if (NVML_SUCCESS != nvResult)
     {
         printf("Failed to SET current power limit %ld [mW]: %s\n", limitInMilliWatts, nvmlErrorString(nvResult));
@@ -193,19 +201,22 @@ double CudaDevice::getCurrentPowerInWatts(std::optional<Domain>) const
 
 void CudaDevice::initDeviceHandles()
 {
+    // getting a handle initializes the GPU in NVML, so only the used one is requested
     nvmlDevice_t nvDevice;
     nvmlReturn_t nvResult;
     deviceHandles_.resize(deviceCount_);
-    for (unsigned i = 0; i < deviceCount_; i++)
+    if (deviceID_ < 0 || (unsigned)deviceID_ >= deviceCount_)
     {
-        nvResult = nvmlDeviceGetHandleByIndex(i, &nvDevice);
-        if (NVML_SUCCESS != nvResult)
-        {
-            printf("Failed to get handle for device 1: %s\n", nvmlErrorString(nvResult));
-            return;
-        }
-        deviceHandles_[i] = nvDevice;
+        printf("Device %d not found\n", deviceID_);
+        exit(-1);
     }
+    nvResult = nvmlDeviceGetHandleByIndex(deviceID_, &nvDevice);
+    if (NVML_SUCCESS != nvResult)
+    {
+        printf("Failed to get handle for device %d: %s\n", deviceID_, nvmlErrorString(nvResult));
+        return;
+    }
+    deviceHandles_[deviceID_] = nvDevice;
 }
 
 unsigned long long int CudaDevice::getPerfCounter() const
@@ -223,5 +234,39 @@ unsigned long long int CudaDevice::getPerfCounter() const
 void CudaDevice::restoreDefaultLimits()
 {
     setPowerLimitInMicroWatts(1e6 * defaultPowerLimitInWatts_);
+    PowerCapJournal::instance().markRestored(getJournalDeviceName());
+}
 
+std::shared_ptr<FrequencyActuator> CudaDevice::getFrequencyActuator(FrequencyDomain domain)
+{
+    if (domain != FrequencyDomain::CORE)
+    {
+        return nullptr;
+    }
+    if (!frequencyActuator_)
+    {
+        frequencyActuator_ = std::make_shared<NvmlFrequencyActuator>(deviceHandles_[deviceID_]);
+    }
+    return frequencyActuator_;
+}
+
+std::optional<WorkloadProfile> CudaDevice::endWorkloadProfiling()
+{
+    // NVML utilization rates are already averaged by the driver over its last sample period
+    nvmlUtilization_t utilization;
+    nvmlReturn_t nvResult = nvmlDeviceGetUtilizationRates(deviceHandles_[deviceID_], &utilization);
+    if (NVML_SUCCESS != nvResult)
+    {
+        printf("Failed to get utilization rates: %s\n", nvmlErrorString(nvResult));
+        return std::nullopt;
+    }
+    WorkloadProfile profile;
+    profile.computeUtilization_ = utilization.gpu;
+    profile.memoryUtilization_ = utilization.memory;
+    return profile;
+}
+
+std::shared_ptr<ProgressMetric> CudaDevice::makeDeviceProgressMetric(const std::string& name)
+{
+    return name == "gpu_busy" ? makeInjectionBusyTimeMetric() : nullptr;
 }
@@ -0,0 +1,49 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/frequency_axis_device.hpp"
+
+FrequencyAxisDevice::FrequencyAxisDevice(std::shared_ptr<Device> device, std::shared_ptr<FrequencyActuator> actuator) :
+    device_(device),
+    actuator_(actuator)
+{
+}
+
+std::string FrequencyAxisDevice::getName() const
+{
+    return device_->getName() + " (" + actuator_->getName() + ")";
+}
+
+std::pair<unsigned, unsigned> FrequencyAxisDevice::getMinMaxLimitInWatts() const
+{
+    auto [minInMHz, maxInMHz] = actuator_->getMinMaxFrequencyInMHz();
+    return std::make_pair(minInMHz / MHZ_PER_LIMIT_UNIT, maxInMHz / MHZ_PER_LIMIT_UNIT);
+}
+
+double FrequencyAxisDevice::getPowerLimitInWatts() const
+{
+    return (double)actuator_->getFrequencyLimitInMHz() / MHZ_PER_LIMIT_UNIT;
+}
+
+void FrequencyAxisDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
+{
+    actuator_->setFrequencyLimitInMHz(toFrequencyInMHz(limitInMicroW));
+}
+
+unsigned FrequencyAxisDevice::toFrequencyInMHz(unsigned long limitInMicroUnits)
+{
+    return limitInMicroUnits * MHZ_PER_LIMIT_UNIT / 1000000;
+}
@@ -0,0 +1,96 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/idle_power_meter.hpp"
+#include "data_structures/data_filter.hpp"
+#include "params_config.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+
+IdlePowerEntry measureIdlePower(Device& device, const std::string& cacheKey, bool withDram, const std::string& deviceLabel)
+{
+    int idleCheckTimeSeconds = 10;
+    int msPause = 100;
+    std::string cacheFile;
+    long cacheExpiryInSeconds = 0;
+    try {
+        ParamsConfig cfg(false);
+        idleCheckTimeSeconds = cfg.idleCheckTime_;
+        msPause = cfg.msPause_;
+        cacheFile = cfg.idlePowerCacheFile_;
+        cacheExpiryInSeconds = cfg.idlePowerCacheExpiry_;
+    } catch (const std::exception& e) {
+        std::cerr << "[WARNING] config.yaml not loaded (" << e.what() << "), idle power is measured with defaults\n";
+    }
+
+    IdlePowerCache cache(cacheKey.empty() ? std::string() : cacheFile, cacheExpiryInSeconds);
+    if (auto cached = cache.lookup(cacheKey)) {
+        std::cout << std::fixed << std::setprecision(3)
+                  << "\n[INFO] " << deviceLabel << " idle average power consumption for CPU PKG domain is " << cached->pkgPowerInWatts
+                  << " W (cached in " << cacheFile << ")\n";
+        return *cached;
+    }
+
+    // the measurement ends early once the power readings of the last 2 seconds are stable
+    constexpr int minCheckTimeInMilliSeconds = 2000;
+    constexpr double maxRelativeErrorOfStableIdle = 0.1;
+    const unsigned filterSize = std::max(2, minCheckTimeInMilliSeconds / msPause);
+    DataFilter filter(filterSize);
+
+    std::cout << "\nChecking idle average power consumption for up to " << idleCheckTimeSeconds << "s.\n";
+    double energy = 0.0;
+    double dramEnergy = 0.0;
+    device.reset();
+    auto clock = device.getClock();
+    const auto start = clock->now();
+    unsigned samples = 0;
+    for (auto i = 0; i < idleCheckTimeSeconds * 1000; i += msPause)
+    {
+        if (!(i%1000)) std::cout << "." << std::flush;
+        auto tmp = clock->now();
+        clock->sleepForMicroSeconds(msPause * 1000);
+        device.triggerPowerApiSample();
+        auto timeDeltaMs = std::chrono::duration_cast<std::chrono::milliseconds>(clock->now() - tmp).count();
+        const double power = device.getCurrentPowerInWatts(std::nullopt);
+        energy += timeDeltaMs * power / 1000;
+        if (withDram) {
+            dramEnergy += timeDeltaMs * device.getCurrentPowerInWatts(Domain::DRAM) / 1000;
+        }
+        filter.storeDataPoint(power);
+        // constant readings (0 / 0 relative error) are stable as well
+        if (++samples >= filterSize && !(filter.getCleanedRelativeError() >= maxRelativeErrorOfStableIdle)) {
+            break;
+        }
+    }
+    double totalTimeInSeconds = std::chrono::duration<double>(clock->now() - start).count();
+    std::cout << "\r";
+    IdlePowerEntry idle;
+    idle.pkgPowerInWatts = totalTimeInSeconds > 0.0 ? energy / totalTimeInSeconds : 0.0;
+    idle.dramPowerInWatts = totalTimeInSeconds > 0.0 ? dramEnergy / totalTimeInSeconds : 0.0;
+    idle.measuredAt = std::time(nullptr);
+    std::cout << std::fixed << std::setprecision(3)
+              << "\n[INFO] " << deviceLabel << " idle average power consumption for CPU PKG domain is " << idle.pkgPowerInWatts
+              << " W (measured for " << totalTimeInSeconds << " s)\n";
+    if (withDram) {
+        std::cout << "[INFO] " << deviceLabel << " idle average power consumption for DRAM domain is " << idle.dramPowerInWatts << " W\n";
+    }
+    cache.store(cacheKey, idle);
+    return idle;
+}
@@ -16,13 +16,20 @@
 
 #include "devices/intel_device.hpp"
 #include "devices/common_const_intel.hpp"
+#include "power_interface/intel_frequency_actuator.hpp"
+#include "perf_counter_interfaces/pcm_fp_ops_metric.hpp"
+#include "devices/idle_power_meter.hpp"
+#include "power_interface/power_cap_journal.hpp"
+#include "logging/startup_timer.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <sstream>
 #include <iostream>
 #include <fstream>
 #include <boost/filesystem.hpp>
 #include <chrono>
+#include <future>
 
 
 #define MAX_CPUS		1024
@@ -54,17 +61,35 @@ static inline void writeLimitToFile (std::string fileName, int limit) {
     outfile.close();
 }
 
-IntelDevice::IntelDevice()
+IntelDevice::IntelDevice(CpuPerfCounterBackend backend)
 {
-    detectCPU();
-    detectPackages();
-    detectPowerCapsAvailability();
-    prepareRaplDirsFromAvailableDomains();
-    readAndStoreDefaultLimits();
+    StartupTimer timer("IntelDevice");
+    // caps left by a killed process are restored before the defaults are read
+    timer.measure("PowerCapJournal", [] { PowerCapJournal::instance(); });
+    // /proc/cpuinfo and sysfs topology are independent probes
+    auto packagesDetection = std::async(std::launch::async, [&] {
+        timer.measure("detectPackages", [this] { detectPackages(); });
+    });
+    timer.measure("detectCPU", [this] { detectCPU(); });
+    packagesDetection.get();
+
+    // performance counters (one perf_event group per CPU) do not depend on RAPL setup
+    auto countersInit = std::async(std::launch::async, [&] {
+        timer.measure("initPerformanceCounters", [this, backend] { initPerformanceCounters(backend); });
+    });
+    timer.measure("detectPowerCapsAvailability", [this] { detectPowerCapsAvailability(); });
+    timer.measure("prepareRaplDirsFromAvailableDomains", [this] { prepareRaplDirsFromAvailableDomains(); });
+    timer.measure("readAndStoreDefaultLimits", [this] { readAndStoreDefaultLimits(); });
     currentPowerLimitInWatts_ = totalPackages_ * raplDefaultCaps_.defaultConstrPKG_->longPower/ 1e6;
-    initPerformanceCounters();
-    initRaplObjectsForEachPKG();
-    checkIdlePowerConsumption();
+    if (devicePowerProfile_.dram_) {
+        currentDramPowerLimitInWatts_ = raplDirs_.dramDirs_.size() * raplDefaultCaps_.defaultConstrDRAM_->powerLimit / 1e6;
+    }
+    countersInit.get();
+
+    timer.measure("initRaplObjectsForEachPKG", [this] { initRaplObjectsForEachPKG(); });
+    timer.measure("checkIdlePowerConsumption", [this] { checkIdlePowerConsumption(); });
+    timer.measure("readDramPowerRange", [this] { readDramPowerRange(); });
+    timer.report();
 }
 
 void IntelDevice::initRaplObjectsForEachPKG()
@@ -90,6 +115,11 @@ std::pair<unsigned, unsigned> IntelDevice::getMinMaxLimitInWatts() const
     // that CPU working above TDP would require much more cooling and would throttle much faster.
     //
     // For MIN power it returns idle power consumption mesured for the CPU PKG at the object creation.
+    //
+    // During DRAM search session the range prepared by readDramPowerRange() is returned instead.
+    if (searchedDomain_ == Domain::DRAM) {
+        return std::make_pair(dramMinMaxPowerInWatts_.first, dramMinMaxPowerInWatts_.second);
+    }
     return std::make_pair(idlePowerConsumption_, (totalPackages_ * raplDefaultCaps_.defaultConstrPKG_->longPower) / 1000000);
 }
 
@@ -121,7 +151,7 @@ void IntelDevice::detectCPU() {
 			sscanf(result,"%*s%*s%s", vendor);
 
 			if (strncmp(vendor, "GenuineIntel", 12)) {
-				printf("%s not an Intel chip\n", vendor);
+				printf("%s not an Intel chip, AMD CPUs are supported by AmdCpuDevice\n", vendor);
 			}
 		}
 		if (!strncmp(result,"cpu family",10)) {
@@ -159,15 +189,17 @@ void IntelDevice::detectPackages() {
 	FILE *fff;
 	int package;
 	std::stringstream filenameStream;
+	// printed at once as it runs concurrently with detectCPU()
+	std::stringstream topology;
 
-	printf("\t");
+	topology << "\t";
 	for(int i = 0; i < MAX_CPUS; i++) {
 		filenameStream << "/sys/devices/system/cpu/cpu" << i << "/topology/physical_package_id";
 		fff = fopen(filenameStream.str().c_str(), "r");
 		if (fff == NULL) break;
 		fscanf(fff, "%d", &package);
-		printf("%d (%d)", i, package);
-		if (i % 8 == 7) printf("\n\t"); else printf(", ");
+		topology << i << " (" << package << ")";
+		if (i % 8 == 7) topology << "\n\t"; else topology << ", ";
 		fclose(fff);
 
 		if (pkgToFirstCoreMap_.size() <= package) {
@@ -178,9 +210,8 @@ void IntelDevice::detectPackages() {
 		totalCores_++;
 	}
 
-	printf("\n");
-
-	printf("\tDetected %d cores in %d packages\n\n", totalCores_, totalPackages_);
+	topology << "\n\tDetected " << totalCores_ << " cores in " << totalPackages_ << " packages\n\n";
+	std::cout << topology.str();
 }
 
 std::string IntelDevice::mapCpuFamilyName(int model) const
@@ -310,11 +341,86 @@ void IntelDevice::prepareRaplDirsFromAvailableDomains()
     }
 }
 
-bool IntelDevice::isDomainAvailable(Domain dom)
+bool IntelDevice::isDomainAvailable(Domain dom) const
 {
 	return devicePowerProfile_.availableDomainsSet_.find(dom) != devicePowerProfile_.availableDomainsSet_.end();
 }
 
+bool IntelDevice::isCappableDomain(Domain dom) const
+{
+    switch (dom) {
+        case Domain::PKG :
+            return true;
+        case Domain::DRAM :
+            return isDomainAvailable(Domain::DRAM)
+                && !raplDirs_.dramDirs_.empty()
+                && dramMinMaxPowerInWatts_.second > dramMinMaxPowerInWatts_.first;
+        default :
+            // PP0/PP1 limits are still writable through setPowerLimitInMicroWatts(limit, dom)
+            // but they are not exposed for searching
+            return false;
+    }
+}
+
+void IntelDevice::beginDomainSearchSession(Domain dom)
+{
+    if (!isCappableDomain(dom)) {
+        std::cerr << "[WARNING] " << dom << " domain cannot be limited on this CPU, search session ignored.\n";
+        return;
+    }
+    searchedDomain_ = dom;
+}
+
+std::shared_ptr<FrequencyActuator> IntelDevice::getFrequencyActuator(FrequencyDomain domain)
+{
+    auto it = frequencyActuators_.find(domain);
+    if (it != frequencyActuators_.end()) {
+        return it->second;
+    }
+    std::shared_ptr<FrequencyActuator> actuator;
+    switch (domain) {
+        case FrequencyDomain::CORE :
+            actuator = std::make_shared<IntelCoreFrequencyActuator>(totalCores_);
+            break;
+        case FrequencyDomain::UNCORE :
+            // MSR_UNCORE_RATIO_LIMIT is available on server parts since Haswell-EP
+            switch (model_) {
+                case CPU_HASWELL_EP:
+                case CPU_BROADWELL_EP:
+                case CPU_SKYLAKE_X:
+                case CPU_ICELAKE_SP:
+                    actuator = std::make_shared<IntelUncoreFrequencyActuator>(pkgToFirstCoreMap_);
+                    break;
+                default:
+                    std::cerr << "[WARNING] Uncore frequency control is not supported for " << getName() << "\n";
+                    break;
+            }
+            break;
+    }
+    frequencyActuators_[domain] = actuator;
+    return actuator;
+}
+
+void IntelDevice::readDramPowerRange()
+{
+    if (!devicePowerProfile_.dram_) {
+        return;
+    }
+    double minPower = 0.0, maxPower = 0.0;
+    for (auto&& rapl : raplVec_) {
+        minPower += rapl.dram_min_power();
+        maxPower += rapl.dram_max_power();
+    }
+    if (maxPower == 0.0) {
+        // some platforms leave MSR_DRAM_POWER_INFO empty - fall back to the default DRAM limit
+        maxPower = raplDirs_.dramDirs_.size() * raplDefaultCaps_.defaultConstrDRAM_->powerLimit / 1e6;
+    }
+    dramMinMaxPowerInWatts_ = std::make_pair(std::max(minPower, idleDramPowerConsumption_), maxPower);
+    std::cout << std::fixed << std::setprecision(3)
+              << "[INFO] IntelDevice DRAM power limit range is [" << dramMinMaxPowerInWatts_.first
+              << ", " << dramMinMaxPowerInWatts_.second << "] W\n";
+}
+
 void IntelDevice::readAndStoreDefaultLimits()
 {
     auto fileExists = boost::filesystem::exists(defaultLimitsFile_);
@@ -360,11 +466,40 @@ void IntelDevice::readAndStoreDefaultLimits()
     if (fs.is_open()) {
         fs.close();
     }
+
+    auto& journal = PowerCapJournal::instance();
+    auto recordOriginal = [this, &journal](const std::string& fileName, int value) {
+        journal.recordOriginal(journalDeviceName_, PowerCapJournal::Backend::SYSFS, fileName, value);
+    };
+    for (auto& currentPkgDir : raplDirs_.packagesDirs_) {
+        recordOriginal(currentPkgDir + raplDirs_.pl0dir_, raplDefaultCaps_.defaultConstrPKG_->longPower);
+        recordOriginal(currentPkgDir + raplDirs_.pl1dir_, raplDefaultCaps_.defaultConstrPKG_->shortPower);
+        recordOriginal(currentPkgDir + raplDirs_.window0dir_, raplDefaultCaps_.defaultConstrPKG_->longWindow);
+        recordOriginal(currentPkgDir + raplDirs_.window1dir_, raplDefaultCaps_.defaultConstrPKG_->shortWindow);
+    }
+    for (auto& currentPP0dir : raplDirs_.pp0Dirs_) {
+        recordOriginal(currentPP0dir + raplDirs_.pl0dir_, raplDefaultCaps_.defaultConstrPP0_->powerLimit);
+        recordOriginal(currentPP0dir + raplDirs_.window0dir_, raplDefaultCaps_.defaultConstrPP0_->timeWindow);
+        recordOriginal(currentPP0dir + raplDirs_.isEnabledDir_, raplDefaultCaps_.defaultConstrPP0_->isEnabled);
+    }
+    for (auto& currentPP1dir : raplDirs_.pp1Dirs_) {
+        recordOriginal(currentPP1dir + raplDirs_.pl0dir_, raplDefaultCaps_.defaultConstrPP1_->powerLimit);
+        recordOriginal(currentPP1dir + raplDirs_.window0dir_, raplDefaultCaps_.defaultConstrPP1_->timeWindow);
+        recordOriginal(currentPP1dir + raplDirs_.isEnabledDir_, raplDefaultCaps_.defaultConstrPP1_->isEnabled);
+    }
+    for (auto& currentDRAMdir : raplDirs_.dramDirs_) {
+        recordOriginal(currentDRAMdir + raplDirs_.pl0dir_, raplDefaultCaps_.defaultConstrDRAM_->powerLimit);
+        recordOriginal(currentDRAMdir + raplDirs_.window0dir_, raplDefaultCaps_.defaultConstrDRAM_->timeWindow);
+        recordOriginal(currentDRAMdir + raplDirs_.isEnabledDir_, raplDefaultCaps_.defaultConstrDRAM_->isEnabled);
+    }
 }
 
 void IntelDevice::restoreDefaultLimits ()
 {
     currentPowerLimitInWatts_ = totalPackages_ * raplDefaultCaps_.defaultConstrPKG_->longPower / 1e6;
+    if (devicePowerProfile_.dram_) {
+        currentDramPowerLimitInWatts_ = raplDirs_.dramDirs_.size() * raplDefaultCaps_.defaultConstrDRAM_->powerLimit / 1e6;
+    }
     //assume that both PKGs has the same limits
     for (auto& currentPkgDir : raplDirs_.packagesDirs_) {
         writeLimitToFile (currentPkgDir + raplDirs_.pl0dir_, raplDefaultCaps_.defaultConstrPKG_->longPower);
@@ -387,25 +522,29 @@ void IntelDevice::restoreDefaultLimits ()
         writeLimitToFile (currentDRAMdir + raplDirs_.window0dir_, raplDefaultCaps_.defaultConstrDRAM_->timeWindow);
         writeLimitToFile (currentDRAMdir + raplDirs_.isEnabledDir_, raplDefaultCaps_.defaultConstrDRAM_->isEnabled);
     }
+    PowerCapJournal::instance().markRestored(journalDeviceName_);
 }
 
 double IntelDevice::getPowerLimitInWatts() const
 {
-	return currentPowerLimitInWatts_;
+	return searchedDomain_ == Domain::DRAM ? currentDramPowerLimitInWatts_ : currentPowerLimitInWatts_;
 }
 
 void IntelDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
 {
-    Domain dom = PowerCapDomain::PKG; // TODO: the domain is hardcoded so that it can fit generic API for CPU and GPU
-                                      //       It should be considered to drop support for PP0, PP1 domains and to
-                                      //       have separate API for DRAM domain.
+    // generic API for CPU and GPU - PKG domain unless DRAM search session is active
+    setPowerLimitInMicroWatts(limitInMicroW, searchedDomain_);
+}
+
+void IntelDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW, Domain dom)
+{
     auto&& numPkgs = totalPackages_; // packagesDirs_.size();
     auto singlePKGcap = limitInMicroW / numPkgs;
     switch (dom) {
         case PowerCapDomain::PKG :
             setLongTimeWindow(int(2*1e5)); // set to 200ms
             for (auto& curentPkgDir : raplDirs_.packagesDirs_) {
-                writeLimitToFile(curentPkgDir + raplDirs_.pl0dir_, singlePKGcap);
+                writeCapToFile(curentPkgDir + raplDirs_.pl0dir_, singlePKGcap);
                 //TODO: rework below temporary solution
                 //      move current cap to power interface class
                 //      along with this whole method setPowerCap
@@ -414,34 +553,72 @@ void IntelDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
             break;
         case PowerCapDomain::PP0 :
             for (auto& curentPP0dir : raplDirs_.pp0Dirs_) {
-                writeLimitToFile(curentPP0dir + raplDirs_.pl0dir_, limitInMicroW);
-                writeLimitToFile(curentPP0dir + raplDirs_.isEnabledDir_, 1);
+                writeCapToFile(curentPP0dir + raplDirs_.pl0dir_, limitInMicroW);
+                writeCapToFile(curentPP0dir + raplDirs_.isEnabledDir_, 1);
             }
             break;
         case PowerCapDomain::PP1 :
             for (auto& curentPP1dir : raplDirs_.pp1Dirs_) {
-                writeLimitToFile(curentPP1dir + raplDirs_.pl0dir_, limitInMicroW);
-                writeLimitToFile(curentPP1dir + raplDirs_.isEnabledDir_, 1);
+                writeCapToFile(curentPP1dir + raplDirs_.pl0dir_, limitInMicroW);
+                writeCapToFile(curentPP1dir + raplDirs_.isEnabledDir_, 1);
             }
             break;
         case PowerCapDomain::DRAM :
+            // as for PKG, the limit is given for the whole device and split evenly between the packages
             for (auto& curentDRAMdir : raplDirs_.dramDirs_) {
-                writeLimitToFile(curentDRAMdir + raplDirs_.pl0dir_, limitInMicroW);
-                writeLimitToFile(curentDRAMdir + raplDirs_.isEnabledDir_, 1);
+                writeCapToFile(curentDRAMdir + raplDirs_.pl0dir_, limitInMicroW / raplDirs_.dramDirs_.size());
+                writeCapToFile(curentDRAMdir + raplDirs_.isEnabledDir_, 1);
             }
+            currentDramPowerLimitInWatts_ = (double)limitInMicroW / 1000000;
             break;
         default :
             break;
     }
 }
 
+void IntelDevice::writeCapToFile(const std::string& fileName, int value)
+{
+    PowerCapJournal::instance().apply(journalDeviceName_, PowerCapJournal::Backend::SYSFS, fileName, value,
+                                      [&] { writeLimitToFile(fileName, value); });
+}
+
 void IntelDevice::setLongTimeWindow(int longTimeWindow) {
     for (auto& curentPkgDir : raplDirs_.packagesDirs_) {
-        writeLimitToFile (curentPkgDir + raplDirs_.window0dir_, longTimeWindow);
+        writeCapToFile (curentPkgDir + raplDirs_.window0dir_, longTimeWindow);
+    }
+}
+
+void IntelDevice::initPerformanceCounters(CpuPerfCounterBackend backend)
+{
+    if (backend == CpuPerfCounterBackend::PERF_EVENT)
+    {
+        perfEventCounters_ = std::make_unique<PerfEventCounters>();
+        if (perfEventCounters_->isOpen())
+        {
+            return;
+        }
+        std::cerr << "[WARNING] perf_event counters unavailable, using PCM for instructions retired\n";
+        perfEventCounters_.reset();
+    }
+    initPcm();
+}
+
+pcm::PCM* IntelDevice::getPcm()
+{
+    if (pcm_ == nullptr)
+    {
+        // PCM programs the PMU directly, behind the back of perf_event - hand the
+        // instructions count over to PCM keeping the value accumulated since reset
+        instructionsBeforePcmSwitch_ = getNumInstructionsSinceReset() * 1000000;
+        perfEventCounters_.reset();
+        initPcm();
+        std::vector<pcm::SocketCounterState> dummySocketStates;
+        pcm_->getAllCounterStates(sysBeforeState_, dummySocketStates, beforeState_);
     }
+    return pcm_;
 }
 
-void IntelDevice::initPerformanceCounters()
+void IntelDevice::initPcm()
 {
     pcm_ = pcm::PCM::getInstance();
     std::cerr << "\n Resetting PMU configuration" << std::endl;
@@ -475,18 +652,83 @@ void IntelDevice::reset()
     {
         rapl.reset();
     }
+    instructionsBeforePcmSwitch_ = 0.0;
+    if (perfEventCounters_)
+    {
+        perfEventInstructionsAtReset_ = perfEventCounters_->read().instructions;
+        return;
+    }
     std::vector<pcm::SocketCounterState> dummySocketStates_;
 
     pcm_->getAllCounterStates(sysBeforeState_, dummySocketStates_, beforeState_);
 }
 
+EnergyCrossDomains IntelDevice::getEnergySinceResetPerDomain() const
+{
+    EnergyCrossDomains result;
+    for (auto&& rapl : raplVec_)
+    {
+        const auto raplEnergy = rapl.getTotalEnergy();
+        for (auto&& dom : devicePowerProfile_.availableDomainsSet_)
+        {
+            result[dom] += raplEnergy.at(dom);
+        }
+    }
+    return result;
+}
+
 double IntelDevice::getNumInstructionsSinceReset() const
 {
+    if (perfEventCounters_)
+    {
+        return (perfEventCounters_->read().instructions - perfEventInstructionsAtReset_) / 1000000;
+    }
     pcm::SystemCounterState sysAfterState_;
     std::vector<pcm::CoreCounterState> afterState_;
     std::vector<pcm::SocketCounterState> dummySocketStates_;
     pcm_->getAllCounterStates(sysAfterState_, dummySocketStates_, afterState_);
-	return (double)getInstructionsRetired(sysBeforeState_, sysAfterState_)/1000000;
+	return (instructionsBeforePcmSwitch_ + getInstructionsRetired(sysBeforeState_, sysAfterState_))/1000000;
+}
+
+void IntelDevice::beginWorkloadProfiling()
+{
+    std::vector<pcm::CoreCounterState> dummyCoreStates;
+    std::vector<pcm::SocketCounterState> dummySocketStates;
+    getPcm()->getAllCounterStates(workloadProfilingBeforeState_, dummySocketStates, dummyCoreStates);
+    workloadProfilingStart_ = getClock()->now();
+}
+
+std::optional<WorkloadProfile> IntelDevice::endWorkloadProfiling()
+{
+    pcm::SystemCounterState afterState;
+    std::vector<pcm::CoreCounterState> dummyCoreStates;
+    std::vector<pcm::SocketCounterState> dummySocketStates;
+    getPcm()->getAllCounterStates(afterState, dummySocketStates, dummyCoreStates);
+    const double seconds = std::chrono::duration<double>(getClock()->now() - workloadProfilingStart_).count();
+    const double instructions = getInstructionsRetired(workloadProfilingBeforeState_, afterState);
+    if (seconds <= 0.0 || instructions <= 0.0)
+    {
+        return std::nullopt;
+    }
+    const double bytes = getBytesReadFromMC(workloadProfilingBeforeState_, afterState)
+                       + getBytesWrittenToMC(workloadProfilingBeforeState_, afterState);
+    WorkloadProfile profile;
+    profile.ipc_ = getIPC(workloadProfilingBeforeState_, afterState);
+    profile.bytesPerInstruction_ = bytes / instructions;
+    profile.memoryBandwidthInGBps_ = bytes / seconds / 1e9;
+    return profile;
+}
+
+std::shared_ptr<ProgressMetric> IntelDevice::makeDeviceProgressMetric(const std::string& name)
+{
+    if (name != "fp_ops")
+    {
+        return nullptr;
+    }
+    auto metric = std::make_shared<PcmFpOpsMetric>(getPcm());
+    // PCM was reprogrammed so the instructions baseline has to be taken again
+    reset();
+    return metric->isProgrammed() ? metric : nullptr;
 }
 
 unsigned long long int IntelDevice::getPerfCounter() const
@@ -503,27 +745,27 @@ void IntelDevice::triggerPowerApiSample()
     }
 }
 
+std::string IntelDevice::makeIdlePowerCacheKey() const
+{
+    char hostname[256] = {0};
+    gethostname(hostname, sizeof(hostname) - 1);
+    // changed default (BIOS) limits usually mean a changed platform configuration
+    std::stringstream key;
+    key << std::fixed << std::setprecision(0)
+        << hostname << "|" << getName() << "|model " << model_ << "|" << totalPackages_ << " pkg"
+        << "|PL1 " << raplDefaultCaps_.defaultConstrPKG_->longPower
+        << " PL2 " << raplDefaultCaps_.defaultConstrPKG_->shortPower
+        << " TW1 " << raplDefaultCaps_.defaultConstrPKG_->longWindow
+        << " TW2 " << raplDefaultCaps_.defaultConstrPKG_->shortWindow;
+    if (devicePowerProfile_.dram_) {
+        key << "|DRAM " << raplDefaultCaps_.defaultConstrDRAM_->powerLimit;
+    }
+    return key.str();
+}
+
 void IntelDevice::checkIdlePowerConsumption()
 {
-    // TODO: pass below two values through config file
-    int idleCheckTimeSeconds = 10;
-    int msPause = 100;
-    std::cout << "\nChecking idle average power consumption for " << idleCheckTimeSeconds << "s.\n";
-    double energy = 0.0;
-    reset();
-    const auto start = std::chrono::high_resolution_clock::now();
-    for (auto i = 0; i < idleCheckTimeSeconds * 1000; i += msPause)
-    {
-        if (!(i%1000)) std::cout << "." << std::flush;
-        auto tmp = std::chrono::high_resolution_clock::now();
-        usleep(msPause * 1000);
-        triggerPowerApiSample();
-        auto timeDeltaMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - tmp).count();
-        energy += timeDeltaMs * getCurrentPowerInWatts() / 1000;
-    }
-    double totalTimeInSeconds = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::high_resolution_clock::now() - start).count();
-    std::cout << "\r";
-    idlePowerConsumption_ = energy / totalTimeInSeconds;
-    std::cout << std::fixed << std::setprecision(3)
-              << "\n[INFO] IntelDevice idle average power consumption for CPU PKG domain is " << idlePowerConsumption_ << " W\n";
+    const auto idle = measureIdlePower(*this, makeIdlePowerCacheKey(), devicePowerProfile_.dram_, "IntelDevice");
+    idlePowerConsumption_ = idle.pkgPowerInWatts;
+    idleDramPowerConsumption_ = idle.dramPowerInWatts;
 }
\ No newline at end of file
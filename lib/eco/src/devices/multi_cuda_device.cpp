@@ -3,6 +3,9 @@
 */
 
 #include "devices/multi_cuda_device.hpp"
+#include "logging/startup_timer.hpp"
+#include "power_interface/power_cap_journal.hpp"
+#include "perf_counter_interfaces/progress_metric.hpp"
 
 #include <sstream>
 #include <algorithm>
@@ -10,17 +13,19 @@
 #include <climits>
 #include <cstdlib>
 #include <sys/stat.h>
+#include <future>
+
+static std::string journalDeviceName(int deviceID)
+{
+  return "gpu" + std::to_string(deviceID);
+}
 
 MultiCudaDevice::MultiCudaDevice(const std::vector<int>& deviceIds, bool asyncIndependentPerGpuCaps)
   : deviceIDs_(deviceIds), asyncIndependentPerGpuCaps_(asyncIndependentPerGpuCaps)
 {
-  // CUDA driver init to be consistent with single GPU path
-  CUresult cuRes = cuInit(0);
-  if (cuRes != CUDA_SUCCESS) {
-    std::cerr << "cuInit failed with code " << cuRes << "\n";
-  }
-
-  nvResult_ = nvmlInit();
+  // NVML only, the CUDA driver is not needed (see CudaDevice)
+  StartupTimer timer("MultiCudaDevice");
+  timer.measure("nvmlInit", [this] { nvResult_ = nvmlInit(); });
   if (NVML_SUCCESS != nvResult_)
   {
     std::cerr << "Failed to initialize NVML: " << nvmlErrorString(nvResult_) << "\n";
@@ -32,14 +37,20 @@ MultiCudaDevice::MultiCudaDevice(const std::vector<int>& deviceIds, bool asyncIn
     std::cerr << "Failed to query device count: " << nvmlErrorString(nvResult_) << "\n";
     return;
   }
-  initDeviceHandles();
+  timer.measure("initDeviceHandles", [this] { initDeviceHandles(); });
   validateHomogeneousModel();
+  // caps left by a killed process are restored before the defaults are read
+  timer.measure("PowerCapJournal", [] { PowerCapJournal::instance(); });
   defaultPowerLimitInWatts_.resize(deviceIDs_.size());
   for (size_t i = 0; i < deviceIDs_.size(); ++i)
   {
     unsigned currMw = 0;
     if (NVML_SUCCESS == nvmlDeviceGetEnforcedPowerLimit(deviceHandles_[deviceIDs_[i]], &currMw))
+    {
       defaultPowerLimitInWatts_[i] = static_cast<double>(currMw) / 1000.0;
+      PowerCapJournal::instance().recordOriginal(journalDeviceName(deviceIDs_[i]), PowerCapJournal::Backend::NVML,
+                                                 std::to_string(deviceIDs_[i]), currMw);
+    }
     else
       defaultPowerLimitInWatts_[i] = 0.0;
   }
@@ -52,6 +63,7 @@ MultiCudaDevice::MultiCudaDevice(const std::vector<int>& deviceIds, bool asyncIn
     else
       currentCapsMicroW_[i] = 0UL;
   }
+  timer.report();
 }
 
 // Local helper to read an integer value from a file; returns -1 if not available
@@ -73,17 +85,30 @@ static inline long long readValueFromFile(const std::string& fileName)
 
 void MultiCudaDevice::initDeviceHandles()
 {
+  // getting a handle initializes the GPU in NVML - only the selected GPUs, concurrently
   deviceHandles_.resize(deviceCount_);
-  for (unsigned i = 0; i < deviceCount_; ++i)
+  std::vector<std::future<void>> handles;
+  for (int id : deviceIDs_)
   {
-    nvmlDevice_t h;
-    nvmlReturn_t r = nvmlDeviceGetHandleByIndex(i, &h);
-    if (r != NVML_SUCCESS)
+    if (id < 0 || (unsigned)id >= deviceCount_)
     {
-      std::cerr << "Failed to get handle for device " << i << ": " << nvmlErrorString(r) << "\n";
+      std::cerr << "Device " << id << " not found\n";
       continue;
     }
-    deviceHandles_[i] = h;
+    handles.push_back(std::async(std::launch::async, [this, id] {
+      nvmlDevice_t h;
+      nvmlReturn_t r = nvmlDeviceGetHandleByIndex(id, &h);
+      if (r != NVML_SUCCESS)
+      {
+        std::cerr << "Failed to get handle for device " << id << ": " << nvmlErrorString(r) << "\n";
+        return;
+      }
+      deviceHandles_[id] = h;
+    }));
+  }
+  for (auto& handle : handles)
+  {
+    handle.get();
   }
 }
 
@@ -166,14 +191,22 @@ double MultiCudaDevice::getPowerLimitInWatts() const
   return static_cast<double>(currMw) / 1000.0;
 }
 
+nvmlReturn_t MultiCudaDevice::setJournaledPowerLimit(int deviceID, unsigned long limitInMilliWatts)
+{
+  nvmlReturn_t r;
+  PowerCapJournal::instance().apply(journalDeviceName(deviceID), PowerCapJournal::Backend::NVML,
+                                    std::to_string(deviceID), limitInMilliWatts,
+                                    [&] { r = nvmlDeviceSetPowerManagementLimit(deviceHandles_[deviceID], limitInMilliWatts); });
+  return r;
+}
+
 void MultiCudaDevice::applyPerGpuVectorMicroWatts_(const std::vector<unsigned long>& microWattsPerSubdevice)
 {
   currentCapsMicroW_ = microWattsPerSubdevice;
   for (size_t i = 0; i < deviceIDs_.size(); ++i)
   {
     unsigned long limitInMilliWatts = microWattsPerSubdevice[i] / 1000UL;
-    nvmlReturn_t r =
-        nvmlDeviceSetPowerManagementLimit(deviceHandles_[deviceIDs_[i]], limitInMilliWatts);
+    nvmlReturn_t r = setJournaledPowerLimit(deviceIDs_[i], limitInMilliWatts);
     if (r != NVML_SUCCESS)
     {
       std::cerr << "Failed to set power limit " << limitInMilliWatts << " mW for GPU " << deviceIDs_[i]
@@ -182,7 +215,7 @@ void MultiCudaDevice::applyPerGpuVectorMicroWatts_(const std::vector<unsigned lo
   }
 }
 
-void MultiCudaDevice::beginPerGpuSearchSession(size_t focusIndex, const std::vector<unsigned long>& baselineCapsMicroW)
+void MultiCudaDevice::beginSubdeviceSearchSession(size_t focusIndex, const std::vector<unsigned long>& baselineCapsMicroW)
 {
   if (!asyncIndependentPerGpuCaps_ || baselineCapsMicroW.size() != deviceIDs_.size())
   {
@@ -194,7 +227,7 @@ void MultiCudaDevice::beginPerGpuSearchSession(size_t focusIndex, const std::vec
   applyPerGpuVectorMicroWatts_(baselineCapsMicroW);
 }
 
-void MultiCudaDevice::endPerGpuSearchSession()
+void MultiCudaDevice::endSubdeviceSearchSession()
 {
   inPerGpuSearchSession_ = false;
 }
@@ -213,7 +246,7 @@ void MultiCudaDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
   currentCapsMicroW_.assign(deviceIDs_.size(), limitInMicroW);
   for (int id : deviceIDs_)
   {
-    nvmlReturn_t r = nvmlDeviceSetPowerManagementLimit(deviceHandles_[id], limitInMilliWatts);
+    nvmlReturn_t r = setJournaledPowerLimit(id, limitInMilliWatts);
     if (r != NVML_SUCCESS)
     {
       std::cerr << "Failed to set power limit " << limitInMilliWatts << " mW for GPU " << id
@@ -316,8 +349,13 @@ void MultiCudaDevice::restoreDefaultLimits()
     {
       std::cerr << "Failed to restore default power limit for GPU " << deviceIDs_[i]
                 << ": " << nvmlErrorString(r) << "\n";
+      continue;
     }
+    PowerCapJournal::instance().markRestored(journalDeviceName(deviceIDs_[i]));
   }
 }
 
-
+std::shared_ptr<ProgressMetric> MultiCudaDevice::makeDeviceProgressMetric(const std::string& name)
+{
+  return name == "gpu_busy" ? makeInjectionBusyTimeMetric() : nullptr;
+}
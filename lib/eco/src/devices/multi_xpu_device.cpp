@@ -0,0 +1,271 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/multi_xpu_device.hpp"
+#include "../../../src/logging.hpp"
+#include "logging/startup_timer.hpp"
+
+#include <sstream>
+#include <algorithm>
+#include <climits>
+#include <future>
+#include <stdexcept>
+
+MultiXPUDevice::MultiXPUDevice(const std::vector<int>& deviceIds, bool asyncIndependentPerCardCaps, bool useAmperes)
+  : deviceIDs_(deviceIds), asyncIndependentPerCardCaps_(asyncIndependentPerCardCaps)
+{
+    LOAD_ENV_LEVELS()
+
+    if (deviceIDs_.empty())
+    {
+        throw std::runtime_error("MultiXPUDevice: no XPU selected!");
+    }
+    StartupTimer timer("MultiXPUDevice");
+    cards_.resize(deviceIDs_.size());
+    // the first card sets up the Sysman environment and initializes Level Zero,
+    // the remaining ones only query their limits - concurrently
+    timer.measure("XPUDevice", [&] { cards_[0] = std::make_unique<XPUDevice>(deviceIDs_[0], useAmperes); });
+    timer.measure("XPUDevices", [&] {
+        std::vector<std::future<void>> cards;
+        for (size_t i = 1; i < deviceIDs_.size(); ++i)
+        {
+            cards.push_back(std::async(std::launch::async, [this, i, useAmperes] {
+                cards_[i] = std::make_unique<XPUDevice>(deviceIDs_[i], useAmperes);
+            }));
+        }
+        for (auto& card : cards)
+        {
+            card.get();
+        }
+    });
+    for (size_t i = 1; i < cards_.size(); ++i)
+    {
+        if (cards_[i]->getName() != cards_[0]->getName())
+        {
+            LOG_WARN("Selected XPUs have different models; proceeding but behavior may vary.");
+            break;
+        }
+    }
+    currentCapsMicroW_.resize(cards_.size());
+    for (size_t i = 0; i < cards_.size(); ++i)
+    {
+        currentCapsMicroW_[i] = static_cast<unsigned long>(cards_[i]->getPowerLimitInWatts() * 1e6);
+    }
+    timer.report();
+}
+
+std::string MultiXPUDevice::getName() const
+{
+    std::stringstream ss;
+    ss << cards_.front()->getName() << " x" << cards_.size();
+    return ss.str();
+}
+
+std::pair<unsigned, unsigned> MultiXPUDevice::getMinMaxLimitInWatts() const
+{
+    // Intersect min/max across all selected cards
+    unsigned globalMinW = 0;
+    unsigned globalMaxW = UINT_MAX;
+    for (const auto& card : cards_)
+    {
+        auto minMaxW = card->getMinMaxLimitInWatts();
+        globalMinW = std::max(globalMinW, minMaxW.first);
+        globalMaxW = std::min(globalMaxW, minMaxW.second);
+    }
+    if (globalMaxW < globalMinW) globalMaxW = globalMinW;
+    return {globalMinW, globalMaxW};
+}
+
+double MultiXPUDevice::getPowerLimitInWatts() const
+{
+    if (inPerCardSearchSession_ && searchFocusIndex_ < cards_.size())
+    {
+        return cards_[searchFocusIndex_]->getPowerLimitInWatts();
+    }
+    if (asyncIndependentPerCardCaps_ && cards_.size() > 1)
+    {
+        double sumW = 0.0;
+        for (const auto& card : cards_)
+        {
+            sumW += card->getPowerLimitInWatts();
+        }
+        return sumW / static_cast<double>(cards_.size());
+    }
+    return cards_.front()->getPowerLimitInWatts();
+}
+
+void MultiXPUDevice::setCardPowerLimit_(size_t card, unsigned long limitInMicroW)
+{
+    try
+    {
+        cards_[card]->setPowerLimitInMicroWatts(limitInMicroW);
+        currentCapsMicroW_[card] = limitInMicroW;
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR("Failed to set power limit {} uW for XPU {}: {}", limitInMicroW, deviceIDs_[card], e.what());
+    }
+}
+
+void MultiXPUDevice::applyPerCardVectorMicroWatts_(const std::vector<unsigned long>& microWattsPerSubdevice)
+{
+    for (size_t i = 0; i < cards_.size(); ++i)
+    {
+        setCardPowerLimit_(i, microWattsPerSubdevice[i]);
+    }
+}
+
+void MultiXPUDevice::beginSubdeviceSearchSession(size_t focusIndex, const std::vector<unsigned long>& baselineCapsMicroW)
+{
+    if (!asyncIndependentPerCardCaps_ || baselineCapsMicroW.size() != cards_.size())
+    {
+        return;
+    }
+    searchFocusIndex_ = focusIndex;
+    searchBaselineCapsMicroW_ = baselineCapsMicroW;
+    inPerCardSearchSession_ = true;
+    applyPerCardVectorMicroWatts_(baselineCapsMicroW);
+}
+
+void MultiXPUDevice::endSubdeviceSearchSession()
+{
+    inPerCardSearchSession_ = false;
+}
+
+void MultiXPUDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
+{
+    if (inPerCardSearchSession_ && searchFocusIndex_ < cards_.size())
+    {
+        // only the focused card moves, the others keep their baseline caps
+        setCardPowerLimit_(searchFocusIndex_, limitInMicroW);
+        return;
+    }
+    for (size_t i = 0; i < cards_.size(); ++i)
+    {
+        setCardPowerLimit_(i, limitInMicroW);
+    }
+}
+
+void MultiXPUDevice::setPowerLimitsPerGpuMicroWatts(const std::vector<unsigned long>& microWattsPerSubdevice)
+{
+    if (!asyncIndependentPerCardCaps_)
+    {
+        if (!microWattsPerSubdevice.empty())
+        {
+            setPowerLimitInMicroWatts(microWattsPerSubdevice.front());
+        }
+        return;
+    }
+    if (microWattsPerSubdevice.size() != cards_.size())
+    {
+        LOG_ERROR("MultiXPUDevice: expected {} per-card caps, got {}", cards_.size(), microWattsPerSubdevice.size());
+        return;
+    }
+    applyPerCardVectorMicroWatts_(microWattsPerSubdevice);
+}
+
+void MultiXPUDevice::reset()
+{
+    for (auto& card : cards_)
+    {
+        card->reset();
+    }
+}
+
+void MultiXPUDevice::triggerPowerApiSample()
+{
+    for (auto& card : cards_)
+    {
+        card->triggerPowerApiSample();
+    }
+
+    // The energy is the sum of the card counters. The cards timestamp their counters
+    // independently, so the combined timestamp advances by the longest card interval; it
+    // stays put when no counter was updated, which EnergyIntegrator then ignores.
+    lastCardTimestampsInMicroSeconds_.resize(cards_.size());
+    EnergyCounterSample sum;
+    uint64_t advanceInMicroSeconds = 0;
+    for (size_t i = 0; i < cards_.size(); i++)
+    {
+        const auto sample = cards_[i]->getEnergyCounterSample();
+        if (!sample.has_value())
+        {
+            // power of the cards is integrated by DeviceStateAccumulator then
+            lastEnergySample_ = std::nullopt;
+            return;
+        }
+        sum.energyInMicroJoules += sample->energyInMicroJoules;
+        auto& lastTimestamp = lastCardTimestampsInMicroSeconds_[i];
+        if (lastTimestamp.has_value() && sample->timestampInMicroSeconds > *lastTimestamp)
+        {
+            advanceInMicroSeconds = std::max(advanceInMicroSeconds, sample->timestampInMicroSeconds - *lastTimestamp);
+        }
+        lastTimestamp = sample->timestampInMicroSeconds;
+    }
+    combinedTimestampInMicroSeconds_ += advanceInMicroSeconds;
+    sum.timestampInMicroSeconds = combinedTimestampInMicroSeconds_;
+    lastEnergySample_ = sum;
+}
+
+double MultiXPUDevice::getCurrentPowerInWatts(std::optional<Domain>) const
+{
+    // Sum power across all selected cards
+    double sumW = 0.0;
+    for (const auto& card : cards_)
+    {
+        sumW += card->getCurrentPowerInWatts();
+    }
+    return sumW;
+}
+
+double MultiXPUDevice::getCurrentPowerInWattsForSubdevice(size_t index) const
+{
+    if (index >= cards_.size()) return 0.0;
+    return cards_[index]->getCurrentPowerInWatts();
+}
+
+double MultiXPUDevice::getPowerLimitInWattsForSubdevice(size_t index) const
+{
+    if (index >= cards_.size()) return -1.0;
+    return cards_[index]->getPowerLimitInWatts();
+}
+
+unsigned long long int MultiXPUDevice::getPerfCounter() const
+{
+    // XVE instructions of all cards, every card streams its own metrics
+    unsigned long long int sum = 0;
+    for (const auto& card : cards_)
+    {
+        sum += card->getPerfCounter();
+    }
+    return sum;
+}
+
+void MultiXPUDevice::restoreDefaultLimits()
+{
+    for (size_t i = 0; i < cards_.size(); ++i)
+    {
+        try
+        {
+            cards_[i]->restoreDefaultLimits();
+            currentCapsMicroW_[i] = static_cast<unsigned long>(cards_[i]->getPowerLimitInWatts() * 1e6);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("Failed to restore default power limit for XPU {}: {}", deviceIDs_[i], e.what());
+        }
+    }
+}
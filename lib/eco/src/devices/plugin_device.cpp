@@ -0,0 +1,299 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/plugin_device.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <dlfcn.h>
+
+#ifndef ECO_PLUGIN_DIR
+#define ECO_PLUGIN_DIR ""
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const std::string PLUGIN_PREFIX = "libeco_device_";
+const std::string PLUGIN_SUFFIX = ".so";
+
+std::vector<std::string> pluginDirectories()
+{
+    const char* env = std::getenv(ECO_PLUGIN_PATH_ENV);
+    std::stringstream ss((env != nullptr && env[0] != '\0') ? env : ECO_PLUGIN_DIR);
+    std::vector<std::string> dirs;
+    std::string dir;
+    while (std::getline(ss, dir, ':'))
+    {
+        if (!dir.empty()) dirs.push_back(dir);
+    }
+    return dirs;
+}
+
+/// Entry table of the plugin library \p path, nullptr (and \p error) when it cannot be loaded.
+const eco_device_v1* loadPlugin(const std::string& path, std::string& error)
+{
+    void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr)
+    {
+        error = dlerror();
+        return nullptr;
+    }
+    auto entry = reinterpret_cast<eco_device_v1_entry_fn>(dlsym(handle, ECO_DEVICE_V1_ENTRY));
+    const eco_device_v1* api = entry != nullptr ? entry() : nullptr;
+    if (api == nullptr || api->abi_version != ECO_DEVICE_ABI_VERSION)
+    {
+        error = path + ": not an eco_device_v" + std::to_string(ECO_DEVICE_ABI_VERSION) + " plugin";
+        // nothing of the library was run yet, so it can be unloaded
+        dlclose(handle);
+        return nullptr;
+    }
+    return api;
+}
+
+} // namespace
+
+PluginDevice::PluginDevice(const std::string& path, const std::string& options)
+{
+    std::string error;
+    api_ = loadPlugin(path, error);
+    if (api_ == nullptr)
+    {
+        throw std::runtime_error("Failed to load device plugin " + error);
+    }
+    device_ = api_->create(options.c_str());
+    if (device_ == nullptr)
+    {
+        throw std::runtime_error("Device plugin " + std::string(api_->name) + ": " + api_->last_error(nullptr));
+    }
+}
+
+PluginDevice::PluginDevice(const eco_device_v1* api, const std::string& options) : api_(api)
+{
+    device_ = api_->create(options.c_str());
+    if (device_ == nullptr)
+    {
+        throw std::runtime_error("Device plugin " + std::string(api_->name) + ": " + api_->last_error(nullptr));
+    }
+}
+
+PluginDevice::~PluginDevice()
+{
+    api_->destroy(device_);
+}
+
+std::vector<std::string> PluginDevice::discoverPlugins()
+{
+    std::vector<std::string> plugins;
+    for (const auto& dir : pluginDirectories())
+    {
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(dir, ec))
+        {
+            const auto file = entry.path().filename().string();
+            if (file.rfind(PLUGIN_PREFIX, 0) == 0 && file.size() > PLUGIN_SUFFIX.size()
+                && file.compare(file.size() - PLUGIN_SUFFIX.size(), PLUGIN_SUFFIX.size(), PLUGIN_SUFFIX) == 0)
+            {
+                plugins.push_back(entry.path().string());
+            }
+        }
+    }
+    std::sort(plugins.begin(), plugins.end());
+    return plugins;
+}
+
+std::shared_ptr<PluginDevice> PluginDevice::make(const std::string& name, const std::string& options)
+{
+    const bool autoSelect = (name == "auto");
+    const eco_device_v1* selected = nullptr;
+    std::string skipped;
+    for (const auto& path : discoverPlugins())
+    {
+        std::string error;
+        const eco_device_v1* api = loadPlugin(path, error);
+        if (api == nullptr)
+        {
+            skipped += "\n  " + error;
+            continue;
+        }
+        if (!autoSelect)
+        {
+            if (name == api->name)
+            {
+                selected = api;
+                break;
+            }
+            continue;
+        }
+        if (api->probe() != 1)
+        {
+            continue;
+        }
+        if (selected == nullptr || (std::string(selected->type) == "cpu" && std::string(api->type) != "cpu"))
+        {
+            selected = api;
+        }
+    }
+    if (selected == nullptr)
+    {
+        throw std::runtime_error("No device plugin \"" + name + "\" found in " ECO_PLUGIN_PATH_ENV "=\""
+                                 + (std::getenv(ECO_PLUGIN_PATH_ENV) ? std::getenv(ECO_PLUGIN_PATH_ENV) : ECO_PLUGIN_DIR)
+                                 + "\"" + (skipped.empty() ? "" : ", not loaded:" + skipped));
+    }
+    return std::shared_ptr<PluginDevice>(new PluginDevice(selected, options));
+}
+
+bool PluginDevice::load(const std::string& name)
+{
+    for (const auto& dir : pluginDirectories())
+    {
+        const auto path = dir + "/" + PLUGIN_PREFIX + name + PLUGIN_SUFFIX;
+        std::error_code ec;
+        if (!fs::exists(path, ec))
+        {
+            continue;
+        }
+        std::string error;
+        if (loadPlugin(path, error) != nullptr)
+        {
+            return true;
+        }
+        std::cerr << "Failed to load device plugin " << error << "\n";
+    }
+    return false;
+}
+
+void PluginDevice::warnOnError(int result, const char* call) const
+{
+    if (result != 0)
+    {
+        std::cerr << "Device plugin " << api_->name << " " << call << " failed: " << api_->last_error(device_) << "\n";
+    }
+}
+
+std::string PluginDevice::getName() const
+{
+    char name[128] = {0};
+    if (api_->get_name(device_, name, sizeof(name)) != 0)
+    {
+        return "Unknown " + getDeviceTypeString();
+    }
+    return name;
+}
+
+std::pair<unsigned, unsigned> PluginDevice::getMinMaxLimitInWatts() const
+{
+    unsigned minW = 0, maxW = 0;
+    warnOnError(api_->get_min_max_limit(device_, &minW, &maxW), "get_min_max_limit");
+    return {minW, maxW};
+}
+
+double PluginDevice::getPowerLimitInWatts() const
+{
+    return api_->get_power_limit(device_);
+}
+
+void PluginDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
+{
+    warnOnError(api_->set_power_limit(device_, limitInMicroW), "set_power_limit");
+}
+
+void PluginDevice::reset()
+{
+    warnOnError(api_->reset(device_), "reset");
+}
+
+unsigned long long int PluginDevice::getPerfCounter() const
+{
+    return api_->get_perf_counter(device_);
+}
+
+double PluginDevice::getCurrentPowerInWatts(std::optional<Domain> dom) const
+{
+    return api_->get_power(device_, dom.has_value() ? static_cast<int>(*dom) : ECO_DEVICE_DOMAIN_ALL);
+}
+
+void PluginDevice::restoreDefaultLimits()
+{
+    warnOnError(api_->restore_default_limits(device_), "restore_default_limits");
+}
+
+void PluginDevice::triggerPowerApiSample()
+{
+    warnOnError(api_->sample(device_), "sample");
+}
+
+std::optional<EnergyCounterSample> PluginDevice::getEnergyCounterSample() const
+{
+    EnergyCounterSample sample;
+    if (api_->get_energy_counter(device_, &sample.energyInMicroJoules, &sample.timestampInMicroSeconds) != 0)
+    {
+        return std::nullopt;
+    }
+    return sample;
+}
+
+size_t PluginDevice::getNumSubdevices() const
+{
+    return api_->get_num_subdevices(device_);
+}
+
+double PluginDevice::getCurrentPowerInWattsForSubdevice(size_t index) const
+{
+    return api_->get_subdevice_power(device_, index);
+}
+
+double PluginDevice::getPowerLimitInWattsForSubdevice(size_t index) const
+{
+    return api_->get_subdevice_power_limit(device_, index);
+}
+
+std::string PluginDevice::getSubdeviceLabel(size_t index) const
+{
+    char label[64] = {0};
+    if (api_->get_subdevice_label(device_, index, label, sizeof(label)) != 0)
+    {
+        return std::to_string(index);
+    }
+    return label;
+}
+
+bool PluginDevice::usesIndependentSubdevicePowerCaps() const
+{
+    return api_->has_independent_subdevice_caps(device_) == 1;
+}
+
+void PluginDevice::setPowerLimitsPerGpuMicroWatts(const std::vector<unsigned long>& microWattsPerSubdevice)
+{
+    warnOnError(api_->set_subdevice_power_limits(device_, microWattsPerSubdevice.data(), microWattsPerSubdevice.size()),
+                "set_subdevice_power_limits");
+}
+
+void PluginDevice::beginSubdeviceSearchSession(size_t focusIndex, const std::vector<unsigned long>& baselineCapsMicroW)
+{
+    warnOnError(api_->begin_subdevice_search(device_, focusIndex, baselineCapsMicroW.data(), baselineCapsMicroW.size()),
+                "begin_subdevice_search");
+}
+
+void PluginDevice::endSubdeviceSearchSession()
+{
+    warnOnError(api_->end_subdevice_search(device_), "end_subdevice_search");
+}
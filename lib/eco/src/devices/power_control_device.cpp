@@ -0,0 +1,322 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/power_control_device.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+PowerControlDevice::PowerControlDevice(const std::string& socketPath, std::shared_ptr<Clock> clock) :
+    clock_(std::move(clock))
+{
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("PowerControlDevice: socket path too long: " + socketPath);
+    }
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    socketFd_ = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (socketFd_ < 0 || ::connect(socketFd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        const std::string error = strerror(errno);
+        if (socketFd_ >= 0)
+        {
+            ::close(socketFd_);
+        }
+        throw std::runtime_error("PowerControlDevice: cannot connect to the power control helper at " + socketPath + ": " + error);
+    }
+
+    int snapshotFd = -1;
+    const auto results = transact({{static_cast<uint32_t>(PowerControlOp::HELLO), 0, 0}}, &snapshotFd);
+    struct stat snapshotStat {};
+    if (results.empty() || snapshotFd < 0 || ::fstat(snapshotFd, &snapshotStat) != 0
+        || static_cast<size_t>(snapshotStat.st_size) < sizeof(PowerControlSnapshot))
+    {
+        if (snapshotFd >= 0)
+        {
+            ::close(snapshotFd);
+        }
+        ::close(socketFd_);
+        throw std::runtime_error("PowerControlDevice: the power control helper at " + socketPath
+                                 + " refused the connection (is the cgroup of this process allowed?)");
+    }
+    void* mapping = ::mmap(nullptr, sizeof(PowerControlSnapshot), PROT_READ, MAP_SHARED, snapshotFd, 0);
+    ::close(snapshotFd);
+    if (mapping == MAP_FAILED)
+    {
+        const std::string error = strerror(errno);
+        ::close(socketFd_);
+        throw std::runtime_error("PowerControlDevice: cannot map the snapshot: " + error);
+    }
+    snapshot_ = static_cast<const PowerControlSnapshot*>(mapping);
+    std::cout << "\tpower control helper " << socketPath << ": " << getName() << "\n";
+
+    triggerPowerApiSample();
+    reset();
+}
+
+PowerControlDevice::~PowerControlDevice()
+{
+    ::munmap(const_cast<PowerControlSnapshot*>(snapshot_), sizeof(PowerControlSnapshot));
+    // the helper restores the caps of this connection once it is closed
+    ::close(socketFd_);
+}
+
+std::string PowerControlDevice::defaultSocketPath()
+{
+    const char* env_p = std::getenv("ECO_POWER_CONTROL_SOCKET");
+    return env_p != nullptr && *env_p != '\0' ? std::string(env_p) : std::string(powerControlDefaultSocketPath);
+}
+
+bool PowerControlDevice::shouldUseHelper(const std::string& socketPath)
+{
+    struct stat socketStat {};
+    return ::geteuid() != 0 && ::stat(socketPath.c_str(), &socketStat) == 0 && S_ISSOCK(socketStat.st_mode);
+}
+
+std::vector<PowerControlResult> PowerControlDevice::transact(const std::vector<PowerControlCommand>& commands, int* receivedFd)
+{
+    if (commands.empty() || commands.size() > powerControlMaxCommands)
+    {
+        throw std::invalid_argument("PowerControlDevice: 1 to " + std::to_string(powerControlMaxCommands)
+                                    + " commands per request");
+    }
+    PowerControlRequest request {};
+    request.magic = powerControlMagic;
+    request.version = powerControlVersion;
+    request.numCommands = static_cast<uint16_t>(commands.size());
+    std::copy(commands.begin(), commands.end(), request.commands);
+    const size_t requestSize = powerControlRequestSize(commands.size());
+    if (::send(socketFd_, &request, requestSize, MSG_NOSIGNAL) != static_cast<ssize_t>(requestSize))
+    {
+        return {};
+    }
+
+    PowerControlResponse response {};
+    iovec data {&response, sizeof(response)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+    msghdr message {};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t length;
+    do
+    {
+        length = ::recvmsg(socketFd_, &message, MSG_CMSG_CLOEXEC);
+    } while (length < 0 && errno == EINTR);
+
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); length > 0 && header != nullptr; header = CMSG_NXTHDR(&message, header))
+    {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(header), sizeof(fd));
+            if (receivedFd != nullptr)
+            {
+                *receivedFd = fd;
+            }
+            else
+            {
+                ::close(fd);
+            }
+        }
+    }
+    if (length <= 0 || response.magic != powerControlMagic || response.numResults != commands.size()
+        || static_cast<size_t>(length) != powerControlResponseSize(response.numResults))
+    {
+        return {};
+    }
+    return std::vector<PowerControlResult>(response.results, response.results + response.numResults);
+}
+
+std::string PowerControlDevice::getName() const
+{
+    return std::string(snapshot_->deviceName, strnlen(snapshot_->deviceName, sizeof(snapshot_->deviceName)));
+}
+
+std::string PowerControlDevice::getDeviceTypeString() const
+{
+    return std::string(snapshot_->deviceType, strnlen(snapshot_->deviceType, sizeof(snapshot_->deviceType)));
+}
+
+bool PowerControlDevice::isCappableDomain(Domain dom) const
+{
+    return static_cast<unsigned>(dom) < powerControlMaxDomains && (snapshot_->cappableDomainMask & (1u << dom));
+}
+
+bool PowerControlDevice::isMeasuredDomain(Domain dom) const
+{
+    return static_cast<unsigned>(dom) < powerControlMaxDomains && (snapshot_->measuredDomainMask & (1u << dom));
+}
+
+std::pair<unsigned, unsigned> PowerControlDevice::getMinMaxLimitInWatts() const
+{
+    if (!isCappableDomain(searchedDomain_))
+    {
+        return std::make_pair(0u, 0u);
+    }
+    return std::make_pair(snapshot_->minLimitInWatts[searchedDomain_], snapshot_->maxLimitInWatts[searchedDomain_]);
+}
+
+double PowerControlDevice::getPowerLimitInWatts() const
+{
+    if (!isCappableDomain(searchedDomain_))
+    {
+        return -1.0;
+    }
+    // the helper publishes new limits before it answers, no need to wait for the next sample
+    const auto reading = readPowerControlSnapshot(*snapshot_);
+    return (reading.has_value() ? *reading : lastReading_).powerLimitInMicroWatts[searchedDomain_] / 1e6;
+}
+
+void PowerControlDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
+{
+    // generic API for CPU and GPU - PKG domain unless a domain search session is active
+    setPowerLimitsInMicroWatts({{searchedDomain_, limitInMicroW}});
+}
+
+bool PowerControlDevice::setPowerLimitsInMicroWatts(const std::vector<std::pair<Domain, unsigned long>>& limits)
+{
+    std::vector<PowerControlCommand> commands;
+    for (const auto& [dom, limitInMicroW] : limits)
+    {
+        commands.push_back({static_cast<uint32_t>(PowerControlOp::SET_POWER_LIMIT), static_cast<uint32_t>(dom), limitInMicroW});
+    }
+    const auto results = transact(commands);
+    if (results.empty())
+    {
+        std::cerr << "[ERROR] Failed to SET power limits: the power control helper closed the connection\n";
+        return false;
+    }
+    bool succeeded = true;
+    for (size_t index = 0; index < results.size(); ++index)
+    {
+        if (results[index].status != 0)
+        {
+            std::cerr << "[ERROR] Failed to SET " << limits[index].first << " power limit " << limits[index].second
+                      << " [uW] through the power control helper: " << strerror(-results[index].status) << "\n";
+            succeeded = false;
+        }
+    }
+    return succeeded;
+}
+
+void PowerControlDevice::restoreDefaultLimits()
+{
+    const auto results = transact({{static_cast<uint32_t>(PowerControlOp::RESTORE_DEFAULT_LIMITS), 0, 0}});
+    if (results.empty() || results.front().status != 0)
+    {
+        std::cerr << "[ERROR] Failed to restore the default power limits through the power control helper: "
+                  << (results.empty() ? "connection closed" : strerror(-results.front().status)) << "\n";
+    }
+}
+
+bool PowerControlDevice::setNmiWatchdog(bool enabled)
+{
+    const auto results = transact({{static_cast<uint32_t>(PowerControlOp::SET_NMI_WATCHDOG), 0, enabled ? 1u : 0u}});
+    if (results.empty() || results.front().status != 0)
+    {
+        std::cerr << "[WARNING] Failed to set the NMI watchdog through the power control helper: "
+                  << (results.empty() ? "connection closed" : strerror(-results.front().status)) << "\n";
+        return false;
+    }
+    return true;
+}
+
+void PowerControlDevice::triggerPowerApiSample()
+{
+    const auto snapshotReading = readPowerControlSnapshot(*snapshot_);
+    if (!snapshotReading.has_value())
+    {
+        return; // the helper is stuck in an update, the last reading is kept
+    }
+    const auto& reading = *snapshotReading;
+    if (reading.timestampInMicroSeconds <= lastReading_.timestampInMicroSeconds)
+    {
+        return; // no new sample of the helper yet
+    }
+    if (lastReading_.timestampInMicroSeconds != 0)
+    {
+        const double seconds = (reading.timestampInMicroSeconds - lastReading_.timestampInMicroSeconds) / 1e6;
+        for (unsigned index = 0; index < powerControlMaxDomains; ++index)
+        {
+            const auto dom = static_cast<Domain>(index);
+            if (isMeasuredDomain(dom))
+            {
+                powerInWatts_[dom] = (reading.energyInMicroJoules[index] - lastReading_.energyInMicroJoules[index]) / 1e6 / seconds;
+            }
+        }
+    }
+    lastReading_ = reading;
+}
+
+double PowerControlDevice::getCurrentPowerInWatts(std::optional<Domain> dom) const
+{
+    const auto power = powerInWatts_.find(dom.value_or(Domain::PKG));
+    return power == powerInWatts_.end() ? 0.0 : power->second;
+}
+
+void PowerControlDevice::reset()
+{
+    readingAtReset_ = lastReading_;
+    perfCounterAtReset_ = readPerfCounter();
+}
+
+uint64_t PowerControlDevice::readPerfCounter() const
+{
+    // as current as the last sample of the helper, not only of this process
+    const auto reading = readPowerControlSnapshot(*snapshot_);
+    return (reading.has_value() ? *reading : lastReading_).perfCounter;
+}
+
+unsigned long long int PowerControlDevice::getPerfCounter() const
+{
+    const uint64_t perfCounter = readPerfCounter();
+    return perfCounter > perfCounterAtReset_ ? perfCounter - perfCounterAtReset_ : 0;
+}
+
+EnergyCrossDomains PowerControlDevice::getEnergySinceResetPerDomain() const
+{
+    EnergyCrossDomains result;
+    for (unsigned index = 0; index < powerControlMaxDomains; ++index)
+    {
+        const auto dom = static_cast<Domain>(index);
+        if (isMeasuredDomain(dom))
+        {
+            result[dom] = (lastReading_.energyInMicroJoules[index] - readingAtReset_.energyInMicroJoules[index]) / 1e6;
+        }
+    }
+    return result;
+}
+
+std::optional<EnergyCounterSample> PowerControlDevice::getEnergyCounterSample() const
+{
+    EnergyCounterSample sample;
+    sample.energyInMicroJoules = lastReading_.energyInMicroJoules[Domain::PKG];
+    sample.timestampInMicroSeconds = lastReading_.timestampInMicroSeconds;
+    return sample;
+}
@@ -0,0 +1,512 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/powercap_device.hpp"
+#include "devices/idle_power_meter.hpp"
+#include "power_interface/power_cap_journal.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string readFirstLine(const fs::path& fileName)
+{
+    std::ifstream file(fileName);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+std::optional<long long> readNumber(const fs::path& fileName)
+{
+    std::ifstream file(fileName);
+    long long value;
+    if (file >> value)
+    {
+        return value;
+    }
+    return std::nullopt;
+}
+
+bool writeNumber(const std::string& fileName, long long value)
+{
+    std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+    file << value;
+    file.close();
+    return !file.fail();
+}
+
+std::optional<Domain> domainOfZone(const std::string& name)
+{
+    if (name.rfind("package", 0) == 0)
+    {
+        return Domain::PKG;
+    }
+    if (name == "core")
+    {
+        return Domain::PP0;
+    }
+    if (name == "uncore")
+    {
+        return Domain::PP1;
+    }
+    if (name == "dram")
+    {
+        return Domain::DRAM;
+    }
+    return std::nullopt; // psys and unknown zones
+}
+
+// <control type>:<zone>[:<subzone>], e.g. intel-rapl:0:1
+struct ZoneId
+{
+    std::string controlType;
+    int zone {-1};
+    int subzone {-1};
+
+    static std::optional<ZoneId> parse(const std::string& fileName)
+    {
+        const auto first = fileName.find(':');
+        if (first == std::string::npos)
+        {
+            return std::nullopt; // the control type directory
+        }
+        ZoneId id;
+        id.controlType = fileName.substr(0, first);
+        char* end = nullptr;
+        id.zone = std::strtol(fileName.c_str() + first + 1, &end, 10);
+        if (*end == ':')
+        {
+            id.subzone = std::strtol(end + 1, &end, 10);
+        }
+        return *end == '\0' ? std::optional<ZoneId>(id) : std::nullopt;
+    }
+    std::string parent() const { return controlType + ":" + std::to_string(zone); }
+    auto key() const { return std::make_tuple(controlType != "intel-rapl", controlType, zone, subzone); }
+};
+
+} // namespace
+
+PowercapDevice::PowercapDevice(const std::string& rootDir, std::shared_ptr<Clock> clock)
+    : rootDir_(rootDir), clock_(std::move(clock))
+{
+    std::ifstream cpuinfo(rootDir_ + "/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line))
+    {
+        const auto begin = line.find_first_not_of(" \t", line.find(':') + 1);
+        if (line.rfind("model name", 0) == 0 && line.find(':') != std::string::npos && begin != std::string::npos)
+        {
+            name_ = line.substr(begin);
+            break;
+        }
+    }
+
+    discoverZones();
+    if (std::none_of(zones_.begin(), zones_.end(), [](const PowercapZone& zone) { return zone.domain == Domain::PKG; }))
+    {
+        throw std::runtime_error("PowercapDevice: no readable package zone in " + rootDir_ + "/sys/class/powercap");
+    }
+
+    const bool isAnyZoneCappable = std::any_of(zones_.begin(), zones_.end(),
+                                               [](const PowercapZone& zone) { return !zone.powerLimitFile.empty(); });
+    if (isAnyZoneCappable)
+    {
+        // caps left by a killed process are restored before the defaults are read
+        auto& journal = PowerCapJournal::instance();
+        for (auto& zone : zones_)
+        {
+            if (zone.powerLimitFile.empty())
+            {
+                continue;
+            }
+            zone.defaultPowerLimitInMicroWatts = readNumber(zone.powerLimitFile).value_or(0);
+            journal.recordOriginal(journalDeviceName_, PowerCapJournal::Backend::SYSFS, zone.powerLimitFile,
+                                   zone.defaultPowerLimitInMicroWatts);
+            currentLimitInWatts_[zone.domain] += zone.defaultPowerLimitInMicroWatts / 1e6;
+        }
+    }
+
+    perfEventCounters_ = std::make_unique<PerfEventCounters>();
+    if (!perfEventCounters_->isOpen())
+    {
+        std::cerr << "[WARNING] perf_event counters unavailable, instructions retired reported as 0\n";
+        perfEventCounters_.reset();
+    }
+
+    if (isAnyZoneCappable)
+    {
+        triggerPowerApiSample();
+        const auto idle = measureIdlePower(*this, makeIdlePowerCacheKey(), isCappableDomain(Domain::DRAM), "PowercapDevice");
+        idlePowerInWatts_[Domain::PKG] = idle.pkgPowerInWatts;
+        idlePowerInWatts_[Domain::DRAM] = idle.dramPowerInWatts;
+    }
+
+    triggerPowerApiSample();
+    reset();
+}
+
+std::string PowercapDevice::makeIdlePowerCacheKey() const
+{
+    if (!rootDir_.empty())
+    {
+        return ""; // synthetic tree, not cached
+    }
+    char hostname[256] = {0};
+    gethostname(hostname, sizeof(hostname) - 1);
+    std::stringstream key;
+    key << hostname << "|" << name_ << "|powercap|limits";
+    for (const auto& zone : zones_)
+    {
+        key << " " << zone.defaultPowerLimitInMicroWatts;
+    }
+    return key.str();
+}
+
+PowercapDevice::~PowercapDevice()
+{
+    for (auto& zone : zones_)
+    {
+        if (zone.energyFd >= 0)
+        {
+            ::close(zone.energyFd);
+        }
+    }
+}
+
+bool PowercapDevice::isAvailable(const std::string& rootDir)
+{
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(rootDir + "/sys/class/powercap", ec))
+    {
+        if (ZoneId::parse(entry.path().filename().string()).has_value()
+            && readFirstLine(entry.path() / "name").rfind("package", 0) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PowercapDevice::discoverZones()
+{
+    std::vector<std::pair<ZoneId, fs::path>> entries;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(rootDir_ + "/sys/class/powercap", ec))
+    {
+        if (auto id = ZoneId::parse(entry.path().filename().string()))
+        {
+            entries.emplace_back(*id, entry.path());
+        }
+    }
+    // intel-rapl before the other control types, parents before their subzones
+    std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) { return a.first.key() < b.first.key(); });
+
+    std::map<std::string, std::string> zoneNames;
+    std::set<std::string> discovered;
+    for (const auto& [id, path] : entries)
+    {
+        PowercapZone zone;
+        zone.path = path.string();
+        zone.name = readFirstLine(path / "name");
+        const bool isSubzone = id.subzone >= 0;
+        if (!isSubzone)
+        {
+            zoneNames[id.parent()] = zone.name;
+        }
+        const auto domain = domainOfZone(zone.name);
+        // e.g. intel-rapl-mmio:0 is the package-0 of intel-rapl:0 read through MMIO
+        const std::string uniqueName = isSubzone ? zoneNames[id.parent()] + "/" + zone.name : zone.name;
+        if (!domain.has_value() || !discovered.insert(uniqueName).second)
+        {
+            continue;
+        }
+        zone.domain = *domain;
+        if (!openZone(zone))
+        {
+            std::cerr << "[WARNING] Cannot read " << zone.path << "/energy_uj: " << strerror(errno) << ", zone skipped\n";
+            continue;
+        }
+        std::cout << "\tpowercap zone " << path.filename().string() << " (" << zone.name << "): " << zone.domain
+                  << (zone.powerLimitFile.empty() ? "" : ", power limit " + zone.powerLimitFile) << "\n";
+        zones_.push_back(zone);
+    }
+}
+
+bool PowercapDevice::openZone(PowercapZone& zone) const
+{
+    zone.energyFd = ::open((zone.path + "/energy_uj").c_str(), O_RDONLY | O_CLOEXEC);
+    if (zone.energyFd < 0 || !readEnergy(zone, zone.lastEnergyInMicroJoules))
+    {
+        const int savedErrno = errno;
+        if (zone.energyFd >= 0)
+        {
+            ::close(zone.energyFd);
+            zone.energyFd = -1;
+        }
+        errno = savedErrno;
+        return false;
+    }
+    zone.maxEnergyRangeInMicroJoules = readNumber(zone.path + "/max_energy_range_uj").value_or(0);
+
+    // the long term constraint, constraint_0 when the driver does not name them
+    for (int index = 0;; ++index)
+    {
+        const std::string prefix = zone.path + "/constraint_" + std::to_string(index) + "_";
+        if (!fs::exists(prefix + "power_limit_uw"))
+        {
+            break;
+        }
+        const std::string name = readFirstLine(prefix + "name");
+        if (index == 0 || name == "long_term")
+        {
+            zone.powerLimitFile = prefix + "power_limit_uw";
+        }
+        if (name == "long_term")
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+bool PowercapDevice::readEnergy(const PowercapZone& zone, uint64_t& energyInMicroJoules) const
+{
+    char buffer[32];
+    const ssize_t length = ::pread(zone.energyFd, buffer, sizeof(buffer) - 1, 0);
+    if (length <= 0)
+    {
+        return false;
+    }
+    buffer[length] = '\0';
+    char* end = nullptr;
+    energyInMicroJoules = std::strtoull(buffer, &end, 10);
+    return end != buffer;
+}
+
+void PowercapDevice::triggerPowerApiSample()
+{
+    const auto now = clock_->now();
+    for (auto& zone : zones_)
+    {
+        uint64_t energy = 0;
+        if (!readEnergy(zone, energy))
+        {
+            continue;
+        }
+        uint64_t delta = energy - zone.lastEnergyInMicroJoules;
+        if (energy < zone.lastEnergyInMicroJoules)
+        {
+            // the counter wrapped around after max_energy_range_uj
+            delta = zone.maxEnergyRangeInMicroJoules > zone.lastEnergyInMicroJoules
+                ? zone.maxEnergyRangeInMicroJoules - zone.lastEnergyInMicroJoules + energy
+                : energy;
+        }
+        zone.joules += delta / 1e6;
+        zone.lastEnergyInMicroJoules = energy;
+    }
+    std::map<Domain, double> joules;
+    for (const auto& zone : zones_)
+    {
+        joules[zone.domain] = sumJoules(zone.domain);
+    }
+    if (lastSampleTime_.has_value())
+    {
+        const double seconds = std::chrono::duration<double>(now - *lastSampleTime_).count();
+        if (seconds > 0.0)
+        {
+            for (const auto& [dom, value] : joules)
+            {
+                powerInWatts_[dom] = (value - lastJoules_[dom]) / seconds;
+            }
+        }
+    }
+    lastSampleTime_ = now;
+    lastJoules_ = joules;
+}
+
+double PowercapDevice::sumJoules(Domain dom) const
+{
+    double joules = 0.0;
+    for (const auto& zone : zones_)
+    {
+        if (zone.domain == dom)
+        {
+            joules += zone.joules;
+        }
+    }
+    return joules;
+}
+
+double PowercapDevice::getCurrentPowerInWatts(std::optional<Domain> dom) const
+{
+    const auto power = powerInWatts_.find(dom.value_or(Domain::PKG));
+    return power == powerInWatts_.end() ? 0.0 : power->second;
+}
+
+void PowercapDevice::reset()
+{
+    joulesAtReset_ = lastJoules_;
+    if (perfEventCounters_)
+    {
+        perfEventInstructionsAtReset_ = perfEventCounters_->read().instructions;
+    }
+}
+
+unsigned long long int PowercapDevice::getPerfCounter() const
+{
+    if (!perfEventCounters_)
+    {
+        return 0;
+    }
+    return (unsigned long long) ((perfEventCounters_->read().instructions - perfEventInstructionsAtReset_) / 1000000);
+}
+
+EnergyCrossDomains PowercapDevice::getEnergySinceResetPerDomain() const
+{
+    EnergyCrossDomains result;
+    for (const auto& [dom, joules] : lastJoules_)
+    {
+        const auto atReset = joulesAtReset_.find(dom);
+        result[dom] = joules - (atReset == joulesAtReset_.end() ? 0.0 : atReset->second);
+    }
+    return result;
+}
+
+std::optional<EnergyCounterSample> PowercapDevice::getEnergyCounterSample() const
+{
+    if (!lastSampleTime_.has_value())
+    {
+        return std::nullopt;
+    }
+    const auto pkg = lastJoules_.find(Domain::PKG);
+    EnergyCounterSample sample;
+    sample.energyInMicroJoules = static_cast<uint64_t>(std::llround((pkg == lastJoules_.end() ? 0.0 : pkg->second) * 1e6));
+    sample.timestampInMicroSeconds = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(lastSampleTime_->time_since_epoch()).count());
+    return sample;
+}
+
+bool PowercapDevice::isCappableDomain(Domain dom) const
+{
+    return currentLimitInWatts_.count(dom) > 0;
+}
+
+void PowercapDevice::beginDomainSearchSession(Domain dom)
+{
+    if (isCappableDomain(dom))
+    {
+        searchedDomain_ = dom;
+    }
+}
+
+std::pair<unsigned, unsigned> PowercapDevice::getMinMaxLimitInWatts() const
+{
+    // as for IntelDevice the default long term limit is the max and the idle power the min
+    long long maxInMicroWatts = 0;
+    for (const auto& zone : zones_)
+    {
+        if (zone.domain == searchedDomain_ && !zone.powerLimitFile.empty())
+        {
+            maxInMicroWatts += zone.defaultPowerLimitInMicroWatts;
+        }
+    }
+    const auto maxInWatts = static_cast<unsigned>(maxInMicroWatts / 1000000);
+    const auto idle = idlePowerInWatts_.find(searchedDomain_);
+    const auto minInWatts = idle == idlePowerInWatts_.end() ? 0u : static_cast<unsigned>(idle->second);
+    return std::make_pair(std::min(minInWatts, maxInWatts), maxInWatts);
+}
+
+double PowercapDevice::getPowerLimitInWatts() const
+{
+    const auto limit = currentLimitInWatts_.find(searchedDomain_);
+    return limit == currentLimitInWatts_.end() ? -1.0 : limit->second;
+}
+
+void PowercapDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
+{
+    // generic API for CPU and GPU - PKG domain unless a domain search session is active
+    setPowerLimitInMicroWatts(limitInMicroW, searchedDomain_);
+}
+
+void PowercapDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW, Domain dom)
+{
+    const auto numZones = std::count_if(zones_.begin(), zones_.end(), [dom](const PowercapZone& zone) {
+        return zone.domain == dom && !zone.powerLimitFile.empty();
+    });
+    if (numZones == 0)
+    {
+        return;
+    }
+    // the limit is given for the whole device and split evenly between the zones
+    for (const auto& zone : zones_)
+    {
+        if (zone.domain == dom && !zone.powerLimitFile.empty())
+        {
+            writeLimit(zone.powerLimitFile, limitInMicroW / numZones);
+        }
+    }
+    currentLimitInWatts_[dom] = limitInMicroW / 1e6;
+}
+
+void PowercapDevice::restoreDefaultLimits()
+{
+    currentLimitInWatts_.clear();
+    bool isRestored = true;
+    for (const auto& zone : zones_)
+    {
+        if (zone.powerLimitFile.empty())
+        {
+            continue;
+        }
+        if (!writeNumber(zone.powerLimitFile, zone.defaultPowerLimitInMicroWatts))
+        {
+            std::cerr << "[ERROR] Cannot restore the default limit in " << zone.powerLimitFile << "\n";
+            isRestored = false;
+        }
+        currentLimitInWatts_[zone.domain] += zone.defaultPowerLimitInMicroWatts / 1e6;
+    }
+    // a cap left behind stays in the journal, for restoreLeftovers after a crash
+    if (!currentLimitInWatts_.empty() && isRestored)
+    {
+        PowerCapJournal::instance().markRestored(journalDeviceName_);
+    }
+}
+
+void PowercapDevice::writeLimit(const std::string& fileName, long long value)
+{
+    PowerCapJournal::instance().apply(journalDeviceName_, PowerCapJournal::Backend::SYSFS, fileName, value, [&] {
+        if (!writeNumber(fileName, value))
+        {
+            std::cerr << "cannot write the limit to file " << fileName << "\n";
+        }
+    });
+}
@@ -0,0 +1,189 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/rocm_device.hpp"
+#include "power_interface/power_cap_journal.hpp"
+#include "logging/startup_timer.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+// ROCm SMI power caps of a journal (see PowerCapJournal)
+static bool restoreRocmPowerCap(const PowerCapJournal::Record& record)
+{
+    static const bool isRsmiInitialized = RSMI_STATUS_SUCCESS == rsmi_init(0);
+    return isRsmiInitialized
+        && RSMI_STATUS_SUCCESS == rsmi_dev_power_cap_set(std::stoul(record.target), 0, static_cast<uint64_t>(record.value));
+}
+
+[[maybe_unused]] static const bool isRocmRestorerRegistered =
+    PowerCapJournal::registerRestorer(PowerCapJournal::Backend::ROCM_SMI, restoreRocmPowerCap);
+
+RocmDevice::RocmDevice(int devID) :
+    deviceID_(static_cast<uint32_t>(devID))
+{
+    StartupTimer timer("RocmDevice");
+    rsmi_status_t status;
+    timer.measure("rsmi_init", [&status] { status = rsmi_init(0); });
+    if (RSMI_STATUS_SUCCESS != status)
+    {
+        printError("Failed to initialize ROCm SMI", status);
+        throw std::runtime_error("RocmDevice: rsmi_init failed");
+    }
+    uint32_t deviceCount = 0;
+    status = rsmi_num_monitor_devices(&deviceCount);
+    if (RSMI_STATUS_SUCCESS != status || devID < 0 || deviceID_ >= deviceCount)
+    {
+        throw std::runtime_error("RocmDevice: device " + std::to_string(devID) + " not found ("
+                                 + std::to_string(deviceCount) + " ROCm SMI devices)");
+    }
+    // caps left by a killed process are restored before the default is read
+    timer.measure("PowerCapJournal", [] { PowerCapJournal::instance(); });
+    status = rsmi_dev_power_cap_get(deviceID_, 0, &defaultPowerCapInMicroWatts_);
+    if (RSMI_STATUS_SUCCESS != status)
+    {
+        printError("Failed to GET the default power cap", status);
+    }
+    else
+    {
+        PowerCapJournal::instance().recordOriginal(getJournalDeviceName(), PowerCapJournal::Backend::ROCM_SMI,
+                                                   std::to_string(deviceID_), defaultPowerCapInMicroWatts_);
+    }
+    triggerPowerApiSample();
+    reset();
+    timer.report();
+}
+
+void RocmDevice::printError(const char* what, rsmi_status_t status) const
+{
+    const char* description = nullptr;
+    rsmi_status_string(status, &description);
+    std::cerr << "[ERROR] " << what << " of ROCm device " << deviceID_ << ": "
+              << (description != nullptr ? description : "unknown error") << "\n";
+}
+
+double RocmDevice::getPowerLimitInWatts() const
+{
+    uint64_t capInMicroWatts = 0;
+    rsmi_status_t status = rsmi_dev_power_cap_get(deviceID_, 0, &capInMicroWatts);
+    if (RSMI_STATUS_SUCCESS != status)
+    {
+        printError("Failed to GET current power limit", status);
+        return -1;
+    }
+    return capInMicroWatts / 1e6;
+}
+
+std::string RocmDevice::getName() const
+{
+    constexpr size_t maxLength = 128;
+    char name[maxLength];
+    if (RSMI_STATUS_SUCCESS != rsmi_dev_name_get(deviceID_, name, maxLength))
+    {
+        return std::string("Unknown AMD GPU");
+    }
+    return std::string(name);
+}
+
+std::pair<unsigned, unsigned> RocmDevice::getMinMaxLimitInWatts() const
+{
+    uint64_t max = 0, min = 0;
+    rsmi_status_t status = rsmi_dev_power_cap_range_get(deviceID_, 0, &max, &min);
+    if (RSMI_STATUS_SUCCESS != status)
+    {
+        printError("Failed to GET min/max power limit", status);
+    }
+    return std::make_pair(static_cast<unsigned>(min / 1000000), static_cast<unsigned>(max / 1000000));
+}
+
+void RocmDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
+{
+    rsmi_status_t status;
+    PowerCapJournal::instance().apply(getJournalDeviceName(), PowerCapJournal::Backend::ROCM_SMI, std::to_string(deviceID_),
+                                      limitInMicroW, [&] {
+        status = rsmi_dev_power_cap_set(deviceID_, 0, limitInMicroW);
+    });
+    if (RSMI_STATUS_SUCCESS != status)
+    {
+        printError(("Failed to SET current power limit " + std::to_string(limitInMicroW) + " [uW]").c_str(), status);
+    }
+}
+
+void RocmDevice::restoreDefaultLimits()
+{
+    if (defaultPowerCapInMicroWatts_ == 0)
+    {
+        return;
+    }
+    setPowerLimitInMicroWatts(defaultPowerCapInMicroWatts_);
+    PowerCapJournal::instance().markRestored(getJournalDeviceName());
+}
+
+double RocmDevice::getCurrentPowerInWatts(std::optional<Domain>) const
+{
+    uint64_t powerInMicroWatts = 0;
+    rsmi_status_t status = rsmi_dev_power_ave_get(deviceID_, 0, &powerInMicroWatts);
+    if (RSMI_STATUS_SUCCESS != status)
+    {
+        printError("Failed to get power usage", status);
+        return -1.0;
+    }
+    return powerInMicroWatts / 1e6;
+}
+
+void RocmDevice::triggerPowerApiSample()
+{
+    uint64_t count = 0, timestampInNanoSeconds = 0;
+    float resolutionInMicroJoules = 0.0f;
+    if (RSMI_STATUS_SUCCESS != rsmi_dev_energy_count_get(deviceID_, &count, &resolutionInMicroJoules, &timestampInNanoSeconds))
+    {
+        // older GPUs have no energy counter, power is integrated by DeviceStateAccumulator then
+        lastEnergySample_ = std::nullopt;
+        return;
+    }
+    EnergyCounterSample sample;
+    sample.energyInMicroJoules = static_cast<uint64_t>(std::llround(count * static_cast<double>(resolutionInMicroJoules)));
+    sample.timestampInMicroSeconds = timestampInNanoSeconds / 1000;
+    lastEnergySample_ = sample;
+}
+
+std::optional<uint64_t> RocmDevice::readGfxActivity() const
+{
+    rsmi_utilization_counter_t counter {};
+    counter.type = RSMI_COARSE_GRAIN_GFX_ACTIVITY;
+    uint64_t timestamp = 0;
+    if (RSMI_STATUS_SUCCESS != rsmi_utilization_count_get(deviceID_, &counter, 1, &timestamp))
+    {
+        return std::nullopt;
+    }
+    return counter.value;
+}
+
+void RocmDevice::reset()
+{
+    gfxActivityAtReset_ = readGfxActivity().value_or(0);
+}
+
+unsigned long long int RocmDevice::getPerfCounter() const
+{
+    const auto activity = readGfxActivity();
+    if (!activity.has_value() || *activity < gfxActivityAtReset_)
+    {
+        return 0;
+    }
+    return *activity - gfxActivityAtReset_;
+}
@@ -0,0 +1,253 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "devices/simulated_device.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+SimulatedDeviceModel SimulatedDeviceModel::fromPowerLog(const std::string& powerLogPath, SimulatedDeviceModel base)
+{
+    // cap response of the replayed phases is taken from the first phase of the base model
+    const double capSensitivity = base.phases.empty() ? SimulatedPhase().capSensitivity : base.phases.front().capSensitivity;
+    base.phases.clear();
+    std::ifstream file(powerLogPath);
+    if (!file.is_open())
+    {
+        std::cerr << "[WARNING] cannot open power log " << powerLogPath << " for replay\n";
+        return base;
+    }
+    std::string line;
+    double prevTimeInMs = -1.0;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream row(line);
+        double timeInMs, cap, avPower, smaPower, energy, perfCounterDelta;
+        if (!(row >> timeInMs >> cap >> avPower >> smaPower >> energy >> perfCounterDelta))
+        {
+            continue;
+        }
+        if (prevTimeInMs >= 0.0 && timeInMs > prevTimeInMs)
+        {
+            SimulatedPhase phase;
+            phase.durationInSeconds = (timeInMs - prevTimeInMs) / 1000.0;
+            phase.uncappedPowerInWatts = avPower;
+            phase.maxThroughput = std::max(0.0, perfCounterDelta) / phase.durationInSeconds;
+            phase.capSensitivity = capSensitivity;
+            base.phases.push_back(phase);
+        }
+        prevTimeInMs = timeInMs;
+    }
+    return base;
+}
+
+SimulatedDeviceModel SimulatedDeviceModel::fromPowerLog(const std::string& powerLogPath)
+{
+    return fromPowerLog(powerLogPath, SimulatedDeviceModel());
+}
+
+SimulatedDevice::SimulatedDevice(SimulatedDeviceModel model, std::shared_ptr<Clock> clock) :
+    model_(std::move(model)),
+    clock_(clock),
+    capInWatts_(model_.defaultLimitInWatts),
+    startTime_(clock_->now()),
+    rng_(model_.seed),
+    lastUpdate_(startTime_),
+    effectiveCapInWatts_(model_.defaultLimitInWatts),
+    lastSampleTime_(startTime_)
+{
+    // phases of a replayed power log are many and short, phaseIndexAt bisects their end times
+    double endInSeconds = 0.0;
+    for (auto&& phase : model_.phases)
+    {
+        endInSeconds += phase.durationInSeconds;
+        phaseEndsInSeconds_.push_back(endInSeconds);
+    }
+}
+
+std::pair<unsigned, unsigned> SimulatedDevice::getMinMaxLimitInWatts() const
+{
+    return std::make_pair(model_.minLimitInWatts, model_.maxLimitInWatts);
+}
+
+double SimulatedDevice::getPowerLimitInWatts() const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    return capInWatts_;
+}
+
+void SimulatedDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    // the interval until now was run with the previous cap
+    advanceTo(clock_->now());
+    capInWatts_ = std::clamp(limitInMicroW / 1e6, (double)model_.minLimitInWatts, (double)model_.maxLimitInWatts);
+}
+
+void SimulatedDevice::reset()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    advanceTo(clock_->now());
+    energyAtReset_ = totalEnergy_;
+    workAtReset_ = totalWork_;
+}
+
+unsigned long long int SimulatedDevice::getPerfCounter() const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    advanceTo(clock_->now());
+    return (unsigned long long)(totalWork_ - workAtReset_);
+}
+
+double SimulatedDevice::getCurrentPowerInWatts(std::optional<Domain> domain) const
+{
+    if (domain.has_value() && domain.value() != Domain::PKG)
+    {
+        return 0.0;
+    }
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    advanceTo(clock_->now());
+    // like RAPL, power is averaged over the last sampling period when it is triggered
+    double power = lastSampledPowerInWatts_ >= 0.0 ? lastSampledPowerInWatts_ : instantPowerInWatts_;
+    if (model_.powerNoiseStdDevInWatts > 0.0)
+    {
+        std::normal_distribution<double> noise(0.0, model_.powerNoiseStdDevInWatts);
+        power += noise(rng_);
+    }
+    return std::max(0.0, power);
+}
+
+void SimulatedDevice::restoreDefaultLimits()
+{
+    setPowerLimitInMicroWatts(model_.defaultLimitInWatts * 1e6);
+}
+
+void SimulatedDevice::triggerPowerApiSample()
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    const auto now = clock_->now();
+    advanceTo(now);
+    const double periodInSeconds = std::chrono::duration<double>(now - lastSampleTime_).count();
+    if (periodInSeconds > 0.0)
+    {
+        lastSampledPowerInWatts_ = (totalEnergy_ - energyAtLastSample_) / periodInSeconds;
+        energyAtLastSample_ = totalEnergy_;
+        lastSampleTime_ = now;
+    }
+}
+
+EnergyCrossDomains SimulatedDevice::getEnergySinceResetPerDomain() const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    advanceTo(clock_->now());
+    EnergyCrossDomains result;
+    result[Domain::PKG] = totalEnergy_ - energyAtReset_;
+    return result;
+}
+
+double SimulatedDevice::getTotalWork() const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    advanceTo(clock_->now());
+    return totalWork_;
+}
+
+double SimulatedDevice::getTotalEnergyInJoules() const
+{
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    advanceTo(clock_->now());
+    return totalEnergy_;
+}
+
+int SimulatedDevice::getCurrentPhaseIndex() const
+{
+    return phaseIndexAt(std::chrono::duration<double>(clock_->now() - startTime_).count());
+}
+
+int SimulatedDevice::phaseIndexAt(double timeInSeconds) const
+{
+    const double totalDuration = phaseEndsInSeconds_.empty() ? 0.0 : phaseEndsInSeconds_.back();
+    if (totalDuration <= 0.0)
+    {
+        return -1;
+    }
+    if (timeInSeconds >= totalDuration)
+    {
+        if (!model_.repeatPhases)
+        {
+            return -1;
+        }
+        timeInSeconds = std::fmod(timeInSeconds, totalDuration);
+    }
+    const auto end = std::upper_bound(phaseEndsInSeconds_.begin(), phaseEndsInSeconds_.end(), timeInSeconds);
+    if (end == phaseEndsInSeconds_.end())
+    {
+        return phaseEndsInSeconds_.size() - 1;
+    }
+    return end - phaseEndsInSeconds_.begin();
+}
+
+void SimulatedDevice::advanceTo(Clock::TimePoint t) const
+{
+    double remainingInSeconds = std::chrono::duration<double>(t - lastUpdate_).count();
+    double timeInSeconds = std::chrono::duration<double>(lastUpdate_ - startTime_).count();
+    const double idle = model_.idlePowerInWatts;
+    while (remainingInSeconds > 0.0)
+    {
+        const double step = std::min(model_.integrationStepInSeconds, remainingInSeconds);
+        if (model_.actuationLagInSeconds > 0.0)
+        {
+            effectiveCapInWatts_ += (capInWatts_ - effectiveCapInWatts_) * (1.0 - std::exp(-step / model_.actuationLagInSeconds));
+        }
+        else
+        {
+            effectiveCapInWatts_ = capInWatts_;
+        }
+
+        double power = idle;
+        double throughput = 0.0;
+        const int phaseIndex = phaseIndexAt(timeInSeconds + step / 2);
+        if (phaseIndex >= 0)
+        {
+            const auto& phase = model_.phases[phaseIndex];
+            const double demand = std::max(phase.uncappedPowerInWatts, idle);
+            power = std::max(idle, std::min(demand, effectiveCapInWatts_));
+            const double ratio = demand > idle ? (power - idle) / (demand - idle) : 1.0;
+            throughput = phase.maxThroughput * std::pow(std::clamp(ratio, 0.0, 1.0), phase.capSensitivity);
+            if (model_.throughputRelativeNoise > 0.0)
+            {
+                std::normal_distribution<double> noise(1.0, model_.throughputRelativeNoise);
+                throughput *= std::max(0.0, noise(rng_));
+            }
+        }
+        instantPowerInWatts_ = power;
+        totalEnergy_ += power * step;
+        totalWork_ += throughput * step;
+        timeInSeconds += step;
+        remainingInSeconds -= step;
+    }
+    if (t > lastUpdate_)
+    {
+        lastUpdate_ = t;
+    }
+}
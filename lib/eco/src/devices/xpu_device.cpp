@@ -17,7 +17,10 @@
 #include "devices/xpu_device.hpp"
 #include "perf_counter_interfaces/xpu_perf_counter.hpp"
 #include "../../../src/logging.hpp"
+#include "logging/startup_timer.hpp"
+#include "power_interface/power_cap_journal.hpp"
 
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <tuple>
@@ -25,6 +28,62 @@
 static constexpr double MICRO_W = 1e6;
 static constexpr double MILI_W  = 1e3;
 
+// Level Zero power limits of a journal, target <card>:<power domain>:<level>:<unit> (see PowerCapJournal)
+static bool restoreLevelZeroLimit(const PowerCapJournal::Record& record)
+{
+    unsigned int card = 0, domainIndex = 0;
+    int          level = 0, unit = 0;
+    if (std::sscanf(record.target.c_str(), "%u:%u:%d:%d", &card, &domainIndex, &level, &unit) != 4)
+    {
+        return false;
+    }
+    // Sysman has to be requested before the first zeInit of the process (see XPUDevice::initL0)
+    setenv("ZES_ENABLE_SYSMAN", "1", 0);
+    unsigned int numDrivers = 0;
+    if (zeInit(ZE_INIT_FLAG_GPU_ONLY) != ZE_RESULT_SUCCESS || zeDriverGet(&numDrivers, nullptr) != ZE_RESULT_SUCCESS
+        || numDrivers == 0)
+    {
+        return false;
+    }
+    std::vector<zes_driver_handle_t> drivers(numDrivers, nullptr);
+    unsigned int numDevices = 0;
+    if (zeDriverGet(&numDrivers, drivers.data()) != ZE_RESULT_SUCCESS
+        || zeDeviceGet(drivers.front(), &numDevices, nullptr) != ZE_RESULT_SUCCESS || card >= numDevices)
+    {
+        return false;
+    }
+    std::vector<zes_device_handle_t> devices(numDevices, nullptr);
+    unsigned int numDomains = 0;
+    if (zeDeviceGet(drivers.front(), &numDevices, devices.data()) != ZE_RESULT_SUCCESS
+        || zesDeviceEnumPowerDomains(devices[card], &numDomains, nullptr) != ZE_RESULT_SUCCESS || domainIndex >= numDomains)
+    {
+        return false;
+    }
+    std::vector<zes_pwr_handle_t> domains(numDomains, nullptr);
+    unsigned int numLimits = 0;
+    if (zesDeviceEnumPowerDomains(devices[card], &numDomains, domains.data()) != ZE_RESULT_SUCCESS
+        || zesPowerGetLimitsExt(domains[domainIndex], &numLimits, nullptr) != ZE_RESULT_SUCCESS)
+    {
+        return false;
+    }
+    std::vector<zes_power_limit_ext_desc_t> limits(numLimits);
+    if (zesPowerGetLimitsExt(domains[domainIndex], &numLimits, limits.data()) != ZE_RESULT_SUCCESS)
+    {
+        return false;
+    }
+    auto it = std::find_if(limits.begin(), limits.end(), [&](const zes_power_limit_ext_desc_t& limit)
+                           { return limit.level == level && limit.limitUnit == unit; });
+    if (it == limits.end())
+    {
+        return false;
+    }
+    it->limit = static_cast<int32_t>(record.value);
+    return zesPowerSetLimitsExt(domains[domainIndex], &numLimits, limits.data()) == ZE_RESULT_SUCCESS;
+}
+
+[[maybe_unused]] static const bool isLevelZeroRestorerRegistered =
+    PowerCapJournal::registerRestorer(PowerCapJournal::Backend::LEVEL_ZERO, restoreLevelZeroLimit);
+
 void XPUDevice::initL0()
 {
     // If ZES_ENABLE_SYSMAN is not set then make it set
@@ -181,19 +240,30 @@ void XPUDevice::getPowerDomain(zes_device_handle_t& device)
         throw std::runtime_error(errorMap.at(result));
     }
 
-    // Get first domain for whole XPU card
-    for (auto& domain : phdomains)
+    // Get first domain for whole XPU card, the tiles of multi-tile cards
+    // (e.g. PVC) expose their own ZES_POWER_DOMAIN_STACK energy counters
+    for (size_t index = 0; index < phdomains.size(); ++index)
     {
-        auto domain_type = getPowerDomainProperties(domain);
-        if (domain_type == ZES_POWER_DOMAIN_CARD)
+        auto& domain      = phdomains[index];
+        auto  domain_type = getPowerDomainProperties(domain);
+        if (domain_type == ZES_POWER_DOMAIN_CARD && this->power_handle == nullptr)
         {
-            this->power_handle = domain;
-            return;
+            this->power_handle        = domain;
+            this->power_domain_index_ = index;
+        }
+        else if (domain_type == ZES_POWER_DOMAIN_STACK)
+        {
+            this->tile_power_handles_.push_back(domain);
         }
     }
 
-    throw std::runtime_error("No Level Zero power domain  of type "
-                             "ZES_POWER_DOMAIN_CARD found for selected device!");
+    if (this->power_handle == nullptr)
+    {
+        throw std::runtime_error("No Level Zero power domain  of type "
+                                 "ZES_POWER_DOMAIN_CARD found for selected device!");
+    }
+    LOG_DEBUG("Level Zero Number of tile power domains: {}", this->tile_power_handles_.size());
+    this->tile_energy_.assign(this->tile_power_handles_.size(), EnergyIntegrator {});
 }
 
 XPUDevice::XPUDevice(int devID, bool useAmperes)
@@ -201,25 +271,38 @@ XPUDevice::XPUDevice(int devID, bool useAmperes)
   device_properties {},
   power_handle(nullptr),
   zeResult_(ZE_RESULT_SUCCESS),
-  energy_samples {{0, 0}, {0, 0}},
   useAmperes_(useAmperes)
 {
     LOAD_ENV_LEVELS()
 
     LOG_DEBUG("XPUDevice constructor called");
+    StartupTimer timer("XPUDevice");
 
     try
     {
-        this->initL0();
-        auto driver = this->initL0Driver();
+        timer.measure("initL0", [this] { this->initL0(); });
+        timer.measure("initL0Driver", [this] { this->driver_ = this->initL0Driver(); });
         // Lets get selected device from first driver
-        this->device = getL0Device(driver, devID);
+        timer.measure("getL0Device", [this, devID] { this->device = getL0Device(this->driver_, devID); });
 
         this->device_properties = getDeviceProperties(device);
 
         LOG_INFO("Device: {} initialized", this->device_properties.core.name);
 
-        getPowerDomain(device);
+        timer.measure("getPowerDomain", [this] { getPowerDomain(device); });
+
+        // caps left by a killed process are restored before the defaults are read,
+        // both limits are changed below
+        timer.measure("PowerCapJournal", [] { PowerCapJournal::instance(); });
+        for (const auto& limit : getLimits())
+        {
+            if ((limit.level == ZES_POWER_LEVEL_SUSTAINED && limit.limitUnit == ZES_LIMIT_UNIT_POWER)
+                || (limit.level == ZES_POWER_LEVEL_PEAK && limit.limitUnit == ZES_LIMIT_UNIT_CURRENT))
+            {
+                PowerCapJournal::instance().recordOriginal(getJournalDeviceName(), PowerCapJournal::Backend::LEVEL_ZERO,
+                                                           getJournalTarget(limit), limit.limit);
+            }
+        }
 
         // XPU is by default having max set to power limits
         // temporary set useAmperes_ to true and false to set both limits
@@ -243,19 +326,30 @@ XPUDevice::XPUDevice(int devID, bool useAmperes)
             this->minLimitValue = std::get<0>(minMaxPower);
             this->maxLimitValue = std::get<1>(minMaxPower);
         }
-
-        metric_collector_ =
-            ZeMetricCollector::Create((ze_driver_handle_t)driver, (ze_device_handle_t)device, "ComputeBasic");
     }
     catch (const std::exception& e)
     {
         LOG_ERROR("XPU initialization error: {}", e.what());
         throw;
     }
+    timer.report();
+}
+
+ZeMetricCollector* XPUDevice::getMetricCollector() const
+{
+    std::call_once(metric_collector_init_, [this] {
+        metric_collector_ =
+            ZeMetricCollector::Create((ze_driver_handle_t)driver_, (ze_device_handle_t)device, "ComputeBasic");
+    });
+    return metric_collector_;
 }
 
-std::vector<zes_power_limit_ext_desc_t> XPUDevice::getLimits() const
+const std::vector<zes_power_limit_ext_desc_t>& XPUDevice::getLimits() const
 {
+    if (limits_cache_.has_value())
+    {
+        return *limits_cache_;
+    }
     unsigned int num_limits = 0;
     auto         result     = zesPowerGetLimitsExt(this->power_handle, &num_limits, nullptr);
     if (result == ZE_RESULT_SUCCESS)
@@ -274,7 +368,8 @@ std::vector<zes_power_limit_ext_desc_t> XPUDevice::getLimits() const
         throw std::runtime_error(errorMap.at(result));
     }
 
-    return phlimits;
+    limits_cache_ = std::move(phlimits);
+    return *limits_cache_;
 }
 
 std::string XPUDevice::getDeviceTypeString() const
@@ -292,6 +387,19 @@ void XPUDevice::restoreDefaultLimits()
     {
         setPowerLimitInMicroWatts(MICRO_W * defaultPowerLimitInWatts_);
     }
+    // a failed write throws, the caps are then restored by the journal
+    PowerCapJournal::instance().markRestored(getJournalDeviceName());
+}
+
+std::string XPUDevice::getJournalDeviceName() const
+{
+    return "xpu" + std::to_string(deviceID_);
+}
+
+std::string XPUDevice::getJournalTarget(const zes_power_limit_ext_desc_t& limit) const
+{
+    return std::to_string(deviceID_) + ":" + std::to_string(power_domain_index_) + ":" + std::to_string(limit.level)
+           + ":" + std::to_string(limit.limitUnit);
 }
 
 double XPUDevice::getPowerLimitSustained() const
@@ -314,7 +422,7 @@ double XPUDevice::getInnerPowerLimit(bool useAmperes) const
 {
     try
     {
-        auto phlimits = getLimits();
+        const auto& phlimits = getLimits();
 
         auto it = std::find_if(
             phlimits.begin(),
@@ -426,7 +534,11 @@ void XPUDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
         unsigned int size = phlimits.size();
 
         // Set limits with modified values
-        auto result = zesPowerSetLimitsExt(this->power_handle, &size, phlimits.data());
+        ze_result_t result = ZE_RESULT_SUCCESS;
+        PowerCapJournal::instance().apply(getJournalDeviceName(), PowerCapJournal::Backend::LEVEL_ZERO,
+                                          getJournalTarget(*it), it->limit,
+                                          [&] { result = zesPowerSetLimitsExt(this->power_handle, &size, phlimits.data()); });
+        this->limits_cache_.reset();
         if (result != ZE_RESULT_SUCCESS)
         {
             throw std::runtime_error(errorMap.at(result));
@@ -451,25 +563,38 @@ void XPUDevice::setPowerLimitInMicroWatts(unsigned long limitInMicroW)
 
 void XPUDevice::reset()
 {
-    metric_collector_->resetAccumulatedMetrics();
+    getMetricCollector()->resetAccumulatedMetrics();
 }
 
 double XPUDevice::getCurrentPowerInWatts(std::optional<Domain>) const
 {
     // (t1,e1) and (t2,e2) = (e2 - e1)/(t2-t1)
-    //
-    auto delta_t = energy_samples[1].timestamp - energy_samples[0].timestamp;
-    auto delta_e = energy_samples[1].energy - energy_samples[0].energy;
+    return energy_.getLastIntervalPowerInWatts();
+}
 
-    double avg_power = static_cast<double>(delta_e) / static_cast<double>(delta_t);
+double XPUDevice::getCurrentPowerInWattsForTile(size_t tile) const
+{
+    if (tile >= tile_energy_.size())
+    {
+        return 0.0;
+    }
+    return tile_energy_[tile].getLastIntervalPowerInWatts();
+}
 
-    return avg_power;
+size_t XPUDevice::getNumTilePowerDomains() const
+{
+    return tile_power_handles_.size();
 }
 
 zes_power_energy_counter_t XPUDevice::sampleEnergyCounter()
+{
+    return sampleEnergyCounter(this->power_handle);
+}
+
+zes_power_energy_counter_t XPUDevice::sampleEnergyCounter(zes_pwr_handle_t domain)
 {
     zes_power_energy_counter_t energy_counter;
-    auto                       result = zesPowerGetEnergyCounter(this->power_handle, &energy_counter);
+    auto                       result = zesPowerGetEnergyCounter(domain, &energy_counter);
 
     if (result != ZE_RESULT_SUCCESS)
     {
@@ -480,11 +605,16 @@ zes_power_energy_counter_t XPUDevice::sampleEnergyCounter()
 
 void XPUDevice::triggerPowerApiSample()
 {
-    // Discard older sample and get current sample
-    this->energy_samples[0] = this->energy_samples[1];
     try
     {
-        this->energy_samples[1] = sampleEnergyCounter();
+        auto counter              = sampleEnergyCounter();
+        this->last_energy_sample_ = EnergyCounterSample {counter.energy, counter.timestamp};
+        this->energy_.addEnergyCounterSample(*this->last_energy_sample_);
+        for (size_t i = 0; i < tile_power_handles_.size(); ++i)
+        {
+            auto tile_counter = sampleEnergyCounter(tile_power_handles_[i]);
+            tile_energy_[i].addEnergyCounterSample({tile_counter.energy, tile_counter.timestamp});
+        }
     }
     catch (const std::exception& e)
     {
@@ -494,5 +624,15 @@ void XPUDevice::triggerPowerApiSample()
 
 unsigned long long int XPUDevice::getPerfCounter() const
 {
-    return metric_collector_->getAccumulatedMetricsSinceLastReset();
+    return getMetricCollector()->getAccumulatedMetricsSinceLastReset();
+}
+
+unsigned long long int XPUDevice::getPerfCounterForTile(size_t tile) const
+{
+    return getMetricCollector()->getTileMetricsSinceLastReset(tile).total();
+}
+
+size_t XPUDevice::getNumTiles() const
+{
+    return getMetricCollector()->getTileCount();
 }
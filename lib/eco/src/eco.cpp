@@ -19,7 +19,7 @@
 #include <numeric>
 #include "eco.hpp"
 #include "devices/abstract_device.hpp"
-#include "devices/multi_cuda_device.hpp"
+#include "devices/frequency_axis_device.hpp"
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <cerrno>
@@ -27,6 +27,7 @@
 #include <algorithm>
 #include "plot_builder.hpp"
 #include "logging/log.hpp"
+#include "power_interface/power_cap_journal.hpp"
 
 #include <atomic>
 #include <filesystem>
@@ -81,24 +82,60 @@ void monitor_trigger_file() {
     }
 }
 
+static Algorithm makeSearchAlgorithm(SearchType searchType, std::optional<std::pair<unsigned, unsigned>> limitsRangeInWatts = std::nullopt)
+{
+    if (searchType == SearchType::LINEAR_SEARCH)
+    {
+        return LinearSearchAlgorithm(limitsRangeInWatts);
+    }
+    return GoldenSectionSearchAlgorithm(limitsRangeInWatts);
+}
+
 static constexpr char FLUSH_AND_RETURN[] = "\r                                                                                     \r";
 
 Eco::Eco(std::shared_ptr<Device> d) :
-    device_(d), devStateGlobal_(d), trigger_(cfg_), logger_(d->getDeviceTypeString())
+    device_(d), clock_(d->getClock()), devStateGlobal_(d), trigger_(cfg_), logger_(d->getDeviceTypeString())
 {
+    // caps restored also when the tool is interrupted, terminated or crashes
+    PowerCapJournal::installSignalHandlers();
     defaultWatchdog = readWatchdog();
     if (defaultWatchdog == WatchdogStatus::ENABLED)
     {
         modifyWatchdog(WatchdogStatus::DISABLED);
     }
+    if (isDramCapSearchOn())
+    {
+        // DRAM cap is traded against PKG cap so DRAM energy has to be a part of the optimized metric
+        devStateGlobal_.includeDomainInEnergy(Domain::DRAM);
+    }
+    devStateGlobal_.setProgressMetric(makeProgressMetric(cfg_.progressMetric_, device_));
+    if (cfg_.frequencySearch_)
+    {
+        const auto domain = cfg_.frequencySearch_ == 1 ? FrequencyDomain::CORE : FrequencyDomain::UNCORE;
+        frequencyActuator_ = device_->getFrequencyActuator(domain);
+        if (!frequencyActuator_)
+        {
+            std::cerr << "[WARNING] Frequency search for " << domain << " is not supported by "
+                      << device_->getName() << ". Frequency search disabled.\n";
+        }
+    }
     device_->reset();
 }
 
 Eco::~Eco() {
-    device_->restoreDefaultLimits();
+    restoreDefaults();
     modifyWatchdog(defaultWatchdog);
 }
 
+void Eco::restoreDefaults()
+{
+    device_->restoreDefaultLimits();
+    if (frequencyActuator_)
+    {
+        frequencyActuator_->restoreDefaultFrequency();
+    }
+}
+
 static inline int readLimitFromFile (std::string fileName) {
     std::ifstream limitFile (fileName.c_str());
     std::string line;
@@ -159,7 +196,7 @@ void Eco::singleAppRunAndPowerSample(char* const* argv) {
         perror("open");
         std::abort();
     }
-    pid_t childProcId = fork();
+    pid_t childProcId = forkAppProcess(argv, fd);
 
     if (childProcId < 0)
     {
@@ -168,12 +205,6 @@ void Eco::singleAppRunAndPowerSample(char* const* argv) {
         close(fd);
         return;
     }
-
-    if (childProcId == 0) {
-        // Child process
-        int ret = mainAppProcess(argv, fd);
-        std::exit(ret);
-    }
     // Parent process
     int status;
     pid_t result;
@@ -181,7 +212,7 @@ void Eco::singleAppRunAndPowerSample(char* const* argv) {
         result = waitpid(childProcId, &status, WNOHANG);
         if (result == 0) {
             // child alive - monitored app is running
-            usleep(cfg_.msPause_ * 1000);
+            clock_->sleepForMicroSeconds(cfg_.msPause_ * 1000);
             devStateGlobal_.sample();
             auto tmp = devStateGlobal_.getCurrentPowerAndPerf();
             logger_.logPowerLogLine(devStateGlobal_, tmp);
@@ -219,11 +250,11 @@ void Eco::singleAppRunAndPowerSample(char* const* argv) {
 PowAndPerfResult Eco::checkPowerAndPerformance(int usPeriod)
 {
     auto pause = cfg_.msPause_ * 1000;
-    usleep(pause);
+    clock_->sleepForMicroSeconds(pause);
     devStateGlobal_.sample();
     auto resultAccumulator = devStateGlobal_.getCurrentPowerAndPerf(trigger_);
     while (usPeriod > pause){
-        usleep(pause);
+        clock_->sleepForMicroSeconds(pause);
         devStateGlobal_.sample();
         auto tmp = devStateGlobal_.getCurrentPowerAndPerf(trigger_);
         logger_.logPowerLogLine(devStateGlobal_, tmp);
@@ -263,24 +294,11 @@ void Eco::reportResult(double waitTime, double testTime) {
     auto&& totalE = devStateGlobal_.getEnergySinceReset();
     auto&& totalTime = devStateGlobal_.getTimeSinceReset<std::chrono::milliseconds>() / 1000.0;
     std::cout << "Total E: " << totalE;
-    // ----------------------------------------------------------------------------------------
-    // Below code is temporary disabled as it uses method specific to some
-    // class of systems with two Intel CPUs treated as a single device.
-    // Ultimately the Device shall represent single CPU and the energy readings
-    // shall be combined in DeviceStateAccumulator. If a system consist of
-    // multiple CPUs used by the same application it shall be reflected as multiple
-    // Device object instances within DeviceStateAccumulator.
-    //
-    //  || || || || || || || || || || || || || || || || ||
-    //  \/ \/ \/ \/ \/ \/ \/ \/ \/ \/ \/ \/ \/ \/ \/ \/ \/
-    //
-    // auto&& energyVec = devStateGlobal_.getTotalEnergyVec(Domain::PKG);
-    // int pkgID = 0;
-    // for (auto&& pkgE : energyVec) {
-    //     pkgID++;
-    //     std::cout << "\nPKG" << pkgID << ": " << pkgE << ", (" << (pkgE/totalE)*100 << "%)";
-    // }
-    // ----------------------------------------------------------------------------------------
+    // Per-domain energy (e.g. RAPL PKG/PP0/DRAM) is reported by the device power interface
+    // and summed over all packages of the device. PP0 is a part of PKG energy.
+    for (auto&& [dom, domainE] : devStateGlobal_.getEnergySinceResetPerDomain()) {
+        std::cout << "\n" << dom << " E: " << domainE << ", (" << (domainE/totalE)*100 << "%)";
+    }
     std::cout << "\nTotal P: " << totalE / totalTime <<
                  "\nTotal t: " << totalTime << "s\n";
     if (waitTime != 0.0 || testTime != 0.0) {
@@ -324,7 +342,9 @@ void Eco::execPhase(
     int& status,
     int childPID,
     PowAndPerfResult& refResult,
-    const std::optional<std::vector<unsigned long>>& perGpuCapsMicroW)
+    const std::optional<std::vector<unsigned long>>& perGpuCapsMicroW,
+    const std::optional<unsigned long>& dramCapMicroW,
+    const std::optional<unsigned>& frequencyLimitInMHz)
 {
     int repetitionPeriodInUs = cfg_.repeatTuningPeriodInSec_ * 1e6 + cfg_.usTestPhasePeriod_;
     if (perGpuCapsMicroW.has_value()
@@ -337,6 +357,16 @@ void Eco::execPhase(
     {
         device_->setPowerLimitInMicroWatts(static_cast<unsigned long>(powerCap_uW));
     }
+    if (dramCapMicroW.has_value())
+    {
+        device_->beginDomainSearchSession(Domain::DRAM);
+        device_->setPowerLimitInMicroWatts(*dramCapMicroW);
+        device_->endDomainSearchSession();
+    }
+    if (frequencyLimitInMHz.has_value() && frequencyActuator_)
+    {
+        frequencyActuator_->setFrequencyLimitInMHz(*frequencyLimitInMHz);
+    }
     printLine();
     // Console: print per-subdevice current powers when applicable
     if (device_->getNumSubdevices() > 1)
@@ -395,12 +425,58 @@ int Eco::mainAppProcess(char* const* argv, int& stdoutFileDescriptor)
     return execStatus;
 }
 
+pid_t Eco::forkAppProcess(char* const* argv, int& stdoutFileDescriptor)
+{
+    // the child waits for the parent to attach the progress metric to it before exec,
+    // so that process scoped counters follow the application from its first instruction
+    int handshake[2];
+    if (pipe(handshake) < 0)
+    {
+        perror("pipe");
+        abort();
+    }
+    pid_t childProcId = fork();
+    if (childProcId == 0)
+    {
+        close(handshake[1]);
+        char go;
+        while (read(handshake[0], &go, 1) < 0 && errno == EINTR) {}
+        close(handshake[0]);
+        int ret = mainAppProcess(argv, stdoutFileDescriptor);
+        std::exit(ret);
+    }
+    close(handshake[0]);
+    if (childProcId > 0)
+    {
+        devStateGlobal_.getProgressMetric()->attachToProcess(childProcId);
+        const char go = 1;
+        if (write(handshake[1], &go, 1) < 0)
+        {
+            perror("write");
+        }
+    }
+    close(handshake[1]);
+    return childProcId;
+}
+
 FinalPowerAndPerfResult Eco::runAppWithSearch(
     char* const* argv,
-    TargetMetric targerMetric,
+    TargetMetric metric,
     SearchType searchType,
     int argc)
 {
+    const auto targetMetric = cfg_.customMetric_.empty() ?
+        MetricExpression::fromTargetMetric(metric, cfg_.k_) : MetricExpression::compile(cfg_.customMetric_, cfg_.k_);
+    return runAppWithSearch(argv, targetMetric, searchType, argc);
+}
+
+FinalPowerAndPerfResult Eco::runAppWithSearch(
+    char* const* argv,
+    const MetricExpression& targerMetric,
+    SearchType searchType,
+    int argc)
+{
+    std::cout << "[INFO] Target metric: " << targerMetric << "\n";
     // this is redirecting the original output of the tuned application to txt file
     int fd = open("redirected.txt", O_WRONLY|O_TRUNC|O_CREAT, 0644);
     if (fd < 0) { perror("open"); abort(); }
@@ -426,72 +502,88 @@ FinalPowerAndPerfResult Eco::runAppWithSearch(
 
     double waitTime = 0.0, testTime = 0.0;
     int bestResultCapInMicroWatts = -1;
-    pid_t childProcId = fork();
+    std::optional<unsigned long> bestDramCapInMicroWatts;
+    std::optional<unsigned> bestFrequencyInMHz;
+    pid_t childProcId = forkAppProcess(argv, fd);
     if (childProcId >= 0) //fork successful
     {
-        if (childProcId == 0) // child process
-        {
-            mainAppProcess(argv, fd);
-        }
-        else  // parent process
+        int status = 1;
+        printHeader();
+        waitTime = measureDuration(*clock_, [&, this] {
+            waitForTuningTrigger(status, childProcId);
+        });
+        //----------------------------------------------------------------------------
+        Algorithm algorithm = makeSearchAlgorithm(searchType);
+        //----------------------------------------------------------------------------
+        PowAndPerfResult referenceRun;
+        while (status)
         {
-            int status = 1;
-            printHeader();
-            waitTime = measureDuration([&, this] {
-                waitForTuningTrigger(status, childProcId);
-            });
-            //----------------------------------------------------------------------------
-            Algorithm algorithm;
-            if (searchType == SearchType::LINEAR_SEARCH)
-            {
-                algorithm = LinearSearchAlgorithm();
-            }
-            else
-            {
-                algorithm = GoldenSectionSearchAlgorithm();
-            }
-            //----------------------------------------------------------------------------
-            PowAndPerfResult referenceRun;
-            while (status)
-            {
-                std::optional<std::vector<unsigned long>> perGpuCapsForExec;
-                testTime += measureDuration([&, this] {
-                    referenceRun = checkPowerAndPerformance(cfg_.referenceRunMultiplier_ * cfg_.usTestPhasePeriod_);
-                    logger_.logPowerLogLine(devStateGlobal_, referenceRun);
-                    if (device_->usesIndependentSubdevicePowerCaps())
+            std::optional<std::vector<unsigned long>> perGpuCapsForExec;
+            testTime += measureDuration(*clock_, [&, this] {
+                if (cfg_.workloadClassifier_)
+                {
+                    device_->beginWorkloadProfiling();
+                }
+                referenceRun = checkPowerAndPerformance(cfg_.referenceRunMultiplier_ * cfg_.usTestPhasePeriod_);
+                logger_.logPowerLogLine(devStateGlobal_, referenceRun);
+                // only the power cap search is narrowed, DRAM and frequency axes use the full range
+                Algorithm capAlgorithm = cfg_.workloadClassifier_ ?
+                    makeSearchAlgorithm(searchType, classifyWorkload()) : algorithm;
+                if (device_->usesIndependentSubdevicePowerCaps())
+                {
+                    const auto minMaxW = device_->getMinMaxLimitInWatts();
+                    const unsigned long maxU = static_cast<unsigned long>(minMaxW.second) * 1000000UL;
+                    std::vector<unsigned long> caps(device_->getNumSubdevices(), maxU);
+                    device_->setPowerLimitsPerGpuMicroWatts(caps);
+                    for (size_t gi = 0; gi < device_->getNumSubdevices(); ++gi)
                     {
-                        auto* m = dynamic_cast<MultiCudaDevice*>(device_.get());
-                        const auto minMaxW = device_->getMinMaxLimitInWatts();
-                        const unsigned long maxU = static_cast<unsigned long>(minMaxW.second) * 1000000UL;
-                        std::vector<unsigned long> caps(m->getNumSubdevices(), maxU);
-                        m->setPowerLimitsPerGpuMicroWatts(caps);
-                        for (size_t gi = 0; gi < m->getNumSubdevices(); ++gi)
-                        {
-                            m->beginPerGpuSearchSession(gi, caps);
-                            const unsigned bestMicro = algorithm(
-                                device_,
-                                devStateGlobal_,
-                                trigger_,
-                                targerMetric,
-                                referenceRun,
-                                status,
-                                childProcId,
-                                cfg_.msPause_,
-                                cfg_.msTestPhasePeriod_,
-                                logger_);
-                            m->endPerGpuSearchSession();
-                            caps[gi] = bestMicro;
-                            m->setPowerLimitsPerGpuMicroWatts(caps);
-                        }
-                        const unsigned long long sumCaps =
-                            std::accumulate(caps.begin(), caps.end(), 0ULL);
-                        bestResultCapInMicroWatts = static_cast<int>(
-                            sumCaps / std::max<size_t>(1, caps.size()));
-                        perGpuCapsForExec = caps;
+                        device_->beginSubdeviceSearchSession(gi, caps);
+                        const unsigned bestMicro = capAlgorithm(
+                            device_,
+                            devStateGlobal_,
+                            trigger_,
+                            targerMetric,
+                            referenceRun,
+                            status,
+                            childProcId,
+                            cfg_.msPause_,
+                            cfg_.msTestPhasePeriod_,
+                            logger_);
+                        device_->endSubdeviceSearchSession();
+                        caps[gi] = bestMicro;
+                        device_->setPowerLimitsPerGpuMicroWatts(caps);
                     }
-                    else
+                    const unsigned long long sumCaps =
+                        std::accumulate(caps.begin(), caps.end(), 0ULL);
+                    bestResultCapInMicroWatts = static_cast<int>(
+                        sumCaps / std::max<size_t>(1, caps.size()));
+                    perGpuCapsForExec = caps;
+                }
+                else if (frequencyActuator_ && cfg_.frequencySearchOnly_)
+                {
+                    // power cap stays at default, only frequency limit is tuned below
+                    bestResultCapInMicroWatts = static_cast<int>(device_->getPowerLimitInWatts() * 1e6);
+                }
+                else
+                {
+                    bestResultCapInMicroWatts = static_cast<int>(capAlgorithm(
+                        device_,
+                        devStateGlobal_,
+                        trigger_,
+                        targerMetric,
+                        referenceRun,
+                        status,
+                        childProcId,
+                        cfg_.msPause_,
+                        cfg_.msTestPhasePeriod_,
+                        logger_));
+                    if (isDramCapSearchOn() && status)
                     {
-                        bestResultCapInMicroWatts = static_cast<int>(algorithm(
+                        // PKG x DRAM space is searched coordinate-wise: DRAM cap is tuned
+                        // by the same algorithm with the best PKG cap already applied
+                        device_->setPowerLimitInMicroWatts(bestResultCapInMicroWatts);
+                        device_->beginDomainSearchSession(Domain::DRAM);
+                        bestDramCapInMicroWatts = algorithm(
                             device_,
                             devStateGlobal_,
                             trigger_,
@@ -501,12 +593,49 @@ FinalPowerAndPerfResult Eco::runAppWithSearch(
                             childProcId,
                             cfg_.msPause_,
                             cfg_.msTestPhasePeriod_,
-                            logger_));
+                            logger_);
+                        device_->endDomainSearchSession();
+                        std::cout << "[INFO] Selected PKG cap " << bestResultCapInMicroWatts / 1.0e6
+                                  << " W and DRAM cap " << *bestDramCapInMicroWatts / 1.0e6 << " W\n";
                     }
-                });
-                execPhase(bestResultCapInMicroWatts, status, childProcId, referenceRun, perGpuCapsForExec);
-                device_->restoreDefaultLimits();
-            }
+                }
+                if (frequencyActuator_ && status)
+                {
+                    // power cap x frequency space is searched coordinate-wise as well:
+                    // frequency limit is tuned with the best caps already applied
+                    if (perGpuCapsForExec.has_value())
+                    {
+                        device_->setPowerLimitsPerGpuMicroWatts(*perGpuCapsForExec);
+                    }
+                    else
+                    {
+                        device_->setPowerLimitInMicroWatts(bestResultCapInMicroWatts);
+                    }
+                    if (bestDramCapInMicroWatts.has_value())
+                    {
+                        device_->beginDomainSearchSession(Domain::DRAM);
+                        device_->setPowerLimitInMicroWatts(*bestDramCapInMicroWatts);
+                        device_->endDomainSearchSession();
+                    }
+                    auto frequencyAxis = std::make_shared<FrequencyAxisDevice>(device_, frequencyActuator_);
+                    bestFrequencyInMHz = FrequencyAxisDevice::toFrequencyInMHz(algorithm(
+                        frequencyAxis,
+                        devStateGlobal_,
+                        trigger_,
+                        targerMetric,
+                        referenceRun,
+                        status,
+                        childProcId,
+                        cfg_.msPause_,
+                        cfg_.msTestPhasePeriod_,
+                        logger_));
+                    std::cout << "[INFO] Selected " << frequencyActuator_->getName() << " limit "
+                              << *bestFrequencyInMHz << " MHz\n";
+                }
+            });
+            execPhase(bestResultCapInMicroWatts, status, childProcId, referenceRun, perGpuCapsForExec,
+                      bestDramCapInMicroWatts, bestFrequencyInMHz);
+            restoreDefaults();
         }
     }
     else
@@ -522,18 +651,18 @@ FinalPowerAndPerfResult Eco::runAppWithSearch(
     monitor_thread.join();
 
 
-    return FinalPowerAndPerfResult(bestResultCapInMicroWatts / 1.0e6,
-                                devStateGlobal_.getEnergySinceReset(),
-                                devStateGlobal_.getEnergySinceReset() / totalTimeInSeconds,
-                                // devStateGlobal_.getEnergySinceReset(Domain::PP0) / totalTimeInSeconds,
-                                // devStateGlobal_.getEnergySinceReset(Domain::PP1) / totalTimeInSeconds,
-                                // devStateGlobal_.getEnergySinceReset(Domain::DRAM) / totalTimeInSeconds,
-                                0.0,
-                                0.0,
-                                0.0,
-                                TimeResult(totalTimeInSeconds, waitTime, testTime),
-                                0.0,
-                                0.0);
+    auto result = makeFinalResult(bestResultCapInMicroWatts / 1.0e6,
+                                  TimeResult(totalTimeInSeconds, waitTime, testTime),
+                                  0.0);
+    if (bestDramCapInMicroWatts.has_value())
+    {
+        result.dramPowercap = *bestDramCapInMicroWatts / 1.0e6;
+    }
+    if (bestFrequencyInMHz.has_value())
+    {
+        result.frequencyLimitInMHz = *bestFrequencyInMHz;
+    }
+    return result;
 }
 
 
@@ -542,21 +671,61 @@ FinalPowerAndPerfResult Eco::runAppWithSampling(char* const* argv, int argc) {
     reportResult();
     double totalTimeInSeconds = devStateGlobal_.getTimeSinceReset<std::chrono::milliseconds>() / 1000.0;
 
-    return FinalPowerAndPerfResult(device_->getPowerLimitInWatts(),
+    return makeFinalResult(device_->getPowerLimitInWatts(),
+                           totalTimeInSeconds,
+                           devStateGlobal_.getPerfCounterSinceReset());
+}
+
+FinalPowerAndPerfResult Eco::makeFinalResult(double powerCapInWatts, TimeResult time, double perfCounter) const
+{
+    const double totalTimeInSeconds = time.totalTime_;
+    const auto energyPerDomain = devStateGlobal_.getEnergySinceResetPerDomain();
+    auto domainPower = [&](Domain dom) {
+        auto it = energyPerDomain.find(dom);
+        return it == energyPerDomain.end() ? 0.0 : it->second / totalTimeInSeconds;
+    };
+    return FinalPowerAndPerfResult(powerCapInWatts,
                                 devStateGlobal_.getEnergySinceReset(),
                                 devStateGlobal_.getEnergySinceReset() / totalTimeInSeconds,
-                                // devStateGlobal_.getEnergySinceReset(Domain::PP0) / totalTimeInSeconds,
-                                // devStateGlobal_.getEnergySinceReset(Domain::PP1) / totalTimeInSeconds,
-                                // devStateGlobal_.getEnergySinceReset(Domain::DRAM) / totalTimeInSeconds,
-                                0.0,
-                                0.0,
-                                0.0,
-                                totalTimeInSeconds,
-                                devStateGlobal_.getPerfCounterSinceReset(),
+                                domainPower(Domain::PP0),
+                                domainPower(Domain::PP1),
+                                domainPower(Domain::DRAM),
+                                time,
+                                perfCounter,
                                 0.0 // num of cycles is not needed, so might be removed in the future
                                 );
 }
 
+std::optional<std::pair<unsigned, unsigned>> Eco::classifyWorkload()
+{
+    const auto profile = device_->endWorkloadProfiling();
+    if (!profile.has_value())
+    {
+        std::cout << "[INFO] Workload profiling is not supported by " << device_->getName() << ", full limits range is searched\n";
+        return std::nullopt;
+    }
+    const auto workloadClass = WorkloadClassifier::classify(*profile);
+    const auto [minLimitInWatts, maxLimitInWatts] = device_->getMinMaxLimitInWatts();
+    const auto range = WorkloadClassifier::narrowRange(workloadClass, minLimitInWatts, maxLimitInWatts);
+    std::cout << "[INFO] Workload classified as " << workloadClass;
+    if (profile->ipc_.has_value())
+    {
+        std::cout << " (IPC " << *profile->ipc_ << ", memory traffic " << profile->memoryBandwidthInGBps_.value_or(0.0) << " GB/s)";
+    }
+    if (profile->computeUtilization_.has_value())
+    {
+        std::cout << " (compute busy " << *profile->computeUtilization_ << "%, memory busy "
+                  << profile->memoryUtilization_.value_or(0.0) << "%)";
+    }
+    std::cout << ", searching limits in [" << range.first << ", " << range.second << "] W\n";
+    return range;
+}
+
+bool Eco::isDramCapSearchOn() const
+{
+    return cfg_.dramCapSearch_ && device_->isCappableDomain(Domain::DRAM);
+}
+
 FinalPowerAndPerfResult Eco::multipleAppRunAndPowerSample(char* const* argv, int numIterations, std::optional<std::reference_wrapper<std::stringstream>> stream) {
     FinalPowerAndPerfResult sum;
     for(auto i = 0; i < cfg_.numIterations_; i++) {
@@ -637,7 +806,7 @@ void Eco::plotPowerLog(std::optional<FinalPowerAndPerfResult> results, std::stri
             const auto csv = logger_.getPerSubdeviceFileName(i);
             std::string img = csv;
             PlotBuilder ps(img.replace(img.end()-3, img.end(), "png"));
-            ps.setPlotTitle("gpu" + device_->getSubdeviceLabel(i) + " power log: " + device_->getName(), 16);
+            ps.setPlotTitle(device_->getSubdeviceLabel(i) + " power log: " + device_->getName(), 16);
             Series pcap(csv, 1, 2, "P cap [W]");
             Series pav(csv, 1, 3, "P[W]");
             ps.plotPowerLog({pcap, pav});
@@ -687,35 +856,68 @@ void Eco::staticEnergyProfiler(char* const* argv, int argc)
         stream << "# " << std::fixed << std::setprecision(3) << tmp << "\n";
     }
     reference /= cfg_.numIterations_;
+    if (isDramCapSearchOn()) {
+        device_->beginDomainSearchSession(Domain::DRAM);
+        reference.dramPowercap = device_->getPowerLimitInWatts();
+        device_->endDomainSearchSession();
+    }
     resultsVec.push_back(reference);
     stream << reference << "\n";
     auto powerLimitsVec = prepareListOfPowerCapsInMicroWatts();
+    // with DRAM cap search enabled each PKG cap is profiled for the whole list of DRAM caps
+    std::vector<std::optional<int>> dramLimitsVec {std::nullopt};
+    if (isDramCapSearchOn()) {
+        device_->beginDomainSearchSession(Domain::DRAM);
+        const auto dramLimits = prepareListOfPowerCapsInMicroWatts();
+        device_->endDomainSearchSession();
+        dramLimitsVec.assign(dramLimits.begin(), dramLimits.end());
+        stream << "# PKG x DRAM power caps grid, DRAM P_cap [W] in the last column\n";
+    }
     for (auto& currentLimit : powerLimitsVec) {
         device_->setPowerLimitInMicroWatts(currentLimit);
-        auto avResult = multipleAppRunAndPowerSample(argv, cfg_.numIterations_, stream);
-        auto k = getK();
-        auto mPlus = EnergyTimeResult(avResult.energy,
-                                        avResult.time_.totalTime_,
-                                        avResult.pkgPower).checkPlusMetric(reference.getEnergyAndTime(), k);
-        auto mPlusDynamic = (1.0/k) * (reference.getInstrPerSec() / avResult.getInstrPerSec()) *
-                            ((k-1.0) * (avResult.getEnergyPerInstr() / reference.getEnergyPerInstr()) + 1.0);
-        auto&& timeDelta = avResult.time_.totalTime_ - reference.time_.totalTime_;
-        resultsVec.emplace_back((double)currentLimit / 1000000,
-                                 avResult.energy,
-                                 avResult.pkgPower,
-                                 avResult.pp0power,
-                                 avResult.pp1power,
-                                 avResult.dramPower,
-                                 avResult.time_.totalTime_,
-                                 avResult.inst,
-                                 avResult.cycl,
-                                 avResult.energy - reference.energy,
-                                 timeDelta,
-                                 100 * (avResult.energy - reference.energy) / reference.energy,
-                                 100 * (timeDelta) / reference.time_.totalTime_,
-                                 mPlus);
-        stream << resultsVec.back() << "\t" << mPlusDynamic << "\n";
-        if (resultsVec.back().relativeDeltaT > (double)cfg_.perfDropStopCondition_) {
+        bool perfDropExceeded = false;
+        for (auto& currentDramLimit : dramLimitsVec) {
+            if (currentDramLimit.has_value()) {
+                device_->beginDomainSearchSession(Domain::DRAM);
+                device_->setPowerLimitInMicroWatts(*currentDramLimit);
+                device_->endDomainSearchSession();
+            }
+            auto avResult = multipleAppRunAndPowerSample(argv, cfg_.numIterations_, stream);
+            auto k = getK();
+            auto mPlus = EnergyTimeResult(avResult.energy,
+                                            avResult.time_.totalTime_,
+                                            avResult.pkgPower).checkPlusMetric(reference.getEnergyAndTime(), k);
+            auto mPlusDynamic = (1.0/k) * (reference.getInstrPerSec() / avResult.getInstrPerSec()) *
+                                ((k-1.0) * (avResult.getEnergyPerInstr() / reference.getEnergyPerInstr()) + 1.0);
+            auto&& timeDelta = avResult.time_.totalTime_ - reference.time_.totalTime_;
+            resultsVec.emplace_back((double)currentLimit / 1000000,
+                                     avResult.energy,
+                                     avResult.pkgPower,
+                                     avResult.pp0power,
+                                     avResult.pp1power,
+                                     avResult.dramPower,
+                                     avResult.time_.totalTime_,
+                                     avResult.inst,
+                                     avResult.cycl,
+                                     avResult.energy - reference.energy,
+                                     timeDelta,
+                                     100 * (avResult.energy - reference.energy) / reference.energy,
+                                     100 * (timeDelta) / reference.time_.totalTime_,
+                                     mPlus);
+            stream << resultsVec.back() << "\t" << mPlusDynamic;
+            if (currentDramLimit.has_value()) {
+                resultsVec.back().dramPowercap = (double)*currentDramLimit / 1000000;
+                stream << "\t" << resultsVec.back().dramPowercap;
+            }
+            stream << "\n";
+            if (resultsVec.back().relativeDeltaT > (double)cfg_.perfDropStopCondition_) {
+                // lower DRAM caps would only drop the performance further, while for
+                // the highest DRAM cap it means that lower PKG caps are not worth checking
+                perfDropExceeded = (&currentDramLimit == &dramLimitsVec.front());
+                break;
+            }
+        }
+        if (perfDropExceeded) {
             break;
         }
     }
@@ -734,5 +936,11 @@ void Eco::staticEnergyProfiler(char* const* argv, int argc)
                                 resultsVec.end(),
                                 CompareFinalResultsForMplus())->powercap
             << " W.\n";
+    if (isDramCapSearchOn()) {
+        const auto& bestE = *std::min_element(resultsVec.begin(), resultsVec.end(), CompareFinalResultsForMinE());
+        const auto& bestEt = *std::min_element(resultsVec.begin(), resultsVec.end(), CompareFinalResultsForMinEt());
+        stream << "# PKG x DRAM caps for: min(E): " << bestE.powercap << " W x " << bestE.dramPowercap << " W, "
+               << "min(Et): " << bestEt.powercap << " W x " << bestEt.dramPowercap << " W.\n";
+    }
     logger_.logToResultFile(stream);
 }
\ No newline at end of file
@@ -19,11 +19,18 @@
 #include "params_config.hpp"
 #include <yaml-cpp/yaml.h>
 
-ParamsConfig::ParamsConfig()
+ParamsConfig::ParamsConfig() :
+    ParamsConfig(true)
+{
+}
+
+ParamsConfig::ParamsConfig(bool printExplained)
 {
     loadConfig();
-    // TODO: might be printed on request and silent by default
-    printConfigExplained();
+    if (printExplained)
+    {
+        printConfigExplained();
+    }
 }
 
 void ParamsConfig::printConfigExplained()
@@ -33,6 +40,12 @@ void ParamsConfig::printConfigExplained()
             << percentStep_ << "%\n";
     std::cout << "\tCPU idle power consumption check time set to "
             << idleCheckTime_ << "s\n";
+    std::cout << "\tCPU idle power consumption is "
+            << (idlePowerCacheExpiry_ > 0 ? "cached in " + idlePowerCacheFile_ + " for " + std::to_string(idlePowerCacheExpiry_) + "s"
+                                          : std::string("measured on every start")) << ".\n";
+    std::cout << "\tPower caps are "
+            << (powerCapJournalDir_.empty() ? std::string("not journaled")
+                                            : "journaled in " + powerCapJournalDir_ + " and restored after a crash") << ".\n";
     std::cout << "\tEach experiment stored in result.csv is an average of "
             << numIterations_ << " test runs.\n";
     std::cout << "\tEnergy profiling for PKG domain will break after "
@@ -51,8 +64,20 @@ void ParamsConfig::printConfigExplained()
             << optimizationDelay_ << " seconds.\n";
     std::cout << "\tTuning phase will be repeated after "
             << repeatTuningPeriodInSec_ << " seconds.\n";
+    if (!customMetric_.empty())
+    {
+        std::cout << "\tDEPO minimizes custom metric: " << customMetric_ << "\n";
+    }
     std::cout << "\tDEPO will DO "
             << (doWaitPhase_ ? "" : "NOT") << " wait for steady power consumption profile basing on SMA filtered power reading.\n";
+    std::cout << "\tDRAM power cap search along with PKG power cap is "
+            << (dramCapSearch_ ? "ENABLED" : "DISABLED") << ".\n";
+    std::cout << "\tPerformance is measured with \"" << progressMetric_ << "\" progress metric.\n";
+    std::cout << "\tWorkload classifier narrowing the power cap search range is "
+            << (workloadClassifier_ ? "ENABLED" : "DISABLED") << ".\n";
+    std::cout << "\tFrequency limit search is "
+            << (frequencySearch_ == 0 ? "DISABLED" : (frequencySearch_ == 1 ? "ENABLED for core" : "ENABLED for uncore"))
+            << (frequencySearch_ && frequencySearchOnly_ ? " (power cap left at default)" : "") << ".\n";
     }
 
 
@@ -67,6 +92,7 @@ void ParamsConfig::loadConfig()
     perfDropStopCondition_ = config["perfDropStopCondition"].as<int>();
     powerSampleOn_ = config["powerSampleOn"].as<int>();
     targetMetric_ = config["targetMetric"].as<int>();
+    customMetric_ = config["customMetric"].as<std::string>();
     msTestPhasePeriod_ = config["msTestPhasePeriod"].as<int>();
     reducedPowerCapRange_ = config["reducedPowerCapRange"].as<int>();
     isPowerLogOn_ = config["powerLog"].as<int>();
@@ -75,6 +101,14 @@ void ParamsConfig::loadConfig()
     repeatTuningPeriodInSec_ = config["repeatTuningPeriodInSec"].as<int>();
     doWaitPhase_ = config["doWaitPhase"].as<int>();
     referenceRunMultiplier_ = config["referenceRunMultiplier"].as<int>();
+    dramCapSearch_ = config["dramCapSearch"].as<int>();
+    progressMetric_ = config["progressMetric"].as<std::string>();
+    frequencySearch_ = config["frequencySearch"].as<int>();
+    workloadClassifier_ = config["workloadClassifier"].as<int>();
+    frequencySearchOnly_ = config["frequencySearchOnly"].as<int>();
+    idlePowerCacheFile_ = config["idlePowerCacheFile"].as<std::string>();
+    idlePowerCacheExpiry_ = config["idlePowerCacheExpiry"].as<int>();
+    powerCapJournalDir_ = config["powerCapJournalDir"].as<std::string>();
     usTestPhasePeriod_ = msTestPhasePeriod_ * 1000;
     // return cfg;
 }
\ No newline at end of file
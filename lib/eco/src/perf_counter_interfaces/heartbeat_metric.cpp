@@ -0,0 +1,81 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "perf_counter_interfaces/heartbeat_metric.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+HeartbeatMetric::HeartbeatMetric() :
+    shmName_("/eco_heartbeat_" + std::to_string(getpid()))
+{
+    int fd = shm_open(shmName_.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        std::cerr << "[WARNING] Failed to create heartbeat shared memory " << shmName_
+                  << ": " << strerror(errno) << "\n";
+        return;
+    }
+    // the application may run as a different user than the tool, umask would drop the write bit
+    fchmod(fd, 0666);
+    if (ftruncate(fd, sizeof(eco_heartbeat_shm)) != 0)
+    {
+        std::cerr << "[WARNING] Failed to size heartbeat shared memory: " << strerror(errno) << "\n";
+        close(fd);
+        shm_unlink(shmName_.c_str());
+        return;
+    }
+    void* addr = mmap(nullptr, sizeof(eco_heartbeat_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        std::cerr << "[WARNING] Failed to map heartbeat shared memory: " << strerror(errno) << "\n";
+        shm_unlink(shmName_.c_str());
+        return;
+    }
+    region_ = static_cast<eco_heartbeat_shm*>(addr);
+    region_->units = 0;
+    region_->beats = 0;
+    region_->version = ECO_HEARTBEAT_VERSION;
+    __atomic_store_n(&region_->magic, ECO_HEARTBEAT_MAGIC, __ATOMIC_RELEASE);
+    setenv(ECO_HEARTBEAT_SHM_ENV, shmName_.c_str(), 1);
+}
+
+HeartbeatMetric::~HeartbeatMetric()
+{
+    if (region_ != nullptr)
+    {
+        munmap(region_, sizeof(eco_heartbeat_shm));
+        shm_unlink(shmName_.c_str());
+        unsetenv(ECO_HEARTBEAT_SHM_ENV);
+    }
+}
+
+unsigned long long HeartbeatMetric::readUnits() const
+{
+    return region_ == nullptr ? 0 : __atomic_load_n(&region_->units, __ATOMIC_RELAXED);
+}
+
+void HeartbeatMetric::reset()
+{
+    baseline_ = readUnits();
+}
+
+unsigned long long HeartbeatMetric::getCountSinceReset()
+{
+    return readUnits() - baseline_;
+}
@@ -0,0 +1,74 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "perf_counter_interfaces/pcm_fp_ops_metric.hpp"
+
+#include <iostream>
+
+namespace
+{
+constexpr int32_t FP_ARITH_INST_RETIRED = 0xC7;
+// umasks: scalar, 128-bit, 256-bit and 512-bit packed, single and double precision each
+constexpr int32_t FP_ARITH_UMASKS[] = {0x03, 0x0C, 0x30, 0xC0};
+// double precision lanes per vector width
+constexpr unsigned long long FP_ARITH_WEIGHTS[] = {1, 2, 4, 8};
+constexpr int32_t NUM_FP_ARITH_COUNTERS = 4;
+}
+
+PcmFpOpsMetric::PcmFpOpsMetric(pcm::PCM* pcm) :
+    pcm_(pcm)
+{
+    pcm::PCM::CustomCoreEventDescription events[NUM_FP_ARITH_COUNTERS];
+    for (int32_t i = 0; i < NUM_FP_ARITH_COUNTERS; i++)
+    {
+        events[i].event_number = FP_ARITH_INST_RETIRED;
+        events[i].umask_value = FP_ARITH_UMASKS[i];
+    }
+    pcm_->cleanup();
+    programmed_ = pcm_->program(pcm::PCM::CUSTOM_CORE_EVENTS, events) == pcm::PCM::Success;
+    if (!programmed_)
+    {
+        std::cerr << "[WARNING] Unsuccesfull FP_ARITH_INST_RETIRED events programming, restoring default PCM events\n";
+        pcm_->cleanup();
+        pcm_->program();
+    }
+    before_ = readState();
+}
+
+pcm::SystemCounterState PcmFpOpsMetric::readState() const
+{
+    pcm::SystemCounterState state;
+    std::vector<pcm::SocketCounterState> dummySocketStates;
+    std::vector<pcm::CoreCounterState> dummyCoreStates;
+    pcm_->getAllCounterStates(state, dummySocketStates, dummyCoreStates);
+    return state;
+}
+
+void PcmFpOpsMetric::reset()
+{
+    before_ = readState();
+}
+
+unsigned long long PcmFpOpsMetric::getCountSinceReset()
+{
+    const auto after = readState();
+    unsigned long long result = 0;
+    for (int32_t i = 0; i < NUM_FP_ARITH_COUNTERS; i++)
+    {
+        result += FP_ARITH_WEIGHTS[i] * getNumberOfCustomEvents(i, before_, after);
+    }
+    return result;
+}
@@ -0,0 +1,112 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "perf_counter_interfaces/perf_event_counters.hpp"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+// read() layout of a group with PERF_FORMAT_GROUP | TOTAL_TIME_ENABLED | TOTAL_TIME_RUNNING
+struct GroupReadFormat
+{
+    uint64_t nr;
+    uint64_t timeEnabled;
+    uint64_t timeRunning;
+    uint64_t values[2];
+};
+
+int openCounter(uint64_t config, int cpu, int groupFd)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(__NR_perf_event_open, &attr, -1 /* all processes */, cpu, groupFd, 0);
+}
+}
+
+PerfEventCounters::PerfEventCounters()
+{
+    const long numCpus = sysconf(_SC_NPROCESSORS_CONF);
+    for (int cpu = 0; cpu < numCpus; cpu++)
+    {
+        const int leaderFd = openCounter(PERF_COUNT_HW_INSTRUCTIONS, cpu, -1);
+        if (leaderFd < 0)
+        {
+            if (errno == ENODEV)
+            {
+                continue; // offline CPU
+            }
+            std::cerr << "[WARNING] perf_event_open failed on CPU " << cpu << ": " << std::strerror(errno) << "\n";
+            close();
+            return;
+        }
+        groupLeaderFds_.push_back(leaderFd);
+        const int memberFd = openCounter(PERF_COUNT_HW_CPU_CYCLES, cpu, leaderFd);
+        if (memberFd < 0)
+        {
+            std::cerr << "[WARNING] perf_event_open failed on CPU " << cpu << ": " << std::strerror(errno) << "\n";
+            close();
+            return;
+        }
+        memberFds_.push_back(memberFd);
+    }
+}
+
+PerfEventCounters::~PerfEventCounters()
+{
+    close();
+}
+
+void PerfEventCounters::close()
+{
+    for (auto fd : memberFds_)
+    {
+        ::close(fd);
+    }
+    for (auto fd : groupLeaderFds_)
+    {
+        ::close(fd);
+    }
+    memberFds_.clear();
+    groupLeaderFds_.clear();
+}
+
+PerfEventCounters::Values PerfEventCounters::read() const
+{
+    Values result;
+    for (auto fd : groupLeaderFds_)
+    {
+        GroupReadFormat group;
+        if (::read(fd, &group, sizeof(group)) != sizeof(group) || group.timeRunning == 0)
+        {
+            continue;
+        }
+        const double scale = double(group.timeEnabled) / group.timeRunning;
+        result.instructions += group.values[0] * scale;
+        result.cycles += group.values[1] * scale;
+    }
+    return result;
+}
@@ -0,0 +1,84 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "perf_counter_interfaces/process_instructions_metric.hpp"
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+ProcessInstructionsMetric::~ProcessInstructionsMetric()
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+}
+
+void ProcessInstructionsMetric::attachToProcess(pid_t pid)
+{
+    if (fd_ >= 0)
+    {
+        close(fd_);
+    }
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.inherit = 1;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    fd_ = syscall(__NR_perf_event_open, &attr, pid, -1 /* any CPU */, -1, 0);
+    if (fd_ < 0)
+    {
+        std::cerr << "[WARNING] perf_event_open failed for PID " << pid << ": " << std::strerror(errno)
+                  << ", process_instructions metric will count 0\n";
+    }
+    baseline_ = 0;
+}
+
+unsigned long long ProcessInstructionsMetric::readInstructions() const
+{
+    struct
+    {
+        uint64_t value;
+        uint64_t timeEnabled;
+        uint64_t timeRunning;
+    } counter;
+    if (fd_ < 0 || read(fd_, &counter, sizeof(counter)) != sizeof(counter) || counter.timeRunning == 0)
+    {
+        return 0;
+    }
+    // scale when the kernel multiplexes the PMU
+    return counter.value * (double(counter.timeEnabled) / counter.timeRunning);
+}
+
+void ProcessInstructionsMetric::reset()
+{
+    baseline_ = readInstructions();
+}
+
+unsigned long long ProcessInstructionsMetric::getCountSinceReset()
+{
+    const auto value = readInstructions();
+    return value > baseline_ ? value - baseline_ : 0;
+}
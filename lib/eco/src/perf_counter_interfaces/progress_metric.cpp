@@ -0,0 +1,91 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "perf_counter_interfaces/progress_metric.hpp"
+#include "perf_counter_interfaces/heartbeat_metric.hpp"
+#include "perf_counter_interfaces/process_instructions_metric.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+void FileCounterMetric::reset()
+{
+    const auto value = readCounter();
+    baseline_ = value < 0 ? 0 : value;
+    lastValue_ = baseline_;
+}
+
+unsigned long long FileCounterMetric::getCountSinceReset()
+{
+    const auto value = readCounter();
+    // file may be read while being rewritten - keep the last valid value then
+    if (value >= 0 && (unsigned long long)value >= lastValue_)
+    {
+        lastValue_ = value;
+    }
+    return lastValue_ - baseline_;
+}
+
+long long FileCounterMetric::readCounter() const
+{
+    std::ifstream file(path_);
+    long long value = -1;
+    if (!(file >> value))
+    {
+        return -1;
+    }
+    return value;
+}
+
+std::shared_ptr<ProgressMetric> makeInjectionBusyTimeMetric()
+{
+    // the injection library is loaded by the tuned application, which inherits the environment
+    setenv("INJECTION_MODE", "activity", 1);
+    return std::make_shared<FileCounterMetric>("./gpu_busy_ns");
+}
+
+std::shared_ptr<ProgressMetric> makeProgressMetric(const std::string& spec, std::shared_ptr<Device> device)
+{
+    const std::string filePrefix {"file:"};
+    if (spec.empty() || spec == "device")
+    {
+        return std::make_shared<DevicePerfCounterMetric>(device);
+    }
+    if (spec.compare(0, filePrefix.size(), filePrefix) == 0 && spec.size() > filePrefix.size())
+    {
+        return std::make_shared<FileCounterMetric>(spec.substr(filePrefix.size()));
+    }
+    if (spec == "process_instructions")
+    {
+        return std::make_shared<ProcessInstructionsMetric>();
+    }
+    if (spec == "heartbeat")
+    {
+        auto heartbeat = std::make_shared<HeartbeatMetric>();
+        if (heartbeat->isAvailable())
+        {
+            return heartbeat;
+        }
+    }
+    else if (auto metric = device->makeDeviceProgressMetric(spec))
+    {
+        return metric;
+    }
+    std::cerr << "[WARNING] Progress metric \"" << spec << "\" is not supported by " << device->getName()
+              << ", using the device performance counter instead.\n";
+    return std::make_shared<DevicePerfCounterMetric>(device);
+}
@@ -71,7 +71,7 @@ RaplState RaplStateSequence::getCurrentEnergyIncrement() const
 	                 energyDelta(current_.pp0_, next_.pp0_),
 					 energyDelta(current_.pp1_, next_.pp1_),
 					 energyDelta(current_.dram_, next_.dram_),
-					 std::chrono::high_resolution_clock::now()); // probably does not matter
+					 next_.timeSec_);
 }
 
 RaplState RaplStateSequence::getPreviousEnergyIncrement() const
@@ -80,7 +80,7 @@ RaplState RaplStateSequence::getPreviousEnergyIncrement() const
 	                 energyDelta(previous_.pp0_, current_.pp0_),
 					 energyDelta(previous_.pp1_, current_.pp1_),
 					 energyDelta(previous_.dram_, current_.dram_),
-					 std::chrono::high_resolution_clock::now()); // probably does not matter
+					 current_.timeSec_);
 }
 
 double RaplStateSequence::getCurrentTimeIncrement() const
@@ -134,8 +134,8 @@ void Rapl::initializeRaplForPowerReadingAndCapping()
 
 }
 
-Rapl::Rapl(int core, AvailableRaplPowerDomains avDom) :
-    cpuCore_(core), availableDomains_(avDom)
+Rapl::Rapl(int core, AvailableRaplPowerDomains avDom, std::shared_ptr<Clock> clock) :
+    availableDomains_(avDom), cpuCore_(core), clock_(clock)
 {
     initializeRaplForPowerReadingAndCapping();
     reset();
@@ -147,6 +147,7 @@ void Rapl::reset() {
     sample();
     sample();
 	RaplState emptyState;
+	emptyState.timeSec_ = clock_->now(); // start time of the averages
 	totalResultSinceLastReset_ = emptyState;
 }
 
@@ -157,7 +158,7 @@ void Rapl::sample() {
 		msr.getEnergyStatus(Domain::PP0),
 		availableDomains_.pp1_ ? msr.getEnergyStatus(Domain::PP1) : 0,
 		availableDomains_.dram_ ? msr.getEnergyStatus(Domain::DRAM) : 0,
-		std::chrono::high_resolution_clock::now());
+		clock_->now());
 
     rss_.storeNextState(nextState);
 
@@ -252,6 +253,20 @@ double Rapl::pkg_max_power() const
     return maxPower ? maxPower : pkgPowerInfo.thermalDesignPower;
 }
 
+double Rapl::dram_max_power() const
+{
+    if (!availableDomains_.dram_) { return 0.0; }
+    auto&& dramPowerInfo = MSR(cpuCore_).getPowerInfoForDRAM();
+    auto&& maxPower = dramPowerInfo.maxPower;
+    return maxPower ? maxPower : dramPowerInfo.thermalDesignPower;
+}
+
+double Rapl::dram_min_power() const
+{
+    if (!availableDomains_.dram_) { return 0.0; }
+    return MSR(cpuCore_).getPowerInfoForDRAM().minPower;
+}
+
 EnergyCrossDomains Rapl::getTotalEnergy() const
 {
     EnergyCrossDomains result;
@@ -0,0 +1,113 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "power_interface/amd_hsmp.hpp"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#if __has_include(<asm/amd_hsmp.h>)
+#include <asm/amd_hsmp.h>
+#else
+// uapi of the amd_hsmp driver (Linux 6.1+), for the older kernel headers
+#include <linux/types.h>
+#define HSMP_MAX_MSG_LEN 8
+struct hsmp_message {
+    __u32 msg_id;
+    __u16 num_args;
+    __u16 response_sz;
+    __u32 args[HSMP_MAX_MSG_LEN];
+    __u16 sock_ind;
+};
+#define HSMP_BASE_IOCTL_NR 0xF8
+#define HSMP_IOCTL_CMD _IOWR(HSMP_BASE_IOCTL_NR, 0, struct hsmp_message)
+#endif
+
+namespace {
+
+// message ids of the HSMP protocol, identical in all protocol versions
+constexpr uint32_t hsmpGetSocketPower {4};
+constexpr uint32_t hsmpSetSocketPowerLimit {5};
+constexpr uint32_t hsmpGetSocketPowerLimit {6};
+constexpr uint32_t hsmpGetSocketPowerLimitMax {7};
+
+} // namespace
+
+AmdHsmp::AmdHsmp(const std::string& devicePath)
+{
+    fd_ = ::open(devicePath.c_str(), O_RDWR | O_CLOEXEC);
+}
+
+AmdHsmp::~AmdHsmp()
+{
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+    }
+}
+
+std::optional<uint32_t> AmdHsmp::get(uint32_t messageId, uint16_t socket) const
+{
+    if (fd_ < 0)
+    {
+        return std::nullopt;
+    }
+    struct hsmp_message message {};
+    message.msg_id = messageId;
+    message.num_args = 0;
+    message.response_sz = 1;
+    message.sock_ind = socket;
+    int result;
+    while ((result = ::ioctl(fd_, HSMP_IOCTL_CMD, &message)) < 0 && errno == EINTR) {}
+    if (result < 0)
+    {
+        return std::nullopt;
+    }
+    return message.args[0];
+}
+
+std::optional<uint32_t> AmdHsmp::getSocketPowerInMilliWatts(uint16_t socket) const
+{
+    return get(hsmpGetSocketPower, socket);
+}
+
+std::optional<uint32_t> AmdHsmp::getSocketPowerLimitInMilliWatts(uint16_t socket) const
+{
+    return get(hsmpGetSocketPowerLimit, socket);
+}
+
+std::optional<uint32_t> AmdHsmp::getSocketPowerLimitMaxInMilliWatts(uint16_t socket) const
+{
+    return get(hsmpGetSocketPowerLimitMax, socket);
+}
+
+bool AmdHsmp::setSocketPowerLimitInMilliWatts(uint16_t socket, uint32_t limitInMilliWatts) const
+{
+    if (fd_ < 0)
+    {
+        return false;
+    }
+    struct hsmp_message message {};
+    message.msg_id = hsmpSetSocketPowerLimit;
+    message.num_args = 1;
+    message.response_sz = 0;
+    message.args[0] = limitInMilliWatts;
+    message.sock_ind = socket;
+    int result;
+    while ((result = ::ioctl(fd_, HSMP_IOCTL_CMD, &message)) < 0 && errno == EINTR) {}
+    return result == 0;
+}
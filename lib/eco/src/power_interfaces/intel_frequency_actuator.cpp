@@ -0,0 +1,163 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "power_interface/intel_frequency_actuator.hpp"
+#include "power_interface/msr_offsets.hpp"
+#include "power_interface/power_cap_journal.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+static inline int readFrequencyFromFile (std::string fileName) {
+    std::ifstream freqFile (fileName.c_str());
+    std::string line;
+    int freq = -1;
+    if (freqFile.is_open()){
+        while ( getline (freqFile, line) ){
+            freq = atoi(line.c_str());
+        }
+        freqFile.close();
+    } else {
+        std::cerr << "cannot read the frequency file: " << fileName << "\n"
+                  << "file not open\n";
+    }
+    return freq;
+}
+
+static inline bool writeFrequencyToFile (std::string fileName, int freq) {
+    std::ofstream outfile (fileName.c_str(), std::ios::out | std::ios::trunc);
+    if (outfile.is_open()){
+        outfile << freq;
+    } else {
+        std::cerr << "cannot write the frequency to file " << fileName << "\n"
+                  << "file not open\n";
+    }
+    outfile.close();
+    return !outfile.fail();
+}
+
+// journal target of MSR_UNCORE_RATIO_LIMIT of a core
+static inline std::string uncoreRatioLimitTarget (int core) {
+    std::stringstream target;
+    target << "/dev/cpu/" << core << "/msr:0x" << std::hex << MSR_UNCORE_RATIO_LIMIT;
+    return target.str();
+}
+
+IntelCoreFrequencyActuator::IntelCoreFrequencyActuator(int numCores)
+{
+    // limits left by a killed process are restored before the defaults are read
+    auto& journal = PowerCapJournal::instance();
+    for (int core = 0; core < numCores; core++) {
+        const auto coreDir = cpufreqBaseDirectory_ + std::to_string(core) + "/cpufreq/";
+        const auto defaultFreq = readFrequencyFromFile(coreDir + "scaling_max_freq");
+        if (defaultFreq < 0) {
+            continue; // offline core or no cpufreq driver
+        }
+        scalingMaxFreqFiles_.push_back(coreDir + "scaling_max_freq");
+        defaultScalingMaxFreqInKHz_.push_back(defaultFreq);
+        journal.recordOriginal(journalDeviceName_, PowerCapJournal::Backend::SYSFS, scalingMaxFreqFiles_.back(), defaultFreq);
+        if (scalingMaxFreqFiles_.size() == 1) {
+            // cpufreq uses kHz
+            minFrequencyInMHz_ = readFrequencyFromFile(coreDir + "cpuinfo_min_freq") / 1000;
+            maxFrequencyInMHz_ = readFrequencyFromFile(coreDir + "cpuinfo_max_freq") / 1000;
+            currentLimitInMHz_ = defaultFreq / 1000;
+        }
+    }
+    std::cout << "[INFO] " << getName() << " frequency range for " << scalingMaxFreqFiles_.size()
+              << " cores is [" << minFrequencyInMHz_ << ", " << maxFrequencyInMHz_ << "] MHz\n";
+}
+
+std::pair<unsigned, unsigned> IntelCoreFrequencyActuator::getMinMaxFrequencyInMHz() const
+{
+    return std::make_pair(minFrequencyInMHz_, maxFrequencyInMHz_);
+}
+
+void IntelCoreFrequencyActuator::setFrequencyLimitInMHz(unsigned limitInMHz)
+{
+    currentLimitInMHz_ = std::clamp(limitInMHz, minFrequencyInMHz_, maxFrequencyInMHz_);
+    const int limitInKHz = currentLimitInMHz_ * 1000;
+    auto& journal = PowerCapJournal::instance();
+    for (auto& scalingMaxFreqFile : scalingMaxFreqFiles_) {
+        journal.apply(journalDeviceName_, PowerCapJournal::Backend::SYSFS, scalingMaxFreqFile, limitInKHz,
+                      [&] { writeFrequencyToFile(scalingMaxFreqFile, limitInKHz); });
+    }
+}
+
+void IntelCoreFrequencyActuator::restoreDefaultFrequency()
+{
+    bool isRestored = true;
+    for (size_t i = 0; i < scalingMaxFreqFiles_.size(); i++) {
+        isRestored = writeFrequencyToFile(scalingMaxFreqFiles_[i], defaultScalingMaxFreqInKHz_[i]) && isRestored;
+    }
+    if (!defaultScalingMaxFreqInKHz_.empty()) {
+        currentLimitInMHz_ = defaultScalingMaxFreqInKHz_.front() / 1000;
+    }
+    if (isRestored) {
+        PowerCapJournal::instance().markRestored(journalDeviceName_);
+    }
+}
+
+IntelUncoreFrequencyActuator::IntelUncoreFrequencyActuator(std::vector<int> pkgToFirstCoreMap) :
+    pkgToFirstCoreMap_(pkgToFirstCoreMap)
+{
+    // limits left by a killed process are restored before the defaults are read
+    auto& journal = PowerCapJournal::instance();
+    for (auto&& core : pkgToFirstCoreMap_) {
+        MSR msr(core);
+        defaultRatioLimits_.push_back(msr.getUncoreRatioLimit());
+        journal.recordOriginal(journalDeviceName_, PowerCapJournal::Backend::MSR, uncoreRatioLimitTarget(core),
+                               msr.getUncoreRatioLimitRegister());
+    }
+    if (!defaultRatioLimits_.empty()) {
+        // assume that all packages share the same defaults
+        minFrequencyInMHz_ = defaultRatioLimits_.front().minRatio * UNCORE_RATIO_TO_MHZ;
+        maxFrequencyInMHz_ = defaultRatioLimits_.front().maxRatio * UNCORE_RATIO_TO_MHZ;
+        currentLimitInMHz_ = maxFrequencyInMHz_;
+    }
+    std::cout << "[INFO] " << getName() << " frequency range is ["
+              << minFrequencyInMHz_ << ", " << maxFrequencyInMHz_ << "] MHz\n";
+}
+
+std::pair<unsigned, unsigned> IntelUncoreFrequencyActuator::getMinMaxFrequencyInMHz() const
+{
+    return std::make_pair(minFrequencyInMHz_, maxFrequencyInMHz_);
+}
+
+void IntelUncoreFrequencyActuator::setFrequencyLimitInMHz(unsigned limitInMHz)
+{
+    currentLimitInMHz_ = std::clamp(limitInMHz, minFrequencyInMHz_, maxFrequencyInMHz_);
+    auto& journal = PowerCapJournal::instance();
+    for (size_t pkg = 0; pkg < pkgToFirstCoreMap_.size(); pkg++) {
+        UncoreRatioLimit limit = defaultRatioLimits_[pkg];
+        limit.maxRatio = std::max(currentLimitInMHz_ / UNCORE_RATIO_TO_MHZ, limit.minRatio);
+        MSR msr(pkgToFirstCoreMap_[pkg]);
+        const auto rawValue = MSR::encodeUncoreRatioLimit(msr.getUncoreRatioLimitRegister(), limit);
+        journal.apply(journalDeviceName_, PowerCapJournal::Backend::MSR, uncoreRatioLimitTarget(pkgToFirstCoreMap_[pkg]),
+                      rawValue, [&] { msr.setUncoreRatioLimit(limit); });
+    }
+}
+
+void IntelUncoreFrequencyActuator::restoreDefaultFrequency()
+{
+    for (size_t pkg = 0; pkg < pkgToFirstCoreMap_.size(); pkg++) {
+        MSR(pkgToFirstCoreMap_[pkg]).setUncoreRatioLimit(defaultRatioLimits_[pkg]);
+    }
+    currentLimitInMHz_ = maxFrequencyInMHz_;
+    // a failed MSR write exits the process (see MSR), which leaves the limits to the journal
+    PowerCapJournal::instance().markRestored(journalDeviceName_);
+}
@@ -109,7 +109,15 @@ double MSR::getFixedDramUnitsValue() {
 }
 
 PowerInfo MSR::getPowerInfoForPKG() {
-    uint64_t rawValue = readMSR(MSR_PKG_POWER_INFO);
+    return decodePowerInfo(readMSR(MSR_PKG_POWER_INFO));
+}
+
+PowerInfo MSR::getPowerInfoForDRAM() {
+    // MSR_DRAM_POWER_INFO shares the bit layout of MSR_PKG_POWER_INFO
+    return decodePowerInfo(readMSR(MSR_DRAM_POWER_INFO));
+}
+
+PowerInfo MSR::decodePowerInfo(uint64_t rawValue) {
 	PowerInfo result;
 	auto powerUnits = getUnits(Quantity::Power);
     result.thermalDesignPower = powerUnits * ((double)(rawValue & 0x7fff));
@@ -162,6 +170,29 @@ void MSR::disablePowerCapping(Domain domain) {
 	writeMSR(offset, (rawValue & ~(0x1 << 15)));
 }
 
+UncoreRatioLimit MSR::getUncoreRatioLimit() {
+    uint64_t rawValue = readMSR(MSR_UNCORE_RATIO_LIMIT);
+    UncoreRatioLimit result;
+    result.maxRatio = rawValue & UNCORE_MAX_RATIO_MASK;
+    result.minRatio = (rawValue >> UNCORE_MIN_RATIO_OFFSET) & UNCORE_MAX_RATIO_MASK;
+    return result;
+}
+
+void MSR::setUncoreRatioLimit(UncoreRatioLimit limit) {
+    writeMSR(MSR_UNCORE_RATIO_LIMIT, encodeUncoreRatioLimit(readMSR(MSR_UNCORE_RATIO_LIMIT), limit));
+}
+
+uint64_t MSR::getUncoreRatioLimitRegister() {
+    return readMSR(MSR_UNCORE_RATIO_LIMIT);
+}
+
+uint64_t MSR::encodeUncoreRatioLimit(uint64_t rawValue, UncoreRatioLimit limit) {
+    rawValue &= ~((uint64_t)UNCORE_MAX_RATIO_MASK | ((uint64_t)UNCORE_MAX_RATIO_MASK << UNCORE_MIN_RATIO_OFFSET));
+    rawValue |= (limit.maxRatio & UNCORE_MAX_RATIO_MASK);
+    rawValue |= (uint64_t)(limit.minRatio & UNCORE_MAX_RATIO_MASK) << UNCORE_MIN_RATIO_OFFSET;
+    return rawValue;
+}
+
 bool MSR::checkLockedByBIOS() {
 	uint64_t rawValue = readMSR(getOffsetForPowerLimit(Domain::PKG));
 	bool result = (rawValue >> 63) == 1;
@@ -0,0 +1,148 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "power_interface/nvml_frequency_actuator.hpp"
+#include "power_interface/power_cap_journal.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+// NVML clocks of a journal, reset to their defaults (see PowerCapJournal)
+static bool resetNvmlClocks(const PowerCapJournal::Record& record)
+{
+    static const bool isNvmlInitialized = NVML_SUCCESS == nvmlInit();
+    nvmlDevice_t handle;
+    if (!isNvmlInitialized || NVML_SUCCESS != nvmlDeviceGetHandleByIndex(std::stoul(record.target), &handle))
+    {
+        return false;
+    }
+    const nvmlReturn_t result = record.backend == PowerCapJournal::Backend::NVML_LOCKED_CLOCKS
+                                ? nvmlDeviceResetGpuLockedClocks(handle)
+                                : nvmlDeviceResetApplicationsClocks(handle);
+    // locked clocks are journaled before they turn out not to be supported
+    return result == NVML_SUCCESS || result == NVML_ERROR_NOT_SUPPORTED;
+}
+
+[[maybe_unused]] static const bool isLockedClocksRestorerRegistered =
+    PowerCapJournal::registerRestorer(PowerCapJournal::Backend::NVML_LOCKED_CLOCKS, resetNvmlClocks);
+[[maybe_unused]] static const bool isApplicationClocksRestorerRegistered =
+    PowerCapJournal::registerRestorer(PowerCapJournal::Backend::NVML_APPLICATION_CLOCKS, resetNvmlClocks);
+
+NvmlFrequencyActuator::NvmlFrequencyActuator(nvmlDevice_t deviceHandle) :
+    deviceHandle_(deviceHandle)
+{
+    unsigned index = 0;
+    nvmlDeviceGetIndex(deviceHandle_, &index);
+    journalDeviceName_ = "gpu" + std::to_string(index) + "_clocks";
+    journalTarget_ = std::to_string(index);
+    unsigned count = 0;
+    nvmlReturn_t result = nvmlDeviceGetSupportedMemoryClocks(deviceHandle_, &count, nullptr);
+    std::vector<unsigned> memoryClocks(count);
+    if (count == 0 || (result = nvmlDeviceGetSupportedMemoryClocks(deviceHandle_, &count, memoryClocks.data())) != NVML_SUCCESS)
+    {
+        printf("Failed to get supported memory clocks: %s\n", nvmlErrorString(result));
+    }
+    else
+    {
+        memoryClockInMHz_ = *std::max_element(memoryClocks.begin(), memoryClocks.end());
+        count = 0;
+        nvmlDeviceGetSupportedGraphicsClocks(deviceHandle_, memoryClockInMHz_, &count, nullptr);
+        supportedGraphicsClocksInMHz_.resize(count);
+        result = nvmlDeviceGetSupportedGraphicsClocks(deviceHandle_, memoryClockInMHz_, &count, supportedGraphicsClocksInMHz_.data());
+        if (result != NVML_SUCCESS)
+        {
+            printf("Failed to get supported graphics clocks: %s\n", nvmlErrorString(result));
+            supportedGraphicsClocksInMHz_.clear();
+        }
+        std::sort(supportedGraphicsClocksInMHz_.begin(), supportedGraphicsClocksInMHz_.end());
+    }
+    currentLimitInMHz_ = getMinMaxFrequencyInMHz().second;
+    std::cout << "[INFO] " << getName() << " frequency range is [" << getMinMaxFrequencyInMHz().first
+              << ", " << getMinMaxFrequencyInMHz().second << "] MHz\n";
+}
+
+std::string NvmlFrequencyActuator::getName() const
+{
+    return useLockedClocks_ ? "NVIDIA GPU locked clocks" : "NVIDIA GPU application clocks";
+}
+
+std::pair<unsigned, unsigned> NvmlFrequencyActuator::getMinMaxFrequencyInMHz() const
+{
+    if (supportedGraphicsClocksInMHz_.empty())
+    {
+        return std::make_pair(0U, 0U);
+    }
+    return std::make_pair(supportedGraphicsClocksInMHz_.front(), supportedGraphicsClocksInMHz_.back());
+}
+
+unsigned NvmlFrequencyActuator::findSupportedGraphicsClock(unsigned limitInMHz) const
+{
+    auto it = std::upper_bound(supportedGraphicsClocksInMHz_.begin(), supportedGraphicsClocksInMHz_.end(), limitInMHz);
+    return it == supportedGraphicsClocksInMHz_.begin() ? supportedGraphicsClocksInMHz_.front() : *(it - 1);
+}
+
+void NvmlFrequencyActuator::setFrequencyLimitInMHz(unsigned limitInMHz)
+{
+    if (supportedGraphicsClocksInMHz_.empty())
+    {
+        return;
+    }
+    const unsigned clockInMHz = findSupportedGraphicsClock(limitInMHz);
+    nvmlReturn_t result = NVML_ERROR_NOT_SUPPORTED;
+    auto& journal = PowerCapJournal::instance();
+    if (useLockedClocks_)
+    {
+        // the original of the clocks is their default, restored by the reset
+        journal.recordOriginal(journalDeviceName_, PowerCapJournal::Backend::NVML_LOCKED_CLOCKS, journalTarget_, 0);
+        journal.apply(journalDeviceName_, PowerCapJournal::Backend::NVML_LOCKED_CLOCKS, journalTarget_, clockInMHz, [&] {
+            result = nvmlDeviceSetGpuLockedClocks(deviceHandle_, supportedGraphicsClocksInMHz_.front(), clockInMHz);
+        });
+        if (result == NVML_ERROR_NOT_SUPPORTED)
+        {
+            std::cout << "[INFO] GPU locked clocks not supported, falling back to application clocks.\n";
+            useLockedClocks_ = false;
+        }
+    }
+    if (!useLockedClocks_)
+    {
+        journal.recordOriginal(journalDeviceName_, PowerCapJournal::Backend::NVML_APPLICATION_CLOCKS, journalTarget_, 0);
+        journal.apply(journalDeviceName_, PowerCapJournal::Backend::NVML_APPLICATION_CLOCKS, journalTarget_, clockInMHz, [&] {
+            result = nvmlDeviceSetApplicationsClocks(deviceHandle_, memoryClockInMHz_, clockInMHz);
+        });
+    }
+    if (result != NVML_SUCCESS)
+    {
+        printf("Failed to set GPU clock to %u MHz: %s\n", clockInMHz, nvmlErrorString(result));
+        return;
+    }
+    currentLimitInMHz_ = clockInMHz;
+}
+
+void NvmlFrequencyActuator::restoreDefaultFrequency()
+{
+    nvmlReturn_t result = useLockedClocks_ ? nvmlDeviceResetGpuLockedClocks(deviceHandle_)
+                                           : nvmlDeviceResetApplicationsClocks(deviceHandle_);
+    if (result != NVML_SUCCESS)
+    {
+        printf("Failed to reset GPU clocks: %s\n", nvmlErrorString(result));
+    }
+    else
+    {
+        PowerCapJournal::instance().markRestored(journalDeviceName_);
+    }
+    currentLimitInMHz_ = getMinMaxFrequencyInMHz().second;
+}
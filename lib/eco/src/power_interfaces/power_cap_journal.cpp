@@ -0,0 +1,553 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "power_interface/power_cap_journal.hpp"
+#include "power_interface/amd_hsmp.hpp"
+#include "devices/plugin_device.hpp"
+#include "params_config.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/file.h>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* toString(PowerCapJournal::Backend backend)
+{
+    switch (backend)
+    {
+        case PowerCapJournal::Backend::NVML:
+            return "nvml";
+        case PowerCapJournal::Backend::HSMP:
+            return "hsmp";
+        case PowerCapJournal::Backend::ROCM_SMI:
+            return "rocm_smi";
+        case PowerCapJournal::Backend::MSR:
+            return "msr";
+        case PowerCapJournal::Backend::NVML_LOCKED_CLOCKS:
+            return "nvml_locked_clocks";
+        case PowerCapJournal::Backend::NVML_APPLICATION_CLOCKS:
+            return "nvml_application_clocks";
+        case PowerCapJournal::Backend::LEVEL_ZERO:
+            return "level_zero";
+        default:
+            return "sysfs";
+    }
+}
+
+PowerCapJournal::Backend parseBackend(const std::string& name)
+{
+    for (auto backend : {PowerCapJournal::Backend::NVML, PowerCapJournal::Backend::HSMP, PowerCapJournal::Backend::ROCM_SMI,
+                         PowerCapJournal::Backend::MSR, PowerCapJournal::Backend::NVML_LOCKED_CLOCKS,
+                         PowerCapJournal::Backend::NVML_APPLICATION_CLOCKS, PowerCapJournal::Backend::LEVEL_ZERO})
+    {
+        if (name == toString(backend))
+        {
+            return backend;
+        }
+    }
+    return PowerCapJournal::Backend::SYSFS;
+}
+
+// device plugin which registers the restorer of a vendor backend when it is loaded
+const char* pluginOf(PowerCapJournal::Backend backend)
+{
+    switch (backend)
+    {
+        case PowerCapJournal::Backend::NVML:
+        case PowerCapJournal::Backend::NVML_LOCKED_CLOCKS:
+        case PowerCapJournal::Backend::NVML_APPLICATION_CLOCKS:
+            return "cuda";
+        case PowerCapJournal::Backend::ROCM_SMI:
+            return "rocm";
+        case PowerCapJournal::Backend::LEVEL_ZERO:
+            return "xpu";
+        default:
+            return "";
+    }
+}
+
+std::mutex restorersMutex;
+
+std::map<PowerCapJournal::Backend, PowerCapJournal::Restorer>& restorers()
+{
+    static std::map<PowerCapJournal::Backend, PowerCapJournal::Restorer> registered;
+    return registered;
+}
+
+PowerCapJournal::Restorer findRestorer(PowerCapJournal::Backend backend)
+{
+    {
+        std::lock_guard<std::mutex> lock(restorersMutex);
+        const auto restorer = restorers().find(backend);
+        if (restorer != restorers().end())
+        {
+            return restorer->second;
+        }
+    }
+    // e.g. the NVML caps left by a crashed DEPO, restored by RestorePowerCaps
+    const std::string plugin = pluginOf(backend);
+    if (plugin.empty() || !PluginDevice::load(plugin))
+    {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(restorersMutex);
+    const auto restorer = restorers().find(backend);
+    return restorer != restorers().end() ? restorer->second : nullptr;
+}
+
+// sysfs settings restored from the fatal signals handler, prepared by recordOriginal
+struct SignalSafeSetting
+{
+    char path[256];
+    char value[24];
+};
+constexpr size_t maxSignalSafeSettings = 256;
+SignalSafeSetting signalSafeSettings[maxSignalSafeSettings];
+std::atomic<size_t> numSignalSafeSettings {0};
+std::atomic<bool> anyCapApplied {false};
+std::atomic<PowerCapJournal*> activeJournal {nullptr};
+pid_t handlersOwnerPid {0};
+int restorerPipe[2] {-1, -1};
+
+// only async-signal-safe calls below
+void restoreSysfsSettingsFromSignalHandler()
+{
+    if (!anyCapApplied.load())
+    {
+        return;
+    }
+    const size_t numSettings = numSignalSafeSettings.load(std::memory_order_acquire);
+    for (size_t i = 0; i < numSettings; ++i)
+    {
+        const int fd = ::open(signalSafeSettings[i].path, O_WRONLY | O_TRUNC);
+        if (fd >= 0)
+        {
+            const ssize_t written = ::write(fd, signalSafeSettings[i].value, ::strlen(signalSafeSettings[i].value));
+            (void)written;
+            ::close(fd);
+        }
+    }
+}
+
+void reraise(int signo)
+{
+    ::signal(signo, SIG_DFL);
+    ::raise(signo);
+}
+
+void terminationSignalHandler(int signo)
+{
+    // a forked child shares the handlers until it calls exec
+    if (::getpid() == handlersOwnerPid)
+    {
+        const int savedErrno = errno;
+        const unsigned char byte = static_cast<unsigned char>(signo);
+        const bool restorerWoken = restorerPipe[1] >= 0 && ::write(restorerPipe[1], &byte, 1) == 1;
+        errno = savedErrno;
+        if (restorerWoken)
+        {
+            return;
+        }
+        restoreSysfsSettingsFromSignalHandler();
+    }
+    reraise(signo);
+}
+
+void fatalSignalHandler(int signo)
+{
+    if (::getpid() == handlersOwnerPid)
+    {
+        restoreSysfsSettingsFromSignalHandler();
+    }
+    reraise(signo);
+}
+
+// <msr file>:<offset>, e.g. /dev/cpu/0/msr:0x620
+bool writeMsr(const std::string& target, long long value)
+{
+    const auto separator = target.rfind(':');
+    if (separator == std::string::npos)
+    {
+        return false;
+    }
+    const int fd = ::open(target.substr(0, separator).c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    const uint64_t rawValue = static_cast<uint64_t>(value);
+    const off_t offset = std::stoul(target.substr(separator + 1), nullptr, 0);
+    const bool isWritten = ::pwrite(fd, &rawValue, sizeof(rawValue), offset) == sizeof(rawValue);
+    ::close(fd);
+    return isWritten;
+}
+
+bool restoreSetting(const PowerCapJournal::Record& record)
+{
+    if (record.backend == PowerCapJournal::Backend::SYSFS)
+    {
+        std::ofstream file(record.target, std::ios::out | std::ios::trunc);
+        file << record.value;
+        file.close();
+        return !file.fail();
+    }
+    if (record.backend == PowerCapJournal::Backend::HSMP)
+    {
+        static const AmdHsmp hsmp;
+        return hsmp.setSocketPowerLimitInMilliWatts(std::stoul(record.target), static_cast<uint32_t>(record.value));
+    }
+    if (record.backend == PowerCapJournal::Backend::MSR)
+    {
+        return writeMsr(record.target, record.value);
+    }
+    const auto restorer = findRestorer(record.backend);
+    if (restorer == nullptr)
+    {
+        std::cerr << "[ERROR] No restorer of " << toString(record.backend) << " settings, is the "
+                  << pluginOf(record.backend) << " device plugin in " ECO_PLUGIN_PATH_ENV "?\n";
+        return false;
+    }
+    return restorer(record);
+}
+
+// writes back the originals of the devices in \p devicesWithCapsApplied, returns the number of failures
+int restoreOriginals(const std::vector<PowerCapJournal::Record>& originals,
+                     const std::map<std::string, bool>& devicesWithCapsApplied,
+                     bool dryRun)
+{
+    int failures = 0;
+    for (const auto& original : originals)
+    {
+        const auto applied = devicesWithCapsApplied.find(original.device);
+        if (applied == devicesWithCapsApplied.end() || !applied->second)
+        {
+            continue;
+        }
+        std::cout << "[INFO] " << (dryRun ? "Would restore " : "Restoring ") << original.device << " "
+                  << toString(original.backend) << " " << original.target << " = " << original.value << "\n";
+        if (!dryRun && !restoreSetting(original))
+        {
+            std::cerr << "[ERROR] Failed to restore " << original.target << " of " << original.device << "\n";
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+} // namespace
+
+bool PowerCapJournal::registerRestorer(Backend backend, Restorer restorer)
+{
+    std::lock_guard<std::mutex> lock(restorersMutex);
+    restorers()[backend] = restorer;
+    return true;
+}
+
+PowerCapJournal& PowerCapJournal::instance()
+{
+    static PowerCapJournal journal([] {
+        try
+        {
+            return ParamsConfig(false).powerCapJournalDir_;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "[WARNING] config.yaml not loaded (" << e.what() << "), power caps journal in " << defaultDir << "\n";
+            return std::string(defaultDir);
+        }
+    }());
+    return journal;
+}
+
+int PowerCapJournal::restoreLeftovers(const std::string& journalDir, bool dryRun)
+{
+    int failures = 0;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(journalDir, ec))
+    {
+        if (entry.path().extension() != ".journal")
+        {
+            continue;
+        }
+        const int fd = ::open(entry.path().c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            continue;
+        }
+        if (::flock(fd, LOCK_EX | LOCK_NB) != 0)
+        {
+            // owned by a running process
+            ::close(fd);
+            continue;
+        }
+        std::vector<Record> originals;
+        std::map<std::string, bool> devicesWithCapsApplied;
+        std::ifstream journal(entry.path());
+        std::string line;
+        while (std::getline(journal, line))
+        {
+            std::istringstream fields(line);
+            std::string kind, backend;
+            Record record;
+            fields >> kind >> record.device;
+            if (kind == "RESTORED")
+            {
+                devicesWithCapsApplied[record.device] = false;
+                continue;
+            }
+            fields >> backend >> record.value >> std::ws;
+            std::getline(fields, record.target);
+            if (fields.fail() || record.target.empty())
+            {
+                continue; // torn record of the crashed process
+            }
+            record.backend = parseBackend(backend);
+            if (kind == "ORIGINAL")
+            {
+                originals.push_back(record);
+            }
+            else if (kind == "APPLY")
+            {
+                devicesWithCapsApplied[record.device] = true;
+            }
+        }
+        std::cout << "[INFO] Power caps journal " << entry.path().string() << " left by a process that is gone\n";
+        const int journalFailures = restoreOriginals(originals, devicesWithCapsApplied, dryRun);
+        if (!dryRun && journalFailures == 0)
+        {
+            fs::remove(entry.path(), ec);
+        }
+        failures += journalFailures;
+        ::close(fd);
+    }
+    return failures;
+}
+
+void PowerCapJournal::installSignalHandlers()
+{
+    static std::once_flag installed;
+    std::call_once(installed, [] {
+        handlersOwnerPid = ::getpid();
+        if (::pipe2(restorerPipe, O_CLOEXEC) == 0)
+        {
+            std::thread(&PowerCapJournal::runSignalRestorer).detach();
+        }
+        auto install = [](int signo, void (*handler)(int)) {
+            struct sigaction current {};
+            if (::sigaction(signo, nullptr, &current) != 0 || current.sa_handler != SIG_DFL)
+            {
+                return; // ignored or handled by the application
+            }
+            struct sigaction action {};
+            action.sa_handler = handler;
+            sigemptyset(&action.sa_mask);
+            action.sa_flags = SA_RESTART;
+            ::sigaction(signo, &action, nullptr);
+        };
+        for (int signo : {SIGINT, SIGTERM, SIGHUP, SIGQUIT})
+        {
+            install(signo, terminationSignalHandler);
+        }
+        for (int signo : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT})
+        {
+            install(signo, fatalSignalHandler);
+        }
+    });
+}
+
+void PowerCapJournal::runSignalRestorer()
+{
+    unsigned char signo = 0;
+    while (::read(restorerPipe[0], &signo, 1) < 0 && errno == EINTR) {}
+    std::cerr << "\n[INFO] " << ::strsignal(signo) << " received, restoring default power caps\n";
+    if (auto* journal = activeJournal.load())
+    {
+        // the lock is never released so that no cap is applied after the restore
+        journal->mutex_.lock();
+        if (journal->restoreAllLocked() == 0)
+        {
+            journal->removeFile();
+        }
+    }
+    reraise(signo);
+    ::_exit(128 + signo);
+}
+
+PowerCapJournal::PowerCapJournal(const std::string& journalDir)
+{
+    if (journalDir.empty())
+    {
+        std::cerr << "[WARNING] Power caps journal disabled, caps are not restored after a crash\n";
+        activeJournal.store(this);
+        return;
+    }
+    // before any device reads its defaults
+    restoreLeftovers(journalDir);
+
+    std::error_code ec;
+    fs::create_directories(journalDir, ec);
+    path_ = journalDir + "/" + std::to_string(::getpid()) + ".journal";
+    // locked under a temporary name and renamed, so that restoreLeftovers of another process
+    // never finds it unlocked (and empty) and removes it; O_CLOEXEC - the lock must not be
+    // inherited by the tuned application
+    const std::string temporaryPath = path_ + ".tmp";
+    fd_ = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0 || ::flock(fd_, LOCK_EX | LOCK_NB) != 0 || ::rename(temporaryPath.c_str(), path_.c_str()) != 0)
+    {
+        std::cerr << "[WARNING] Cannot open power caps journal " << path_ << ": " << strerror(errno)
+                  << ", caps are not restored after a crash\n";
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        ::unlink(temporaryPath.c_str());
+    }
+    activeJournal.store(this);
+}
+
+PowerCapJournal::~PowerCapJournal()
+{
+    activeJournal.store(nullptr);
+    std::lock_guard<std::mutex> lock(mutex_);
+    // safety net for devices that have not restored their defaults
+    if (restoreAllLocked() == 0)
+    {
+        removeFile();
+    }
+    if (fd_ >= 0)
+    {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void PowerCapJournal::recordOriginal(const std::string& device, Backend backend, const std::string& target, long long value)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& original : originals_)
+    {
+        if (original.device == device && original.backend == backend && original.target == target)
+        {
+            return;
+        }
+    }
+    originals_.push_back(Record{device, backend, target, value});
+    append(originals_.back(), "ORIGINAL");
+
+    const size_t index = numSignalSafeSettings.load(std::memory_order_relaxed);
+    if (backend == Backend::SYSFS && index < maxSignalSafeSettings && target.size() < sizeof(SignalSafeSetting::path))
+    {
+        std::snprintf(signalSafeSettings[index].path, sizeof(SignalSafeSetting::path), "%s", target.c_str());
+        std::snprintf(signalSafeSettings[index].value, sizeof(SignalSafeSetting::value), "%lld", value);
+        numSignalSafeSettings.store(index + 1, std::memory_order_release);
+    }
+}
+
+void PowerCapJournal::journalApplied(const Record& record)
+{
+    append(record, "APPLY");
+    devicesWithCapsApplied_[record.device] = true;
+    anyCapApplied.store(true);
+}
+
+void PowerCapJournal::markRestored(const std::string& device)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto applied = devicesWithCapsApplied_.find(device);
+    if (applied == devicesWithCapsApplied_.end() || !applied->second)
+    {
+        return;
+    }
+    applied->second = false;
+    appendLine("RESTORED " + device + "\n");
+}
+
+void PowerCapJournal::restoreAll()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    restoreAllLocked();
+}
+
+int PowerCapJournal::restoreAllLocked()
+{
+    const int failures = restoreOriginals(originals_, devicesWithCapsApplied_, false);
+    if (failures > 0)
+    {
+        return failures; // the journal is kept for restoreLeftovers()
+    }
+    for (auto& [device, applied] : devicesWithCapsApplied_)
+    {
+        if (applied)
+        {
+            applied = false;
+            appendLine("RESTORED " + device + "\n");
+        }
+    }
+    return 0;
+}
+
+void PowerCapJournal::removeFile()
+{
+    if (fd_ >= 0)
+    {
+        ::unlink(path_.c_str());
+    }
+}
+
+void PowerCapJournal::append(const Record& record, const char* kind)
+{
+    std::ostringstream line;
+    line << kind << " " << record.device << " " << toString(record.backend) << " " << record.value << " " << record.target << "\n";
+    appendLine(line.str());
+}
+
+void PowerCapJournal::appendLine(const std::string& line)
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+    size_t written = 0;
+    while (written < line.size())
+    {
+        const ssize_t result = ::write(fd_, line.data() + written, line.size() - written);
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result < 0)
+        {
+            std::cerr << "[WARNING] Cannot write power caps journal " << path_ << ": " << strerror(errno) << "\n";
+            return;
+        }
+        written += result;
+    }
+    // the record has to be on disk before the setting is changed
+    ::fdatasync(fd_);
+}
@@ -0,0 +1,584 @@
+/*
+   Copyright 2022-2024, Adam Krzywaniak.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "power_interface/power_control_server.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <tuple>
+#include <unistd.h>
+
+// Linux 6.5, missing from older libc headers; the value of asm-generic/socket.h
+#if !defined(SO_PEERPIDFD) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || defined(__riscv))
+#define SO_PEERPIDFD 77
+#endif
+
+namespace {
+
+std::runtime_error systemError(const std::string& what)
+{
+    return std::runtime_error("PowerControlServer: " + what + ": " + strerror(errno));
+}
+
+uint32_t domainBit(Domain dom)
+{
+    return 1u << static_cast<unsigned>(dom);
+}
+
+bool writeNmiWatchdog(const std::string& fileName, const std::string& value)
+{
+    const int fd = ::open(fileName.c_str(), O_WRONLY | O_TRUNC | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    const bool written = ::write(fd, value.c_str(), value.size()) == static_cast<ssize_t>(value.size());
+    const int savedErrno = errno;
+    ::close(fd);
+    errno = savedErrno;
+    return written;
+}
+
+// a pidfd of the process that connected \p fd, -1 when the kernel has no SO_PEERPIDFD; pidfd_open(pid)
+// is no substitute, by the time of accept the pid may belong to another process
+int openPeerPidFd([[maybe_unused]] int fd)
+{
+#ifdef SO_PEERPIDFD
+    int pidFd = -1;
+    socklen_t length = sizeof(pidFd);
+    if (::getsockopt(fd, SOL_SOCKET, SO_PEERPIDFD, &pidFd, &length) == 0)
+    {
+        return pidFd;
+    }
+#else
+    errno = ENOPROTOOPT;
+#endif
+    return -1;
+}
+
+bool isProcessAlive(int pidFd)
+{
+    // a pidfd becomes readable when its process exits
+    pollfd fd {pidFd, POLLIN, 0};
+    return ::poll(&fd, 1, 0) == 0;
+}
+
+} // namespace
+
+PowerControlServer::PowerControlServer(std::shared_ptr<Device> device, PowerControlServerOptions options) :
+    device_(std::move(device)),
+    options_(std::move(options))
+{
+    if (!device_)
+    {
+        throw std::runtime_error("PowerControlServer: no device");
+    }
+    if (::pipe2(stopPipe_, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+        throw systemError("pipe2");
+    }
+
+    // the snapshot: sized and sealed before it is shared, clients get a read-only descriptor and,
+    // as F_SEAL_FUTURE_WRITE only spares the mapping of the helper, can not reopen it writable
+    snapshotFd_ = ::memfd_create("eco_power_control", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (snapshotFd_ < 0 || ::ftruncate(snapshotFd_, sizeof(PowerControlSnapshot)) != 0)
+    {
+        throw systemError("cannot create the snapshot memfd");
+    }
+    void* address = ::mmap(nullptr, sizeof(PowerControlSnapshot), PROT_READ | PROT_WRITE, MAP_SHARED, snapshotFd_, 0);
+    if (address == MAP_FAILED)
+    {
+        throw systemError("mmap");
+    }
+    snapshot_ = new (address) PowerControlSnapshot();
+    if (::fcntl(snapshotFd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) != 0)
+    {
+        throw systemError("cannot seal the snapshot memfd");
+    }
+    readOnlySnapshotFd_ = ::open(("/proc/self/fd/" + std::to_string(snapshotFd_)).c_str(), O_RDONLY | O_CLOEXEC);
+    if (readOnlySnapshotFd_ < 0)
+    {
+        throw systemError("cannot reopen the snapshot memfd read-only");
+    }
+
+    strncpy(snapshot_->deviceName, device_->getName().c_str(), sizeof(snapshot_->deviceName) - 1);
+    strncpy(snapshot_->deviceType, device_->getDeviceTypeString().c_str(), sizeof(snapshot_->deviceType) - 1);
+    const auto energy = device_->getEnergySinceResetPerDomain();
+    snapshot_->measuredDomainMask = domainBit(Domain::PKG);
+    for (const auto& domainEnergy : energy)
+    {
+        snapshot_->measuredDomainMask |= domainBit(domainEnergy.first);
+    }
+    // the requests are validated against the private copies, never against the shared page
+    for (unsigned index = 0; index < powerControlMaxDomains; ++index)
+    {
+        const auto dom = static_cast<Domain>(index);
+        if (!device_->isCappableDomain(dom))
+        {
+            continue;
+        }
+        cappableDomainMask_ |= domainBit(dom);
+        device_->beginDomainSearchSession(dom);
+        std::tie(minLimitInWatts_[index], maxLimitInWatts_[index]) = device_->getMinMaxLimitInWatts();
+        device_->endDomainSearchSession();
+        snapshot_->minLimitInWatts[index] = minLimitInWatts_[index];
+        snapshot_->maxLimitInWatts[index] = maxLimitInWatts_[index];
+    }
+    snapshot_->cappableDomainMask = cappableDomainMask_;
+    readLimits();
+    sample();
+
+    sockaddr_un address_un {};
+    address_un.sun_family = AF_UNIX;
+    if (options_.socketPath.size() >= sizeof(address_un.sun_path))
+    {
+        throw std::runtime_error("PowerControlServer: socket path too long: " + options_.socketPath);
+    }
+    strncpy(address_un.sun_path, options_.socketPath.c_str(), sizeof(address_un.sun_path) - 1);
+    listenFd_ = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0)
+    {
+        throw systemError("socket");
+    }
+    // a socket left by a killed helper
+    ::unlink(options_.socketPath.c_str());
+    if (::bind(listenFd_, reinterpret_cast<sockaddr*>(&address_un), sizeof(address_un)) != 0)
+    {
+        throw systemError("cannot bind " + options_.socketPath);
+    }
+    // everybody may connect, the connections are authorized by their cgroup
+    ::chmod(options_.socketPath.c_str(), 0666);
+    if (::listen(listenFd_, 16) != 0)
+    {
+        throw systemError("listen");
+    }
+    std::cout << "PowerControlServer: serving " << snapshot_->deviceName << " on " << options_.socketPath << "\n";
+}
+
+PowerControlServer::~PowerControlServer()
+{
+    while (!connections_.empty())
+    {
+        closeConnection(connections_.size() - 1);
+    }
+    if (listenFd_ >= 0)
+    {
+        ::close(listenFd_);
+        ::unlink(options_.socketPath.c_str());
+    }
+    for (int fd : {stopPipe_[0], stopPipe_[1], snapshotFd_, readOnlySnapshotFd_})
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+    if (snapshot_ != nullptr)
+    {
+        ::munmap(snapshot_, sizeof(PowerControlSnapshot));
+    }
+}
+
+void PowerControlServer::stop()
+{
+    const char byte = 0;
+    [[maybe_unused]] ssize_t written = ::write(stopPipe_[1], &byte, 1);
+}
+
+void PowerControlServer::run()
+{
+    using SteadyClock = std::chrono::steady_clock;
+    auto nextSample = SteadyClock::now() + options_.samplePeriod;
+    for (;;)
+    {
+        std::vector<pollfd> fds {{stopPipe_[0], POLLIN, 0}, {listenFd_, POLLIN, 0}};
+        for (const auto& connection : connections_)
+        {
+            fds.push_back({connection.fd, POLLIN, 0});
+        }
+        const auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(nextSample - SteadyClock::now());
+        if (::poll(fds.data(), fds.size(), std::max<int>(0, timeout.count())) < 0 && errno != EINTR)
+        {
+            throw systemError("poll");
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            char buffer[16];
+            while (::read(stopPipe_[0], buffer, sizeof(buffer)) > 0) {}
+            return;
+        }
+        const auto now = SteadyClock::now();
+        if (now >= nextSample)
+        {
+            sample();
+            nextSample = std::max(nextSample + options_.samplePeriod, now);
+        }
+        // backwards, so that closing a connection keeps the indices of the ones before
+        for (size_t index = connections_.size(); index-- > 0;)
+        {
+            if (fds[index + 2].revents && !serveRequest(connections_[index]))
+            {
+                closeConnection(index);
+            }
+        }
+        if (fds[1].revents & POLLIN)
+        {
+            acceptConnection();
+        }
+    }
+}
+
+void PowerControlServer::sample()
+{
+    device_->triggerPowerApiSample();
+    const auto now = device_->getClock()->now();
+    auto energy = device_->getEnergySinceResetPerDomain();
+    if (energy.empty())
+    {
+        // single domain devices: the main domain power integrated between the samples
+        if (lastSampleTime_.has_value())
+        {
+            const double seconds = std::chrono::duration<double>(now - *lastSampleTime_).count();
+            integratedJoules_ += std::max(0.0, device_->getCurrentPowerInWatts(std::nullopt)) * seconds;
+        }
+        energy[Domain::PKG] = integratedJoules_;
+    }
+    lastSampleTime_ = now;
+    for (const auto& [dom, joules] : energy)
+    {
+        if (static_cast<unsigned>(dom) < powerControlMaxDomains)
+        {
+            reading_.energyInMicroJoules[dom] = static_cast<uint64_t>(std::llround(std::max(0.0, joules) * 1e6));
+        }
+    }
+    reading_.timestampInMicroSeconds = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+    // counted by the privileged helper, system-wide counters are not open to the clients
+    reading_.perfCounter = device_->getPerfCounter();
+    publish();
+}
+
+void PowerControlServer::publish()
+{
+    writePowerControlSnapshot(*snapshot_, reading_);
+}
+
+void PowerControlServer::readLimits()
+{
+    for (unsigned index = 0; index < powerControlMaxDomains; ++index)
+    {
+        const auto dom = static_cast<Domain>(index);
+        if (!(cappableDomainMask_ & domainBit(dom)))
+        {
+            continue;
+        }
+        device_->beginDomainSearchSession(dom);
+        const double limitInWatts = device_->getPowerLimitInWatts();
+        device_->endDomainSearchSession();
+        reading_.powerLimitInMicroWatts[index] = limitInWatts > 0.0 ? static_cast<uint64_t>(std::llround(limitInWatts * 1e6)) : 0;
+    }
+}
+
+std::optional<std::string> PowerControlServer::cgroupOfProcess(pid_t pid, const std::string& procDir)
+{
+    std::ifstream file(procDir + "/" + std::to_string(pid) + "/cgroup");
+    std::string line;
+    // <hierarchy id>:<controllers>:<path>, the unified hierarchy is 0::<path>; the v1 hierarchies
+    // are not trusted, a process may be in a cgroup of its own there
+    while (std::getline(file, line))
+    {
+        const auto first = line.find(':');
+        const auto second = first == std::string::npos ? std::string::npos : line.find(':', first + 1);
+        if (second == std::string::npos)
+        {
+            continue;
+        }
+        if (line.compare(0, second + 1, "0::") == 0)
+        {
+            return line.substr(second + 1);
+        }
+    }
+    return std::nullopt;
+}
+
+bool PowerControlServer::isAuthorized(uid_t uid, const std::optional<std::string>& cgroup) const
+{
+    if (options_.allowRoot && uid == 0)
+    {
+        return true;
+    }
+    if (!cgroup.has_value())
+    {
+        return false;
+    }
+    for (auto allowed : options_.allowedCgroups)
+    {
+        while (allowed.size() > 1 && allowed.back() == '/')
+        {
+            allowed.pop_back();
+        }
+        if (allowed == "/" || *cgroup == allowed || cgroup->rfind(allowed + "/", 0) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PowerControlServer::acceptConnection()
+{
+    Connection connection;
+    connection.fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (connection.fd < 0)
+    {
+        return;
+    }
+    ucred credentials {};
+    socklen_t length = sizeof(credentials);
+    if (::getsockopt(connection.fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0)
+    {
+        ::close(connection.fd);
+        return;
+    }
+    connection.pid = credentials.pid;
+    connection.uid = credentials.uid;
+    // the credentials belong to the socket, root is authorized without looking up its pid
+    std::optional<std::string> cgroup;
+    if (!isAuthorized(credentials.uid, std::nullopt))
+    {
+        const int pidFd = openPeerPidFd(connection.fd);
+        if (pidFd < 0)
+        {
+            std::cerr << "[WARNING] PowerControlServer: no pidfd of pid " << connection.pid << " (" << strerror(errno)
+                      << ", SO_PEERPIDFD needs Linux 6.5), rejected\n";
+            ::close(connection.fd);
+            return;
+        }
+        cgroup = cgroupOfProcess(credentials.pid, options_.procDir);
+        // while the process is alive its pid can not have been reused, so the cgroup read is its own
+        const bool isAlive = isProcessAlive(pidFd);
+        ::close(pidFd);
+        if (!isAlive)
+        {
+            std::cerr << "[WARNING] PowerControlServer: pid " << connection.pid << " exited before it was authorized\n";
+            ::close(connection.fd);
+            return;
+        }
+    }
+    connection.cgroup = cgroup.value_or("unknown");
+    if (!isAuthorized(credentials.uid, cgroup))
+    {
+        std::cerr << "[WARNING] PowerControlServer: rejected pid " << connection.pid << " (uid " << connection.uid
+                  << ", cgroup " << connection.cgroup << ")\n";
+        ::close(connection.fd);
+        return;
+    }
+    std::cout << "PowerControlServer: pid " << connection.pid << " (uid " << connection.uid << ", cgroup "
+              << connection.cgroup << ") connected\n";
+    connections_.push_back(connection);
+}
+
+bool PowerControlServer::serveRequest(Connection& connection)
+{
+    PowerControlRequest request;
+    const ssize_t length = ::recv(connection.fd, &request, sizeof(request), MSG_TRUNC);
+    if (length < 0 && errno == EINTR)
+    {
+        return true;
+    }
+    if (length <= 0)
+    {
+        return false; // disconnected
+    }
+    if (static_cast<size_t>(length) < powerControlRequestSize(0) || request.magic != powerControlMagic
+        || request.version != powerControlVersion || request.numCommands > powerControlMaxCommands
+        || static_cast<size_t>(length) != powerControlRequestSize(request.numCommands))
+    {
+        std::cerr << "[WARNING] PowerControlServer: malformed request from pid " << connection.pid << ", disconnected\n";
+        return false;
+    }
+
+    PowerControlResponse response {};
+    response.magic = powerControlMagic;
+    response.version = powerControlVersion;
+    response.numResults = request.numCommands;
+    bool limitsChanged = false;
+    bool sendSnapshot = false;
+    for (size_t index = 0; index < request.numCommands; ++index)
+    {
+        response.results[index] = execute(connection, request.commands[index], limitsChanged);
+        sendSnapshot |= request.commands[index].op == static_cast<uint32_t>(PowerControlOp::HELLO);
+    }
+    if (limitsChanged)
+    {
+        // the clients see the new limits as soon as they get the response
+        readLimits();
+        publish();
+    }
+
+    iovec data {&response, powerControlResponseSize(response.numResults)};
+    msghdr message {};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+    if (sendSnapshot)
+    {
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &readOnlySnapshotFd_, sizeof(int));
+    }
+    // a client that does not read its responses must not block the helper, it is dropped instead
+    if (::sendmsg(connection.fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL) != static_cast<ssize_t>(data.iov_len))
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            std::cerr << "[WARNING] PowerControlServer: pid " << connection.pid << " does not read its responses, disconnected\n";
+        }
+        return false;
+    }
+    return true;
+}
+
+PowerControlResult PowerControlServer::execute(Connection& connection, const PowerControlCommand& command, bool& limitsChanged)
+{
+    PowerControlResult result {};
+    switch (static_cast<PowerControlOp>(command.op))
+    {
+        case PowerControlOp::HELLO:
+            result.value = sizeof(PowerControlSnapshot);
+            break;
+        case PowerControlOp::SET_POWER_LIMIT:
+        {
+            const auto dom = static_cast<Domain>(command.domain);
+            if (command.domain >= powerControlMaxDomains || !(cappableDomainMask_ & domainBit(dom)))
+            {
+                result.status = -EINVAL;
+            }
+            else if (command.value < minLimitInWatts_[command.domain] * 1000000ull
+                     || (maxLimitInWatts_[command.domain] > 0 && command.value > maxLimitInWatts_[command.domain] * 1000000ull))
+            {
+                result.status = -ERANGE;
+            }
+            else if (!acquireCaps(connection))
+            {
+                result.status = -EBUSY;
+            }
+            else
+            {
+                device_->beginDomainSearchSession(dom);
+                device_->setPowerLimitInMicroWatts(command.value);
+                device_->endDomainSearchSession();
+                limitsChanged = true;
+                result.value = command.value;
+            }
+            break;
+        }
+        case PowerControlOp::RESTORE_DEFAULT_LIMITS:
+            if (capsOwnerFd_ == connection.fd)
+            {
+                restoreDefaults(connection);
+                limitsChanged = true;
+            }
+            else if (capsOwnerFd_ >= 0)
+            {
+                result.status = -EBUSY;
+            }
+            break;
+        case PowerControlOp::SET_NMI_WATCHDOG:
+        {
+            if (command.value > 1)
+            {
+                result.status = -EINVAL;
+                break;
+            }
+            if (!acquireCaps(connection))
+            {
+                result.status = -EBUSY;
+                break;
+            }
+            if (!connection.originalNmiWatchdog.has_value())
+            {
+                std::ifstream file(options_.nmiWatchdogFile);
+                std::string original;
+                if (!std::getline(file, original))
+                {
+                    result.status = -ENOENT;
+                    break;
+                }
+                connection.originalNmiWatchdog = original;
+            }
+            if (!writeNmiWatchdog(options_.nmiWatchdogFile, std::to_string(command.value)))
+            {
+                result.status = -errno;
+            }
+            result.value = command.value;
+            break;
+        }
+        default:
+            result.status = -EOPNOTSUPP;
+            break;
+    }
+    return result;
+}
+
+bool PowerControlServer::acquireCaps(const Connection& connection)
+{
+    if (capsOwnerFd_ < 0)
+    {
+        capsOwnerFd_ = connection.fd;
+    }
+    return capsOwnerFd_ == connection.fd;
+}
+
+void PowerControlServer::restoreDefaults(Connection& connection)
+{
+    device_->restoreDefaultLimits();
+    if (connection.originalNmiWatchdog.has_value())
+    {
+        writeNmiWatchdog(options_.nmiWatchdogFile, *connection.originalNmiWatchdog);
+        connection.originalNmiWatchdog = std::nullopt;
+    }
+    capsOwnerFd_ = -1;
+}
+
+void PowerControlServer::closeConnection(size_t index)
+{
+    auto& connection = connections_[index];
+    if (capsOwnerFd_ == connection.fd)
+    {
+        std::cout << "PowerControlServer: pid " << connection.pid << " disconnected, restoring the default limits\n";
+        restoreDefaults(connection);
+        readLimits();
+        publish();
+    }
+    ::close(connection.fd);
+    connections_.erase(connections_.begin() + index);
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <omp.h>
 #include <string.h>
+#include "heartbeat/eco_heartbeat.h"
 
 static int SIZE;
 
@@ -33,6 +34,7 @@ int main(int argc, char *argv[]){
     temp1 = temps[0];
     temps[0] = temps[1];
     temps[1] = temp1;
+    eco_heartbeat(1); // one heat step is one unit of work
   }
 
   if ((argc == 5) && !strncmp(argv[4], "--notrace", 9)) {
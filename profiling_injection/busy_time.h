@@ -0,0 +1,49 @@
+// Kernel busy time of one GPU, the union of its kernel intervals.
+//
+// CUPTI delivers the CONCURRENT_KERNEL records of a buffer in completion order across
+// streams, e.g. [5,8] before [0,10]. The intervals of a buffer are therefore collected
+// with Add and merged by Flush in the order of their start, against the end of the busy
+// time merged so far, so that overlapping kernels count once.
+
+#pragma once
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+class BusyTimeMerger
+{
+public:
+    void
+    Add(
+        unsigned long long startNs,
+        unsigned long long endNs)
+    {
+        if (endNs > startNs)
+        {
+            pending.emplace_back(startNs, endNs);
+        }
+    }
+
+    // Merges the collected intervals, returns the busy time they add.
+    unsigned long long
+    Flush()
+    {
+        std::sort(pending.begin(), pending.end());
+        unsigned long long addedNs = 0;
+        for (const auto &interval : pending)
+        {
+            if (interval.second > busyUntilNs)
+            {
+                addedNs += interval.second - std::max(interval.first, busyUntilNs);
+                busyUntilNs = interval.second;
+            }
+        }
+        pending.clear();
+        return addedNs;
+    }
+
+private:
+    std::vector<std::pair<unsigned long long, unsigned long long>> pending;
+    unsigned long long busyUntilNs = 0;
+};
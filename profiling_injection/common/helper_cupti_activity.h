@@ -63,6 +63,7 @@ typedef struct UserData_st
     uint8_t printActivityRecords;                                    // Print CUPTI activity records.
     uint8_t skipCuptiSubscription;                                   // Check if the user application wants to skip subscription in CUPTI.
     void    (*pPostProcessActivityRecords)(CUpti_Activity *pRecord); // Provide function pointer in the user application for CUPTI records for post processing.
+    void    (*pPostProcessActivityBuffer)(void);                     // Called after the last record of a buffer was post processed.
 } UserData;
 
 // Global variables
@@ -2331,6 +2332,12 @@ PrintActivityBuffer(
             CUPTI_API_CALL(status);
         }
     } while (1);
+
+    if (pUserData &&
+        ((UserData *)pUserData)->pPostProcessActivityBuffer)
+    {
+        ((UserData *)pUserData)->pPostProcessActivityBuffer();
+    }
 }
 
 // Buffer Management Functions
@@ -19,8 +19,18 @@
 // An atexit callback is also used to ensure that any partial sessions
 // are handled when the target application exits.
 //
+// Kernels are counted on every launch path selected by INJECTION_LAUNCH_CALLBACKS
+// (cuLaunchKernel, cuLaunchKernelEx, cooperative, legacy and graph launches),
+// a graph launch counts the kernel nodes of the launched graph.
+//
+// With INJECTION_MODE=activity no launch callback is registered at all. Kernels are
+// counted from CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL records, processed on the CUPTI
+// worker thread, which also give the per-GPU kernel busy time (gpu_busy_ns files).
+//
 // This code supports multiple contexts and multithreading through
-// locking shared data structures.
+// locking shared data structures. Kernel launches are counted without
+// locks in per-thread counters, summed up by a publisher thread which
+// writes the kernels_count files read by DEPO.
 
 // System headers
 #include <iostream>
@@ -47,6 +57,10 @@ using ::std::vector;
 #include <string.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <thread>
 
 // CUDA headers
 #include <cuda.h>
@@ -58,7 +72,11 @@ using ::std::vector;
 #include <cupti_driver_cbid.h>
 #include <cupti_target.h>
 #include <cupti_activity.h>
+#include <generated_cuda_meta.h>
+#include <generated_cuda_runtime_api_meta.h>
 #include "helper_cupti.h"
+#include "helper_cupti_activity.h"
+#include "busy_time.h"
 
 // NVPW headers
 #include <nvperf_host.h>
@@ -101,25 +119,8 @@ struct CtxProfilerData
     // Count of sessions.
     int             iterations;
 
-    // Initialize fields, with env var overrides.
-    CtxProfilerData() : curRanges(), maxRangeNameLength(64), iterations()
-    {
-        char *pEnvVar = getenv("INJECTION_KERNEL_COUNT");
-        if (pEnvVar != NULL)
-        {
-            int value = atoi(pEnvVar);
-            if (value < 1)
-            {
-                cerr << "Read " << value << " kernels from INJECTION_KERNEL_COUNT, but must be >= 1; defaulting to 10." << endl;
-                value = 10;
-            }
-            maxNumRanges = value;
-        }
-        else
-        {
-            maxNumRanges = 10;
-        }
-    };
+    // Initialize fields, INJECTION_KERNEL_COUNT is parsed once in InitializeInjection.
+    CtxProfilerData();
 };
 
 // Track per-context profiler API data in a shared map.
@@ -129,6 +130,14 @@ unordered_map<CUcontext, CtxProfilerData> contextData;
 // List of metrics to collect.
 vector<string> metricNames;
 
+// Kernels per profiler pass and per kernels_count update (INJECTION_KERNEL_COUNT).
+static int injectionKernelCount = 10;
+
+CtxProfilerData::CtxProfilerData() :
+    curRanges(), maxNumRanges(injectionKernelCount), maxRangeNameLength(64), iterations()
+{
+}
+
 // Initialize state.
 void
 InitializeState()
@@ -297,22 +306,150 @@ EndSession(
 
 #include <fstream>
 std::ofstream kernelCounterFile;
-unsigned long long int globalCounter = 0;
 
 // DEPO async multi-GPU: per-GPU kernel counts; kernels_count = sum (total activity on targets).
 static std::vector<int> depoTargetGpuIds;
 static bool depoAsyncMultiGpuEnabled = false;
-static std::unordered_map<int, unsigned long long> perDeviceKernelCounts;
+
+// Kernel launches are counted per thread and per device ordinal, every counter has
+// a single writer and its own cache line, so cuLaunchKernel never takes a lock.
+// Counters of launches on contexts of unknown device go to the last slot.
+static constexpr int maxCountedDevices = 64;
+static constexpr int unknownDeviceSlot = maxCountedDevices;
+
+struct alignas(64) PaddedCounter
+{
+    std::atomic<unsigned long long> value {0};
+};
+
+struct ThreadKernelCounters
+{
+    PaddedCounter perDevice[maxCountedDevices + 1];
+};
+
+// Blocks of all threads which launched a kernel, kept after the thread exits.
+static mutex countersRegistryMutex;
+static vector<ThreadKernelCounters*> countersRegistry;
+
+// Device ordinal of every context, the source of the per-thread context cache.
+static unordered_map<CUcontext, int> contextDevice;
+// Bumped when contexts come and go, invalidates the per-thread context cache.
+static std::atomic<unsigned> contextGeneration {1};
+
+struct ThreadLaunchCache
+{
+    ThreadKernelCounters *counters;
+    CUcontext ctx;
+    unsigned generation;
+    int slot;
+    // kernel nodes of the graph launched last by the thread
+    CUgraphExec graphExec;
+    unsigned graphGeneration;
+    unsigned long long graphKernels;
+};
+static thread_local ThreadLaunchCache launchCache;
+
+// Kernel nodes of every instantiated graph, the source of the per-thread graph cache.
+static mutex graphMutex;
+static unordered_map<CUgraphExec, unsigned long long> graphKernelNodes;
+// Bumped when executable graphs come and go, invalidates the per-thread graph cache.
+static std::atomic<unsigned> graphGeneration {1};
+
+// Launch paths counted, selected by INJECTION_LAUNCH_CALLBACKS. Every enabled
+// callback adds to the launch latency, so unused ones can be switched off.
+enum LaunchCallbackCategory : unsigned
+{
+    LAUNCH_KERNEL = 1u << 0,        // cuLaunchKernel
+    LAUNCH_KERNEL_EX = 1u << 1,     // cuLaunchKernelEx
+    LAUNCH_COOPERATIVE = 1u << 2,   // cuLaunchCooperativeKernel[MultiDevice]
+    LAUNCH_GRAPH = 1u << 3,         // cuGraphLaunch, expanded to the kernel nodes
+    LAUNCH_LEGACY = 1u << 4,        // cuLaunch, cuLaunchGrid[Async]
+    LAUNCH_ALL = LAUNCH_KERNEL | LAUNCH_KERNEL_EX | LAUNCH_COOPERATIVE | LAUNCH_GRAPH | LAUNCH_LEGACY
+};
+static unsigned enabledLaunchCategories = LAUNCH_ALL;
+// The runtime API calls the driver API, so only one of the domains may count launches
+// (INJECTION_LAUNCH_API=driver|runtime). The driver one also sees launches of libraries
+// calling the driver directly.
+static bool countRuntimeLaunches = false;
+
+struct LaunchCallback
+{
+    CUpti_CallbackId cbid;
+    unsigned category;
+};
+
+static const LaunchCallback driverLaunchCallbacks[] =
+{
+    { CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel, LAUNCH_KERNEL },
+    { CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel_ptsz, LAUNCH_KERNEL },
+#if CUDA_VERSION >= 12000
+    { CUPTI_DRIVER_TRACE_CBID_cuLaunchKernelEx, LAUNCH_KERNEL_EX },
+    { CUPTI_DRIVER_TRACE_CBID_cuLaunchKernelEx_ptsz, LAUNCH_KERNEL_EX },
+#endif
+    { CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernel, LAUNCH_COOPERATIVE },
+    { CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernel_ptsz, LAUNCH_COOPERATIVE },
+    { CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernelMultiDevice, LAUNCH_COOPERATIVE },
+    { CUPTI_DRIVER_TRACE_CBID_cuGraphLaunch, LAUNCH_GRAPH },
+    { CUPTI_DRIVER_TRACE_CBID_cuGraphLaunch_ptsz, LAUNCH_GRAPH },
+    { CUPTI_DRIVER_TRACE_CBID_cuLaunch, LAUNCH_LEGACY },
+    { CUPTI_DRIVER_TRACE_CBID_cuLaunchGrid, LAUNCH_LEGACY },
+    { CUPTI_DRIVER_TRACE_CBID_cuLaunchGridAsync, LAUNCH_LEGACY },
+};
+
+static const LaunchCallback runtimeLaunchCallbacks[] =
+{
+    { CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000, LAUNCH_KERNEL },
+    { CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_ptsz_v7000, LAUNCH_KERNEL },
+#if CUDA_VERSION >= 11060
+    { CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernelExC_v11060, LAUNCH_KERNEL_EX },
+    { CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernelExC_ptsz_v11060, LAUNCH_KERNEL_EX },
+#endif
+    { CUPTI_RUNTIME_TRACE_CBID_cudaLaunchCooperativeKernel_v9000, LAUNCH_COOPERATIVE },
+    { CUPTI_RUNTIME_TRACE_CBID_cudaLaunchCooperativeKernel_ptsz_v9000, LAUNCH_COOPERATIVE },
+    { CUPTI_RUNTIME_TRACE_CBID_cudaLaunchCooperativeKernelMultiDevice_v9000, LAUNCH_COOPERATIVE },
+    { CUPTI_RUNTIME_TRACE_CBID_cudaGraphLaunch_v10000, LAUNCH_GRAPH },
+    { CUPTI_RUNTIME_TRACE_CBID_cudaGraphLaunch_ptsz_v10000, LAUNCH_GRAPH },
+    { CUPTI_RUNTIME_TRACE_CBID_cudaLaunch_v3020, LAUNCH_LEGACY },
+    { CUPTI_RUNTIME_TRACE_CBID_cudaLaunch_ptsz_v7000, LAUNCH_LEGACY },
+};
+
+// Driver calls keeping graphKernelNodes up to date, enabled together with LAUNCH_GRAPH
+// in both modes, as cudaGraphInstantiate goes through the driver as well.
+static const CUpti_CallbackId graphBookkeepingCallbacks[] =
+{
+#if CUDA_VERSION >= 12000
+    CUPTI_DRIVER_TRACE_CBID_cuGraphInstantiateWithParams,
+    CUPTI_DRIVER_TRACE_CBID_cuGraphInstantiateWithParams_ptsz,
+#else
+    CUPTI_DRIVER_TRACE_CBID_cuGraphInstantiate_v2,
+#endif
+#if CUDA_VERSION >= 11040
+    CUPTI_DRIVER_TRACE_CBID_cuGraphInstantiateWithFlags,
+#endif
+    CUPTI_DRIVER_TRACE_CBID_cuGraphExecDestroy,
+};
+
+// INJECTION_MODE=activity: kernels counted from activity records instead of launch callbacks.
+static bool activityMode = false;
+// Period of delivering activity buffers by the CUPTI worker thread (INJECTION_ACTIVITY_FLUSH_MS).
+static uint32_t activityFlushPeriodMs = 10;
+
+// Kernel busy time per device slot, written from the activity buffer callbacks only.
+// Intervals of concurrent kernels are merged per buffer, so overlapping kernels count once.
+static mutex busyTimeMutex;
+static BusyTimeMerger busyTime[maxCountedDevices + 1];
+static std::atomic<unsigned long long> busyNs[maxCountedDevices + 1];
+
+// Interval of publishing the summed counters (INJECTION_PUBLISH_INTERVAL_US).
+static std::chrono::microseconds publishInterval {1000};
+static std::thread publisherThread;
+static mutex publisherMutex;
+static std::condition_variable publisherWakeUp;
+static bool publisherStop = false;
 
 static void
 ParseDepoAsyncEnv()
 {
-    static bool parsed = false;
-    if (parsed)
-    {
-        return;
-    }
-    parsed = true;
     const char *async = getenv("DEPO_ASYNC_MULTI_GPU");
     const char *ids = getenv("DEPO_TARGET_GPU_IDS");
     if (!async || strcmp(async, "1") != 0 || !ids || ids[0] == '\0')
@@ -332,7 +469,16 @@ ParseDepoAsyncEnv()
         std::string token = s.substr(start, comma - start);
         if (!token.empty())
         {
-            depoTargetGpuIds.push_back(atoi(token.c_str()));
+            int id = atoi(token.c_str());
+            if (id >= 0 && id < maxCountedDevices)
+            {
+                depoTargetGpuIds.push_back(id);
+            }
+            else
+            {
+                cerr << "libinjection: GPU " << id << " from DEPO_TARGET_GPU_IDS is not counted, ids must be < "
+                     << maxCountedDevices << endl;
+            }
         }
         start = comma + 1;
     }
@@ -342,27 +488,633 @@ ParseDepoAsyncEnv()
     }
 }
 
+// Read the environment once, the launch callback must not call getenv.
 static void
-WriteKernelsCountFile(unsigned long long value)
+ParseInjectionEnv()
 {
-    kernelCounterFile.open("kernels_count", std::ios::out | std::ios::trunc);
-    kernelCounterFile << value << std::flush;
-    kernelCounterFile.close();
+    char *pEnvVar = getenv("INJECTION_KERNEL_COUNT");
+    if (pEnvVar != NULL)
+    {
+        int value = atoi(pEnvVar);
+        if (value < 1)
+        {
+            cerr << "Read " << value << " kernels from INJECTION_KERNEL_COUNT, but must be >= 1; defaulting to 10." << endl;
+            value = 10;
+        }
+        injectionKernelCount = value;
+    }
+    pEnvVar = getenv("INJECTION_PUBLISH_INTERVAL_US");
+    if (pEnvVar != NULL)
+    {
+        long value = atol(pEnvVar);
+        if (value < 1)
+        {
+            cerr << "Read " << value << " us from INJECTION_PUBLISH_INTERVAL_US, but must be >= 1; defaulting to "
+                 << publishInterval.count() << "." << endl;
+        }
+        else
+        {
+            publishInterval = std::chrono::microseconds(value);
+        }
+    }
+    pEnvVar = getenv("INJECTION_MODE");
+    if (pEnvVar != NULL)
+    {
+        if (strcmp(pEnvVar, "activity") == 0)
+        {
+            activityMode = true;
+        }
+        else if (strcmp(pEnvVar, "callback") != 0)
+        {
+            cerr << "Unknown INJECTION_MODE '" << pEnvVar << "', must be callback or activity; defaulting to callback." << endl;
+        }
+    }
+    pEnvVar = getenv("INJECTION_ACTIVITY_FLUSH_MS");
+    if (pEnvVar != NULL)
+    {
+        int value = atoi(pEnvVar);
+        if (value < 1)
+        {
+            cerr << "Read " << value << " ms from INJECTION_ACTIVITY_FLUSH_MS, but must be >= 1; defaulting to "
+                 << activityFlushPeriodMs << "." << endl;
+        }
+        else
+        {
+            activityFlushPeriodMs = static_cast<uint32_t>(value);
+        }
+    }
+    pEnvVar = getenv("INJECTION_LAUNCH_API");
+    if (pEnvVar != NULL)
+    {
+        if (strcmp(pEnvVar, "runtime") == 0)
+        {
+            countRuntimeLaunches = true;
+        }
+        else if (strcmp(pEnvVar, "driver") != 0)
+        {
+            cerr << "Unknown INJECTION_LAUNCH_API '" << pEnvVar << "', must be driver or runtime; defaulting to driver." << endl;
+        }
+    }
+    pEnvVar = getenv("INJECTION_LAUNCH_CALLBACKS");
+    if (pEnvVar != NULL)
+    {
+        enabledLaunchCategories = 0;
+        string list(pEnvVar);
+        size_t start = 0;
+        while (start <= list.size())
+        {
+            size_t end = list.find_first_of(" ;,", start);
+            if (end == string::npos)
+            {
+                end = list.size();
+            }
+            const string token = list.substr(start, end - start);
+            if (token == "all")
+            {
+                enabledLaunchCategories |= LAUNCH_ALL;
+            }
+            else if (token == "kernel")
+            {
+                enabledLaunchCategories |= LAUNCH_KERNEL;
+            }
+            else if (token == "kernel_ex")
+            {
+                enabledLaunchCategories |= LAUNCH_KERNEL_EX;
+            }
+            else if (token == "cooperative")
+            {
+                enabledLaunchCategories |= LAUNCH_COOPERATIVE;
+            }
+            else if (token == "graph")
+            {
+                enabledLaunchCategories |= LAUNCH_GRAPH;
+            }
+            else if (token == "legacy")
+            {
+                enabledLaunchCategories |= LAUNCH_LEGACY;
+            }
+            else if (!token.empty())
+            {
+                cerr << "Unknown launch category '" << token << "' in INJECTION_LAUNCH_CALLBACKS, "
+                     << "expected all, kernel, kernel_ex, cooperative, graph or legacy." << endl;
+            }
+            start = end + 1;
+        }
+        if (enabledLaunchCategories == 0)
+        {
+            cerr << "No launch category enabled by INJECTION_LAUNCH_CALLBACKS; defaulting to all." << endl;
+            enabledLaunchCategories = LAUNCH_ALL;
+        }
+    }
+    ParseDepoAsyncEnv();
 }
 
 static void
-WritePerGpuKernelCountFile(int deviceId, unsigned long long value)
+WriteCounterFile(const std::string &name, unsigned long long value)
 {
-    std::string name = std::string("kernels_gpu_") + std::to_string(deviceId);
     kernelCounterFile.open(name.c_str(), std::ios::out | std::ios::trunc);
     kernelCounterFile << value << std::flush;
     kernelCounterFile.close();
 }
 
+static void
+WriteKernelsCountFile(unsigned long long value)
+{
+    WriteCounterFile("kernels_count", value);
+}
+
+static void
+WritePerGpuKernelCountFile(int deviceId, unsigned long long value)
+{
+    WriteCounterFile(std::string("kernels_gpu_") + std::to_string(deviceId), value);
+}
+
+// Sum of the per-thread counters, indexed by device slot.
+static vector<unsigned long long>
+AggregateKernelCounts()
+{
+    vector<unsigned long long> perSlot(maxCountedDevices + 1, 0ULL);
+    std::lock_guard<mutex> lock(countersRegistryMutex);
+    for (const ThreadKernelCounters *counters : countersRegistry)
+    {
+        for (int slot = 0; slot <= maxCountedDevices; ++slot)
+        {
+            perSlot[slot] += counters->perDevice[slot].value.load(std::memory_order_relaxed);
+        }
+    }
+    return perSlot;
+}
+
+static unsigned long long
+TotalKernelCount(const vector<unsigned long long> &perSlot)
+{
+    unsigned long long total = 0ULL;
+    for (unsigned long long c : perSlot)
+    {
+        total += c;
+    }
+    return total;
+}
+
+// Sum over the DEPO target GPUs in async mode, over all devices otherwise.
+static unsigned long long
+SumOverCountedDevices(const vector<unsigned long long> &perSlot)
+{
+    if (!depoAsyncMultiGpuEnabled)
+    {
+        return TotalKernelCount(perSlot);
+    }
+    unsigned long long counted = 0ULL;
+    for (int tid : depoTargetGpuIds)
+    {
+        counted += perSlot[tid];
+    }
+    return counted;
+}
+
+// Write the kernels_count files when the count crossed a multiple of INJECTION_KERNEL_COUNT,
+// the written value is always such a multiple. In DEPO async mode kernels_count is the sum
+// over the target GPUs, each of them gets its own kernels_gpu_<id> file as well.
+static void
+PublishKernelCounts()
+{
+    static unsigned long long lastPublished = 0ULL;
+    const vector<unsigned long long> perSlot = AggregateKernelCounts();
+    const unsigned long long counted = SumOverCountedDevices(perSlot);
+    const unsigned long long step = static_cast<unsigned long long>(injectionKernelCount);
+    const unsigned long long value = counted - counted % step;
+    if (value == 0ULL || value == lastPublished)
+    {
+        return;
+    }
+    lastPublished = value;
+    WriteKernelsCountFile(value);
+    if (depoAsyncMultiGpuEnabled)
+    {
+        for (int tid : depoTargetGpuIds)
+        {
+            WritePerGpuKernelCountFile(tid, perSlot[tid]);
+        }
+    }
+}
+
+// Write gpu_busy_ns (and gpu_busy_ns_<id> of the DEPO async target GPUs) when the busy time grew.
+static void
+PublishBusyTime()
+{
+    static unsigned long long lastPublished = 0ULL;
+    vector<unsigned long long> perSlot(maxCountedDevices + 1, 0ULL);
+    for (int slot = 0; slot <= maxCountedDevices; ++slot)
+    {
+        perSlot[slot] = busyNs[slot].load(std::memory_order_relaxed);
+    }
+    const unsigned long long value = SumOverCountedDevices(perSlot);
+    if (value == lastPublished)
+    {
+        return;
+    }
+    lastPublished = value;
+    WriteCounterFile("gpu_busy_ns", value);
+    if (depoAsyncMultiGpuEnabled)
+    {
+        for (int tid : depoTargetGpuIds)
+        {
+            WriteCounterFile(std::string("gpu_busy_ns_") + std::to_string(tid), perSlot[tid]);
+        }
+    }
+}
+
+static void
+PublishCounters()
+{
+    PublishKernelCounts();
+    if (activityMode)
+    {
+        PublishBusyTime();
+    }
+}
+
+static void
+PublisherLoop()
+{
+    std::unique_lock<mutex> lock(publisherMutex);
+    while (!publisherStop)
+    {
+        publisherWakeUp.wait_for(lock, publishInterval);
+        PublishCounters();
+    }
+}
+
+static void
+StartPublisher()
+{
+    publisherThread = std::thread(PublisherLoop);
+}
+
+static void
+StopPublisher()
+{
+    if (!publisherThread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<mutex> lock(publisherMutex);
+        publisherStop = true;
+    }
+    publisherWakeUp.notify_one();
+    publisherThread.join();
+}
+
+static void
+RegisterThreadCounters()
+{
+    if (launchCache.counters == NULL)
+    {
+        ThreadKernelCounters *counters = new ThreadKernelCounters();
+        std::lock_guard<mutex> lock(countersRegistryMutex);
+        countersRegistry.push_back(counters);
+        launchCache.counters = counters;
+    }
+}
+
+static inline void
+AddToThreadCounter(
+    int slot,
+    unsigned long long kernels)
+{
+    // the only writer of this counter, no read-modify-write needed
+    std::atomic<unsigned long long> &counter = launchCache.counters->perDevice[slot].value;
+    counter.store(counter.load(std::memory_order_relaxed) + kernels, std::memory_order_relaxed);
+}
+
+// Slow path of a launch: first launch of the thread or a context not seen since the last change.
+static void
+RefreshLaunchCache(
+    CUcontext ctx,
+    unsigned generation)
+{
+    RegisterThreadCounters();
+    int slot = unknownDeviceSlot;
+    {
+        std::lock_guard<mutex> lock(ctxDataMutex);
+        auto it = contextDevice.find(ctx);
+        if (it != contextDevice.end() && it->second >= 0 && it->second < maxCountedDevices)
+        {
+            slot = it->second;
+        }
+    }
+    launchCache.ctx = ctx;
+    launchCache.generation = generation;
+    launchCache.slot = slot;
+}
+
+static inline void
+CountKernelLaunch(
+    CUcontext ctx,
+    unsigned long long kernels = 1)
+{
+    const unsigned generation = contextGeneration.load(std::memory_order_acquire);
+    if (launchCache.ctx != ctx || launchCache.generation != generation || launchCache.counters == NULL)
+    {
+        RefreshLaunchCache(ctx, generation);
+    }
+    AddToThreadCounter(launchCache.slot, kernels);
+}
+
+// Kernel nodes of \p graph, including the ones of child graphs.
+static unsigned long long
+CountGraphKernelNodes(
+    CUgraph graph)
+{
+    size_t numNodes = 0;
+    if (cuGraphGetNodes(graph, NULL, &numNodes) != CUDA_SUCCESS || numNodes == 0)
+    {
+        return 0ULL;
+    }
+    vector<CUgraphNode> nodes(numNodes);
+    if (cuGraphGetNodes(graph, nodes.data(), &numNodes) != CUDA_SUCCESS)
+    {
+        return 0ULL;
+    }
+    unsigned long long kernels = 0ULL;
+    for (size_t i = 0; i < numNodes; ++i)
+    {
+        CUgraphNodeType type;
+        if (cuGraphNodeGetType(nodes[i], &type) != CUDA_SUCCESS)
+        {
+            continue;
+        }
+        if (type == CU_GRAPH_NODE_TYPE_KERNEL)
+        {
+            ++kernels;
+        }
+        else if (type == CU_GRAPH_NODE_TYPE_GRAPH)
+        {
+            CUgraph child;
+            if (cuGraphChildGraphNodeGetGraph(nodes[i], &child) == CUDA_SUCCESS)
+            {
+                kernels += CountGraphKernelNodes(child);
+            }
+        }
+    }
+    return kernels;
+}
+
+static void
+RecordGraphExec(
+    CUgraphExec graphExec,
+    CUgraph graph)
+{
+    const unsigned long long kernels = CountGraphKernelNodes(graph);
+    std::lock_guard<mutex> lock(graphMutex);
+    graphKernelNodes[graphExec] = kernels;
+    graphGeneration.fetch_add(1, std::memory_order_release);
+}
+
+static void
+ForgetGraphExec(
+    CUgraphExec graphExec)
+{
+    std::lock_guard<mutex> lock(graphMutex);
+    graphKernelNodes.erase(graphExec);
+    graphGeneration.fetch_add(1, std::memory_order_release);
+}
+
+// Kernels run by one launch of \p graphExec. A graph instantiated before the
+// injection was loaded is counted as a single kernel, so that it still shows activity.
+static unsigned long long
+GraphLaunchKernels(
+    CUgraphExec graphExec)
+{
+    const unsigned generation = graphGeneration.load(std::memory_order_acquire);
+    if (launchCache.graphExec != graphExec || launchCache.graphGeneration != generation)
+    {
+        unsigned long long kernels = 1ULL;
+        {
+            std::lock_guard<mutex> lock(graphMutex);
+            auto it = graphKernelNodes.find(graphExec);
+            if (it != graphKernelNodes.end())
+            {
+                kernels = it->second;
+            }
+        }
+        launchCache.graphExec = graphExec;
+        launchCache.graphGeneration = generation;
+        launchCache.graphKernels = kernels;
+    }
+    return launchCache.graphKernels;
+}
+
+// Every launch of a multi-device cooperative kernel is counted on the context of its stream.
+template<typename LaunchParams>
+static void
+CountMultiDeviceLaunch(
+    const LaunchParams *launchParamsList,
+    unsigned numDevices,
+    CUstream LaunchParams::*stream,
+    CUcontext current)
+{
+    for (unsigned i = 0; i < numDevices; ++i)
+    {
+        CUcontext ctx = current;
+        if (cuStreamGetCtx(launchParamsList[i].*stream, &ctx) != CUDA_SUCCESS)
+        {
+            ctx = current;
+        }
+        CountKernelLaunch(ctx);
+    }
+}
+
+static void
+HandleDriverLaunch(
+    CUpti_CallbackId callbackId,
+    CUpti_CallbackData const *pData)
+{
+    switch (callbackId)
+    {
+    case CUPTI_DRIVER_TRACE_CBID_cuGraphLaunch:
+    case CUPTI_DRIVER_TRACE_CBID_cuGraphLaunch_ptsz:
+    {
+        // both parameter structs hold the same fields
+        const cuGraphLaunch_params *params = static_cast<const cuGraphLaunch_params *>(pData->functionParams);
+        CountKernelLaunch(pData->context, GraphLaunchKernels(params->hGraphExec));
+        break;
+    }
+    case CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernelMultiDevice:
+    {
+        const cuLaunchCooperativeKernelMultiDevice_params *params =
+            static_cast<const cuLaunchCooperativeKernelMultiDevice_params *>(pData->functionParams);
+        CountMultiDeviceLaunch(params->launchParamsList, params->numDevices, &CUDA_LAUNCH_PARAMS::hStream, pData->context);
+        break;
+    }
+    default:
+        CountKernelLaunch(pData->context);
+        break;
+    }
+}
+
+static void
+HandleRuntimeLaunch(
+    CUpti_CallbackId callbackId,
+    CUpti_CallbackData const *pData)
+{
+    switch (callbackId)
+    {
+    case CUPTI_RUNTIME_TRACE_CBID_cudaGraphLaunch_v10000:
+    case CUPTI_RUNTIME_TRACE_CBID_cudaGraphLaunch_ptsz_v10000:
+    {
+        // both parameter structs hold the same fields
+        const cudaGraphLaunch_v10000_params *params = static_cast<const cudaGraphLaunch_v10000_params *>(pData->functionParams);
+        CountKernelLaunch(pData->context, GraphLaunchKernels(params->graphExec));
+        break;
+    }
+    case CUPTI_RUNTIME_TRACE_CBID_cudaLaunchCooperativeKernelMultiDevice_v9000:
+    {
+        const cudaLaunchCooperativeKernelMultiDevice_v9000_params *params =
+            static_cast<const cudaLaunchCooperativeKernelMultiDevice_v9000_params *>(pData->functionParams);
+        CountMultiDeviceLaunch(params->launchParamsList, params->numDevices, &cudaLaunchParams::stream, pData->context);
+        break;
+    }
+    default:
+        CountKernelLaunch(pData->context);
+        break;
+    }
+}
+
+// Keep graphKernelNodes up to date, instantiation is handled when the call returned the executable graph.
+static void
+HandleGraphBookkeeping(
+    CUpti_CallbackId callbackId,
+    CUpti_CallbackData const *pData)
+{
+    if (callbackId == CUPTI_DRIVER_TRACE_CBID_cuGraphExecDestroy)
+    {
+        if (pData->callbackSite == CUPTI_API_ENTER)
+        {
+            ForgetGraphExec(static_cast<const cuGraphExecDestroy_params *>(pData->functionParams)->hGraphExec);
+        }
+        return;
+    }
+    if (pData->callbackSite != CUPTI_API_EXIT
+        || *static_cast<const CUresult *>(pData->functionReturnValue) != CUDA_SUCCESS)
+    {
+        return;
+    }
+    switch (callbackId)
+    {
+#if CUDA_VERSION >= 12000
+    case CUPTI_DRIVER_TRACE_CBID_cuGraphInstantiateWithParams:
+    case CUPTI_DRIVER_TRACE_CBID_cuGraphInstantiateWithParams_ptsz:
+    {
+        // both parameter structs hold the same fields
+        const cuGraphInstantiateWithParams_params *params =
+            static_cast<const cuGraphInstantiateWithParams_params *>(pData->functionParams);
+        RecordGraphExec(*params->phGraphExec, params->hGraph);
+        break;
+    }
+#else
+    case CUPTI_DRIVER_TRACE_CBID_cuGraphInstantiate_v2:
+    {
+        const cuGraphInstantiate_v2_params *params = static_cast<const cuGraphInstantiate_v2_params *>(pData->functionParams);
+        RecordGraphExec(*params->phGraphExec, params->hGraph);
+        break;
+    }
+#endif
+#if CUDA_VERSION >= 11040
+    case CUPTI_DRIVER_TRACE_CBID_cuGraphInstantiateWithFlags:
+    {
+        const cuGraphInstantiateWithFlags_params *params =
+            static_cast<const cuGraphInstantiateWithFlags_params *>(pData->functionParams);
+        RecordGraphExec(*params->phGraphExec, params->hGraph);
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+}
+
+static bool
+IsGraphBookkeepingCallback(
+    CUpti_CallbackId callbackId)
+{
+    for (CUpti_CallbackId cbid : graphBookkeepingCallbacks)
+    {
+        if (cbid == callbackId)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Called by the activity buffer callback for every record, on the CUPTI worker thread
+// or on the thread flushing the buffers.
+static void
+ProcessActivityRecord(
+    CUpti_Activity *pRecord)
+{
+    if (pRecord->kind != CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL)
+    {
+        return;
+    }
+    const CUpti_ActivityKernel9 *pKernel = reinterpret_cast<const CUpti_ActivityKernel9 *>(pRecord);
+    const int slot = pKernel->deviceId < static_cast<uint32_t>(maxCountedDevices)
+        ? static_cast<int>(pKernel->deviceId) : unknownDeviceSlot;
+
+    RegisterThreadCounters();
+    AddToThreadCounter(slot, 1);
+
+    std::lock_guard<mutex> lock(busyTimeMutex);
+    busyTime[slot].Add(pKernel->start, pKernel->end);
+}
+
+// Called after the last record of an activity buffer: the records are in completion
+// order, their intervals are merged sorted by start.
+static void
+ProcessActivityBuffer()
+{
+    std::lock_guard<mutex> lock(busyTimeMutex);
+    for (int slot = 0; slot <= maxCountedDevices; slot++)
+    {
+        const unsigned long long addedNs = busyTime[slot].Flush();
+        if (addedNs > 0)
+        {
+            busyNs[slot].fetch_add(addedNs, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Collect kernel records through the activity buffers of helper_cupti_activity.h,
+// the callback subscriber stays the one of RegisterCallbacks.
+static void
+InitializeActivityMode()
+{
+    UserData *pUserData = static_cast<UserData *>(calloc(1, sizeof(UserData)));
+    MEMORY_ALLOCATION_CALL(pUserData);
+    pUserData->skipCuptiSubscription = 1;
+    pUserData->printActivityRecords = 0;
+    pUserData->pPostProcessActivityRecords = ProcessActivityRecord;
+    pUserData->pPostProcessActivityBuffer = ProcessActivityBuffer;
+    InitCuptiTrace(pUserData, NULL, stdout);
+
+    CUPTI_API_CALL(cuptiActivityEnable(CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL));
+    // Buffers are delivered periodically, not only when full, so the counters stay current
+    CUPTI_API_CALL(cuptiActivityFlushPeriod(activityFlushPeriodMs));
+}
+
 // Clean up at end of execution
 static void
 EndExecution()
 {
+    if (activityMode)
+    {
+        CUPTI_API_CALL(cuptiActivityFlushAll(1));
+    }
+    StopPublisher();
+    PublishCounters();
+
     CUPTI_API_CALL(cuptiGetLastError());
     ctxDataMutex.lock();
 
@@ -378,7 +1130,7 @@ EndExecution()
     }
 
     ctxDataMutex.unlock();
-    cout << "[DEBUG] total kernels counted: " << globalCounter << "." << std::endl;
+    cout << "[DEBUG] total kernels counted: " << TotalKernelCount(AggregateKernelCounts()) << "." << std::endl;
 }
 
 // Callback handler
@@ -394,119 +1146,48 @@ ProfilerCallbackHandler(
     CUptiResult res;
     if (domain == CUPTI_CB_DOMAIN_DRIVER_API)
     {
-        // For a driver call to launch a kernel:
-        if (callbackId == CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel)
-        {
-            CUpti_CallbackData const *pData = static_cast<CUpti_CallbackData const *>(pCallbackData);
-            CUcontext ctx = pData->context;
-
-            // On entry, enable / update profiling as needed
-            if (pData->callbackSite == CUPTI_API_ENTER)
-            {
-                ParseDepoAsyncEnv();
-                ctxDataMutex.lock();
+        CUpti_CallbackData const *pData = static_cast<CUpti_CallbackData const *>(pCallbackData);
 
-                if (depoAsyncMultiGpuEnabled && !depoTargetGpuIds.empty())
-                {
-                    int maxNumRanges = 1;
-                    const char *pEnvVar = getenv("INJECTION_KERNEL_COUNT");
-                    if (pEnvVar != NULL)
-                    {
-                        int v = atoi(pEnvVar);
-                        if (v >= 1)
-                        {
-                            maxNumRanges = v;
-                        }
-                    }
-                    if (contextData.count(ctx) > 0)
-                    {
-                        maxNumRanges = contextData[ctx].maxNumRanges;
-                        const int devId = contextData[ctx].deviceId;
-                        for (int tid : depoTargetGpuIds)
-                        {
-                            if (tid == devId)
-                            {
-                                perDeviceKernelCounts[devId]++;
-                                break;
-                            }
-                        }
-                    }
-                    ++globalCounter;
-
-                    unsigned long long sumKernels = 0ULL;
-                    for (int tid : depoTargetGpuIds)
-                    {
-                        auto it = perDeviceKernelCounts.find(tid);
-                        const unsigned long long c =
-                            (it == perDeviceKernelCounts.end()) ? 0ULL : it->second;
-                        sumKernels += c;
-                    }
-                    if (sumKernels > 0ULL
-                        && maxNumRanges > 0
-                        && (sumKernels % static_cast<unsigned long long>(maxNumRanges)) == 0ULL)
-                    {
-                        WriteKernelsCountFile(sumKernels);
-                        for (int tid : depoTargetGpuIds)
-                        {
-                            auto it = perDeviceKernelCounts.find(tid);
-                            const unsigned long long c =
-                                (it == perDeviceKernelCounts.end()) ? 0ULL : it->second;
-                            WritePerGpuKernelCountFile(tid, c);
-                        }
-                    }
-                }
-                else
-                {
-                    ++globalCounter;
-                    int maxNumRanges = 10;
-                    if (contextData.count(ctx) > 0)
-                    {
-                        maxNumRanges = contextData[ctx].maxNumRanges;
-                    }
-                    else
-                    {
-                        char *pEnvVar = getenv("INJECTION_KERNEL_COUNT");
-                        if (pEnvVar != NULL)
-                        {
-                            int v = atoi(pEnvVar);
-                            if (v >= 1)
-                            {
-                                maxNumRanges = v;
-                            }
-                        }
-                    }
-                    if (maxNumRanges > 0
-                        && (globalCounter % static_cast<unsigned long long>(maxNumRanges)) == 0ULL)
-                    {
-                        WriteKernelsCountFile(globalCounter);
-                    }
-                }
-
-                ctxDataMutex.unlock();
-                // // Check for this context in the configured contexts
-                // // If not configured, it isn't compatible with profiling
-                // ctxDataMutex.lock();
-                // if (contextData.count(ctx) > 0)
-                // {
-                //     // If at maximum number of ranges, end session and reset
-                //     if (contextData[ctx].curRanges == contextData[ctx].maxNumRanges)
-                //     {
-                //         EndSession(contextData[ctx]);
-                //         contextData[ctx].curRanges = 0;
-                //     }
-
-                //     // If no currently enabled session on this context, start one
-                //     if (contextData[ctx].curRanges == 0)
-                // {
-                //         InitializeContextData(contextData[ctx]);
-                //         StartSession(contextData[ctx]);
-                // }
-
-                //                     // Increment curRanges
-                //     contextData[ctx].curRanges++;
-                // }
-                // ctxDataMutex.unlock();
-            }
+        // Only the enabled launch paths and the graph bookkeeping calls get here
+        if (IsGraphBookkeepingCallback(callbackId))
+        {
+            HandleGraphBookkeeping(callbackId, pData);
+        }
+        else if (pData->callbackSite == CUPTI_API_ENTER)
+        {
+            HandleDriverLaunch(callbackId, pData);
+
+            // // Check for this context in the configured contexts
+            // // If not configured, it isn't compatible with profiling
+            // ctxDataMutex.lock();
+            // if (contextData.count(ctx) > 0)
+            // {
+            //     // If at maximum number of ranges, end session and reset
+            //     if (contextData[ctx].curRanges == contextData[ctx].maxNumRanges)
+            //     {
+            //         EndSession(contextData[ctx]);
+            //         contextData[ctx].curRanges = 0;
+            //     }
+
+            //     // If no currently enabled session on this context, start one
+            //     if (contextData[ctx].curRanges == 0)
+            // {
+            //         InitializeContextData(contextData[ctx]);
+            //         StartSession(contextData[ctx]);
+            // }
+
+            //                     // Increment curRanges
+            //     contextData[ctx].curRanges++;
+            // }
+            // ctxDataMutex.unlock();
+        }
+    }
+    else if (domain == CUPTI_CB_DOMAIN_RUNTIME_API)
+    {
+        CUpti_CallbackData const *pData = static_cast<CUpti_CallbackData const *>(pCallbackData);
+        if (pData->callbackSite == CUPTI_API_ENTER)
+        {
+            HandleRuntimeLaunch(callbackId, pData);
         }
     }
     else if (domain == CUPTI_CB_DOMAIN_RESOURCE)
@@ -535,6 +1216,9 @@ ProfilerCallbackHandler(
 
             // If valid for profiling, set up profiler and save to shared structure
             ctxDataMutex.lock();
+            // Kernels are counted per device also on contexts not supported by the profiler
+            contextDevice[ctx] = data.deviceId;
+            contextGeneration.fetch_add(1, std::memory_order_release);
             if (params.isSupported == CUPTI_PROFILER_CONFIGURATION_SUPPORTED)
             {
                 // Update shared structures
@@ -587,6 +1271,16 @@ ProfilerCallbackHandler(
             }
             ctxDataMutex.unlock();
         }
+        else if (callbackId == CUPTI_CBID_RESOURCE_CONTEXT_DESTROY_STARTING)
+        {
+            CUpti_ResourceData const *pResourceData = static_cast<CUpti_ResourceData const *>(pCallbackData);
+
+            // A new context may get the same handle, drop it from the per-thread caches
+            ctxDataMutex.lock();
+            contextDevice.erase(pResourceData->context);
+            contextGeneration.fetch_add(1, std::memory_order_release);
+            ctxDataMutex.unlock();
+        }
     }
 
     return;
@@ -599,10 +1293,29 @@ RegisterCallbacks()
     // One subscriber is used to register multiple callback domains
     CUpti_SubscriberHandle subscriber;
     CUPTI_API_CALL(cuptiSubscribe(&subscriber, (CUpti_CallbackFunc)ProfilerCallbackHandler, NULL));
-    // Runtime callback domain is needed for kernel launch callbacks
-    CUPTI_API_CALL(cuptiEnableCallback(1, subscriber, CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel));
+    // Driver or runtime callback domain is needed for kernel launch callbacks
+    const CUpti_CallbackDomain launchDomain = countRuntimeLaunches ? CUPTI_CB_DOMAIN_RUNTIME_API : CUPTI_CB_DOMAIN_DRIVER_API;
+    const LaunchCallback *launchCallbacks = countRuntimeLaunches ? runtimeLaunchCallbacks : driverLaunchCallbacks;
+    const size_t numLaunchCallbacks = countRuntimeLaunches
+        ? sizeof(runtimeLaunchCallbacks) / sizeof(runtimeLaunchCallbacks[0])
+        : sizeof(driverLaunchCallbacks) / sizeof(driverLaunchCallbacks[0]);
+    for (size_t i = 0; i < numLaunchCallbacks && !activityMode; ++i)
+    {
+        if (launchCallbacks[i].category & enabledLaunchCategories)
+        {
+            CUPTI_API_CALL(cuptiEnableCallback(1, subscriber, launchDomain, launchCallbacks[i].cbid));
+        }
+    }
+    if ((enabledLaunchCategories & LAUNCH_GRAPH) && !activityMode)
+    {
+        for (CUpti_CallbackId cbid : graphBookkeepingCallbacks)
+        {
+            CUPTI_API_CALL(cuptiEnableCallback(1, subscriber, CUPTI_CB_DOMAIN_DRIVER_API, cbid));
+        }
+    }
     // Resource callback domain is needed for context creation callbacks
     CUPTI_API_CALL(cuptiEnableCallback(1, subscriber, CUPTI_CB_DOMAIN_RESOURCE, CUPTI_CBID_RESOURCE_CONTEXT_CREATED));
+    CUPTI_API_CALL(cuptiEnableCallback(1, subscriber, CUPTI_CB_DOMAIN_RESOURCE, CUPTI_CBID_RESOURCE_CONTEXT_DESTROY_STARTING));
 
     // Register callback for application exit
     atexit(EndExecution);
@@ -619,7 +1332,7 @@ InitializeInjection()
     {
         injectionInitialized = true;
 
-        ParseDepoAsyncEnv();
+        ParseInjectionEnv();
 
         // Read in optional list of metrics to gather
         char *pMetricEnv = getenv("INJECTION_METRICS");
@@ -642,6 +1355,11 @@ InitializeInjection()
 
         // Subscribe to some callbacks
         RegisterCallbacks();
+        if (activityMode)
+        {
+            InitializeActivityMode();
+        }
+        StartPublisher();
     }
     return 1;
 }
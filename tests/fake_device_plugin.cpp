@@ -0,0 +1,86 @@
+// eco_device_v1 plugin of a fake two-GPU device, loaded by test_plugin_device
+#include "devices/device_plugin_export.hpp"
+#include "power_interface/power_cap_journal.hpp"
+#include <stdexcept>
+
+class FakeDevice : public Device
+{
+public:
+    // device 9 fails the queries that have no error return in the C ABI
+    explicit FakeDevice(const DevicePluginOptions& options) :
+        async_(options.async), broken_(!options.ids.empty() && options.ids.front() == 9), capsMicroW_(2, 250000000UL)
+    {
+    }
+
+    std::string getName() const override { return "Fake device"; }
+    std::pair<unsigned, unsigned> getMinMaxLimitInWatts() const override { return {50, 250}; }
+    double getPowerLimitInWatts() const override { return capsMicroW_.front() / 1e6; }
+    void setPowerLimitInMicroWatts(unsigned long limitInMicroW) override
+    {
+        if (limitInMicroW < 50000000UL)
+        {
+            throw std::runtime_error("limit below minimum");
+        }
+        capsMicroW_.assign(2, limitInMicroW);
+    }
+    void reset() override { samples_ = 0; }
+    unsigned long long int getPerfCounter() const override { return samples_ * 1000ULL; }
+    double getCurrentPowerInWatts(std::optional<Domain> dom) const override { return dom.has_value() ? 10.0 : 100.0; }
+    void restoreDefaultLimits() override { capsMicroW_.assign(2, 250000000UL); }
+    std::string getDeviceTypeString() const override { return "gpu"; }
+    void triggerPowerApiSample() override
+    {
+        ++samples_;
+        counter_.energyInMicroJoules += 100000000ULL;  // 100 W for 1 s
+        counter_.timestampInMicroSeconds += 1000000ULL;
+    }
+    std::optional<EnergyCounterSample> getEnergyCounterSample() const override { return checked(counter_); }
+    size_t getNumSubdevices() const override { return checked(size_t {2}); }
+    double getCurrentPowerInWattsForSubdevice(size_t index) const override { return index == 0 ? 60.0 : 40.0; }
+    double getPowerLimitInWattsForSubdevice(size_t index) const override { return capsMicroW_.at(index) / 1e6; }
+    std::string getSubdeviceLabel(size_t index) const override { return "gpu" + std::to_string(index); }
+    bool usesIndependentSubdevicePowerCaps() const override { return checked(async_); }
+    void setPowerLimitsPerGpuMicroWatts(const std::vector<unsigned long>& microWattsPerSubdevice) override
+    {
+        capsMicroW_ = microWattsPerSubdevice;
+    }
+
+private:
+    template <class T>
+    T checked(T value) const
+    {
+        if (broken_)
+        {
+            throw std::runtime_error("device lost");
+        }
+        return value;
+    }
+
+    bool async_;
+    bool broken_;
+    std::vector<unsigned long> capsMicroW_;
+    unsigned long long samples_ {0};
+    EnergyCounterSample counter_;
+};
+
+static int probeFake()
+{
+    return 1;
+}
+
+static std::unique_ptr<Device> makeFakeDevice(const DevicePluginOptions& options)
+{
+    if (!options.ids.empty() && options.ids.front() < 0)
+    {
+        throw std::runtime_error("no such device");
+    }
+    return std::make_unique<FakeDevice>(options);
+}
+
+ECO_DEVICE_PLUGIN("fake", "gpu", probeFake, makeFakeDevice)
+
+// lets test_plugin_device check that the plugin shares the journal of the application
+extern "C" __attribute__((visibility("default"))) void* eco_fake_plugin_journal()
+{
+    return &PowerCapJournal::instance();
+}
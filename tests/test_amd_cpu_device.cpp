@@ -0,0 +1,172 @@
+#include "devices/amd_cpu_device.hpp"
+#include "power_interface/msr_offsets.hpp"
+#include "test_fixtures.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#define CHECK(x)                                                                                                       \
+    if ((x) != true)                                                                                                   \
+    {                                                                                                                  \
+        std::cerr << "CHECK failed at line " << __LINE__ << ": " #x "\n";                                             \
+        exit(-1);                                                                                                      \
+    }
+
+// fake /dev/cpu/<cpu>/msr - a sparse file read with pread at the MSR address
+static void writeMsr(const fs::path& path, off_t offset, uint64_t value)
+{
+    fs::create_directories(path.parent_path());
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    CHECK(fd >= 0);
+    CHECK(::pwrite(fd, &value, sizeof(value), offset) == sizeof(value));
+    ::close(fd);
+}
+
+static void writeHwmonCounters(const fs::path& hwmon, uint64_t socket0, uint64_t socket1, uint64_t core)
+{
+    // energy1..2 - sockets, energy3..5 - cores (in micro-joules)
+    writeFile(hwmon / "energy1_input", std::to_string(socket0));
+    writeFile(hwmon / "energy2_input", std::to_string(socket1));
+    for (int i = 3; i <= 5; ++i)
+    {
+        writeFile(hwmon / ("energy" + std::to_string(i) + "_input"), std::to_string(core));
+    }
+}
+
+static void test_vendor_detection(const fs::path& root)
+{
+    makeFakeCpuTree(root / "amd", "AuthenticAMD");
+    makeFakeCpuTree(root / "intel", "GenuineIntel");
+    CHECK(AmdCpuDevice::isAmdCpu((root / "amd").string()));
+    CHECK(!AmdCpuDevice::isAmdCpu((root / "intel").string()));
+    CHECK(!AmdCpuDevice::isAmdCpu((root / "missing").string()));
+
+    bool thrown = false;
+    try
+    {
+        AmdCpuDevice device(AmdEnergySource::AUTO, (root / "intel").string());
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+static void test_hwmon_counters(const fs::path& root)
+{
+    makeFakeCpuTree(root, "AuthenticAMD");
+    // another hwmon driver is skipped
+    writeFile(root / "sys/class/hwmon/hwmon0/name", "k10temp");
+    writeFile(root / "sys/class/hwmon/hwmon0/energy1_label", "Esocket0");
+    writeFile(root / "sys/class/hwmon/hwmon0/energy1_input", "0");
+    const fs::path hwmon = root / "sys/class/hwmon/hwmon1";
+    writeFile(hwmon / "name", "amd_energy");
+    writeFile(hwmon / "energy1_label", "Esocket0");
+    writeFile(hwmon / "energy2_label", "Esocket1");
+    writeFile(hwmon / "energy3_label", "Ecore000");
+    writeFile(hwmon / "energy4_label", "Ecore001");
+    writeFile(hwmon / "energy5_label", "Ecore002");
+    writeHwmonCounters(hwmon, 1000000, 2000000, 500000);
+
+    auto clock = std::make_shared<SimulatedClock>();
+    // no msr device nodes in the tree, AUTO falls back to hwmon
+    AmdCpuDevice device(AmdEnergySource::AUTO, root.string(), clock);
+    CHECK(device.getEnergySource() == AmdEnergySource::HWMON);
+    CHECK(device.getName() == "AMD EPYC 7763 64-Core Processor");
+    CHECK(device.getDeviceTypeString() == "cpu");
+    CHECK(device.getNumPackages() == 2);
+    CHECK(device.getNumCoreCounters() == 3);
+    // no /dev/hsmp - measuring only
+    CHECK(!device.isPowerCappingAvailable());
+    CHECK(device.getMinMaxLimitInWatts() == std::make_pair(0u, 0u));
+    CHECK(device.getPowerLimitInWatts() < 0.0);
+    device.setPowerLimitInMicroWatts(100000000);
+
+    // 150 J on the sockets and 3 * 20 J on the cores in 2 s
+    writeHwmonCounters(hwmon, 51000000, 102000000, 20500000);
+    clock->advance(std::chrono::seconds(2));
+    device.triggerPowerApiSample();
+    CHECK(isNear(device.getCurrentPowerInWatts(std::nullopt), 75.0));
+    CHECK(isNear(device.getCurrentPowerInWatts(Domain::PKG), 75.0));
+    CHECK(isNear(device.getCurrentPowerInWatts(Domain::PP0), 30.0));
+    auto energy = device.getEnergySinceResetPerDomain();
+    CHECK(isNear(energy[Domain::PKG], 150.0));
+    CHECK(isNear(energy[Domain::PP0], 60.0));
+    auto sample = device.getEnergyCounterSample();
+    CHECK(sample.has_value());
+    CHECK(sample->energyInMicroJoules == 150000000);
+    CHECK(sample->timestampInMicroSeconds == 2000000);
+
+    // a counter going backwards (driver reloaded) counts from zero
+    device.reset();
+    writeHwmonCounters(hwmon, 1000000, 102000000, 20500000);
+    clock->advance(std::chrono::seconds(1));
+    device.triggerPowerApiSample();
+    CHECK(isNear(device.getEnergySinceResetPerDomain()[Domain::PKG], 1.0));
+    CHECK(isNear(device.getEnergySinceResetPerDomain()[Domain::PP0], 0.0));
+    CHECK(device.getEnergyCounterSample()->energyInMicroJoules == 151000000);
+
+    bool thrown = false;
+    try
+    {
+        AmdCpuDevice msrOnly(AmdEnergySource::MSR, root.string(), clock);
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+static void test_msr_counters(const fs::path& root)
+{
+    makeFakeCpuTree(root, "AuthenticAMD");
+    // ESU = 16: 1/65536 J per count, upper 32 bits of the energy MSRs are reserved
+    const uint64_t reserved = 0xAB00000000000000ull;
+    // the 8-byte registers at consecutive addresses overlap in the fake file: the low 24 bits
+    // of the package counters are kept 0, so that the core counters of cpu0 and cpu2 read
+    // the low byte of the register below only (the energy unit field or 0)
+    writeMsr(root / "dev/cpu/0/msr", MSR_AMD_RAPL_POWER_UNIT, 0x000A1003);
+    writeMsr(root / "dev/cpu/1/msr", MSR_AMD_CORE_ENERGY_STATUS, 0);
+    writeMsr(root / "dev/cpu/2/msr", MSR_AMD_CORE_ENERGY_STATUS, 0);
+    writeMsr(root / "dev/cpu/0/msr", MSR_AMD_PKG_ENERGY_STATUS, reserved | 0xFF000000);
+    writeMsr(root / "dev/cpu/2/msr", MSR_AMD_PKG_ENERGY_STATUS, reserved | 0x01000000);
+
+    auto clock = std::make_shared<SimulatedClock>();
+    AmdCpuDevice device(AmdEnergySource::AUTO, root.string(), clock);
+    CHECK(device.getEnergySource() == AmdEnergySource::MSR);
+    CHECK(device.getNumPackages() == 2);
+    CHECK(device.getNumCoreCounters() == 3);
+
+    // socket 0 wraps around: 0xFF000000 -> 0x01000000 is 2 * 2^24 counts (512 J)
+    writeMsr(root / "dev/cpu/0/msr", MSR_AMD_PKG_ENERGY_STATUS, reserved | 0x01000000);
+    writeMsr(root / "dev/cpu/2/msr", MSR_AMD_PKG_ENERGY_STATUS, reserved | 0x03000000);
+    writeMsr(root / "dev/cpu/1/msr", MSR_AMD_CORE_ENERGY_STATUS, 0x00800000);
+    clock->advance(std::chrono::seconds(4));
+    device.triggerPowerApiSample();
+    CHECK(isNear(device.getEnergySinceResetPerDomain()[Domain::PKG], 1024.0));
+    CHECK(isNear(device.getEnergySinceResetPerDomain()[Domain::PP0], 128.0));
+    CHECK(isNear(device.getCurrentPowerInWatts(Domain::PKG), 256.0));
+    CHECK(isNear(device.getCurrentPowerInWatts(Domain::PP0), 32.0));
+}
+
+int main()
+{
+    char dirTemplate[] = "/tmp/test_amd_cpu_device_XXXXXX";
+    const fs::path root = mkdtemp(dirTemplate);
+
+    test_vendor_detection(root / "vendor");
+    test_hwmon_counters(root / "hwmon");
+    test_msr_counters(root / "msr");
+
+    fs::remove_all(root);
+    std::cout << "test_amd_cpu_device passed\n";
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include "busy_time.h"
+#include <cstdlib>
+#include <iostream>
+
+#define CHECK(x)                                                                                                       \
+    if ((x) != true)                                                                                                   \
+    {                                                                                                                  \
+        std::cerr << "CHECK failed at line " << __LINE__ << ": " #x "\n";                                             \
+        exit(-1);                                                                                                      \
+    }
+
+static void test_out_of_order_overlap()
+{
+    // B [5,8] completes before A [0,10]: the union is 10 ns, not 3 + 2
+    BusyTimeMerger merger;
+    merger.Add(5, 8);
+    merger.Add(0, 10);
+    CHECK(merger.Flush() == 10);
+    CHECK(merger.Flush() == 0);
+}
+
+static void test_gaps_and_next_buffer()
+{
+    BusyTimeMerger merger;
+    merger.Add(30, 40);
+    merger.Add(0, 10);
+    merger.Add(5, 12);
+    CHECK(merger.Flush() == 22);
+    // the next buffer overlaps the end of the previous one
+    merger.Add(45, 50);
+    merger.Add(35, 42);
+    merger.Add(41, 41);
+    CHECK(merger.Flush() == 7);
+}
+
+int main()
+{
+    test_out_of_order_overlap();
+    test_gaps_and_next_buffer();
+    std::cout << "test_busy_time passed\n";
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include "data_structures/energy_integrator.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#define CHECK(x)                                                                                                       \
+    if ((x) != true)                                                                                                   \
+    {                                                                                                                  \
+        std::cerr << "CHECK failed at line " << __LINE__ << ": " #x "\n";                                             \
+        exit(-1);                                                                                                      \
+    }
+
+static bool isNear(double value, double expected, double tolerance = 1e-9)
+{
+    return std::fabs(value - expected) <= tolerance * std::max(1.0, std::fabs(expected));
+}
+
+static void test_power_samples()
+{
+    EnergyIntegrator integrator;
+    CHECK(integrator.getLastIntervalPowerInWatts() == 0.0);
+    // sub-millisecond intervals are not truncated
+    integrator.addPowerSample(100.0, std::chrono::microseconds(500));
+    integrator.addPowerSample(200.0, std::chrono::microseconds(1500));
+    CHECK(isNear(integrator.getEnergyInJoules(), 0.05 + 0.3));
+    CHECK(isNear(integrator.getLastIntervalPowerInWatts(), 200.0));
+    integrator.reset();
+    CHECK(integrator.getEnergyInJoules() == 0.0);
+}
+
+static void test_counter_samples()
+{
+    EnergyIntegrator integrator;
+    // the first sample only sets the origin
+    integrator.addEnergyCounterSample({5000000, 1000000});
+    CHECK(integrator.getEnergyInJoules() == 0.0);
+    CHECK(integrator.getLastIntervalPowerInWatts() == 0.0);
+    // 300 J in 2 s
+    integrator.addEnergyCounterSample({305000000, 3000000});
+    CHECK(isNear(integrator.getEnergyInJoules(), 300.0));
+    CHECK(isNear(integrator.getLastIntervalPowerInWatts(), 150.0));
+    // counter not updated since the last read: nothing changes
+    integrator.addEnergyCounterSample({305000000, 3000000});
+    CHECK(isNear(integrator.getEnergyInJoules(), 300.0));
+    CHECK(isNear(integrator.getLastIntervalPowerInWatts(), 150.0));
+    // the interval comes from the counter timestamps
+    integrator.addEnergyCounterSample({305250000, 3001000});
+    CHECK(isNear(integrator.getEnergyInJoules(), 300.25));
+    CHECK(isNear(integrator.getLastIntervalPowerInWatts(), 250.0));
+}
+
+static void test_counter_reset()
+{
+    EnergyIntegrator integrator;
+    integrator.addEnergyCounterSample({1000000, 1000000});
+    integrator.addEnergyCounterSample({2000000, 2000000});
+    // a counter going backwards moves the origin only
+    integrator.addEnergyCounterSample({100, 2500000});
+    CHECK(isNear(integrator.getEnergyInJoules(), 1.0));
+    integrator.addEnergyCounterSample({2000100, 3500000});
+    CHECK(isNear(integrator.getEnergyInJoules(), 3.0));
+    // after reset() the next sample is a new origin
+    integrator.reset();
+    integrator.addEnergyCounterSample({9000100, 4500000});
+    CHECK(integrator.getEnergyInJoules() == 0.0);
+    integrator.addEnergyCounterSample({9500100, 5500000});
+    CHECK(isNear(integrator.getEnergyInJoules(), 0.5));
+}
+
+int main()
+{
+    test_power_samples();
+    test_counter_samples();
+    test_counter_reset();
+    std::cout << "test_energy_integrator passed\n";
+    return 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+// helpers shared by the tests of the sysfs based devices, which run on synthetic trees (rootDir)
+
+namespace fs = std::filesystem;
+
+inline bool isNear(double value, double expected, double tolerance = 1e-9)
+{
+    return std::fabs(value - expected) <= tolerance * std::max(1.0, std::fabs(expected));
+}
+
+inline void writeFile(const fs::path& path, long long value)
+{
+    fs::create_directories(path.parent_path());
+    std::ofstream(path, std::ios::out | std::ios::trunc) << value;
+}
+
+inline void writeFile(const fs::path& path, const std::string& content)
+{
+    fs::create_directories(path.parent_path());
+    std::ofstream(path, std::ios::out | std::ios::trunc) << content << "\n";
+}
+
+inline long long readFile(const fs::path& path)
+{
+    long long value = -1;
+    std::ifstream(path) >> value;
+    return value;
+}
+
+constexpr long long maxEnergyRange = 262143328850;
+
+inline void makeZone(const fs::path& zone, const std::string& name, long long energy)
+{
+    writeFile(zone / "name", name);
+    writeFile(zone / "energy_uj", energy);
+    writeFile(zone / "max_energy_range_uj", maxEnergyRange);
+}
+
+inline void addConstraint(const fs::path& zone, int index, const std::string& name, long long limit)
+{
+    const std::string prefix = "constraint_" + std::to_string(index) + "_";
+    writeFile(zone / (prefix + "name"), name);
+    writeFile(zone / (prefix + "power_limit_uw"), limit);
+    writeFile(zone / (prefix + "time_window_us"), 999424);
+}
+
+// intel-rapl with 2 packages (core and dram subzones), psys and an MMIO duplicate of package-0
+inline fs::path makeFakePowercapTree(const fs::path& root)
+{
+    const fs::path powercap = root / "sys/class/powercap";
+    fs::create_directories(powercap / "intel-rapl");
+    for (int pkg = 0; pkg < 2; ++pkg)
+    {
+        const fs::path zone = powercap / ("intel-rapl:" + std::to_string(pkg));
+        makeZone(zone, "package-" + std::to_string(pkg), 1000000);
+        addConstraint(zone, 0, "long_term", 125000000);
+        addConstraint(zone, 1, "short_term", 150000000);
+        makeZone(powercap / ("intel-rapl:" + std::to_string(pkg) + ":0"), "core", 0);
+        makeZone(powercap / ("intel-rapl:" + std::to_string(pkg) + ":1"), "dram", 0);
+        addConstraint(powercap / ("intel-rapl:" + std::to_string(pkg) + ":1"), 0, "long_term", 20000000);
+    }
+    makeZone(powercap / "intel-rapl:2", "psys", 0);
+    makeZone(powercap / "intel-rapl-mmio:0", "package-0", 0);
+    addConstraint(powercap / "intel-rapl-mmio:0", 0, "long_term", 125000000);
+    return powercap;
+}
+
+// 2 sockets, 3 physical cores, cpu3 is the SMT sibling of cpu0
+inline void makeFakeCpuTree(const fs::path& root, const std::string& vendor)
+{
+    writeFile(root / "proc/cpuinfo", "processor\t: 0\nvendor_id\t: " + vendor + "\ncpu family\t: 25\n"
+                                     "model name\t: AMD EPYC 7763 64-Core Processor\n");
+    const int packages[] = {0, 0, 1, 0};
+    const int cores[] = {0, 1, 0, 0};
+    for (int cpu = 0; cpu < 4; ++cpu)
+    {
+        const fs::path topology = root / ("sys/devices/system/cpu/cpu" + std::to_string(cpu)) / "topology";
+        writeFile(topology / "physical_package_id", packages[cpu]);
+        writeFile(topology / "core_id", cores[cpu]);
+    }
+}
@@ -0,0 +1,125 @@
+#include "data_structures/metric_expression.hpp"
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#define CHECK(x)                                                                                                       \
+    if ((x) != true)                                                                                                   \
+    {                                                                                                                  \
+        std::cerr << "CHECK failed at line " << __LINE__ << ": " #x "\n";                                             \
+        exit(-1);                                                                                                      \
+    }
+
+static bool isNear(double value, double expected, double tolerance = 1e-9)
+{
+    return std::fabs(value - expected) <= tolerance * std::max(1.0, std::fabs(expected));
+}
+
+// window of 1 s with \p work units of work at \p power watts
+static PowAndPerfResult window(double work, double power, double cap = 100.0)
+{
+    return PowAndPerfResult(work, 1.0, cap, power, power, 0.0, power);
+}
+
+static bool isRejected(const std::string& text)
+{
+    try
+    {
+        MetricExpression::compile(text);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        return true;
+    }
+    return false;
+}
+
+static void test_arithmetic()
+{
+    const auto result = window(1000.0, 200.0);
+    const auto reference = window(2000.0, 250.0);
+    CHECK(isNear(MetricExpression::compile("E").evaluate(result, reference), 0.2));
+    CHECK(isNear(MetricExpression::compile("T").evaluate(result, reference), 1e-3));
+    CHECK(isNear(MetricExpression::compile("perf / ref_perf").evaluate(result, reference), 0.5));
+    CHECK(isNear(MetricExpression::compile("P - ref_P * 2").evaluate(result, reference), -300.0));
+    CHECK(isNear(MetricExpression::compile("2^3^2").evaluate(result, reference), 512.0));
+    CHECK(isNear(MetricExpression::compile("-2^2").evaluate(result, reference), -4.0));
+    CHECK(isNear(MetricExpression::compile("(1 + 2) * 3 - 4 / 2").evaluate(result, reference), 7.0));
+    CHECK(isNear(MetricExpression::compile("max(cap, 150) + min(1e3, perf)").evaluate(result, reference), 1150.0));
+    CHECK(isNear(MetricExpression::compile("k").evaluate(result, reference), 2.0));
+    CHECK(isNear(MetricExpression::compile("k", 3.5).evaluate(result, reference), 3.5));
+}
+
+static void test_syntax_errors()
+{
+    CHECK(isRejected(""));
+    CHECK(isRejected("E *"));
+    CHECK(isRejected("(E"));
+    CHECK(isRejected("E T"));
+    CHECK(isRejected("energy"));
+    CHECK(isRejected("E subject perf > 1"));
+    CHECK(isRejected("E subject to perf"));
+    CHECK(isRejected("E subject to perf >= 1 and"));
+    CHECK(isRejected("min(E)"));
+    std::string deep = "E";
+    for (int i = 0; i < 40; i++)
+    {
+        deep = "1+(" + deep + ")";
+    }
+    CHECK(isRejected(deep));
+}
+
+static void test_presets_match_previous_comparisons()
+{
+    const auto reference = window(2000.0, 250.0);
+    const auto fast = window(2000.0, 240.0);
+    const auto efficient = window(1500.0, 150.0);
+    const auto energy = MetricExpression::fromTargetMetric(TargetMetric::MIN_E);
+    const auto edp = MetricExpression::fromTargetMetric(TargetMetric::MIN_E_X_T);
+    const auto eds = MetricExpression::fromTargetMetric(TargetMetric::MIN_M_PLUS, 2.0);
+
+    // energy per unit of work: 0.12 vs 0.1 J
+    CHECK(energy.isRightBetter(fast, efficient, reference));
+    CHECK(!energy.isRightBetter(efficient, fast, reference));
+    // EDP ordering is the reverse of getEnergyTimeProd ordering
+    CHECK(edp.isRightBetter(fast, efficient, reference) == (efficient.getEnergyTimeProd() > fast.getEnergyTimeProd()));
+    CHECK(isNear(eds.evaluate(efficient, reference), efficient.checkPlusMetric(reference, 2.0)));
+    CHECK(isNear(eds.evaluate(fast, reference), fast.checkPlusMetric(reference, 2.0)));
+    // equal results are not better
+    CHECK(!energy.isRightBetter(fast, fast, reference));
+}
+
+static void test_constraints()
+{
+    const auto reference = window(2000.0, 250.0);
+    const auto slightlySlower = window(1950.0, 220.0);  // 97.5% perf, 0.113 J
+    const auto slow = window(1500.0, 150.0);            // 75% perf, 0.1 J
+    const auto slower = window(1000.0, 90.0);           // 50% perf, 0.09 J
+    const auto sla = MetricExpression::compile("E subject to perf >= 0.95*ref_perf");
+    CHECK(sla.hasConstraints());
+    CHECK(sla.getConstraintsViolation(slightlySlower, reference) == 0.0);
+    CHECK(isNear(sla.getConstraintsViolation(slow, reference), (1900.0 - 1500.0) / 1900.0));
+
+    // unconstrained E prefers the slow one, the SLA keeps the feasible one
+    CHECK(MetricExpression::compile("E").isRightBetter(slightlySlower, slow, reference));
+    CHECK(!sla.isRightBetter(slightlySlower, slow, reference));
+    CHECK(sla.isRightBetter(slow, slightlySlower, reference));
+    // among infeasible results the one closer to the SLA is better
+    CHECK(sla.isRightBetter(slower, slow, reference));
+
+    const auto twoConstraints = MetricExpression::compile("E*T^2 subject to perf >= 0.7*ref_perf and P < 200");
+    CHECK(twoConstraints.getConstraintsViolation(slow, reference) == 0.0);
+    CHECK(twoConstraints.getConstraintsViolation(slightlySlower, reference) > 0.0);
+    CHECK(twoConstraints.isRightBetter(slightlySlower, slow, reference));
+}
+
+int main()
+{
+    test_arithmetic();
+    test_syntax_errors();
+    test_presets_match_previous_comparisons();
+    test_constraints();
+    std::cout << "test_metric_expression passed\n";
+    return 0;
+}
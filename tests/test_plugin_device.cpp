@@ -0,0 +1,134 @@
+#include "devices/plugin_device.hpp"
+#include "device_state.hpp"
+#include "power_interface/power_cap_journal.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#define CHECK(x)                                                                                                       \
+    if ((x) != true)                                                                                                   \
+    {                                                                                                                  \
+        std::cerr << "CHECK failed at line " << __LINE__ << ": " #x "\n";                                             \
+        exit(-1);                                                                                                      \
+    }
+
+static void test_forwarding(const std::string& path)
+{
+    PluginDevice device(path, "0,1,async");
+    CHECK(device.getPluginName() == "fake");
+    CHECK(device.getName() == "Fake device");
+    CHECK(device.getDeviceTypeString() == "gpu");
+    CHECK(device.getMinMaxLimitInWatts() == std::make_pair(50u, 250u));
+    CHECK(device.getPowerLimitInWatts() == 250.0);
+    device.setPowerLimitInMicroWatts(120000000UL);
+    CHECK(device.getPowerLimitInWatts() == 120.0);
+    // a failing call is reported, not thrown through the C ABI
+    device.setPowerLimitInMicroWatts(1000000UL);
+    CHECK(device.getPowerLimitInWatts() == 120.0);
+
+    CHECK(device.getCurrentPowerInWatts() == 100.0);
+    CHECK(device.getCurrentPowerInWatts(Domain::DRAM) == 10.0);
+    device.triggerPowerApiSample();
+    CHECK(device.getPerfCounter() == 1000ULL);
+    auto counter = device.getEnergyCounterSample();
+    CHECK(counter.has_value() && counter->energyInMicroJoules == 100000000ULL);
+    device.reset();
+    CHECK(device.getPerfCounter() == 0ULL);
+
+    CHECK(device.getNumSubdevices() == 2);
+    CHECK(device.getSubdeviceLabel(1) == "gpu1");
+    CHECK(device.getCurrentPowerInWattsForSubdevice(0) == 60.0);
+    CHECK(device.usesIndependentSubdevicePowerCaps());
+    device.setPowerLimitsPerGpuMicroWatts({100000000UL, 150000000UL});
+    CHECK(device.getPowerLimitInWattsForSubdevice(1) == 150.0);
+    device.restoreDefaultLimits();
+    CHECK(device.getPowerLimitInWattsForSubdevice(1) == 250.0);
+}
+
+static void test_exceptions_stay_in_plugin(const std::string& path)
+{
+    // calls without an error code in the ABI report the failure with a neutral value
+    PluginDevice device(path, "9");
+    CHECK(!device.getEnergyCounterSample().has_value());
+    CHECK(device.getNumSubdevices() == 1);
+    CHECK(!device.usesIndependentSubdevicePowerCaps());
+}
+
+static void test_energy_counter_reaches_accumulator(const std::string& path)
+{
+    // the fake counter advances 100 J per sample, independent of the host time
+    auto device = std::make_shared<PluginDevice>(path);
+    DeviceStateAccumulator deviceState(device);
+    deviceState.resetState();
+    deviceState.sample();
+    deviceState.sample();
+    CHECK(std::fabs(deviceState.getEnergySinceReset() - 300.0) < 1e-9);
+}
+
+static void test_create_failure(const std::string& path)
+{
+    bool thrown = false;
+    try
+    {
+        PluginDevice device(path, "-1");
+    }
+    catch (const std::runtime_error& e)
+    {
+        thrown = std::string(e.what()).find("no such device") != std::string::npos;
+    }
+    CHECK(thrown);
+}
+
+static void test_shared_journal(const std::string& path)
+{
+    // the plugin links libeco.so, so caps it sets are restored by the journal and the signal
+    // handlers of the application
+    PluginDevice device(path);
+    void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_NOLOAD);
+    CHECK(handle != nullptr);
+    auto pluginJournal = reinterpret_cast<void* (*)()>(dlsym(handle, "eco_fake_plugin_journal"));
+    CHECK(pluginJournal != nullptr);
+    CHECK(pluginJournal() == &PowerCapJournal::instance());
+    dlclose(handle);
+}
+
+static void test_discovery(const std::string& path)
+{
+    const auto dir = path.substr(0, path.find_last_of('/'));
+    setenv(ECO_PLUGIN_PATH_ENV, ("/nonexistent:" + dir).c_str(), 1);
+    const auto plugins = PluginDevice::discoverPlugins();
+    CHECK(plugins.size() >= 1);
+    CHECK(PluginDevice::make("fake")->getName() == "Fake device");
+    CHECK(PluginDevice::make("auto")->getPluginName() == "fake");
+    bool thrown = false;
+    try
+    {
+        PluginDevice::make("no_such_plugin");
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: test_plugin_device <path of libeco_device_fake.so>\n";
+        return -1;
+    }
+    const std::string path = argv[1];
+    test_forwarding(path);
+    test_exceptions_stay_in_plugin(path);
+    test_energy_counter_reaches_accumulator(path);
+    test_create_failure(path);
+    test_shared_journal(path);
+    test_discovery(path);
+    std::cout << "test_plugin_device passed\n";
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "power_interface/power_cap_journal.hpp"
+#include <csignal>
+#include <cstdint>
+#include <fcntl.h>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CHECK(x)                                                                                                       \
+    if ((x) != true)                                                                                                   \
+    {                                                                                                                  \
+        std::cerr << "CHECK failed at line " << __LINE__ << ": " #x "\n";                                             \
+        exit(-1);                                                                                                      \
+    }
+
+namespace fs = std::filesystem;
+
+// fake RAPL setting, e.g. constraint_0_power_limit_uw
+static void writeSetting(const std::string& path, long long value)
+{
+    std::ofstream(path, std::ios::out | std::ios::trunc) << value;
+}
+
+static long long readSetting(const std::string& path)
+{
+    long long value = -1;
+    std::ifstream(path) >> value;
+    return value;
+}
+
+static size_t countJournals(const std::string& dir)
+{
+    size_t count = 0;
+    for (const auto& entry : fs::directory_iterator(dir))
+    {
+        count += entry.path().extension() == ".journal";
+    }
+    return count;
+}
+
+// runs \p f in a child process and returns its wait status
+template <class F>
+static int runInChild(F&& f)
+{
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        struct rlimit noCoreDumps {0, 0};
+        setrlimit(RLIMIT_CORE, &noCoreDumps);
+        f();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return status;
+}
+
+static void applyCap(PowerCapJournal& journal, const std::string& setting, long long value)
+{
+    journal.apply("cpu", PowerCapJournal::Backend::SYSFS, setting, value, [&] { writeSetting(setting, value); });
+}
+
+static void test_caps_of_killed_process_are_restored(const std::string& dir, const std::string& setting)
+{
+    writeSetting(setting, 125000000);
+    runInChild([&] {
+        PowerCapJournal journal(dir);
+        journal.recordOriginal("cpu", PowerCapJournal::Backend::SYSFS, setting, 125000000);
+        applyCap(journal, setting, 80000000);
+        applyCap(journal, setting, 60000000);
+        kill(getpid(), SIGKILL);
+    });
+    CHECK(readSetting(setting) == 60000000);
+    CHECK(countJournals(dir) == 1);
+
+    CHECK(PowerCapJournal::restoreLeftovers(dir, true) == 0);
+    CHECK(readSetting(setting) == 60000000);
+    CHECK(PowerCapJournal::restoreLeftovers(dir) == 0);
+    CHECK(readSetting(setting) == 125000000);
+    CHECK(countJournals(dir) == 0);
+}
+
+static void test_caps_restored_by_device_are_left_alone(const std::string& dir, const std::string& setting)
+{
+    writeSetting(setting, 125000000);
+    runInChild([&] {
+        PowerCapJournal journal(dir);
+        journal.recordOriginal("cpu", PowerCapJournal::Backend::SYSFS, setting, 125000000);
+        applyCap(journal, setting, 80000000);
+        writeSetting(setting, 125000000);
+        journal.markRestored("cpu");
+        kill(getpid(), SIGKILL);
+    });
+    // changed by someone else afterwards
+    writeSetting(setting, 90000000);
+    CHECK(PowerCapJournal::restoreLeftovers(dir) == 0);
+    CHECK(readSetting(setting) == 90000000);
+    CHECK(countJournals(dir) == 0);
+}
+
+static void test_journal_of_running_process_is_skipped(const std::string& dir, const std::string& setting)
+{
+    writeSetting(setting, 125000000);
+    {
+        PowerCapJournal journal(dir);
+        // locked under the temporary name and renamed into place
+        for (const auto& entry : fs::directory_iterator(dir))
+        {
+            CHECK(entry.path().extension() != ".tmp");
+        }
+        journal.recordOriginal("cpu", PowerCapJournal::Backend::SYSFS, setting, 125000000);
+        applyCap(journal, setting, 70000000);
+        CHECK(PowerCapJournal::restoreLeftovers(dir) == 0);
+        CHECK(readSetting(setting) == 70000000);
+        CHECK(countJournals(dir) == 1);
+    }
+    // the destructor restores the caps the device has not restored
+    CHECK(readSetting(setting) == 125000000);
+    CHECK(countJournals(dir) == 0);
+}
+
+static void test_caps_restored_on_signals(const std::string& dir, const std::string& setting)
+{
+    for (int signo : {SIGTERM, SIGINT, SIGSEGV})
+    {
+        writeSetting(setting, 125000000);
+        const int status = runInChild([&] {
+            PowerCapJournal::installSignalHandlers();
+            PowerCapJournal journal(dir);
+            journal.recordOriginal("cpu", PowerCapJournal::Backend::SYSFS, setting, 125000000);
+            applyCap(journal, setting, 50000000);
+            raise(signo);
+            pause();
+        });
+        CHECK(WIFSIGNALED(status) && WTERMSIG(status) == signo);
+        CHECK(readSetting(setting) == 125000000);
+        // after a fatal signal the journal is left for restoreLeftovers
+        CHECK(countJournals(dir) == (signo == SIGSEGV ? 1u : 0u));
+        CHECK(PowerCapJournal::restoreLeftovers(dir) == 0);
+        CHECK(countJournals(dir) == 0);
+    }
+}
+
+// fake /dev/cpu/<cpu>/msr, a regular file read and written at the MSR offset
+static uint64_t readMsr(const std::string& path, off_t offset)
+{
+    uint64_t value = 0;
+    const int fd = open(path.c_str(), O_RDONLY);
+    CHECK(fd >= 0 && pread(fd, &value, sizeof(value), offset) == sizeof(value));
+    close(fd);
+    return value;
+}
+
+static void writeMsr(const std::string& path, off_t offset, uint64_t value)
+{
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    CHECK(fd >= 0 && pwrite(fd, &value, sizeof(value), offset) == sizeof(value));
+    close(fd);
+}
+
+static void test_msr_of_killed_process_is_restored(const std::string& dir, const std::string& root)
+{
+    const std::string msr = root + "/msr";
+    writeMsr(msr, 0x620, 0x0818);
+    runInChild([&] {
+        PowerCapJournal journal(dir);
+        journal.recordOriginal("uncore", PowerCapJournal::Backend::MSR, msr + ":0x620", 0x0818);
+        journal.apply("uncore", PowerCapJournal::Backend::MSR, msr + ":0x620", 0x0810, [&] { writeMsr(msr, 0x620, 0x0810); });
+        kill(getpid(), SIGKILL);
+    });
+    CHECK(readMsr(msr, 0x620) == 0x0810);
+    CHECK(PowerCapJournal::restoreLeftovers(dir) == 0);
+    CHECK(readMsr(msr, 0x620) == 0x0818);
+    CHECK(countJournals(dir) == 0);
+}
+
+static std::map<std::string, long long> nvmlLimits;
+
+static bool restoreFakeNvmlLimit(const PowerCapJournal::Record& record)
+{
+    nvmlLimits[record.target] = record.value;
+    return true;
+}
+
+static void test_vendor_caps_restored_by_registered_restorer(const std::string& dir, const std::string& root)
+{
+    runInChild([&] {
+        PowerCapJournal journal(dir);
+        journal.recordOriginal("gpu0", PowerCapJournal::Backend::NVML, "0", 250000);
+        journal.apply("gpu0", PowerCapJournal::Backend::NVML, "0", 150000, [] {});
+        kill(getpid(), SIGKILL);
+    });
+    // no cuda plugin registers the NVML restorer, the caps stay in the journal
+    setenv("ECO_PLUGIN_PATH", root.c_str(), 1);
+    CHECK(PowerCapJournal::restoreLeftovers(dir) == 1);
+    CHECK(countJournals(dir) == 1);
+
+    CHECK(PowerCapJournal::registerRestorer(PowerCapJournal::Backend::NVML, restoreFakeNvmlLimit));
+    CHECK(PowerCapJournal::restoreLeftovers(dir) == 0);
+    CHECK(nvmlLimits["0"] == 250000);
+    CHECK(countJournals(dir) == 0);
+}
+
+int main()
+{
+    char dirTemplate[] = "/tmp/test_power_cap_journal_XXXXXX";
+    const std::string root = mkdtemp(dirTemplate);
+    const std::string dir = root + "/journals";
+    const std::string setting = root + "/constraint_0_power_limit_uw";
+
+    test_caps_of_killed_process_are_restored(dir, setting);
+    test_caps_restored_by_device_are_left_alone(dir, setting);
+    test_journal_of_running_process_is_skipped(dir, setting);
+    test_caps_restored_on_signals(dir, setting);
+    test_msr_of_killed_process_is_restored(dir, root);
+    test_vendor_caps_restored_by_registered_restorer(dir, root);
+
+    fs::remove_all(root);
+    std::cout << "test_power_cap_journal passed\n";
+    return 0;
+}
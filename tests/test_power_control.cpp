@@ -0,0 +1,252 @@
+#include "devices/power_control_device.hpp"
+#include "devices/powercap_device.hpp"
+#include "power_interface/power_control_server.hpp"
+#include "test_fixtures.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#define CHECK(x)                                                                                                       \
+    if ((x) != true)                                                                                                   \
+    {                                                                                                                  \
+        std::cerr << "CHECK failed at line " << __LINE__ << ": " #x "\n";                                             \
+        exit(-1);                                                                                                      \
+    }
+
+// polls \p condition for up to 2 s, the helper samples and serves the clients in its own thread
+static bool waitFor(const std::function<bool()>& condition)
+{
+    for (int attempt = 0; attempt < 400; ++attempt)
+    {
+        if (condition())
+        {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+}
+
+// the instructions counted by the helper device, one million per call
+class CountingPowercapDevice : public PowercapDevice
+{
+public:
+    using PowercapDevice::PowercapDevice;
+    unsigned long long int getPerfCounter() const override { return ++perfCounter_; }
+
+private:
+    mutable unsigned long long perfCounter_ {0};
+};
+
+static void test_authorization(const fs::path& root)
+{
+    writeFile(root / "proc/42/cgroup", "4:memory:/slurm/uid_1000/job_7\n1:cpu:/\n0::/slurm/uid_1000/job_7/step_0");
+    writeFile(root / "proc/43/cgroup", "4:memory:/slurm/uid_1000/job_8\n1:cpu:/");
+    CHECK(PowerControlServer::cgroupOfProcess(42, (root / "proc").string()) == "/slurm/uid_1000/job_7/step_0");
+    // cgroup v1 only, no unified hierarchy to trust
+    CHECK(!PowerControlServer::cgroupOfProcess(43, (root / "proc").string()).has_value());
+    CHECK(!PowerControlServer::cgroupOfProcess(44, (root / "proc").string()).has_value());
+    CHECK(PowerControlServer::cgroupOfProcess(getpid()).has_value());
+
+    makeFakePowercapTree(root);
+    PowerControlServerOptions options;
+    options.socketPath = (root / "helper.sock").string();
+    options.allowedCgroups = {"/slurm/uid_1000/"};
+    options.allowRoot = false;
+    PowerControlServer server(std::make_shared<PowercapDevice>(root.string()), options);
+    CHECK(server.isAuthorized(1000, std::string("/slurm/uid_1000")));
+    CHECK(server.isAuthorized(1000, std::string("/slurm/uid_1000/job_7/step_0")));
+    CHECK(!server.isAuthorized(1000, std::string("/slurm/uid_10000")));
+    CHECK(!server.isAuthorized(1000, std::nullopt));
+    CHECK(!server.isAuthorized(0, std::string("/")));
+
+    // the helper closes the connections it does not authorize
+    bool thrown = false;
+    std::thread helper([&server] { server.run(); });
+    try
+    {
+        PowerControlDevice device(options.socketPath);
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    server.stop();
+    helper.join();
+    CHECK(thrown);
+}
+
+static int connectTo(const std::string& socketPath)
+{
+    const int fd = ::socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    socketPath.copy(address.sun_path, sizeof(address.sun_path) - 1);
+    CHECK(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    return fd;
+}
+
+static void test_snapshot_reader()
+{
+    PowerControlSnapshot snapshot {};
+    PowerControlReading reading;
+    reading.timestampInMicroSeconds = 1000;
+    reading.energyInMicroJoules[Domain::PKG] = 5000000;
+    writePowerControlSnapshot(snapshot, reading);
+    const auto read = readPowerControlSnapshot(snapshot);
+    CHECK(read.has_value() && read->sequence == 2 && read->energyInMicroJoules[Domain::PKG] == 5000000);
+
+    // a writer that died in the middle of an update
+    snapshot.sequence.store(3);
+    CHECK(!readPowerControlSnapshot(snapshot).has_value());
+}
+
+static void test_energy_and_limits(const fs::path& root)
+{
+    const fs::path powercap = makeFakePowercapTree(root);
+    writeFile(root / "nmi_watchdog", "1");
+    PowerControlServerOptions options;
+    options.socketPath = (root / "helper.sock").string();
+    options.allowedCgroups = {*PowerControlServer::cgroupOfProcess(getpid())};
+    options.allowRoot = false;
+    options.samplePeriod = std::chrono::milliseconds(1);
+    options.nmiWatchdogFile = (root / "nmi_watchdog").string();
+    PowerControlServer server(std::make_shared<CountingPowercapDevice>(root.string()), options);
+    std::thread helper([&server] { server.run(); });
+
+    auto device = std::make_unique<PowerControlDevice>(options.socketPath);
+    CHECK(device->getName() == "powercap");
+    CHECK(device->getDeviceTypeString() == "cpu");
+    CHECK(device->getMinMaxLimitInWatts() == std::make_pair(0u, 250u));
+    CHECK(isNear(device->getPowerLimitInWatts(), 250.0));
+    CHECK(device->isCappableDomain(Domain::DRAM));
+    CHECK(!device->isCappableDomain(Domain::PP0));
+
+    // energy is read from the snapshot published by the helper: 2 * 30 J on the packages
+    writeFile(powercap / "intel-rapl:0/energy_uj", "31000000");
+    writeFile(powercap / "intel-rapl:1/energy_uj", "31000000");
+    writeFile(powercap / "intel-rapl:0:0/energy_uj", "5000000");
+    CHECK(waitFor([&device] {
+        device->triggerPowerApiSample();
+        return isNear(device->getEnergySinceResetPerDomain()[Domain::PKG], 60.0);
+    }));
+    CHECK(isNear(device->getEnergySinceResetPerDomain()[Domain::PP0], 5.0));
+    CHECK(device->getEnergyCounterSample()->energyInMicroJoules == 60000000);
+    device->reset();
+    CHECK(isNear(device->getEnergySinceResetPerDomain()[Domain::PKG], 0.0));
+
+    // the instructions come from the helper, an unprivileged client can not count them system-wide
+    const auto perfCounter = device->getPerfCounter();
+    CHECK(waitFor([&device, perfCounter] { return device->getPerfCounter() > perfCounter; }));
+
+    // PKG and DRAM caps in one request
+    CHECK(device->setPowerLimitsInMicroWatts({{Domain::PKG, 180000000}, {Domain::DRAM, 30000000}}));
+    CHECK(readFile(powercap / "intel-rapl:0/constraint_0_power_limit_uw") == 90000000);
+    CHECK(readFile(powercap / "intel-rapl:1:1/constraint_0_power_limit_uw") == 15000000);
+    CHECK(isNear(device->getPowerLimitInWatts(), 180.0));
+    device->beginDomainSearchSession(Domain::DRAM);
+    CHECK(device->getMinMaxLimitInWatts() == std::make_pair(0u, 40u));
+    CHECK(isNear(device->getPowerLimitInWatts(), 30.0));
+    device->endDomainSearchSession();
+    CHECK(!device->setPowerLimitsInMicroWatts({{Domain::PKG, 300000000}}));
+    CHECK(!device->setPowerLimitsInMicroWatts({{Domain::PP0, 10000000}}));
+    CHECK(device->setNmiWatchdog(false));
+    CHECK(readFile(root / "nmi_watchdog") == 0);
+
+    // the caps are held by the first connection
+    PowerControlDevice other(options.socketPath);
+    CHECK(!other.setPowerLimitsInMicroWatts({{Domain::PKG, 100000000}}));
+    other.restoreDefaultLimits();
+    CHECK(readFile(powercap / "intel-rapl:0/constraint_0_power_limit_uw") == 90000000);
+
+    // a malformed request closes the connection
+    int fd = connectTo(options.socketPath);
+    const uint32_t garbage[3] = {powerControlMagic, 7, 0};
+    CHECK(::send(fd, garbage, sizeof(garbage), 0) == sizeof(garbage));
+    char buffer[64];
+    CHECK(::recv(fd, buffer, sizeof(buffer), 0) == 0);
+    ::close(fd);
+
+    // the snapshot descriptor can not be reopened writable
+    fd = connectTo(options.socketPath);
+    PowerControlRequest hello {powerControlMagic, powerControlVersion, 1, {}};
+    hello.commands[0].op = static_cast<uint32_t>(PowerControlOp::HELLO);
+    CHECK(::send(fd, &hello, powerControlRequestSize(1), 0) == static_cast<ssize_t>(powerControlRequestSize(1)));
+    PowerControlResponse response {};
+    iovec data {&response, sizeof(response)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] {};
+    msghdr message {};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    CHECK(::recvmsg(fd, &message, 0) == static_cast<ssize_t>(powerControlResponseSize(1)));
+    int snapshotFd = -1;
+    memcpy(&snapshotFd, CMSG_DATA(CMSG_FIRSTHDR(&message)), sizeof(int));
+    const int writableFd = ::open(("/proc/self/fd/" + std::to_string(snapshotFd)).c_str(), O_RDWR);
+    CHECK(writableFd >= 0);
+    CHECK(::mmap(nullptr, sizeof(PowerControlSnapshot), PROT_READ | PROT_WRITE, MAP_SHARED, writableFd, 0) == MAP_FAILED);
+    CHECK(::write(writableFd, "x", 1) < 0);
+    void* readOnly = ::mmap(nullptr, sizeof(PowerControlSnapshot), PROT_READ, MAP_SHARED, snapshotFd, 0);
+    CHECK(readOnly != MAP_FAILED && ::mprotect(readOnly, sizeof(PowerControlSnapshot), PROT_READ | PROT_WRITE) != 0);
+    ::munmap(readOnly, sizeof(PowerControlSnapshot));
+    ::close(writableFd);
+    ::close(snapshotFd);
+
+    // a client that does not read its responses is dropped instead of blocking the helper
+    hello.commands[0].op = 0; // EOPNOTSUPP, answered without side effects
+    bool dropped = false;
+    for (int attempt = 0; attempt < 100000 && !dropped; ++attempt)
+    {
+        if (::send(fd, &hello, powerControlRequestSize(1), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+        {
+            dropped = errno != EAGAIN && errno != EWOULDBLOCK;
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    CHECK(dropped);
+    ::close(fd);
+
+    // closing the connection (e.g. the process was killed) restores the defaults
+    device.reset();
+    CHECK(waitFor([&] { return readFile(powercap / "intel-rapl:0/constraint_0_power_limit_uw") == 125000000; }));
+    CHECK(readFile(powercap / "intel-rapl:1:1/constraint_0_power_limit_uw") == 20000000);
+    CHECK(readFile(root / "nmi_watchdog") == 1);
+    CHECK(isNear(other.getPowerLimitInWatts(), 250.0));
+
+    CHECK(other.setPowerLimitsInMicroWatts({{Domain::PKG, 100000000}}));
+    CHECK(readFile(powercap / "intel-rapl:1/constraint_0_power_limit_uw") == 50000000);
+    other.restoreDefaultLimits();
+    CHECK(readFile(powercap / "intel-rapl:1/constraint_0_power_limit_uw") == 125000000);
+
+    server.stop();
+    helper.join();
+}
+
+int main()
+{
+    char dirTemplate[] = "/tmp/test_power_control_XXXXXX";
+    const fs::path root = mkdtemp(dirTemplate);
+
+    test_snapshot_reader();
+    test_authorization(root / "authorization");
+    test_energy_and_limits(root / "limits");
+
+    fs::remove_all(root);
+    std::cout << "test_power_control passed\n";
+    return 0;
+}
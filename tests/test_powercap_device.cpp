@@ -0,0 +1,174 @@
+#include "devices/powercap_device.hpp"
+#include "power_interface/power_cap_journal.hpp"
+#include "test_fixtures.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#define CHECK(x)                                                                                                       \
+    if ((x) != true)                                                                                                   \
+    {                                                                                                                  \
+        std::cerr << "CHECK failed at line " << __LINE__ << ": " #x "\n";                                             \
+        exit(-1);                                                                                                      \
+    }
+
+static void test_discovery(const fs::path& root)
+{
+    CHECK(!PowercapDevice::isAvailable(root.string()));
+    bool thrown = false;
+    try
+    {
+        PowercapDevice device(root.string());
+    }
+    catch (const std::runtime_error&)
+    {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    makeFakePowercapTree(root);
+    CHECK(PowercapDevice::isAvailable(root.string()));
+    PowercapDevice device(root.string(), std::make_shared<SimulatedClock>());
+    // 2 packages with core and dram each, psys and intel-rapl-mmio:0 skipped
+    CHECK(device.getZones().size() == 6);
+    for (const auto& zone : device.getZones())
+    {
+        CHECK(zone.path.find("mmio") == std::string::npos);
+        CHECK(zone.name != "psys");
+    }
+    CHECK(device.getZones()[0].domain == Domain::PKG);
+    CHECK(device.getZones()[1].domain == Domain::PP0);
+    CHECK(device.getZones()[2].domain == Domain::DRAM);
+    CHECK(device.getZones()[0].powerLimitFile == device.getZones()[0].path + "/constraint_0_power_limit_uw");
+    CHECK(device.getZones()[1].powerLimitFile.empty());
+    CHECK(device.isCappableDomain(Domain::PKG));
+    CHECK(device.isCappableDomain(Domain::DRAM));
+    CHECK(!device.isCappableDomain(Domain::PP0));
+}
+
+static void test_energy_and_wrap(const fs::path& root)
+{
+    const fs::path powercap = makeFakePowercapTree(root);
+    // package-1 is close to the end of its range
+    writeFile(powercap / "intel-rapl:1/energy_uj", maxEnergyRange - 1000000);
+    auto clock = std::make_shared<SimulatedClock>();
+    PowercapDevice device(root.string(), clock);
+    // the idle power measurement of the constructor advances the clock
+    const auto start = std::chrono::duration_cast<std::chrono::microseconds>(clock->now().time_since_epoch()).count();
+
+    // package-0: 60 J, package-1: wraps around after 1 J and adds 39 J, cores: 2 * 25 J
+    writeFile(powercap / "intel-rapl:0/energy_uj", 61000000);
+    writeFile(powercap / "intel-rapl:1/energy_uj", 39000000);
+    writeFile(powercap / "intel-rapl:0:0/energy_uj", 25000000);
+    writeFile(powercap / "intel-rapl:1:0/energy_uj", 25000000);
+    clock->advance(std::chrono::seconds(2));
+    device.triggerPowerApiSample();
+    auto energy = device.getEnergySinceResetPerDomain();
+    CHECK(isNear(energy[Domain::PKG], 100.0));
+    CHECK(isNear(energy[Domain::PP0], 50.0));
+    CHECK(isNear(energy[Domain::DRAM], 0.0));
+    CHECK(isNear(device.getCurrentPowerInWatts(std::nullopt), 50.0));
+    CHECK(isNear(device.getCurrentPowerInWatts(Domain::PP0), 25.0));
+    CHECK(device.getCurrentPowerInWatts(Domain::PP1) == 0.0);
+    auto sample = device.getEnergyCounterSample();
+    CHECK(sample.has_value());
+    CHECK(sample->energyInMicroJoules == 100000000);
+    CHECK(sample->timestampInMicroSeconds == static_cast<uint64_t>(start) + 2000000);
+
+    device.reset();
+    CHECK(isNear(device.getEnergySinceResetPerDomain()[Domain::PKG], 0.0));
+}
+
+static void test_power_limits(const fs::path& root)
+{
+    const fs::path powercap = makeFakePowercapTree(root);
+    PowercapDevice device(root.string(), std::make_shared<SimulatedClock>());
+    CHECK(device.getMinMaxLimitInWatts() == std::make_pair(0u, 250u));
+    CHECK(isNear(device.getPowerLimitInWatts(), 250.0));
+
+    // split evenly between the packages, long term constraint only
+    device.setPowerLimitInMicroWatts(180000000);
+    CHECK(readFile(powercap / "intel-rapl:0/constraint_0_power_limit_uw") == 90000000);
+    CHECK(readFile(powercap / "intel-rapl:1/constraint_0_power_limit_uw") == 90000000);
+    CHECK(readFile(powercap / "intel-rapl:0/constraint_1_power_limit_uw") == 150000000);
+    CHECK(readFile(powercap / "intel-rapl-mmio:0/constraint_0_power_limit_uw") == 125000000);
+    CHECK(isNear(device.getPowerLimitInWatts(), 180.0));
+
+    device.beginDomainSearchSession(Domain::DRAM);
+    CHECK(device.getMinMaxLimitInWatts() == std::make_pair(0u, 40u));
+    device.setPowerLimitInMicroWatts(30000000);
+    CHECK(readFile(powercap / "intel-rapl:0:1/constraint_0_power_limit_uw") == 15000000);
+    CHECK(isNear(device.getPowerLimitInWatts(), 30.0));
+    device.endDomainSearchSession();
+    CHECK(isNear(device.getPowerLimitInWatts(), 180.0));
+
+    device.restoreDefaultLimits();
+    CHECK(readFile(powercap / "intel-rapl:0/constraint_0_power_limit_uw") == 125000000);
+    CHECK(readFile(powercap / "intel-rapl:1/constraint_0_power_limit_uw") == 125000000);
+    CHECK(readFile(powercap / "intel-rapl:1:1/constraint_0_power_limit_uw") == 20000000);
+    CHECK(isNear(device.getPowerLimitInWatts(), 250.0));
+}
+
+// the last record of the powercap device in the journal of this process
+static std::string lastJournalRecord()
+{
+    std::string last;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(PowerCapJournal::defaultDir, ec))
+    {
+        if (entry.path().filename().string().rfind(std::to_string(getpid()) + ".", 0) != 0)
+        {
+            continue;
+        }
+        std::ifstream journal(entry.path());
+        for (std::string line; std::getline(journal, line);)
+        {
+            if (line.find(" powercap") != std::string::npos)
+            {
+                last = line;
+            }
+        }
+    }
+    return last;
+}
+
+static void test_failed_restore(const fs::path& root)
+{
+    const fs::path powercap = makeFakePowercapTree(root);
+    PowercapDevice device(root.string(), std::make_shared<SimulatedClock>());
+    device.setPowerLimitInMicroWatts(180000000);
+    CHECK(lastJournalRecord().rfind("APPLY", 0) == 0);
+
+    // a limit that can not be written back keeps the caps in the journal
+    const fs::path limit = powercap / "intel-rapl:1/constraint_0_power_limit_uw";
+    fs::remove(limit);
+    fs::create_directory(limit);
+    device.restoreDefaultLimits();
+    CHECK(readFile(powercap / "intel-rapl:0/constraint_0_power_limit_uw") == 125000000);
+    CHECK(lastJournalRecord().rfind("APPLY", 0) == 0);
+
+    fs::remove(limit);
+    device.restoreDefaultLimits();
+    CHECK(readFile(limit) == 125000000);
+    CHECK(lastJournalRecord().rfind("RESTORED", 0) == 0);
+}
+
+int main()
+{
+    char dirTemplate[] = "/tmp/test_powercap_device_XXXXXX";
+    const fs::path root = mkdtemp(dirTemplate);
+
+    test_discovery(root / "discovery");
+    test_energy_and_wrap(root / "energy");
+    test_power_limits(root / "limits");
+    test_failed_restore(root / "restore");
+
+    fs::remove_all(root);
+    std::cout << "test_powercap_device passed\n";
+    return 0;
+}
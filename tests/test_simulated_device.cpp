@@ -0,0 +1,169 @@
+#include "devices/simulated_device.hpp"
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#define CHECK(x)                                                                                                       \
+    if ((x) != true)                                                                                                   \
+    {                                                                                                                  \
+        std::cerr << "CHECK failed at line " << __LINE__ << ": " #x "\n";                                             \
+        exit(-1);                                                                                                      \
+    }
+
+static bool isNear(double value, double expected, double tolerance)
+{
+    return std::fabs(value - expected) <= tolerance;
+}
+
+static SimulatedDeviceModel singlePhaseModel()
+{
+    SimulatedDeviceModel model;
+    model.minLimitInWatts = 50;
+    model.maxLimitInWatts = 250;
+    model.defaultLimitInWatts = 250.0;
+    model.idlePowerInWatts = 20.0;
+    model.phases = {SimulatedPhase{100.0, 200.0, 1000.0, 1.0}};
+    return model;
+}
+
+static void test_uncapped_and_capped_power_and_throughput()
+{
+    auto clock = std::make_shared<SimulatedClock>();
+    SimulatedDevice device(singlePhaseModel(), clock);
+    device.reset();
+
+    clock->advance(std::chrono::seconds(10));
+    device.triggerPowerApiSample();
+    CHECK(isNear(device.getCurrentPowerInWatts(), 200.0, 1e-6));
+    CHECK(isNear(device.getPerfCounter(), 10000.0, 1.0));
+
+    // (110 - 20) / (200 - 20) = 0.5 of dynamic power with linear sensitivity
+    device.setPowerLimitInMicroWatts(110 * 1e6);
+    device.reset();
+    clock->advance(std::chrono::seconds(10));
+    device.triggerPowerApiSample();
+    CHECK(isNear(device.getPowerLimitInWatts(), 110.0, 1e-9));
+    CHECK(isNear(device.getCurrentPowerInWatts(), 110.0, 1e-6));
+    CHECK(isNear(device.getPerfCounter(), 5000.0, 1.0));
+    CHECK(isNear(device.getEnergySinceResetPerDomain()[Domain::PKG], 1100.0, 1e-6));
+
+    // limits are clamped to the model range
+    device.setPowerLimitInMicroWatts(10 * 1e6);
+    CHECK(isNear(device.getPowerLimitInWatts(), 50.0, 1e-9));
+    device.restoreDefaultLimits();
+    CHECK(isNear(device.getPowerLimitInWatts(), 250.0, 1e-9));
+}
+
+static void test_phases()
+{
+    auto model = singlePhaseModel();
+    model.phases = {SimulatedPhase{5.0, 200.0, 1000.0, 1.0}, SimulatedPhase{5.0, 80.0, 100.0, 0.0}};
+    model.repeatPhases = false;
+    auto clock = std::make_shared<SimulatedClock>();
+    SimulatedDevice device(model, clock);
+
+    clock->advance(std::chrono::seconds(1));
+    CHECK(device.getCurrentPhaseIndex() == 0);
+    clock->advance(std::chrono::seconds(5));
+    CHECK(device.getCurrentPhaseIndex() == 1);
+    device.triggerPowerApiSample();
+    device.reset();
+    clock->advance(std::chrono::seconds(2));
+    device.triggerPowerApiSample();
+    CHECK(isNear(device.getCurrentPowerInWatts(), 80.0, 1e-6));
+    // memory-bound phase does not lose throughput under the cap
+    device.setPowerLimitInMicroWatts(50 * 1e6);
+    device.reset();
+    clock->advance(std::chrono::seconds(2));
+    CHECK(isNear(device.getPerfCounter(), 200.0, 1.0));
+    // after the last phase the device stays idle
+    clock->advance(std::chrono::seconds(10));
+    CHECK(device.getCurrentPhaseIndex() == -1);
+    device.triggerPowerApiSample();
+    clock->advance(std::chrono::seconds(1));
+    device.triggerPowerApiSample();
+    CHECK(isNear(device.getCurrentPowerInWatts(), 20.0, 1e-6));
+}
+
+static void test_actuation_lag()
+{
+    auto model = singlePhaseModel();
+    model.actuationLagInSeconds = 1.0;
+    model.integrationStepInSeconds = 0.001;
+    auto clock = std::make_shared<SimulatedClock>();
+    SimulatedDevice device(model, clock);
+
+    device.setPowerLimitInMicroWatts(100 * 1e6);
+    device.triggerPowerApiSample();
+    clock->advance(std::chrono::milliseconds(100));
+    device.triggerPowerApiSample();
+    CHECK(device.getCurrentPowerInWatts() > 150.0);
+    clock->advance(std::chrono::seconds(10));
+    device.triggerPowerApiSample();
+    clock->advance(std::chrono::milliseconds(100));
+    device.triggerPowerApiSample();
+    CHECK(isNear(device.getCurrentPowerInWatts(), 100.0, 0.1));
+}
+
+static void test_power_log_replay()
+{
+    const char* path = "test_simulated_device_power_log.csv";
+    {
+        std::ofstream log(path);
+        log << "#t[ms]\t\tP_cap[W]\t\tP_av[W]\t\tP_SMA[W]\t\tE[J]\t\tinstr[-]\n";
+        log << "0\t\t250\t\t30\t\t-1\t\t0\t\t0\n";
+        log << "1000\t\t250\t\t150\t\t-1\t\t150\t\t2000\n";
+        log << "3000\t\t250\t\t220\t\t-1\t\t440\t\t8000\n";
+    }
+    auto model = SimulatedDeviceModel::fromPowerLog(path, singlePhaseModel());
+    std::remove(path);
+    CHECK(model.phases.size() == 2);
+    CHECK(isNear(model.phases[0].durationInSeconds, 1.0, 1e-9));
+    CHECK(isNear(model.phases[0].uncappedPowerInWatts, 150.0, 1e-9));
+    CHECK(isNear(model.phases[0].maxThroughput, 2000.0, 1e-9));
+    CHECK(isNear(model.phases[1].durationInSeconds, 2.0, 1e-9));
+    CHECK(isNear(model.phases[1].maxThroughput, 4000.0, 1e-9));
+    CHECK(isNear(model.phases[1].capSensitivity, 1.0, 1e-9));
+
+    auto clock = std::make_shared<SimulatedClock>();
+    SimulatedDevice device(model, clock);
+    device.reset();
+    clock->advance(std::chrono::seconds(3));
+    CHECK(isNear(device.getPerfCounter(), 10000.0, 1.0));
+}
+
+static void test_virtual_time_is_fast()
+{
+    auto model = singlePhaseModel();
+    model.powerNoiseStdDevInWatts = 2.0;
+    model.throughputRelativeNoise = 0.05;
+    auto clock = std::make_shared<SimulatedClock>();
+    SimulatedDevice device(model, clock);
+
+    const auto start = std::chrono::steady_clock::now();
+    // one hour session sampled every 100 ms
+    for (int i = 0; i < 36000; i++)
+    {
+        clock->sleepForMicroSeconds(100000);
+        device.triggerPowerApiSample();
+        device.getCurrentPowerInWatts();
+        device.getPerfCounter();
+    }
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CHECK(isNear(clock->getElapsedSeconds(), 3600.0, 1e-6));
+    CHECK(isNear(device.getTotalWork() / 3600.0, 1000.0, 10.0));
+    CHECK(wallSeconds < 60.0);
+}
+
+int main()
+{
+    test_uncapped_and_capped_power_and_throughput();
+    test_phases();
+    test_actuation_lag();
+    test_power_log_replay();
+    test_virtual_time_is_fast();
+    std::cout << "test_simulated_device passed\n";
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "device_state.hpp"
+#include "trigger.hpp"
+#include "params_config.hpp"
+#include "algorithms/linear_search.hpp"
+#include "algorithms/golden_section_search.hpp"
+#include "devices/simulated_device.hpp"
+#include <cmath>
+#include <chrono>
+#include <iostream>
+
+#define CHECK(x)                                                                                                       \
+    if ((x) != true)                                                                                                   \
+    {                                                                                                                  \
+        std::cerr << "CHECK failed at line " << __LINE__ << ": " #x "\n";                                             \
+        exit(-1);                                                                                                      \
+    }
+
+// Energy per unit of work is (idle + d) / d^s for dynamic power d and cap sensitivity s,
+// so the optimal cap for min(E) is idle + s * idle / (1 - s) = 120 W for the model below.
+static SimulatedDeviceModel modelWithKnownOptimum()
+{
+    SimulatedDeviceModel model;
+    model.minLimitInWatts = 50;
+    model.maxLimitInWatts = 250;
+    model.defaultLimitInWatts = 250.0;
+    model.idlePowerInWatts = 60.0;
+    model.phases = {SimulatedPhase{1e6, 200.0, 1e6, 0.5}};
+    return model;
+}
+
+static double runSearch(const SearchAlgorithm& algorithm, std::shared_ptr<SimulatedDevice> device,
+                        ParamsConfig& cfg, Logger& logger)
+{
+    DeviceStateAccumulator deviceState(device);
+    Trigger trigger(cfg);
+    deviceState.resetState();
+    device->restoreDefaultLimits();
+    // no child process - waitpid fails and leaves procStatus untouched
+    int procStatus = 1;
+    auto reference = SearchAlgorithm::sampleAndAccumulatePowAndPerfForGivenPeriod(
+        cfg.usTestPhasePeriod_, cfg.msPause_, deviceState, trigger, procStatus, -1, logger);
+    const auto bestCapInMicroWatts = algorithm(
+        device, deviceState, trigger, MetricExpression::fromTargetMetric(TargetMetric::MIN_E), reference, procStatus, -1,
+        cfg.msPause_, cfg.msTestPhasePeriod_, logger);
+    return bestCapInMicroWatts / 1e6;
+}
+
+int main()
+{
+    ParamsConfig cfg;
+    Logger logger("sim");
+    auto clock = std::make_shared<SimulatedClock>();
+    auto device = std::make_shared<SimulatedDevice>(modelWithKnownOptimum(), clock);
+
+    const auto start = std::chrono::steady_clock::now();
+    const double gssCap = runSearch(GoldenSectionSearchAlgorithm(), device, cfg, logger);
+    const double linearCap = runSearch(LinearSearchAlgorithm(), device, cfg, logger);
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "GSS: " << gssCap << " W, linear: " << linearCap << " W, simulated "
+              << clock->getElapsedSeconds() << " s in " << wallSeconds << " s\n";
+    CHECK(std::fabs(gssCap - 120.0) <= 10.0);
+    CHECK(std::fabs(linearCap - 120.0) <= 20.0);
+    // the whole control loop runs in virtual time
+    CHECK(clock->getElapsedSeconds() > 10.0);
+    CHECK(wallSeconds < clock->getElapsedSeconds());
+    std::cout << "test_simulated_search passed\n";
+    return 0;
+}